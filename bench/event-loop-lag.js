@@ -0,0 +1,68 @@
+// Measures event loop lag while N concurrent encrypt calls are in flight.
+// Run it against different builds to compare them, for example, the current one and the previous release:
+//   node bench/event-loop-lag.js --concurrency 64 --rounds 50
+//   node bench/event-loop-lag.js --module path/to/old/secure-enclave.node
+// The result is printed as JSON.
+
+const path = require('path');
+const { monitorEventLoopDelay, performance } = require('perf_hooks');
+const { parseArgs, round, summarizeEventLoopDelay } = require('./util');
+
+const args = parseArgs({
+    module: path.join(__dirname, '../build/Release/secure-enclave.node'),
+    concurrency: 32,
+    rounds: 20,
+    size: 1024,
+    workerThreads: 0
+});
+
+const keyTag = 'net.antelle.node-secure-enclave.bench.event-loop-lag';
+
+async function main() {
+    const secureEnclave = require(path.resolve(args.module));
+    if (args.workerThreads && secureEnclave.configure) {
+        secureEnclave.configure({ workerThreads: args.workerThreads });
+    }
+
+    await secureEnclave.deleteKeyPair({ keyTag });
+    await secureEnclave.createKeyPair({ keyTag });
+
+    const data = Buffer.alloc(args.size, 1);
+
+    // warm up
+    await secureEnclave.encrypt({ keyTag, data });
+
+    const histogram = monitorEventLoopDelay({ resolution: 1 });
+    histogram.enable();
+
+    const started = performance.now();
+    for (let round = 0; round < args.rounds; round++) {
+        const calls = [];
+        for (let i = 0; i < args.concurrency; i++) {
+            calls.push(secureEnclave.encrypt({ keyTag, data }));
+        }
+        await Promise.all(calls);
+    }
+    const elapsedMs = performance.now() - started;
+
+    histogram.disable();
+    await secureEnclave.deleteKeyPair({ keyTag });
+
+    const operations = args.concurrency * args.rounds;
+    const result = {
+        backend: secureEnclave.backend || 'keychain',
+        concurrency: args.concurrency,
+        rounds: args.rounds,
+        size: args.size,
+        operations,
+        elapsedMs: round(elapsedMs),
+        opsPerSec: round((operations * 1000) / elapsedMs),
+        eventLoopLagMs: summarizeEventLoopDelay(histogram)
+    };
+    process.stdout.write(JSON.stringify(result, null, 2) + '\n');
+}
+
+main().catch((e) => {
+    process.stderr.write(`${e.stack || e}\n`);
+    process.exit(1);
+});
@@ -0,0 +1,365 @@
+// Micro-benchmarks of the native building blocks, without Node.js in the way.
+// Build and run it:
+//   npm run build-bench
+//   npm run bench-native -- --iterations 2000
+// The result is printed as JSON, compare it between builds to catch regressions.
+// With --constant-time, it checks instead that P-256 multiplications don't leak the scalar through timing.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "aes_gcm.h"
+#include "backend.h"
+#include "crypto_kernels.h"
+#include "ecdsa.h"
+#include "ecies.h"
+#include "envelope.h"
+#include "key_cache.h"
+#include "p256.h"
+#include "secure_memory.h"
+#include "secure_random.h"
+#include "sha256.h"
+#include "stats.h"
+#include "worker_pool.h"
+
+namespace {
+
+const char *BENCH_KEY_TAG = "net.antelle.node-secure-enclave.bench.micro";
+const size_t PAYLOAD_SIZES[] = {32, 1024, 64 * 1024};
+constexpr size_t ENVELOPE_SIZE = 1024 * 1024;
+
+size_t iterations = 1000;
+bool firstResult = true;
+
+// runs fn repeatedly, then prints the throughput and the latency of one call
+void bench(const char *name, size_t size, size_t count, const std::function<bool()> &fn) {
+    // warm up caches and lazily initialized state
+    for (size_t i = 0; i < count / 10 + 1; i++) {
+        if (!fn()) {
+            fprintf(stderr, "%s failed\n", name);
+            exit(1);
+        }
+    }
+
+    Histogram histogram;
+    auto started = monotonicNowNs();
+    for (size_t i = 0; i < count; i++) {
+        auto callStarted = monotonicNowNs();
+        fn();
+        histogram.record(monotonicNowNs() - callStarted);
+    }
+    auto elapsedSec = double(monotonicNowNs() - started) / 1e9;
+    auto summary = histogram.summary();
+
+    printf("%s\n    {\"name\": \"%s\", \"size\": %zu, \"iterations\": %zu, \"opsPerSec\": %.1f, \"mbPerSec\": %.2f, "
+           "\"latencyMs\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}}",
+           firstResult ? "" : ",", name, size, count, double(count) / elapsedSec,
+           double(count) * double(size) / elapsedSec / 1e6, summary.meanMs, summary.p50Ms, summary.p95Ms,
+           summary.p99Ms, summary.maxMs);
+    firstResult = false;
+}
+
+// Leakage detection in the style of dudect (https://eprint.iacr.org/2016/1123): timings with a fixed scalar,
+// which has almost all windows zero, are compared with random scalars in random order using Welch's t-test.
+// The slowest 10% are dropped as noise, |t| above 10 is a definite leak.
+constexpr double CONSTANT_TIME_MAX_T = 10;
+
+bool checkConstantTime(const char *name, size_t count, const std::function<void(const uint8_t *scalar)> &fn) {
+    uint8_t fixed[P256_SCALAR_SIZE] = {0};
+    fixed[P256_SCALAR_SIZE - 1] = 1;
+    std::vector<Bytes> scalars(count);
+    std::vector<uint8_t> classes(count);
+    secureRandomBytes(classes.data(), classes.size());
+    for (size_t i = 0; i < count; i++) {
+        classes[i] &= 1;
+        scalars[i].resize(P256_SCALAR_SIZE);
+        if (classes[i]) {
+            uint8_t unused[P256_PUBLIC_KEY_SIZE];
+            p256GenerateKeyPair(scalars[i].data(), unused);
+        } else {
+            memcpy(scalars[i].data(), fixed, sizeof(fixed));
+        }
+    }
+
+    std::vector<int64_t> timings(count);
+    for (size_t i = 0; i < count; i++) {
+        auto started = monotonicNowNs();
+        fn(scalars[i].data());
+        timings[i] = monotonicNowNs() - started;
+    }
+
+    auto sorted = timings;
+    std::sort(sorted.begin(), sorted.end());
+    auto cutoff = sorted[sorted.size() * 9 / 10];
+    double n[2] = {0, 0}, sum[2] = {0, 0}, sumSquares[2] = {0, 0};
+    for (size_t i = 0; i < count; i++) {
+        if (timings[i] > cutoff) {
+            continue;
+        }
+        auto x = double(timings[i]);
+        n[classes[i]]++;
+        sum[classes[i]] += x;
+        sumSquares[classes[i]] += x * x;
+    }
+    double mean[2], variance[2];
+    for (int c = 0; c < 2; c++) {
+        mean[c] = sum[c] / n[c];
+        variance[c] = (sumSquares[c] - n[c] * mean[c] * mean[c]) / (n[c] - 1);
+    }
+    auto t = (mean[0] - mean[1]) / std::sqrt(variance[0] / n[0] + variance[1] / n[1]);
+    auto ok = std::fabs(t) < CONSTANT_TIME_MAX_T;
+
+    printf("%s\n    {\"name\": \"%s\", \"samples\": %zu, \"fixedMeanUs\": %.2f, \"randomMeanUs\": %.2f, "
+           "\"t\": %.2f, \"constantTime\": %s}",
+           firstResult ? "" : ",", name, count, mean[0] / 1e3, mean[1] / 1e3, t, ok ? "true" : "false");
+    firstResult = false;
+    return ok;
+}
+
+int checkConstantTime() {
+    uint8_t peerPrivateKey[P256_SCALAR_SIZE], peerPublicKey[P256_PUBLIC_KEY_SIZE];
+    p256GenerateKeyPair(peerPrivateKey, peerPublicKey);
+    auto table = p256PrecomputePublicKey(peerPublicKey);
+    uint8_t out[P256_PUBLIC_KEY_SIZE];
+    auto count = iterations * 10;
+
+    printf("{\n  \"results\": [");
+    auto ok = checkConstantTime("p256BaseMul.generic", count,
+                                [&](const uint8_t *scalar) { p256ComputePublicKeyGeneric(scalar, out); });
+    ok &= checkConstantTime("p256BaseMul.comb", count,
+                            [&](const uint8_t *scalar) { p256ComputePublicKey(scalar, out); });
+    ok &= checkConstantTime("p256Ecdh.generic", count,
+                            [&](const uint8_t *scalar) { p256Ecdh(scalar, peerPublicKey, out); });
+    ok &= checkConstantTime("p256Ecdh.window", count,
+                            [&](const uint8_t *scalar) { p256Ecdh(scalar, peerPublicKey, out, table.get()); });
+    printf("\n  ]\n}\n");
+    return ok ? 0 : 1;
+}
+
+std::shared_ptr<AuthContext> authenticate() {
+    std::promise<std::shared_ptr<AuthContext>> authenticated;
+    getBackend().authenticate("run benchmarks", [&](const std::shared_ptr<AuthContext> &authContext, long code) {
+        authenticated.set_value(code ? nullptr : authContext);
+    });
+    return authenticated.get_future().get();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    auto constantTime = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--constant-time") == 0) {
+            constantTime = true;
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (constantTime) {
+        return checkConstantTime();
+    }
+
+    auto &backend = getBackend();
+    if (!backend.isSupported()) {
+        fprintf(stderr, "Backend %s is not supported\n", backend.name());
+        return 1;
+    }
+
+    Bytes publicKey;
+    backend.deleteKeyPair(BENCH_KEY_TAG);
+    if (auto error = backend.createKeyPair(BENCH_KEY_TAG, publicKey)) {
+        fprintf(stderr, "createKeyPair failed: %ld %s\n", error.code, error.message.c_str());
+        return 1;
+    }
+    auto authContext = authenticate();
+    if (!authContext) {
+        fprintf(stderr, "Authentication failed\n");
+        return 1;
+    }
+    std::unique_ptr<KeyPair> keyPair;
+    if (auto error = backend.findKeyPair(BENCH_KEY_TAG, authContext.get(), keyPair)) {
+        fprintf(stderr, "findKeyPair failed: %ld\n", error.code);
+        return 1;
+    }
+
+    printf("{\n  \"backend\": \"%s\",\n  \"workerThreads\": %zu,\n  \"aesGcmKernel\": \"%s\",\n"
+           "  \"sha256Kernel\": \"%s\",\n  \"results\": [",
+           backend.name(), getWorkerPool().threadCount(), aesGcmKernelName(aesGcmKernel()),
+           sha256KernelName(sha256Kernel()));
+
+    // keychain lookup, the slowest part of findKeyPair and the first encrypt for a keyTag
+    bench("findKeyPair", 0, iterations / 10 + 1, [&]() {
+        std::unique_ptr<KeyPair> found;
+        return !backend.findKeyPair(BENCH_KEY_TAG, nullptr, found);
+    });
+
+    KeyCache keyCache(DEFAULT_KEY_CACHE_SIZE);
+    keyCache.set(BENCH_KEY_TAG, publicKey, keyCache.generation());
+    bench("keyCacheGet", 0, iterations * 100, [&]() {
+        Bytes cached;
+        return keyCache.get(BENCH_KEY_TAG, cached);
+    });
+
+    bench("p256IsValidPublicKey", 0, iterations,
+          [&]() { return p256IsValidPublicKey(publicKey.data(), publicKey.size()); });
+
+    // generic multiplications against the precomputed tables, the comb is used for every ephemeral key
+    auto table = p256PrecomputePublicKey(publicKey.data());
+    {
+        uint8_t privateKey[P256_SCALAR_SIZE], computed[P256_PUBLIC_KEY_SIZE], sharedSecret[P256_FIELD_SIZE];
+        p256GenerateKeyPair(privateKey, computed);
+        bench("p256BaseMul.generic", 0, iterations,
+              [&]() { return p256ComputePublicKeyGeneric(privateKey, computed); });
+        bench("p256BaseMul.comb", 0, iterations, [&]() { return p256ComputePublicKey(privateKey, computed); });
+        bench("p256Ecdh.generic", 0, iterations,
+              [&]() { return p256Ecdh(privateKey, publicKey.data(), sharedSecret); });
+        bench("p256Ecdh.window", 0, iterations,
+              [&]() { return p256Ecdh(privateKey, publicKey.data(), sharedSecret, table.get()); });
+        bench("p256PrecomputePublicKey", 0, iterations / 10 + 1,
+              [&]() { return p256PrecomputePublicKey(publicKey.data()) != nullptr; });
+        secureZero(privateKey, sizeof(privateKey));
+    }
+
+    {
+        Bytes data(1024);
+        secureRandomBytes(data.data(), data.size());
+        Bytes signature;
+        bench("sign", data.size(), iterations / 10 + 1,
+              [&]() { return !keyPair->sign(data.data(), data.size(), signature); });
+        bench("ecdsaVerify", data.size(), iterations, [&]() {
+            return ecdsaVerify(publicKey.data(), data.data(), data.size(), signature.data(), signature.size());
+        });
+    }
+
+    for (auto size : PAYLOAD_SIZES) {
+        Bytes data(size);
+        secureRandomBytes(data.data(), data.size());
+        Bytes encrypted(size + ECIES_OVERHEAD);
+
+        bench("eciesEncrypt", size, iterations,
+              [&]() { return eciesEncrypt(publicKey.data(), data.data(), data.size(), encrypted.data()); });
+        // with the public key table, as encrypt does for cached keys
+        bench("eciesEncrypt.window", size, iterations, [&]() {
+            return eciesEncrypt(publicKey.data(), data.data(), data.size(), encrypted.data(), table.get());
+        });
+
+        // goes through the backend, which is the Secure Enclave on a Mac
+        bench("decrypt", size, iterations / 10 + 1, [&]() {
+            SecureBytes decrypted;
+            return !keyPair->decrypt(encrypted.data(), encrypted.size(), decrypted);
+        });
+    }
+
+    // every kernel supported by the CPU, checked with known-answer tests first, ECIES above uses the selected ones
+    for (int kernel = 0; kernel < AES_GCM_KERNEL_COUNT; kernel++) {
+        auto aesKernel = AesGcmKernel(kernel);
+        if (!aesGcmKernelSupported(aesKernel)) {
+            continue;
+        }
+        if (!aesGcmKnownAnswerTest(aesKernel)) {
+            fprintf(stderr, "%s AES-GCM failed known-answer tests\n", aesGcmKernelName(aesKernel));
+            return 1;
+        }
+        auto name = std::string("aesGcmEncrypt.") + aesGcmKernelName(aesKernel);
+        uint8_t key[16] = {0}, iv[16] = {0}, tag[GCM_TAG_SIZE];
+        AesGcm aes(key, sizeof(key), aesKernel);
+        for (auto size : PAYLOAD_SIZES) {
+            Bytes data(size), encrypted(size);
+            bench(name.c_str(), size, iterations * 10, [&]() {
+                aes.encrypt(iv, sizeof(iv), nullptr, 0, data.data(), size, encrypted.data(), tag);
+                return true;
+            });
+        }
+    }
+    for (int kernel = 0; kernel < SHA256_KERNEL_COUNT; kernel++) {
+        auto shaKernel = Sha256Kernel(kernel);
+        if (!sha256KernelSupported(shaKernel)) {
+            continue;
+        }
+        if (!sha256KnownAnswerTest(shaKernel)) {
+            fprintf(stderr, "%s SHA-256 failed known-answer tests\n", sha256KernelName(shaKernel));
+            return 1;
+        }
+        auto name = std::string("sha256.") + sha256KernelName(shaKernel);
+        for (auto size : PAYLOAD_SIZES) {
+            Bytes data(size);
+            uint8_t digest[SHA256_DIGEST_SIZE];
+            bench(name.c_str(), size, iterations * 10, [&]() {
+                Sha256 sha(shaKernel);
+                sha.update(data.data(), size);
+                sha.finish(digest);
+                return true;
+            });
+        }
+    }
+    {
+        // the ECIES key derivation: a shared secret and an ephemeral public key in, an AES key and IV out
+        uint8_t sharedSecret[P256_FIELD_SIZE] = {0}, sharedInfo[P256_PUBLIC_KEY_SIZE] = {0}, derived[32];
+        bench("x963KdfSha256", sizeof(derived), iterations * 10, [&]() {
+            x963KdfSha256(sharedSecret, sizeof(sharedSecret), sharedInfo, sizeof(sharedInfo), derived, sizeof(derived));
+            return true;
+        });
+    }
+
+    {
+        Bytes data(ENVELOPE_SIZE);
+        secureRandomBytes(data.data(), data.size());
+        Bytes envelope;
+        bench("envelopeEncrypt", ENVELOPE_SIZE, iterations / 100 + 1, [&]() {
+            envelope.clear();
+            return envelopeEncrypt(publicKey.data(), data.data(), data.size(), envelope);
+        });
+        bench("envelopeDecrypt", ENVELOPE_SIZE, iterations / 100 + 1, [&]() {
+            SecureBytes decrypted;
+            return !envelopeDecrypt(*keyPair, envelope.data(), envelope.size(), decrypted);
+        });
+    }
+
+    // copying results between native and JS memory, what bytesToBuffer does for small results
+    for (auto size : PAYLOAD_SIZES) {
+        Bytes data(size);
+        bench("copyBytes", size, iterations * 10, [&]() {
+            Bytes copy(data.begin(), data.end());
+            return copy.size() == size;
+        });
+    }
+
+    // a plaintext buffer from the secure memory pool, compared to the heap
+    for (auto size : PAYLOAD_SIZES) {
+        bench("secureBytes", size, iterations * 10, [&]() {
+            SecureBytes buffer(size);
+            return buffer.size() == size;
+        });
+        bench("heapBytes", size, iterations * 10, [&]() {
+            Bytes buffer(size);
+            secureZero(buffer.data(), buffer.size());
+            return buffer.size() == size;
+        });
+    }
+
+    // handing a task to a worker thread and getting it back, the native part of the completion hop
+    bench("workerPoolHop", 0, iterations, [&]() {
+        std::promise<void> done;
+        getWorkerPool().submit([&]() { done.set_value(); });
+        done.get_future().wait();
+        return true;
+    });
+
+    printf("\n  ]\n}\n");
+
+    authContext->invalidate();
+    backend.deleteKeyPair(BENCH_KEY_TAG);
+    return 0;
+}
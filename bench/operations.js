@@ -0,0 +1,155 @@
+// Measures throughput and latency of exported operations across payload sizes and concurrency levels.
+//   node bench/operations.js
+//   node bench/operations.js --ops encrypt,decrypt --sizes 1024,1048576 --concurrency 1,16 --calls 500
+//   node bench/operations.js --module path/to/old/secure-enclave.node --output old.json
+// decrypt shows a Touch ID prompt for every call on a Mac, run it with the software backend.
+// The result is printed as JSON, native phase timings are included if the module supports getStats.
+
+const fs = require('fs');
+const path = require('path');
+const { monitorEventLoopDelay, performance } = require('perf_hooks');
+const { parseArgs, round, summarize, summarizeEventLoopDelay } = require('./util');
+
+const args = parseArgs({
+    module: path.join(__dirname, '../build/Release/secure-enclave.node'),
+    ops: ['createKeyPair', 'findKeyPair', 'encrypt', 'decrypt'],
+    sizes: [32, 1024, 65536, 1048576],
+    concurrency: [1, 8, 64],
+    calls: 200,
+    workerThreads: 0,
+    output: ''
+});
+
+const keyTag = 'net.antelle.node-secure-enclave.bench.operations';
+const touchIdPrompt = 'run benchmarks';
+
+// prepare runs before the measurement, call(index) is measured, cleanup runs after it
+const operations = {
+    createKeyPair: {
+        sized: false,
+        prepare: (secureEnclave) => deleteKeys(secureEnclave),
+        call: (secureEnclave, index) => secureEnclave.createKeyPair({ keyTag: `${keyTag}.${index}` }),
+        cleanup: (secureEnclave) => deleteKeys(secureEnclave)
+    },
+    findKeyPair: {
+        sized: false,
+        call: (secureEnclave) => secureEnclave.findKeyPair({ keyTag })
+    },
+    encrypt: {
+        sized: true,
+        prepare: (secureEnclave, size) => ({ data: Buffer.alloc(size, 1) }),
+        call: (secureEnclave, index, { data }) => secureEnclave.encrypt({ keyTag, data })
+    },
+    decrypt: {
+        sized: true,
+        prepare: async (secureEnclave, size) => ({
+            data: await secureEnclave.encrypt({ keyTag, data: Buffer.alloc(size, 1) })
+        }),
+        call: (secureEnclave, index, { data }) => secureEnclave.decrypt({ keyTag, data, touchIdPrompt })
+    }
+};
+
+async function main() {
+    const secureEnclave = require(path.resolve(args.module));
+    if (args.workerThreads && secureEnclave.configure) {
+        secureEnclave.configure({ workerThreads: args.workerThreads });
+    }
+    const hasStats = typeof secureEnclave.getStats === 'function';
+    if (hasStats) {
+        secureEnclave.configure({ stats: true });
+    }
+
+    await secureEnclave.deleteKeyPair({ keyTag });
+    await secureEnclave.createKeyPair({ keyTag });
+
+    const results = [];
+    try {
+        for (const name of args.ops) {
+            const operation = operations[name];
+            if (!operation) {
+                throw new Error(`Unknown operation: ${name}`);
+            }
+            for (const size of operation.sized ? args.sizes : [0]) {
+                for (const concurrency of args.concurrency) {
+                    results.push(await run(secureEnclave, name, operation, size, concurrency, hasStats));
+                }
+            }
+        }
+    } finally {
+        await secureEnclave.deleteKeyPair({ keyTag });
+    }
+
+    const result = {
+        backend: secureEnclave.backend || 'keychain',
+        node: process.version,
+        workerThreads: args.workerThreads || undefined,
+        results
+    };
+    const json = JSON.stringify(result, null, 2) + '\n';
+    if (args.output) {
+        fs.writeFileSync(args.output, json);
+    }
+    process.stdout.write(json);
+}
+
+async function run(secureEnclave, name, operation, size, concurrency, hasStats) {
+    const state = operation.prepare ? await operation.prepare(secureEnclave, size) : undefined;
+
+    // warm up
+    await operation.call(secureEnclave, args.calls, state);
+    if (operation.cleanup) {
+        await operation.cleanup(secureEnclave);
+    }
+    if (hasStats) {
+        secureEnclave.resetStats();
+    }
+
+    const latencies = [];
+    let next = 0;
+    const worker = async () => {
+        while (next < args.calls) {
+            const index = next++;
+            const started = performance.now();
+            await operation.call(secureEnclave, index, state);
+            latencies.push(performance.now() - started);
+        }
+    };
+
+    const histogram = monitorEventLoopDelay({ resolution: 1 });
+    histogram.enable();
+    const started = performance.now();
+    await Promise.all(Array.from({ length: Math.min(concurrency, args.calls) }, worker));
+    const elapsedMs = performance.now() - started;
+    histogram.disable();
+
+    const stats = hasStats ? secureEnclave.getStats()[name] : undefined;
+    if (operation.cleanup) {
+        await operation.cleanup(secureEnclave);
+    }
+
+    return {
+        operation: name,
+        size: operation.sized ? size : undefined,
+        concurrency,
+        calls: args.calls,
+        elapsedMs: round(elapsedMs),
+        opsPerSec: round((args.calls * 1000) / elapsedMs),
+        mbPerSec: operation.sized ? round((args.calls * size) / elapsedMs / 1000) : undefined,
+        latencyMs: summarize(latencies),
+        eventLoopLagMs: summarizeEventLoopDelay(histogram),
+        // native phases, "complete" is the hop from the worker thread to the JS thread
+        phases: stats ? stats.phases : undefined,
+        errors: stats ? stats.errors : undefined
+    };
+}
+
+async function deleteKeys(secureEnclave) {
+    for (let index = 0; index <= args.calls; index++) {
+        await secureEnclave.deleteKeyPair({ keyTag: `${keyTag}.${index}` });
+    }
+}
+
+main().catch((e) => {
+    process.stderr.write(`${e.stack || e}\n`);
+    process.exit(1);
+});
@@ -0,0 +1,53 @@
+// Helpers shared by benchmark scripts.
+
+// Parses --name value arguments, names are converted to camelCase and must be present in defaults.
+// Values are converted to the type of the default value, arrays are comma-separated lists of numbers or strings.
+function parseArgs(defaults) {
+    const result = { ...defaults };
+    const argv = process.argv.slice(2);
+    for (let i = 0; i < argv.length; i += 2) {
+        const name = argv[i].replace(/^--/, '').replace(/-(\w)/g, (_, c) => c.toUpperCase());
+        if (!(name in defaults)) {
+            throw new Error(`Unknown argument: ${argv[i]}`);
+        }
+        result[name] = parseValue(argv[i + 1], defaults[name]);
+    }
+    return result;
+}
+
+function parseValue(value, defaultValue) {
+    if (Array.isArray(defaultValue)) {
+        const items = value.split(',').filter((item) => item);
+        return typeof defaultValue[0] === 'number' ? items.map(Number) : items;
+    }
+    return typeof defaultValue === 'number' ? Number(value) : value;
+}
+
+function round(value) {
+    return Math.round(value * 1000) / 1000;
+}
+
+// summary of latencies in milliseconds, percentiles are nearest-rank
+function summarize(latencies) {
+    const sorted = [...latencies].sort((a, b) => a - b);
+    const percentile = (p) => sorted[Math.max(Math.ceil((p / 100) * sorted.length) - 1, 0)];
+    return {
+        mean: round(sorted.reduce((sum, value) => sum + value, 0) / sorted.length),
+        p50: round(percentile(50)),
+        p95: round(percentile(95)),
+        p99: round(percentile(99)),
+        max: round(sorted[sorted.length - 1])
+    };
+}
+
+// summary of a histogram from perf_hooks.monitorEventLoopDelay, which is in nanoseconds
+function summarizeEventLoopDelay(histogram) {
+    return {
+        mean: round(histogram.mean / 1e6),
+        p50: round(histogram.percentile(50) / 1e6),
+        p99: round(histogram.percentile(99) / 1e6),
+        max: round(histogram.max / 1e6)
+    };
+}
+
+module.exports = { parseArgs, round, summarize, summarizeEventLoopDelay };
@@ -4,32 +4,161 @@
       "target_name": "secure-enclave",
       "sources": [
         "src/addon.cpp",
-        "src/auto_release.h",
+        "src/addon_data.h",
+        "src/addon_data.cpp",
+        "src/aes_gcm.h",
+        "src/aes_gcm.cpp",
+        "src/async_operation.h",
+        "src/async_operation.cpp",
+        "src/backend.h",
+        "src/backend.cpp",
+        "src/cipher_stream.h",
+        "src/cipher_stream.cpp",
+        "src/crypto_kernels.h",
+        "src/crypto_kernels.cpp",
+        "src/crypto_kernels_arm.cpp",
+        "src/crypto_kernels_x86.cpp",
+        "src/decrypt_scheduler.h",
+        "src/decrypt_scheduler.cpp",
+        "src/ecdsa.h",
+        "src/ecdsa.cpp",
+        "src/ecies.h",
+        "src/ecies.cpp",
+        "src/envelope.h",
+        "src/envelope.cpp",
         "src/helpers.h",
         "src/helpers.cpp",
-        "src/objc_impl.mm",
+        "src/key_cache.h",
+        "src/key_cache.cpp",
+        "src/key_index.h",
+        "src/key_index.cpp",
+        "src/key_pool.h",
+        "src/key_pool.cpp",
+        "src/key_tag_queue.h",
+        "src/key_tag_queue.cpp",
+        "src/p256.h",
+        "src/p256.cpp",
+        "src/secure_memory.h",
+        "src/secure_memory.cpp",
+        "src/secure_random.h",
+        "src/secure_random.cpp",
+        "src/session.h",
+        "src/session.cpp",
+        "src/sha256.h",
+        "src/sha256.cpp",
+        "src/stats.h",
+        "src/stats.cpp",
+        "src/stream_cipher.h",
+        "src/stream_cipher.cpp",
+        "src/worker_pool.h",
+        "src/worker_pool.cpp",
       ],
       "include_dirs": ["<!(node -p \"require('node-addon-api').include_dir\")"],
       "defines": [ "NAPI_DISABLE_CPP_EXCEPTIONS" ],
-      "link_settings": {
-        "libraries": [
-          "$(SDKROOT)/System/Library/Frameworks/AppKit.framework",
-          "$(SDKROOT)/System/Library/Frameworks/Security.framework",
-          "$(SDKROOT)/System/Library/Frameworks/LocalAuthentication.framework",
-        ],
-      },
+      "cflags_cc": [ "-std=gnu++17" ],
       "xcode_settings": {
         "CLANG_CXX_LIBRARY": "libc++",
         "MACOSX_DEPLOYMENT_TARGET": "10.14",
         "CLANG_CXX_LANGUAGE_STANDARD": "gnu++17"
       },
       "variables": {
-        "NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN%": "0"
+        "NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN%": "0",
+        "NODE_SECURE_ENCLAVE_SOFTWARE_BACKEND%": "0"
       },
       "conditions": [
         ["NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN==1",
-          { "defines": [ "NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN" ] }]
+          { "defines": [ "NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN" ] }],
+        # the software backend is built only on request, without it other platforms fail in backend.cpp
+        ["NODE_SECURE_ENCLAVE_SOFTWARE_BACKEND==1",
+          {
+            "sources": [ "src/software_backend.cpp" ],
+            "defines": [ "NODE_SECURE_ENCLAVE_SOFTWARE_BACKEND" ],
+          }],
+        ["OS=='mac' and NODE_SECURE_ENCLAVE_SOFTWARE_BACKEND==0",
+          {
+            "sources": [
+              "src/auto_release.h",
+              "src/keychain_backend.cpp",
+              "src/objc_impl.h",
+              "src/objc_impl.mm",
+            ],
+            "link_settings": {
+              "libraries": [
+                "$(SDKROOT)/System/Library/Frameworks/AppKit.framework",
+                "$(SDKROOT)/System/Library/Frameworks/Security.framework",
+                "$(SDKROOT)/System/Library/Frameworks/LocalAuthentication.framework",
+              ],
+            },
+          }]
       ]
     }
+  ],
+  "variables": {
+    "NODE_SECURE_ENCLAVE_BENCH%": "0"
+  },
+  "conditions": [
+    ["NODE_SECURE_ENCLAVE_BENCH==1",
+      {
+        "targets": [
+          {
+            # native micro-benchmarks, built only with --NODE_SECURE_ENCLAVE_BENCH=1
+            "target_name": "secure-enclave-bench",
+            "type": "executable",
+            "sources": [
+              "bench/micro_bench.cpp",
+              "src/aes_gcm.cpp",
+              "src/backend.cpp",
+              "src/crypto_kernels.cpp",
+              "src/crypto_kernels_arm.cpp",
+              "src/crypto_kernels_x86.cpp",
+              "src/ecdsa.cpp",
+              "src/ecies.cpp",
+              "src/envelope.cpp",
+              "src/key_cache.cpp",
+              "src/p256.cpp",
+              "src/secure_memory.cpp",
+              "src/secure_random.cpp",
+              "src/sha256.cpp",
+              "src/stats.cpp",
+              "src/worker_pool.cpp",
+            ],
+            "include_dirs": ["src"],
+            "cflags_cc": [ "-std=gnu++17" ],
+            "xcode_settings": {
+              "CLANG_CXX_LIBRARY": "libc++",
+              "MACOSX_DEPLOYMENT_TARGET": "10.14",
+              "CLANG_CXX_LANGUAGE_STANDARD": "gnu++17"
+            },
+            "variables": {
+              "NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN%": "0",
+              "NODE_SECURE_ENCLAVE_SOFTWARE_BACKEND%": "0"
+            },
+            "conditions": [
+              ["NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN==1",
+                { "defines": [ "NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN" ] }],
+              ["NODE_SECURE_ENCLAVE_SOFTWARE_BACKEND==1",
+                {
+                  "sources": [ "src/software_backend.cpp" ],
+                  "defines": [ "NODE_SECURE_ENCLAVE_SOFTWARE_BACKEND" ],
+                  "libraries": [ "-lpthread" ],
+                }],
+              ["OS=='mac' and NODE_SECURE_ENCLAVE_SOFTWARE_BACKEND==0",
+                {
+                  "sources": [
+                    "src/keychain_backend.cpp",
+                    "src/objc_impl.mm",
+                  ],
+                  "link_settings": {
+                    "libraries": [
+                      "$(SDKROOT)/System/Library/Frameworks/AppKit.framework",
+                      "$(SDKROOT)/System/Library/Frameworks/Security.framework",
+                      "$(SDKROOT)/System/Library/Frameworks/LocalAuthentication.framework",
+                    ],
+                  },
+                }]
+            ]
+          }
+        ]
+      }]
   ]
 }
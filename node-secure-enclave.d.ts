@@ -9,11 +9,30 @@ declare class KeyOperationArg {
     keyTag: string;
 }
 
-declare class EncryptArg extends KeyOperationArg {
+declare class EncryptArg {
+    /**
+     * Key tag of the key pair to encrypt with, not required if publicKey is passed.
+     */
+    keyTag?: string;
+    /**
+     * Public key returned by `createKeyPair` or `findKeyPair` (65 bytes, uncompressed P-256 point).
+     * If passed, the keychain is not accessed at all.
+     */
+    publicKey?: Buffer;
     /**
      * Data you want to encrypt, no padding needed.
      */
     data: Buffer;
+    /**
+     * Encrypt a random data key with ECIES and the data with AES-256-GCM in 64 KiB chunks,
+     *  which are processed in parallel. Use it for large payloads, false by default.
+     */
+    envelope?: boolean;
+    /**
+     * Return the compact format: a 2-byte header and a compressed ephemeral key, 30 bytes shorter than
+     *  the standard one. Both formats are detected on decryption, it can't be used with `envelope`. False by default.
+     */
+    compact?: boolean;
 }
 
 declare class DecryptArg extends KeyOperationArg {
@@ -29,6 +48,472 @@ declare class DecryptArg extends KeyOperationArg {
      *  For example, it can be: "decrypt data", "open file"
      */
     touchIdPrompt: string;
+
+    /**
+     * Aborts the call while it's waiting for the user, the promise is rejected with error.aborted = true.
+     * If no other calls are waiting for the same prompt, the prompt is dismissed.
+     */
+    signal?: AbortSignal;
+
+    /**
+     * Aborts the call like signal if it's not complete in this time.
+     */
+    timeoutMs?: number;
+}
+
+declare class DecryptManyArg extends KeyOperationArg {
+    /**
+     * Data items you want to decrypt, each of them is returned by `encrypt`.
+     */
+    items: Buffer[];
+
+    /**
+     * Text shown during biometric authentication, see `DecryptArg.touchIdPrompt`.
+     */
+    touchIdPrompt: string;
+}
+
+declare class DecryptManyResult {
+    /**
+     * Decrypted data, if this item was decrypted successfully.
+     */
+    data?: Buffer;
+
+    /**
+     * Decryption error for this item, same as the one `decrypt` would throw.
+     */
+    error?: Error;
+}
+
+declare class RewrapArg {
+    /**
+     * Key the items are encrypted with now, it's used after biometric authentication.
+     */
+    fromKeyTag: string;
+
+    /**
+     * Key the items will be encrypted with, only its public key is used.
+     */
+    toKeyTag: string;
+
+    /**
+     * Encrypted items, each of them is returned by `encrypt`.
+     */
+    items: Buffer[];
+
+    /**
+     * Text shown during biometric authentication, see `DecryptArg.touchIdPrompt`.
+     */
+    touchIdPrompt: string;
+}
+
+declare class RewrapResult {
+    /**
+     * Item encrypted with `toKeyTag`, if it was rewrapped successfully.
+     */
+    data?: Buffer;
+
+    /**
+     * Error for this item, same as the one `decrypt` would throw.
+     */
+    error?: Error;
+}
+
+declare class ConvertCiphertextsArg {
+    /**
+     * Encrypted items, each of them is returned by `encrypt`.
+     */
+    items: Buffer[];
+
+    /**
+     * Format to convert items to: `compact` or `standard`, which is `SecKeyCreateEncryptedData` output.
+     * Items already in this format and envelopes are returned as is.
+     */
+    format: 'compact' | 'standard';
+}
+
+declare class ConvertCiphertextsResult {
+    /**
+     * Converted item, if it was converted successfully.
+     */
+    data?: Buffer;
+
+    /**
+     * Error for an item that is not a valid ciphertext.
+     */
+    error?: Error;
+}
+
+declare class SignArg extends KeyOperationArg {
+    /**
+     * Data you want to sign, it's hashed with SHA-256.
+     */
+    data: Buffer;
+
+    /**
+     * Text shown during biometric authentication, see `DecryptArg.touchIdPrompt`.
+     */
+    touchIdPrompt: string;
+}
+
+declare class KdfArg {
+    /**
+     * X9.63 KDF shared info, empty by default.
+     */
+    info?: Buffer;
+    /**
+     * Derived key length in bytes, from 1 to 1024, 32 by default.
+     */
+    length?: number;
+}
+
+declare class DeriveSharedSecretArg extends KeyOperationArg {
+    /**
+     * Public key of the other party, 65 bytes, uncompressed P-256 point.
+     */
+    peerPublicKey: Buffer;
+
+    kdf?: KdfArg;
+
+    /**
+     * Text shown during biometric authentication, see `DecryptArg.touchIdPrompt`.
+     */
+    touchIdPrompt: string;
+}
+
+declare class VerifyKeyArg {
+    /**
+     * Key tag of the key pair that has made the signature, not required if publicKey is passed.
+     */
+    keyTag?: string;
+    /**
+     * Public key returned by `createKeyPair` or `findKeyPair`, if passed, the keychain is not accessed at all.
+     */
+    publicKey?: Buffer;
+}
+
+declare class SignedItem {
+    /**
+     * Signed data.
+     */
+    data: Buffer;
+    /**
+     * Signature returned by `sign`.
+     */
+    signature: Buffer;
+}
+
+declare class VerifyArg extends VerifyKeyArg {
+    data: Buffer;
+    signature: Buffer;
+}
+
+declare class VerifyManyArg extends VerifyKeyArg {
+    items: SignedItem[];
+}
+
+declare class OpenSessionArg extends KeyOperationArg {
+    /**
+     * Text shown during biometric authentication, see `DecryptArg.touchIdPrompt`.
+     */
+    touchIdPrompt: string;
+
+    /**
+     * How long the session can be used after authentication, 300 seconds by default.
+     */
+    reuseSeconds?: number;
+}
+
+declare class Session {
+    /**
+     * False after the session is closed or expired.
+     */
+    readonly isOpen: boolean;
+
+    /**
+     * Decrypts data like `decrypt`, without a Touch ID prompt and without looking the key up.
+     * Throws an error with error.sessionClosed = true if the session is closed or expired.
+     * @param data data returned by `encrypt`
+     * @returns decrypted data
+     */
+    decrypt(data: Buffer): Promise<Buffer>;
+
+    /**
+     * Ends the session, it's also closed when the reuse time is over or the object is garbage collected.
+     */
+    close(): void;
+}
+
+declare class EncryptStreamArg {
+    /**
+     * Key tag of the key pair to encrypt with, not required if publicKey is passed.
+     */
+    keyTag?: string;
+    /**
+     * Public key returned by `createKeyPair` or `findKeyPair`, see `EncryptArg.publicKey`.
+     */
+    publicKey?: Buffer;
+}
+
+declare class DecryptStreamArg extends KeyOperationArg {
+    /**
+     * Text shown during biometric authentication, see `DecryptArg.touchIdPrompt`.
+     */
+    touchIdPrompt: string;
+}
+
+declare class ConfigureArg {
+    /**
+     * Number of native threads that run keychain and crypto operations, 4 by default.
+     * At most this number of operations is executed in parallel, others wait in a queue.
+     */
+    workerThreads?: number;
+
+    /**
+     * Maximum number of public keys cached by keyTag, 256 by default, 0 disables the cache.
+     */
+    keyCacheSize?: number;
+
+    /**
+     * Maximum number of `decrypt` calls waiting for a prompt per keyTag, 1024 by default.
+     */
+    decryptQueueLimit?: number;
+
+    /**
+     * Persistent index of public keys used by `findKeyPair` to avoid keychain queries on cold start, off by default.
+     * The index can be stale, it's reconciled with the keychain in the background, null turns it off.
+     */
+    keyIndex?: KeyIndexArg | null;
+
+    /**
+     * Number of keys generated in the background for `createKeyPair`, from 0 to 32, 0 (off) by default.
+     * Pooled keys have temporary tags and are hidden from `listKeys`, unclaimed keys are deleted when the pool
+     * is turned off or the process exits.
+     */
+    keyPoolDepth?: number;
+
+    /**
+     * Collects latency histograms and error counters of operations, returned by `getStats`, off by default.
+     * Operations started while it's off are not measured.
+     */
+    stats?: boolean;
+
+    /**
+     * Called with the timing of every completed operation, before its promise is settled, null to remove it.
+     * Exceptions thrown by the callback are ignored.
+     */
+    trace?: ((event: TraceEvent) => void) | null;
+}
+
+declare class KeyIndexArg {
+    /**
+     * Index file path, the file is created on the first change.
+     */
+    path: string;
+    /**
+     * Minimum interval between reconciles with the keychain, 60 by default.
+     */
+    reconcileSeconds?: number;
+}
+
+declare class PhaseDurations {
+    /**
+     * Waiting for a native worker thread.
+     */
+    queue?: number;
+    /**
+     * Waiting for the user to authenticate, only for operations that show the prompt.
+     */
+    auth?: number;
+    /**
+     * Keychain queries and public key cache lookups.
+     */
+    lookup?: number;
+    /**
+     * Key generation, encryption or decryption.
+     */
+    crypto?: number;
+    /**
+     * Passing the result from the worker thread to the JS thread.
+     */
+    complete?: number;
+    /**
+     * From the call to the promise settlement.
+     */
+    total?: number;
+}
+
+declare class TraceEvent {
+    /**
+     * Operation name, such as `decrypt` or `findKeyPair`.
+     */
+    operation: string;
+    /**
+     * Whether the promise is rejected.
+     */
+    error: boolean;
+    /**
+     * Keychain status code of the error, 0 on success or if the error has no status code.
+     */
+    status: number;
+    /**
+     * Durations of phases in milliseconds, phases that didn't happen are missing.
+     */
+    phases: PhaseDurations;
+}
+
+declare class LatencyHistogram {
+    count: number;
+    /**
+     * Latencies in milliseconds, percentiles are accurate to about 10%.
+     */
+    mean: number;
+    p50: number;
+    p95: number;
+    p99: number;
+    max: number;
+}
+
+declare class OperationStats {
+    /**
+     * Number of completed operations.
+     */
+    count: number;
+    /**
+     * Number of failed operations by keychain status code, 0 for errors without a status code.
+     */
+    errors: { [status: string]: number };
+    /**
+     * Latency of each phase, see `PhaseDurations`.
+     */
+    phases: { [phase in keyof PhaseDurations]?: LatencyHistogram };
+}
+
+declare class KeyCacheStats {
+    /**
+     * Lookups served from the cache.
+     */
+    hits: number;
+    /**
+     * Lookups that went to the keychain.
+     */
+    misses: number;
+    /**
+     * Number of cached keys.
+     */
+    size: number;
+    /**
+     * Maximum number of cached keys.
+     */
+    capacity: number;
+    /**
+     * Number of cached keys with a precomputed table, which makes encryption faster.
+     * It's built on the second encryption with a key and takes about 15 KiB.
+     */
+    tables: number;
+}
+
+declare class KeyIndexStats {
+    /**
+     * Lookups served from the index.
+     */
+    hits: number;
+    /**
+     * Lookups that went to the keychain.
+     */
+    misses: number;
+    /**
+     * Entries that didn't match the keychain and were fixed.
+     */
+    repairs: number;
+    /**
+     * Completed reconciles with the keychain.
+     */
+    reconciles: number;
+    /**
+     * Number of indexed keys.
+     */
+    size: number;
+}
+
+declare class KeyPoolStats {
+    /**
+     * Configured number of keys, see `ConfigureArg.keyPoolDepth`.
+     */
+    depth: number;
+    /**
+     * Keys ready to be claimed.
+     */
+    size: number;
+    /**
+     * `createKeyPair` calls served with a pooled key.
+     */
+    hits: number;
+    /**
+     * `createKeyPair` calls that generated a key because the pool was empty.
+     */
+    misses: number;
+    /**
+     * hits / (hits + misses), 0 before the first call.
+     */
+    hitRate: number;
+    /**
+     * Failed background key generations.
+     */
+    refillErrors: number;
+    /**
+     * Time to generate one pooled key.
+     */
+    refill: LatencyHistogram;
+}
+
+declare class CryptoKernels {
+    aesGcm: 'aesni' | 'armv8' | 'portable';
+    sha256: 'shani' | 'armv8' | 'portable';
+}
+
+declare class InFlightStats {
+    /**
+     * Native operations that have been started and not deleted yet, in all threads of the process.
+     */
+    operations: number;
+    /**
+     * Decrypt calls of this thread that are waiting for the user or being decrypted.
+     */
+    pendingDecrypts: number;
+}
+
+declare class SecureMemoryStats {
+    /**
+     * Number of locked slabs that small buffers are carved from.
+     */
+    slabs: number;
+    /**
+     * Memory mapped for slabs and large buffers.
+     */
+    reservedBytes: number;
+    /**
+     * Part of reservedBytes locked in RAM, it's less if the system limit on locked memory is reached.
+     */
+    lockedBytes: number;
+    /**
+     * Buffers in use, including ones returned to JS and not yet garbage collected.
+     */
+    inUseBytes: number;
+    peakInUseBytes: number;
+    allocations: number;
+    /**
+     * Allocations served from released buffers, without new system calls.
+     */
+    reusedAllocations: number;
+    /**
+     * Allocations over 64 KiB, they get separate mappings.
+     */
+    largeAllocations: number;
+    /**
+     * Number of mappings that couldn't be locked.
+     */
+    lockFailures: number;
 }
 
 declare class ResultWithPublicKey {
@@ -39,6 +524,22 @@ declare class ResultWithPublicKey {
     publicKey: Buffer;
 }
 
+declare class ListKeysArg {
+    /**
+     * Returns only keys with tags starting with this prefix, all keys by default.
+     */
+    prefix?: string;
+
+    /**
+     * Maximum number of returned keys, all keys by default.
+     */
+    limit?: number;
+}
+
+declare class KeyInfo extends ResultWithPublicKey {
+    keyTag: string;
+}
+
 declare class NodeSecureEnclave {
     /**
      * Checks if biometric authentication and hardware-based encryption is supported.
@@ -46,8 +547,29 @@ declare class NodeSecureEnclave {
      */
     static isSupported: boolean;
 
+    /**
+     * Same as isSupported, but the check runs on a worker thread instead of blocking the event loop.
+     * The result is cached for the process, later isSupported reads are fast.
+     */
+    static checkSupport(): Promise<boolean>;
+
+    /**
+     * Backend the module was built with:
+     *  - keychain: Secure Enclave and Touch ID through Security.framework and LocalAuthentication
+     *  - software: keys in files and simulated authentication, for tests and benchmarks only
+     */
+    static backend: 'keychain' | 'software';
+
+    /**
+     * Implementations of in-process AES-GCM and SHA-256, selected for the CPU when the module is loaded.
+     * Hardware ones are used if they pass known-answer tests,
+     * NODE_SECURE_ENCLAVE_CRYPTO_KERNELS=portable disables them.
+     */
+    static cryptoKernels: CryptoKernels;
+
     /**
      * Creates a new key in the keychain. If a key with this keyTag already exists, an error is thrown.
+     * If the key pool is on, a pre-generated key is renamed to keyTag, see `ConfigureArg.keyPoolDepth`.
      * @param options key creation options
      * @returns created public key
      */
@@ -60,6 +582,14 @@ declare class NodeSecureEnclave {
      */
     static findKeyPair(options: KeyOperationArg): Promise<ResultWithPublicKey | null>;
 
+    /**
+     * Finds all keys with one keychain query, it's faster than calling `findKeyPair` for every keyTag.
+     * Public keys of found keys are cached for `encrypt`.
+     * @param options optional prefix and limit
+     * @returns keys sorted by keyTag
+     */
+    static listKeys(options?: ListKeysArg): Promise<KeyInfo[]>;
+
     /**
      * Deletes a key from Keychain and Secure Enclave.
      * @param options key tag
@@ -68,8 +598,10 @@ declare class NodeSecureEnclave {
     static deleteKeyPair(options: KeyOperationArg): Promise<boolean>;
 
     /**
-     * Encrypts data on Secure Enclave with a key identified by keyTag
+     * Encrypts data with a public key identified by keyTag or passed as publicKey
      *  using ECIESEncryptionCofactorVariableIVX963SHA256AESGCM algorithm.
+     * Only the public key is needed, so encryption is done in-process;
+     *  public keys are cached, the keychain is queried only the first time a keyTag is used.
      * Data doesn't have to be padded, any non-empty Buffer should work.
      * Throws an error if the requested key is not found
      *  or there was an encryption error.
@@ -82,18 +614,172 @@ declare class NodeSecureEnclave {
      * Decrypts data on Secure Enclave with a key identified by keyTag
      *  using ECIESEncryptionCofactorVariableIVX963SHA256AESGCM algorithm.
      * Accepts data returned by `encrypt`, no padding or encoding is required.
+     * Envelopes are detected automatically, they need one Secure Enclave operation however large they are.
      * This method will show the Touch ID prompt and wait until it's approved or rejected.
+     * Concurrent calls for the same keyTag made before the user has authenticated share one prompt,
+     * prompts for different keyTags are shown one at a time.
      * Possible cases that can cause an error:
      *  - the requested key is not found => error.keyNotFound = true
+     *  - too many calls for this keyTag are waiting, see `ConfigureArg.decryptQueueLimit` => error.queueFull = true
      *  - data is invalid or cannot be decrypted with this key => error.badParam = true
      *  - user rejected the Touch ID request using the Cancel button => error.rejected = true
      *  - there was a decryption error
      *  - system refused to show the Touch ID prompt
      *  - Touch ID request timed out
+     *  - the call was aborted with signal or timeoutMs => error.aborted = true
      * @param options
      * @returns decrypted data
      */
     static decrypt(options: DecryptArg): Promise<Buffer>;
+
+    /**
+     * Decrypts many items with one Touch ID prompt, the key is looked up once
+     *  and items are decrypted in parallel on native threads.
+     * The promise is rejected, as in `decrypt`, if the key is not found or the user refuses to authenticate.
+     * Otherwise it resolves to one result per item, in the same order:
+     *  items that can't be decrypted have `error` set, others have `data`.
+     * @param options
+     * @returns decryption results
+     */
+    static decryptMany(options: DecryptManyArg): Promise<DecryptManyResult[]>;
+
+    /**
+     * Re-encrypts items for another key with one Touch ID prompt, for example to rotate keys.
+     * Items are decrypted and encrypted again on native threads, plaintext is never passed to JS.
+     * Envelopes keep their payload, only the data key is encrypted with the new key.
+     * The promise is rejected, as in `decrypt`, if a key is not found or the user refuses to authenticate.
+     * Otherwise it resolves to one result per item, in the same order, as in `decryptMany`.
+     * @param options
+     * @returns rewrapped items
+     */
+    static rewrap(options: RewrapArg): Promise<RewrapResult[]>;
+
+    /**
+     * Converts encrypted items between the standard and compact formats on native threads, no key is needed.
+     * @param options
+     * @returns one result per item, in the same order
+     */
+    static convertCiphertexts(options: ConvertCiphertextsArg): Promise<ConvertCiphertextsResult[]>;
+
+    /**
+     * Signs data on Secure Enclave with a key identified by keyTag using ECDSASignatureMessageX962SHA256 algorithm.
+     * This method will show the Touch ID prompt, possible errors are the same as in `decrypt`.
+     * @param options
+     * @returns DER-encoded ECDSA signature
+     */
+    static sign(options: SignArg): Promise<Buffer>;
+
+    /**
+     * Checks a signature made by `sign`. Only the public key is needed, so it's done in-process without a prompt.
+     * @param options
+     * @returns whether the signature is valid
+     */
+    static verify(options: VerifyArg): Promise<boolean>;
+
+    /**
+     * Checks many signatures made with one key, they are verified in parallel on native threads.
+     * @param options
+     * @returns whether each signature is valid, in the order of items
+     */
+    static verifyMany(options: VerifyManyArg): Promise<boolean[]>;
+
+    /**
+     * Derives a symmetric key from the private key and a peer public key
+     *  using ECDHKeyExchangeCofactorX963SHA256 algorithm: ECDH, then X9.63 KDF with SHA-256.
+     * Use it to agree on a session key once and encrypt locally with fast symmetric crypto.
+     * This method will show the Touch ID prompt, possible errors are the same as in `decrypt`.
+     * The returned key is not copied to JS, like data returned by `decrypt`, wipe it when it's not needed.
+     * @param options
+     * @returns derived key
+     */
+    static deriveSharedSecret(options: DeriveSharedSecretArg): Promise<Buffer>;
+
+    /**
+     * Shows the Touch ID prompt and returns a session that decrypts with this key without prompting again
+     *  until it's closed or reuseSeconds pass.
+     * Throws the same errors as `decrypt` if the key is not found or the user refuses to authenticate.
+     * @param options
+     * @returns session
+     */
+    static openSession(options: OpenSessionArg): Promise<Session>;
+
+    /**
+     * Creates a stream that encrypts data in 64 KiB authenticated frames, for data of any length.
+     * Frames are encrypted on native threads, memory usage doesn't depend on the stream length.
+     * The output can be decrypted only with `createDecryptStream`.
+     * Errors, for example if the key is not found, are emitted as stream errors.
+     * @param options
+     * @returns transform stream
+     */
+    static createEncryptStream(options: EncryptStreamArg): import('stream').Transform;
+
+    /**
+     * Creates a stream that decrypts the output of `createEncryptStream`.
+     * The Touch ID prompt is shown when the first chunk is written.
+     * Data that can't be decrypted, including a truncated stream, is emitted as a stream error
+     *  with error.badParam = true. Errors of `decrypt` are possible as well.
+     * @param options
+     * @returns transform stream
+     */
+    static createDecryptStream(options: DecryptStreamArg): import('stream').Transform;
+
+    /**
+     * Overwrites the buffer with zeros, use it to get rid of decrypted data as soon as it's not needed.
+     * Buffers returned by this module are also zeroized when they are garbage collected.
+     * Throws a TypeError if the argument is not a Buffer.
+     * @param buffer buffer to wipe
+     */
+    static wipe(buffer: Buffer): void;
+
+    /**
+     * Changes module settings, all options are optional.
+     * Throws a TypeError if an option is invalid.
+     * @param options settings to change
+     */
+    static configure(options: ConfigureArg): void;
+
+    /**
+     * Drops cached public keys, call it if keys are created or deleted outside of this module.
+     * `createKeyPair` and `deleteKeyPair` update the cache themselves.
+     */
+    static clearKeyCache(): void;
+
+    /**
+     * Returns public key cache counters, they are not reset by `clearKeyCache`.
+     */
+    static getKeyCacheStats(): KeyCacheStats;
+
+    /**
+     * Returns key index counters, null if the index is off.
+     */
+    static getKeyIndexStats(): KeyIndexStats | null;
+
+    /**
+     * Returns key pool counters, null if the pool is off.
+     */
+    static getKeyPoolStats(): KeyPoolStats | null;
+
+    /**
+     * Returns usage of the memory that holds decrypted data and derived keys.
+     */
+    static getSecureMemoryStats(): SecureMemoryStats;
+
+    /**
+     * Returns the number of native operations and decrypt calls that haven't completed yet,
+     * it should go back to zero when the app is idle.
+     */
+    static getInFlightStats(): InFlightStats;
+
+    /**
+     * Returns latency histograms and error counters by operation name,
+     * collected while enabled with `configure({ stats: true })`.
+     */
+    static getStats(): { [operation: string]: OperationStats };
+
+    /**
+     * Clears collected stats.
+     */
+    static resetStats(): void;
 }
 
 export = NodeSecureEnclave;
@@ -0,0 +1,58 @@
+const { Transform } = require('stream');
+
+const secureEnclave = require('./build/Release/secure-enclave.node');
+
+// Transform stream on top of a native CipherStream, which is opened with the first chunk.
+// Each chunk is processed on native threads, the next one is accepted when the previous one is done,
+// so memory usage doesn't depend on the stream length and backpressure works as usual.
+class CipherTransform extends Transform {
+    constructor(open) {
+        super();
+        this._open = open;
+        this._cipher = undefined;
+    }
+
+    _getCipher() {
+        if (!this._cipher) {
+            this._cipher = this._open();
+        }
+        return this._cipher;
+    }
+
+    _transform(chunk, encoding, callback) {
+        this._getCipher()
+            .then((cipher) => cipher.update(chunk))
+            .then((data) => {
+                if (data.length) {
+                    this.push(data);
+                }
+                callback();
+            }, callback);
+    }
+
+    _flush(callback) {
+        this._getCipher()
+            .then((cipher) => cipher.final())
+            .then((data) => {
+                if (data.length) {
+                    this.push(data);
+                }
+                callback();
+            }, callback);
+    }
+
+    _destroy(err, callback) {
+        if (this._cipher) {
+            this._cipher.then((cipher) => cipher.close(), () => {});
+        }
+        callback(err);
+    }
+}
+
+secureEnclave.createEncryptStream = (options) =>
+    new CipherTransform(() => secureEnclave.openEncryptStream(options));
+
+secureEnclave.createDecryptStream = (options) =>
+    new CipherTransform(() => secureEnclave.openDecryptStream(options));
+
+module.exports = secureEnclave;
@@ -1,26 +1,766 @@
-#include <Security/Security.h>
 #include <napi.h>
 
-#include "auto_release.h"
+#include "addon_data.h"
+#include "async_operation.h"
+#include "backend.h"
+#include "cipher_stream.h"
+#include "crypto_kernels.h"
+#include "ecdsa.h"
+#include "ecies.h"
+#include "envelope.h"
 #include "helpers.h"
+#include "key_cache.h"
+#include "key_index.h"
+#include "key_pool.h"
+#include "p256.h"
+#include "secure_memory.h"
+#include "session.h"
+#include "stats.h"
+#include "stream_cipher.h"
+#include "worker_pool.h"
+
+// Queued by keyTag together with DeleteKeyPairOperation: the keychain allows several keys with one tag, so the
+// duplicate check and the creation or the pool claim must not interleave with other calls for the same keyTag.
+class CreateKeyPairOperation : public AsyncOperation {
+  private:
+    std::shared_ptr<KeyCache> keyCache_;
+    std::shared_ptr<KeyIndex> keyIndex_;
+    std::shared_ptr<KeyPool> keyPool_;
+    std::string keyTag_;
+    Bytes publicKey_;
+
+  protected:
+    void execute() override {
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        auto cacheGeneration = keyCache_->generation();
+        if (!keyPool_ || !keyPool_->claim(keyTag_, publicKey_, error_)) {
+            error_ = getBackend().createKeyPair(keyTag_, publicKey_);
+        }
+        if (!error_) {
+            keyCache_->set(keyTag_, publicKey_, cacheGeneration);
+            if (keyIndex_) {
+                keyIndex_->set(keyTag_, publicKey_);
+            }
+        }
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        auto ret = Napi::Object::New(env);
+        ret.Set("publicKey", bytesToBuffer(env, publicKey_));
+        deferred.Resolve(ret);
+    }
+
+  public:
+    CreateKeyPairOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &keyTag)
+        : AsyncOperation(env, std::move(deferred), "createKeyPair"), keyCache_(getAddonData(env).keyCache),
+          keyIndex_(getAddonData(env).keyIndex), keyPool_(getAddonData(env).keyPool), keyTag_(keyTag) {}
+};
+
+class FindKeyPairOperation : public AsyncOperation {
+  private:
+    std::shared_ptr<KeyCache> keyCache_;
+    std::shared_ptr<KeyIndex> keyIndex_;
+    std::string keyTag_;
+    Bytes publicKey_;
+    bool found_ = false;
+
+  protected:
+    void execute() override {
+        if (keyCache_->get(keyTag_, publicKey_)) {
+            found_ = true;
+            return;
+        }
+
+        PhaseTimer timer(this, PHASE_LOOKUP);
+        if (keyIndex_) {
+            // the index can be stale, it's not put to the cache used by encrypt, the keychain check is deferred
+            reconcileKeyIndexInBackground(keyIndex_);
+            if (keyIndex_->get(keyTag_, publicKey_)) {
+                found_ = true;
+                return;
+            }
+        }
+
+        auto cacheGeneration = keyCache_->generation();
+        std::unique_ptr<KeyPair> keyPair;
+        auto error = getBackend().findKeyPair(keyTag_, nullptr, keyPair);
+        if (error.code == STATUS_ITEM_NOT_FOUND) {
+            return;
+        } else if (error) {
+            error_ = error;
+            return;
+        }
+        error_ = keyPair->copyPublicKey(publicKey_);
+        found_ = !error_;
+        if (found_) {
+            keyCache_->set(keyTag_, publicKey_, cacheGeneration);
+            if (keyIndex_) {
+                keyIndex_->set(keyTag_, publicKey_);
+            }
+        }
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        if (!found_) {
+            deferred.Resolve(env.Null());
+            return;
+        }
+        auto ret = Napi::Object::New(env);
+        ret.Set("publicKey", bytesToBuffer(env, publicKey_));
+        deferred.Resolve(ret);
+    }
+
+  public:
+    FindKeyPairOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &keyTag)
+        : AsyncOperation(env, std::move(deferred), "findKeyPair"), keyCache_(getAddonData(env).keyCache),
+          keyIndex_(getAddonData(env).keyIndex), keyTag_(keyTag) {}
+};
+
+// runs after create and delete calls made earlier for the same keyTag, see CreateKeyPairOperation
+class DeleteKeyPairOperation : public AsyncOperation {
+  private:
+    std::shared_ptr<KeyCache> keyCache_;
+    std::shared_ptr<KeyIndex> keyIndex_;
+    std::string keyTag_;
+    bool deleted_ = false;
+
+  protected:
+    void execute() override {
+        PhaseTimer timer(this, PHASE_LOOKUP);
+        auto error = getBackend().deleteKeyPair(keyTag_);
+        // after the deletion; lookups that have found the key before it was deleted don't cache it, see KeyCache
+        keyCache_->remove(keyTag_);
+        if (keyIndex_ && (!error || error.code == STATUS_ITEM_NOT_FOUND)) {
+            keyIndex_->remove(keyTag_);
+        }
+        if (error.code == STATUS_ITEM_NOT_FOUND) {
+            return;
+        }
+        error_ = error;
+        deleted_ = !error;
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        deferred.Resolve(Napi::Boolean::New(env, deleted_));
+    }
+
+  public:
+    DeleteKeyPairOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &keyTag)
+        : AsyncOperation(env, std::move(deferred), "deleteKeyPair"), keyCache_(getAddonData(env).keyCache),
+          keyIndex_(getAddonData(env).keyIndex), keyTag_(keyTag) {}
+};
+
+// Lists keys with one keychain query instead of a findKeyPair call for every keyTag, found keys are cached.
+class ListKeysOperation : public AsyncOperation {
+  private:
+    std::shared_ptr<KeyCache> keyCache_;
+    std::string prefix_;
+    size_t limit_;
+    std::vector<KeyInfo> keys_;
+
+  protected:
+    void execute() override {
+        PhaseTimer timer(this, PHASE_LOOKUP);
+        auto cacheGeneration = keyCache_->generation();
+        error_ = getBackend().listKeys(prefix_, KEY_POOL_TAG_PREFIX, limit_, keys_);
+        for (auto &key : keys_) {
+            keyCache_->set(key.keyTag, key.publicKey, cacheGeneration);
+        }
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        auto ret = Napi::Array::New(env, keys_.size());
+        for (size_t i = 0; i < keys_.size(); i++) {
+            auto key = Napi::Object::New(env);
+            key.Set("keyTag", Napi::String::New(env, keys_[i].keyTag));
+            key.Set("publicKey", bytesToBuffer(env, keys_[i].publicKey));
+            ret.Set(uint32_t(i), key);
+        }
+        deferred.Resolve(ret);
+    }
+
+  public:
+    ListKeysOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &prefix, size_t limit)
+        : AsyncOperation(env, std::move(deferred), "listKeys"), keyCache_(getAddonData(env).keyCache),
+          prefix_(prefix), limit_(limit) {}
+};
+
+// gets the public key from the cache or the keychain, unless it's already known;
+// if table is passed, the precomputed table of a cached key is returned, it's built on the second use of the key
+BackendError resolvePublicKey(KeyCache &keyCache, const std::string &keyTag, Bytes &publicKey,
+                              std::shared_ptr<const P256PublicKeyTable> *table = nullptr) {
+    if (!publicKey.empty()) {
+        return BackendError();
+    }
+    if (table) {
+        if (keyCache.get(keyTag, publicKey, *table)) {
+            if (!*table) {
+                *table = p256PrecomputePublicKey(publicKey.data());
+                keyCache.setTable(keyTag, publicKey, *table);
+            }
+            return BackendError();
+        }
+    } else if (keyCache.get(keyTag, publicKey)) {
+        return BackendError();
+    }
+
+    auto cacheGeneration = keyCache.generation();
+    std::unique_ptr<KeyPair> keyPair;
+    if (auto error = getBackend().findKeyPair(keyTag, nullptr, keyPair)) {
+        return error;
+    }
+    if (auto error = keyPair->copyPublicKey(publicKey)) {
+        return error;
+    }
+    if (!p256IsValidPublicKey(publicKey.data(), publicKey.size())) {
+        return errorWithMessage("Algorithm not supported");
+    }
+
+    keyCache.set(keyTag, publicKey, cacheGeneration);
+    return BackendError();
+}
+
+// Encryption needs only the public key, so it's done in-process, without calling the keychain.
+// The result is the same as kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM output.
+class EncryptOperation : public AsyncOperation {
+  private:
+    std::shared_ptr<KeyCache> keyCache_;
+    std::shared_ptr<KeyIndex> keyIndex_;
+    // empty if the public key is passed explicitly
+    std::string keyTag_;
+    Bytes publicKey_;
+    // points to the contents of the input Buffer, which is pinned until the operation is complete
+    // it's caller responsibility to clean it up, no need to do it here
+    const uint8_t *data_;
+    size_t length_;
+    bool envelope_;
+    bool compact_;
+    std::shared_ptr<const P256PublicKeyTable> table_;
+    Bytes encryptedData_;
+
+  protected:
+    void execute() override {
+        {
+            PhaseTimer timer(this, PHASE_LOOKUP);
+            error_ = resolvePublicKey(*keyCache_, keyTag_, publicKey_, &table_);
+            removeMissingKeyFromIndex(keyIndex_, keyTag_, error_);
+        }
+        if (error_) {
+            return;
+        }
+
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        if (envelope_) {
+            if (!envelopeEncrypt(publicKey_.data(), data_, length_, encryptedData_, table_.get())) {
+                error_ = errorWithCode(STATUS_PARAM, "SecKeyCreateEncryptedData");
+            }
+            return;
+        }
+
+        encryptedData_.resize(length_ + ECIES_OVERHEAD);
+        if (!eciesEncrypt(publicKey_.data(), data_, length_, encryptedData_.data(), table_.get())) {
+            error_ = errorWithCode(STATUS_PARAM, "SecKeyCreateEncryptedData");
+            return;
+        }
+        if (compact_) {
+            eciesToCompact(encryptedData_.data(), encryptedData_.size(), encryptedData_.data());
+            encryptedData_.resize(length_ + ECIES_COMPACT_OVERHEAD);
+        }
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        deferred.Resolve(bytesToExternalBuffer(env, std::move(encryptedData_)));
+    }
+
+  public:
+    EncryptOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &keyTag,
+                     const Bytes &publicKey, Napi::Buffer<uint8_t> data, bool envelope, bool compact)
+        : AsyncOperation(env, std::move(deferred), "encrypt"), keyCache_(getAddonData(env).keyCache),
+          keyIndex_(getAddonData(env).keyIndex), keyTag_(keyTag), publicKey_(publicKey), data_(data.Data()),
+          length_(data.ByteLength()), envelope_(envelope), compact_(compact) {
+        pin(data);
+    }
+};
+
+// Converts items between ECIES output and the compact format on the worker pool, no key is needed.
+// Items already in the requested format and envelopes are returned as is.
+class ConvertCiphertextsOperation : public AsyncOperation {
+  private:
+    struct Item {
+        // pinned input Buffer, see EncryptOperation
+        const uint8_t *data;
+        size_t length;
+        Bytes convertedData;
+        BackendError error;
+    };
+
+    std::vector<Item> items_;
+    bool compact_;
+
+    BackendError convert(Item &item) {
+        if (isEnvelope(item.data, item.length) || isCompactEcies(item.data, item.length) == compact_) {
+            item.convertedData.assign(item.data, item.data + item.length);
+            return BackendError();
+        }
+        if (compact_) {
+            if (item.length < ECIES_OVERHEAD) {
+                return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData");
+            }
+            item.convertedData.resize(item.length - ECIES_OVERHEAD + ECIES_COMPACT_OVERHEAD);
+            if (!eciesToCompact(item.data, item.length, item.convertedData.data())) {
+                return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData");
+            }
+            return BackendError();
+        }
+        item.convertedData.resize(item.length - ECIES_COMPACT_OVERHEAD + ECIES_OVERHEAD);
+        if (!eciesFromCompact(item.data, item.length, item.convertedData.data())) {
+            return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData");
+        }
+        return BackendError();
+    }
+
+  protected:
+    void execute() override {
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        getWorkerPool().parallelFor(items_.size(), [this](size_t index) {
+            auto &item = items_[index];
+            item.error = convert(item);
+            if (item.error) {
+                item.convertedData.clear();
+            }
+        });
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        auto results = Napi::Array::New(env, items_.size());
+        for (size_t i = 0; i < items_.size(); i++) {
+            auto result = Napi::Object::New(env);
+            if (items_[i].error) {
+                result.Set("error", createBackendError(env, items_[i].error).Value());
+            } else {
+                result.Set("data", bytesToExternalBuffer(env, std::move(items_[i].convertedData)));
+            }
+            results.Set(uint32_t(i), result);
+        }
+        deferred.Resolve(results);
+    }
+
+  public:
+    ConvertCiphertextsOperation(Napi::Env env, Napi::Promise::Deferred deferred,
+                                const std::vector<Napi::Buffer<uint8_t>> &items, bool compact)
+        : AsyncOperation(env, std::move(deferred), "convertCiphertexts"), compact_(compact) {
+        items_.reserve(items.size());
+        for (auto &item : items) {
+            items_.push_back(Item{item.Data(), item.ByteLength(), Bytes(), BackendError()});
+            pin(item);
+        }
+    }
+};
+
+// Decrypts many items after a single prompt, the key is looked up once and items are decrypted in parallel.
+// Items are independent: one that can't be decrypted gets an error, others are still returned.
+class DecryptManyOperation : public AuthenticatedOperation {
+  private:
+    struct Item {
+        // pinned input Buffer, see EncryptOperation
+        const uint8_t *data;
+        size_t length;
+        SecureBytes decryptedData;
+        BackendError error;
+    };
+
+    std::shared_ptr<KeyIndex> keyIndex_;
+    std::string keyTag_;
+    std::vector<Item> items_;
+
+  protected:
+    void execute() override {
+        std::unique_ptr<KeyPair> keyPair;
+        {
+            PhaseTimer timer(this, PHASE_LOOKUP);
+            error_ = getBackend().findKeyPair(keyTag_, authContext_.get(), keyPair);
+            removeMissingKeyFromIndex(keyIndex_, keyTag_, error_);
+        }
+        if (error_) {
+            return;
+        }
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        getWorkerPool().parallelFor(items_.size(), [this, &keyPair](size_t index) {
+            auto &item = items_[index];
+            item.error = decryptWithKeyPair(*keyPair, item.data, item.length, item.decryptedData);
+        });
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        auto results = Napi::Array::New(env, items_.size());
+        for (size_t i = 0; i < items_.size(); i++) {
+            auto result = Napi::Object::New(env);
+            if (items_[i].error) {
+                result.Set("error", createBackendError(env, items_[i].error).Value());
+            } else {
+                result.Set("data", bytesToExternalBuffer(env, std::move(items_[i].decryptedData)));
+            }
+            results.Set(uint32_t(i), result);
+        }
+        deferred.Resolve(results);
+    }
+
+  public:
+    DecryptManyOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &keyTag,
+                         const std::vector<Napi::Buffer<uint8_t>> &items)
+        : AuthenticatedOperation(env, std::move(deferred), "decryptMany"), keyIndex_(getAddonData(env).keyIndex),
+          keyTag_(keyTag) {
+        items_.reserve(items.size());
+        for (auto &item : items) {
+            items_.push_back(Item{item.Data(), item.ByteLength(), SecureBytes(), BackendError()});
+            pin(item);
+        }
+    }
+};
+
+// Moves items to another key after a single prompt: each item is decrypted with the old key and encrypted with
+// the new one on the worker pool, plaintext never leaves native secure memory. Errors are per item, like in
+// DecryptManyOperation.
+class RewrapOperation : public AuthenticatedOperation {
+  private:
+    struct Item {
+        // pinned input Buffer, see EncryptOperation
+        const uint8_t *data;
+        size_t length;
+        Bytes rewrappedData;
+        BackendError error;
+    };
+
+    std::shared_ptr<KeyCache> keyCache_;
+    std::shared_ptr<KeyIndex> keyIndex_;
+    std::string fromKeyTag_;
+    std::string toKeyTag_;
+    std::vector<Item> items_;
+
+  protected:
+    void execute() override {
+        std::unique_ptr<KeyPair> keyPair;
+        Bytes toPublicKey;
+        std::shared_ptr<const P256PublicKeyTable> toTable;
+        {
+            PhaseTimer timer(this, PHASE_LOOKUP);
+            error_ = resolvePublicKey(*keyCache_, toKeyTag_, toPublicKey, &toTable);
+            removeMissingKeyFromIndex(keyIndex_, toKeyTag_, error_);
+            if (error_) {
+                return;
+            }
+            error_ = getBackend().findKeyPair(fromKeyTag_, authContext_.get(), keyPair);
+            removeMissingKeyFromIndex(keyIndex_, fromKeyTag_, error_);
+        }
+        if (error_) {
+            return;
+        }
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        // all items are encrypted with one key, so the table pays off even if the key has not been used yet
+        if (!toTable) {
+            toTable = p256PrecomputePublicKey(toPublicKey.data());
+            keyCache_->setTable(toKeyTag_, toPublicKey, toTable);
+        }
+        getWorkerPool().parallelFor(items_.size(), [&](size_t index) {
+            auto &item = items_[index];
+            item.error = rewrapWithKeyPair(*keyPair, toPublicKey.data(), toTable.get(), item.data, item.length,
+                                           item.rewrappedData);
+        });
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        auto results = Napi::Array::New(env, items_.size());
+        for (size_t i = 0; i < items_.size(); i++) {
+            auto result = Napi::Object::New(env);
+            if (items_[i].error) {
+                result.Set("error", createBackendError(env, items_[i].error).Value());
+            } else {
+                result.Set("data", bytesToExternalBuffer(env, std::move(items_[i].rewrappedData)));
+            }
+            results.Set(uint32_t(i), result);
+        }
+        deferred.Resolve(results);
+    }
+
+  public:
+    RewrapOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &fromKeyTag,
+                    const std::string &toKeyTag, const std::vector<Napi::Buffer<uint8_t>> &items)
+        : AuthenticatedOperation(env, std::move(deferred), "rewrap"), keyCache_(getAddonData(env).keyCache),
+          keyIndex_(getAddonData(env).keyIndex), fromKeyTag_(fromKeyTag), toKeyTag_(toKeyTag) {
+        items_.reserve(items.size());
+        for (auto &item : items) {
+            items_.push_back(Item{item.Data(), item.ByteLength(), Bytes(), BackendError()});
+            pin(item);
+        }
+    }
+};
+
+class SignOperation : public AuthenticatedOperation {
+  private:
+    std::shared_ptr<KeyIndex> keyIndex_;
+    std::string keyTag_;
+    // pinned input Buffer, see EncryptOperation
+    const uint8_t *data_;
+    size_t length_;
+    Bytes signature_;
+
+  protected:
+    void execute() override {
+        std::unique_ptr<KeyPair> keyPair;
+        {
+            PhaseTimer timer(this, PHASE_LOOKUP);
+            error_ = getBackend().findKeyPair(keyTag_, authContext_.get(), keyPair);
+            removeMissingKeyFromIndex(keyIndex_, keyTag_, error_);
+        }
+        if (error_) {
+            return;
+        }
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        error_ = keyPair->sign(data_, length_, signature_);
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        deferred.Resolve(bytesToBuffer(env, signature_));
+    }
+
+  public:
+    SignOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &keyTag,
+                  Napi::Buffer<uint8_t> data)
+        : AuthenticatedOperation(env, std::move(deferred), "sign"), keyIndex_(getAddonData(env).keyIndex),
+          keyTag_(keyTag), data_(data.Data()), length_(data.ByteLength()) {
+        pin(data);
+    }
+};
+
+// Key agreement with the private key, the derived key is returned in a Buffer that is zeroized on garbage collection.
+class DeriveSharedSecretOperation : public AuthenticatedOperation {
+  private:
+    std::shared_ptr<KeyIndex> keyIndex_;
+    std::string keyTag_;
+    Bytes peerPublicKey_;
+    Bytes sharedInfo_;
+    size_t length_;
+    SecureBytes derived_;
+
+  protected:
+    void execute() override {
+        std::unique_ptr<KeyPair> keyPair;
+        {
+            PhaseTimer timer(this, PHASE_LOOKUP);
+            error_ = getBackend().findKeyPair(keyTag_, authContext_.get(), keyPair);
+            removeMissingKeyFromIndex(keyIndex_, keyTag_, error_);
+        }
+        if (error_) {
+            return;
+        }
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        error_ = keyPair->deriveSharedSecret(peerPublicKey_.data(), sharedInfo_.data(), sharedInfo_.size(), length_,
+                                             derived_);
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        deferred.Resolve(bytesToExternalBuffer(env, std::move(derived_)));
+    }
+
+  public:
+    DeriveSharedSecretOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &keyTag,
+                                const Bytes &peerPublicKey, const Bytes &sharedInfo, size_t length)
+        : AuthenticatedOperation(env, std::move(deferred), "deriveSharedSecret"),
+          keyIndex_(getAddonData(env).keyIndex), keyTag_(keyTag), peerPublicKey_(peerPublicKey),
+          sharedInfo_(sharedInfo), length_(length) {}
+};
+
+// Verification needs only the public key, like encryption, so it's done in-process.
+// Items of verifyMany are checked in parallel on the worker pool.
+class VerifyOperation : public AsyncOperation {
+  private:
+    struct Item {
+        // pinned input Buffers, see EncryptOperation
+        const uint8_t *data;
+        size_t length;
+        const uint8_t *signature;
+        size_t signatureLength;
+        bool valid;
+    };
 
-constexpr int KEY_SIZE_IN_BITS = 256;
+    std::shared_ptr<KeyCache> keyCache_;
+    std::shared_ptr<KeyIndex> keyIndex_;
+    // empty if the public key is passed explicitly
+    std::string keyTag_;
+    Bytes publicKey_;
+    std::vector<Item> items_;
+    // verify resolves a boolean, verifyMany an array
+    bool many_;
+
+  protected:
+    void execute() override {
+        {
+            PhaseTimer timer(this, PHASE_LOOKUP);
+            error_ = resolvePublicKey(*keyCache_, keyTag_, publicKey_);
+            removeMissingKeyFromIndex(keyIndex_, keyTag_, error_);
+        }
+        if (error_) {
+            return;
+        }
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        getWorkerPool().parallelFor(items_.size(), [this](size_t index) {
+            auto &item = items_[index];
+            item.valid = ecdsaVerify(publicKey_.data(), item.data, item.length, item.signature, item.signatureLength);
+        });
+    }
 
-struct DecryptContext;
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        if (!many_) {
+            deferred.Resolve(Napi::Boolean::New(env, items_[0].valid));
+            return;
+        }
+        auto results = Napi::Array::New(env, items_.size());
+        for (size_t i = 0; i < items_.size(); i++) {
+            results.Set(uint32_t(i), Napi::Boolean::New(env, items_[i].valid));
+        }
+        deferred.Resolve(results);
+    }
 
-void decryptFinalizeCallback(Napi::Env env, Napi::Function, DecryptContext *, void *);
-using TSFN = Napi::TypedThreadSafeFunction<DecryptContext, void, decryptFinalizeCallback>;
+  public:
+    VerifyOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &keyTag,
+                    const Bytes &publicKey,
+                    const std::vector<std::pair<Napi::Buffer<uint8_t>, Napi::Buffer<uint8_t>>> &items, bool many)
+        : AsyncOperation(env, std::move(deferred), many ? "verifyMany" : "verify"),
+          keyCache_(getAddonData(env).keyCache), keyIndex_(getAddonData(env).keyIndex), keyTag_(keyTag),
+          publicKey_(publicKey), many_(many) {
+        items_.reserve(items.size());
+        for (auto &item : items) {
+            items_.push_back(Item{item.first.Data(), item.first.ByteLength(), item.second.Data(),
+                                  item.second.ByteLength(), false});
+            pin(item.first);
+            pin(item.second);
+        }
+    }
+};
+
+// Keeps the authenticated context and the key found with it, so that session decrypts skip both.
+class OpenSessionOperation : public AuthenticatedOperation {
+  private:
+    std::shared_ptr<KeyIndex> keyIndex_;
+    std::string keyTag_;
+    double reuseSeconds_;
+    std::shared_ptr<SessionState> state_;
+
+  protected:
+    void execute() override {
+        PhaseTimer timer(this, PHASE_LOOKUP);
+        std::unique_ptr<KeyPair> keyPair;
+        error_ = getBackend().findKeyPair(keyTag_, authContext_.get(), keyPair);
+        removeMissingKeyFromIndex(keyIndex_, keyTag_, error_);
+        if (error_) {
+            return;
+        }
+        state_ = std::make_shared<SessionState>(authContext_, std::move(keyPair), reuseSeconds_);
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        deferred.Resolve(Session::create(env, state_));
+    }
 
-struct DecryptContext {
-    Napi::Promise::Deferred deferred;
-    TSFN tsfn;
-    CFMutableDictionaryRef queryAttributes;
-    CFDataRef encryptedData;
-    long authErrorCode;
+  public:
+    OpenSessionOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &keyTag,
+                         double reuseSeconds)
+        : AuthenticatedOperation(env, std::move(deferred), "openSession"), keyIndex_(getAddonData(env).keyIndex),
+          keyTag_(keyTag), reuseSeconds_(reuseSeconds) {}
+};
+
+class OpenEncryptStreamOperation : public AsyncOperation {
+  private:
+    std::shared_ptr<KeyCache> keyCache_;
+    std::shared_ptr<KeyIndex> keyIndex_;
+    // empty if the public key is passed explicitly
+    std::string keyTag_;
+    Bytes publicKey_;
+    std::shared_ptr<const P256PublicKeyTable> table_;
+    std::shared_ptr<StreamEncryptor> encryptor_;
+
+  protected:
+    void execute() override {
+        {
+            PhaseTimer timer(this, PHASE_LOOKUP);
+            error_ = resolvePublicKey(*keyCache_, keyTag_, publicKey_, &table_);
+            removeMissingKeyFromIndex(keyIndex_, keyTag_, error_);
+        }
+        if (error_) {
+            return;
+        }
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        encryptor_ = std::make_shared<StreamEncryptor>();
+        if (!encryptor_->init(publicKey_.data(), table_.get())) {
+            error_ = errorWithCode(STATUS_PARAM, "SecKeyCreateEncryptedData");
+        }
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        deferred.Resolve(CipherStream::create(env, encryptor_));
+    }
+
+  public:
+    OpenEncryptStreamOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &keyTag,
+                               const Bytes &publicKey)
+        : AsyncOperation(env, std::move(deferred), "openEncryptStream"), keyCache_(getAddonData(env).keyCache),
+          keyIndex_(getAddonData(env).keyIndex), keyTag_(keyTag), publicKey_(publicKey) {}
+};
+
+class OpenDecryptStreamOperation : public AuthenticatedOperation {
+  private:
+    std::shared_ptr<KeyIndex> keyIndex_;
+    std::string keyTag_;
+    std::shared_ptr<StreamDecryptor> decryptor_;
+
+  protected:
+    void execute() override {
+        PhaseTimer timer(this, PHASE_LOOKUP);
+        std::unique_ptr<KeyPair> keyPair;
+        error_ = getBackend().findKeyPair(keyTag_, authContext_.get(), keyPair);
+        removeMissingKeyFromIndex(keyIndex_, keyTag_, error_);
+        if (error_) {
+            return;
+        }
+        decryptor_ = std::make_shared<StreamDecryptor>(authContext_, std::move(keyPair));
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        deferred.Resolve(CipherStream::create(env, decryptor_));
+    }
+
+  public:
+    OpenDecryptStreamOperation(Napi::Env env, Napi::Promise::Deferred deferred, const std::string &keyTag)
+        : AuthenticatedOperation(env, std::move(deferred), "openDecryptStream"),
+          keyIndex_(getAddonData(env).keyIndex), keyTag_(keyTag) {}
+};
+
+// The first check can take a while with the keychain backend, so it's done on the worker pool.
+class CheckSupportOperation : public AsyncOperation {
+  private:
+    bool supported_ = false;
+
+  protected:
+    void execute() override { supported_ = getBackend().isSupported(); }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        deferred.Resolve(Napi::Boolean::New(env, supported_));
+    }
+
+  public:
+    CheckSupportOperation(Napi::Env env, Napi::Promise::Deferred deferred)
+        : AsyncOperation(env, std::move(deferred), "checkSupport") {}
 };
 
 Napi::Value isSupported(const Napi::CallbackInfo &info) {
-    return Napi::Boolean::New(info.Env(), isBiometricAuthSupported());
+    return Napi::Boolean::New(info.Env(), getBackend().isSupported());
+}
+
+Napi::Promise checkSupport(const Napi::CallbackInfo &info) {
+    auto deferred = Napi::Promise::Deferred::New(info.Env());
+    auto promise = deferred.Promise();
+    (new CheckSupportOperation(info.Env(), std::move(deferred)))->queue();
+    return promise;
 }
 
 Napi::Promise createKeyPair(const Napi::CallbackInfo &info) {
@@ -32,92 +772,160 @@ Napi::Promise createKeyPair(const Napi::CallbackInfo &info) {
         return deferred.Promise();
     }
 
-    auto_release queryAttributes = getKeyQueryAttributesFromArgs(info, deferred);
-    if (!queryAttributes) {
+    auto keyTag = getKeyTagFromArgs(info, deferred);
+    if (keyTag.empty()) {
         return deferred.Promise();
     }
 
-    auto_release<SecKeyRef> existingPrivateKey = nullptr;
-    auto existingKeyStatus = SecItemCopyMatching(queryAttributes, existingPrivateKey.cfTypeRef());
+    auto promise = deferred.Promise();
+    (new CreateKeyPairOperation(env, std::move(deferred), keyTag))->queue(keyTag);
+    return promise;
+}
+
+Napi::Promise findKeyPair(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
 
-    if (existingKeyStatus == errSecSuccess) {
-        rejectWithMessageAndProp(deferred, "A key with this keyTag already exists, please delete it first",
-                                 "keyExists");
-        return deferred.Promise();
-    } else if (existingKeyStatus != errSecItemNotFound) {
-        rejectWithErrorCode(deferred, existingKeyStatus, "SecItemCopyMatching");
+    auto deferred = Napi::Promise::Deferred::New(env);
+
+    if (rejectIfNotSupported(deferred)) {
         return deferred.Promise();
     }
 
-    auto_release keyTagData = getKeyTagFromArgs(info, deferred);
-    if (!keyTagData) {
+    auto keyTag = getKeyTagFromArgs(info, deferred);
+    if (keyTag.empty()) {
         return deferred.Promise();
     }
 
-    auto_release keySize = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &KEY_SIZE_IN_BITS);
+    auto promise = deferred.Promise();
+    (new FindKeyPairOperation(env, std::move(deferred), keyTag))->queue();
+    return promise;
+}
 
-    auto_release creteKeyAttributes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks,
-                                                                &kCFTypeDictionaryValueCallBacks);
+Napi::Promise deleteKeyPair(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
 
-    auto_release privateKeyAttrs = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks,
-                                                             &kCFTypeDictionaryValueCallBacks);
+    auto deferred = Napi::Promise::Deferred::New(env);
 
-    CFDictionaryAddValue(privateKeyAttrs, kSecAttrIsPermanent, kCFBooleanTrue);
-    CFDictionaryAddValue(privateKeyAttrs, kSecAttrApplicationTag, keyTagData);
-    CFDictionaryAddValue(privateKeyAttrs, kSecAttrLabel, keyTagData);
+    if (rejectIfNotSupported(deferred)) {
+        return deferred.Promise();
+    }
 
-    CFDictionaryAddValue(creteKeyAttributes, kSecAttrKeyType, kSecAttrKeyTypeEC);
-    CFDictionaryAddValue(creteKeyAttributes, kSecAttrKeySizeInBits, keySize);
-    CFDictionaryAddValue(creteKeyAttributes, kSecPrivateKeyAttrs, privateKeyAttrs);
+    auto keyTag = getKeyTagFromArgs(info, deferred);
+    if (keyTag.empty()) {
+        return deferred.Promise();
+    }
 
-#ifdef NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN
-    auto_release publicKeyAttrs = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks,
-                                                            &kCFTypeDictionaryValueCallBacks);
+    auto promise = deferred.Promise();
+    (new DeleteKeyPairOperation(env, std::move(deferred), keyTag))->queue(keyTag);
+    return promise;
+}
 
-    CFDictionaryAddValue(publicKeyAttrs, kSecAttrIsPermanent, kCFBooleanTrue);
-    CFDictionaryAddValue(publicKeyAttrs, kSecAttrApplicationTag, keyTagData);
-    CFDictionaryAddValue(publicKeyAttrs, kSecAttrLabel, keyTagData);
+Napi::Promise listKeys(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
 
-    CFDictionaryAddValue(creteKeyAttributes, kSecPublicKeyAttrs, publicKeyAttrs);
-#else
-    auto accessControl = kSecAccessControlPrivateKeyUsage | kSecAccessControlBiometryCurrentSet;
-    if (__builtin_available(macOS 10.15, *)) {
-        accessControl |= (kSecAccessControlOr | kSecAccessControlWatch);
-    }
-    auto_release access = SecAccessControlCreateWithFlags(
-        kCFAllocatorDefault, kSecAttrAccessibleWhenUnlockedThisDeviceOnly, accessControl, nullptr);
-    CFDictionaryAddValue(privateKeyAttrs, kSecAttrAccessControl, access);
+    auto deferred = Napi::Promise::Deferred::New(env);
 
-    CFDictionaryAddValue(creteKeyAttributes, kSecAttrTokenID, kSecAttrTokenIDSecureEnclave);
-#endif
+    if (rejectIfNotSupported(deferred)) {
+        return deferred.Promise();
+    }
 
-    auto_release<CFErrorRef> error = nullptr;
-    auto_release privateKey = SecKeyCreateRandomKey(creteKeyAttributes, &error);
-    if (!privateKey) {
-        rejectWithCFError(deferred, error, "SecKeyCreateRandomKey");
+    if (info.Length() > 1) {
+        rejectAsTypeError(deferred, "Expected at most one argument");
         return deferred.Promise();
     }
 
-    auto_release publicKey = SecKeyCopyPublicKey(privateKey);
-    if (!publicKey) {
-        rejectWithMessage(deferred, "Can't extract public key");
+    std::string prefix;
+    size_t limit = 0;
+    if (info.Length() == 1 && !info[0].IsUndefined()) {
+        if (!info[0].IsObject()) {
+            rejectAsTypeError(deferred, "options is not an object");
+            return deferred.Promise();
+        }
+        auto options = info[0].ToObject();
+
+        if (options.Has("prefix")) {
+            auto prefixProp = options.Get("prefix");
+            if (!prefixProp.IsString()) {
+                rejectAsTypeError(deferred, "prefix is not a string");
+                return deferred.Promise();
+            }
+            prefix = prefixProp.As<Napi::String>().Utf8Value();
+        }
+
+        if (options.Has("limit")) {
+            auto limitProp = options.Get("limit");
+            if (!limitProp.IsNumber() || limitProp.As<Napi::Number>().Int64Value() < 1) {
+                rejectAsTypeError(deferred, "limit must be a positive number");
+                return deferred.Promise();
+            }
+            limit = size_t(limitProp.As<Napi::Number>().Int64Value());
+        }
+    }
+
+    auto promise = deferred.Promise();
+    (new ListKeysOperation(env, std::move(deferred), prefix, limit))->queue();
+    return promise;
+}
+
+Napi::Promise encryptData(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+
+    auto deferred = Napi::Promise::Deferred::New(env);
+
+    if (rejectIfNotSupported(deferred)) {
         return deferred.Promise();
     }
 
-    auto_release publicKeyData = SecKeyCopyExternalRepresentation(publicKey, &error);
-    if (!publicKeyData) {
-        rejectWithCFError(deferred, error, "SecKeyCopyExternalRepresentation");
+    std::string keyTag;
+    Bytes publicKey;
+    if (hasPublicKeyInArgs(info)) {
+        publicKey = getPublicKeyFromArgs(info, deferred);
+        if (publicKey.empty()) {
+            return deferred.Promise();
+        }
+    } else {
+        keyTag = getKeyTagFromArgs(info, deferred);
+        if (keyTag.empty()) {
+            return deferred.Promise();
+        }
+    }
+
+    auto data = getDataFromArgs(info, deferred);
+    if (data.IsEmpty()) {
         return deferred.Promise();
     }
 
-    auto ret = Napi::Object::New(env);
-    ret.Set("publicKey", cfDataToBuffer(env, publicKeyData));
+    auto envelope = false;
+    auto options = info[0].ToObject();
+    if (options.Has("envelope")) {
+        auto envelopeProp = options.Get("envelope");
+        if (!envelopeProp.IsBoolean()) {
+            rejectAsTypeError(deferred, "envelope is not a boolean");
+            return deferred.Promise();
+        }
+        envelope = envelopeProp.As<Napi::Boolean>().Value();
+    }
+
+    auto compact = false;
+    if (options.Has("compact")) {
+        auto compactProp = options.Get("compact");
+        if (!compactProp.IsBoolean()) {
+            rejectAsTypeError(deferred, "compact is not a boolean");
+            return deferred.Promise();
+        }
+        compact = compactProp.As<Napi::Boolean>().Value();
+    }
+    if (envelope && compact) {
+        rejectAsTypeError(deferred, "envelope and compact cannot be used together");
+        return deferred.Promise();
+    }
 
-    deferred.Resolve(ret);
-    return deferred.Promise();
+    auto promise = deferred.Promise();
+    (new EncryptOperation(env, std::move(deferred), keyTag, publicKey, data, envelope, compact))->queue();
+    return promise;
 }
 
-Napi::Promise findKeyPair(const Napi::CallbackInfo &info) {
+Napi::Promise decryptData(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
 
     auto deferred = Napi::Promise::Deferred::New(env);
@@ -126,43 +934,79 @@ Napi::Promise findKeyPair(const Napi::CallbackInfo &info) {
         return deferred.Promise();
     }
 
-    auto_release queryAttributes = getKeyQueryAttributesFromArgs(info, deferred);
-    if (!queryAttributes) {
+    auto keyTag = getKeyTagFromArgs(info, deferred);
+    if (keyTag.empty()) {
         return deferred.Promise();
     }
 
-    auto_release<SecKeyRef> privateKey = nullptr;
-    auto status = SecItemCopyMatching(queryAttributes, privateKey.cfTypeRef());
+    auto data = getDataFromArgs(info, deferred);
+    if (data.IsEmpty()) {
+        return deferred.Promise();
+    }
 
-    if (status == errSecItemNotFound) {
-        deferred.Resolve(env.Null());
+    auto touchIdPrompt = getTouchIdPromptFromArgs(info, deferred);
+    if (touchIdPrompt.empty()) {
         return deferred.Promise();
-    } else if (status != errSecSuccess) {
-        rejectWithErrorCode(deferred, status, "SecItemCopyMatching");
+    }
+
+    DecryptAbortOptions abortOptions;
+    auto options = info[0].ToObject();
+    // an explicit undefined is the same as a missing option, so that callers can pass their own options through
+    auto signal = options.Get("signal");
+    if (!signal.IsUndefined()) {
+        if (!signal.IsObject() || !signal.As<Napi::Object>().Get("addEventListener").IsFunction() ||
+            !signal.As<Napi::Object>().Get("removeEventListener").IsFunction()) {
+            rejectAsTypeError(deferred, "signal is not an AbortSignal");
+            return deferred.Promise();
+        }
+        abortOptions.signal = signal.As<Napi::Object>();
+    }
+    auto timeoutMs = options.Get("timeoutMs");
+    if (!timeoutMs.IsUndefined()) {
+        if (!timeoutMs.IsNumber() || !(timeoutMs.As<Napi::Number>().DoubleValue() > 0)) {
+            rejectAsTypeError(deferred, "timeoutMs must be a positive number");
+            return deferred.Promise();
+        }
+        abortOptions.timeoutMs = timeoutMs.As<Napi::Number>().DoubleValue();
+    }
+
+    auto promise = deferred.Promise();
+    DecryptRequest request{deferred, Napi::Persistent(data.As<Napi::Object>()), data.Data(), data.ByteLength(),
+                           touchIdPrompt};
+    getAddonData(env).decryptScheduler.enqueue(env, keyTag, std::move(request), abortOptions);
+    return promise;
+}
+
+Napi::Promise decryptMany(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+
+    auto deferred = Napi::Promise::Deferred::New(env);
+
+    if (rejectIfNotSupported(deferred)) {
         return deferred.Promise();
     }
 
-    auto_release publicKey = SecKeyCopyPublicKey(privateKey);
-    if (!publicKey) {
-        rejectWithMessage(deferred, "Can't extract public key");
+    auto keyTag = getKeyTagFromArgs(info, deferred);
+    if (keyTag.empty()) {
         return deferred.Promise();
     }
 
-    auto_release<CFErrorRef> error = nullptr;
-    auto_release publicKeyData = SecKeyCopyExternalRepresentation(publicKey, &error);
-    if (!publicKeyData) {
-        rejectWithCFError(deferred, error, "SecKeyCopyExternalRepresentation");
+    auto items = getItemsFromArgs(info, deferred);
+    if (items.empty()) {
         return deferred.Promise();
     }
 
-    auto ret = Napi::Object::New(env);
-    ret.Set("publicKey", cfDataToBuffer(env, publicKeyData));
+    auto touchIdPrompt = getTouchIdPromptFromArgs(info, deferred);
+    if (touchIdPrompt.empty()) {
+        return deferred.Promise();
+    }
 
-    deferred.Resolve(ret);
-    return deferred.Promise();
+    auto promise = deferred.Promise();
+    (new DecryptManyOperation(env, std::move(deferred), keyTag, items))->start(touchIdPrompt);
+    return promise;
 }
 
-Napi::Promise deleteKeyPair(const Napi::CallbackInfo &info) {
+Napi::Promise rewrap(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
 
     auto deferred = Napi::Promise::Deferred::New(env);
@@ -171,31 +1015,64 @@ Napi::Promise deleteKeyPair(const Napi::CallbackInfo &info) {
         return deferred.Promise();
     }
 
-    auto_release queryAttributes = getKeyQueryAttributesFromArgs(info, deferred);
-    if (!queryAttributes) {
+    auto fromKeyTag = getKeyTagFromArgs(info, deferred, "fromKeyTag");
+    if (fromKeyTag.empty()) {
         return deferred.Promise();
     }
 
-    auto status = SecItemDelete(queryAttributes);
+    auto toKeyTag = getKeyTagFromArgs(info, deferred, "toKeyTag");
+    if (toKeyTag.empty()) {
+        return deferred.Promise();
+    }
 
-    if (status == errSecItemNotFound) {
-        deferred.Resolve(Napi::Boolean::New(env, false));
+    auto items = getItemsFromArgs(info, deferred);
+    if (items.empty()) {
         return deferred.Promise();
-    } else if (status != errSecSuccess) {
-        rejectWithErrorCode(deferred, status, "SecItemDelete");
+    }
+
+    auto touchIdPrompt = getTouchIdPromptFromArgs(info, deferred);
+    if (touchIdPrompt.empty()) {
         return deferred.Promise();
     }
 
-#ifdef NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN
-    CFDictionarySetValue(queryAttributes, kSecAttrKeyClass, kSecAttrKeyClassPublic);
-    SecItemDelete(queryAttributes);
-#endif
+    auto promise = deferred.Promise();
+    (new RewrapOperation(env, std::move(deferred), fromKeyTag, toKeyTag, items))->start(touchIdPrompt);
+    return promise;
+}
+
+Napi::Promise convertCiphertexts(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+
+    auto deferred = Napi::Promise::Deferred::New(env);
 
-    deferred.Resolve(Napi::Boolean::New(env, true));
-    return deferred.Promise();
+    if (info.Length() != 1) {
+        rejectAsTypeError(deferred, "Expected exactly one argument");
+        return deferred.Promise();
+    }
+    if (!info[0].IsObject()) {
+        rejectAsTypeError(deferred, "options is not an object");
+        return deferred.Promise();
+    }
+
+    auto items = getItemsFromArgs(info, deferred);
+    if (items.empty()) {
+        return deferred.Promise();
+    }
+
+    auto formatProp = info[0].ToObject().Get("format");
+    auto format = formatProp.IsString() ? formatProp.As<Napi::String>().Utf8Value() : std::string();
+    if (format != "compact" && format != "standard") {
+        rejectAsTypeError(deferred, "format must be 'compact' or 'standard'");
+        return deferred.Promise();
+    }
+    auto compact = format == "compact";
+
+    auto promise = deferred.Promise();
+    (new ConvertCiphertextsOperation(env, std::move(deferred), items, compact))->queue();
+    return promise;
 }
 
-Napi::Promise encryptData(const Napi::CallbackInfo &info) {
+Napi::Promise sign(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
 
     auto deferred = Napi::Promise::Deferred::New(env);
@@ -204,52 +1081,96 @@ Napi::Promise encryptData(const Napi::CallbackInfo &info) {
         return deferred.Promise();
     }
 
-    auto_release queryAttributes = getKeyQueryAttributesFromArgs(info, deferred);
-    if (!queryAttributes) {
+    auto keyTag = getKeyTagFromArgs(info, deferred);
+    if (keyTag.empty()) {
         return deferred.Promise();
     }
 
-    // decryptedData points to the contents of the input Buffer
-    // it's caller responsibility to clean it up, no need to do it here
-    auto_release decryptedData = getDataFromArgsNoCopy(info, deferred);
-    if (!decryptedData) {
+    auto data = getDataFromArgs(info, deferred);
+    if (data.IsEmpty()) {
+        return deferred.Promise();
+    }
+
+    auto touchIdPrompt = getTouchIdPromptFromArgs(info, deferred);
+    if (touchIdPrompt.empty()) {
         return deferred.Promise();
     }
 
-    auto_release<SecKeyRef> privateKey = nullptr;
-    auto status = SecItemCopyMatching(queryAttributes, privateKey.cfTypeRef());
+    auto promise = deferred.Promise();
+    (new SignOperation(env, std::move(deferred), keyTag, data))->start(touchIdPrompt);
+    return promise;
+}
+
+Napi::Promise deriveSharedSecret(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+
+    auto deferred = Napi::Promise::Deferred::New(env);
 
-    if (status != errSecSuccess) {
-        rejectWithErrorCode(deferred, status, "SecItemCopyMatching");
+    if (rejectIfNotSupported(deferred)) {
         return deferred.Promise();
     }
 
-    auto_release publicKey = SecKeyCopyPublicKey(privateKey);
-    if (!publicKey) {
-        rejectWithMessage(deferred, "Can't extract public key");
+    auto keyTag = getKeyTagFromArgs(info, deferred);
+    if (keyTag.empty()) {
         return deferred.Promise();
     }
 
-    auto supported = SecKeyIsAlgorithmSupported(publicKey, kSecKeyOperationTypeEncrypt,
-                                                kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM);
-    if (!supported) {
-        rejectWithMessage(deferred, "Algorithm not supported");
+    auto options = info[0].ToObject();
+    auto peerPublicKeyProp = options.Get("peerPublicKey");
+    if (!peerPublicKeyProp.IsBuffer()) {
+        rejectAsTypeError(deferred, "peerPublicKey is not a buffer");
+        return deferred.Promise();
+    }
+    auto peerPublicKeyBuffer = peerPublicKeyProp.As<Napi::Buffer<uint8_t>>();
+    if (!p256IsValidPublicKey(peerPublicKeyBuffer.Data(), peerPublicKeyBuffer.ByteLength())) {
+        rejectAsTypeError(deferred, "peerPublicKey is not a valid P-256 public key");
         return deferred.Promise();
     }
+    Bytes peerPublicKey(peerPublicKeyBuffer.Data(), peerPublicKeyBuffer.Data() + peerPublicKeyBuffer.ByteLength());
+
+    Bytes sharedInfo;
+    size_t length = DEFAULT_DERIVED_KEY_SIZE;
+    if (options.Has("kdf")) {
+        auto kdfProp = options.Get("kdf");
+        if (!kdfProp.IsObject()) {
+            rejectAsTypeError(deferred, "kdf is not an object");
+            return deferred.Promise();
+        }
+        auto kdf = kdfProp.ToObject();
+        if (kdf.Has("info")) {
+            auto infoProp = kdf.Get("info");
+            if (!infoProp.IsBuffer()) {
+                rejectAsTypeError(deferred, "kdf.info is not a buffer");
+                return deferred.Promise();
+            }
+            auto infoBuffer = infoProp.As<Napi::Buffer<uint8_t>>();
+            sharedInfo.assign(infoBuffer.Data(), infoBuffer.Data() + infoBuffer.ByteLength());
+        }
+        if (kdf.Has("length")) {
+            auto lengthProp = kdf.Get("length");
+            auto lengthValue = lengthProp.IsNumber() ? lengthProp.As<Napi::Number>().DoubleValue() : 0;
+            if (!(lengthValue >= 1 && lengthValue <= double(MAX_DERIVED_KEY_SIZE)) ||
+                lengthValue != double(size_t(lengthValue))) {
+                rejectAsTypeError(deferred, "kdf.length must be an integer from 1 to 1024");
+                return deferred.Promise();
+            }
+            length = size_t(lengthValue);
+        }
+    }
 
-    auto_release<CFErrorRef> error = nullptr;
-    auto_release encryptedData = SecKeyCreateEncryptedData(
-        publicKey, kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM, decryptedData, &error);
-    if (error) {
-        rejectWithCFError(deferred, error, "SecKeyCreateEncryptedData");
+    auto touchIdPrompt = getTouchIdPromptFromArgs(info, deferred);
+    if (touchIdPrompt.empty()) {
         return deferred.Promise();
     }
 
-    deferred.Resolve(cfDataToBuffer(env, encryptedData));
-    return deferred.Promise();
+    auto promise = deferred.Promise();
+    (new DeriveSharedSecretOperation(env, std::move(deferred), keyTag, peerPublicKey, sharedInfo, length))
+        ->start(touchIdPrompt);
+    return promise;
 }
 
-Napi::Promise decryptData(const Napi::CallbackInfo &info) {
+// verify and verifyMany accept a keyTag or a publicKey, like encrypt
+Napi::Promise verifySignatures(const Napi::CallbackInfo &info, bool many) {
     Napi::Env env = info.Env();
 
     auto deferred = Napi::Promise::Deferred::New(env);
@@ -258,107 +1179,445 @@ Napi::Promise decryptData(const Napi::CallbackInfo &info) {
         return deferred.Promise();
     }
 
-    // released in decryptFinalizeCallback
-    auto queryAttributes = getKeyQueryAttributesFromArgs(info, deferred);
-    if (!queryAttributes) {
+    std::string keyTag;
+    Bytes publicKey;
+    if (hasPublicKeyInArgs(info)) {
+        publicKey = getPublicKeyFromArgs(info, deferred);
+        if (publicKey.empty()) {
+            return deferred.Promise();
+        }
+    } else {
+        keyTag = getKeyTagFromArgs(info, deferred);
+        if (keyTag.empty()) {
+            return deferred.Promise();
+        }
+    }
+
+    std::vector<std::pair<Napi::Buffer<uint8_t>, Napi::Buffer<uint8_t>>> items;
+    if (many) {
+        items = getSignedItemsFromArgs(info, deferred);
+        if (items.empty()) {
+            return deferred.Promise();
+        }
+    } else {
+        auto data = getDataFromArgs(info, deferred);
+        if (data.IsEmpty()) {
+            return deferred.Promise();
+        }
+        auto signature = getSignatureFromArgs(info, deferred);
+        if (signature.IsEmpty()) {
+            return deferred.Promise();
+        }
+        items.emplace_back(data, signature);
+    }
+
+    auto promise = deferred.Promise();
+    (new VerifyOperation(env, std::move(deferred), keyTag, publicKey, items, many))->queue();
+    return promise;
+}
+
+Napi::Promise verify(const Napi::CallbackInfo &info) { return verifySignatures(info, false); }
+
+Napi::Promise verifyMany(const Napi::CallbackInfo &info) { return verifySignatures(info, true); }
+
+Napi::Promise openSession(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+
+    auto deferred = Napi::Promise::Deferred::New(env);
+
+    if (rejectIfNotSupported(deferred)) {
         return deferred.Promise();
     }
 
-    // released in decryptFinalizeCallback
-    auto encryptedData = getDataFromArgsAsCopy(info, deferred);
-    if (!encryptedData) {
+    auto keyTag = getKeyTagFromArgs(info, deferred);
+    if (keyTag.empty()) {
         return deferred.Promise();
     }
 
-    auto_release touchIdPrompt = getTouchIdPromptFromArgs(info, deferred);
-    if (!touchIdPrompt) {
+    auto touchIdPrompt = getTouchIdPromptFromArgs(info, deferred);
+    if (touchIdPrompt.empty()) {
         return deferred.Promise();
     }
 
+    auto reuseSeconds = DEFAULT_SESSION_REUSE_SECONDS;
+    auto options = info[0].ToObject();
+    if (options.Has("reuseSeconds")) {
+        auto reuseSecondsProp = options.Get("reuseSeconds");
+        if (!reuseSecondsProp.IsNumber() || !(reuseSecondsProp.As<Napi::Number>().DoubleValue() > 0)) {
+            rejectAsTypeError(deferred, "reuseSeconds must be a positive number");
+            return deferred.Promise();
+        }
+        reuseSeconds = reuseSecondsProp.As<Napi::Number>().DoubleValue();
+    }
+
     auto promise = deferred.Promise();
+    (new OpenSessionOperation(env, std::move(deferred), keyTag, reuseSeconds))->start(touchIdPrompt);
+    return promise;
+}
 
-    auto decryptContext = new DecryptContext{
-        .deferred = std::move(deferred),
-        .queryAttributes = queryAttributes,
-        .encryptedData = encryptedData,
-        .authErrorCode = -1,
-    };
+Napi::Value configure(const Napi::CallbackInfo &info) {
+    auto env = info.Env();
 
-    decryptContext->tsfn = TSFN::New(env, "decryptTSFN", 0, 1, decryptContext);
+    if (info.Length() != 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "options is not an object").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    auto options = info[0].ToObject();
+
+    if (options.Has("workerThreads")) {
+        auto workerThreads = options.Get("workerThreads");
+        if (!workerThreads.IsNumber() || workerThreads.As<Napi::Number>().Int64Value() < 1 ||
+            workerThreads.As<Napi::Number>().Int64Value() > int64_t(MAX_WORKER_THREADS)) {
+            Napi::TypeError::New(env, "workerThreads must be a number from 1 to " +
+                                          std::to_string(MAX_WORKER_THREADS))
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        getWorkerPool().setThreadCount(workerThreads.As<Napi::Number>().Int64Value());
+    }
 
-    authenticateAndDecrypt(touchIdPrompt, queryAttributes, decryptContext);
+    if (options.Has("keyCacheSize")) {
+        auto keyCacheSize = options.Get("keyCacheSize");
+        if (!keyCacheSize.IsNumber() || keyCacheSize.As<Napi::Number>().Int64Value() < 0 ||
+            keyCacheSize.As<Napi::Number>().Int64Value() > int64_t(MAX_KEY_CACHE_SIZE)) {
+            Napi::TypeError::New(env, "keyCacheSize must be a number from 0 to " +
+                                          std::to_string(MAX_KEY_CACHE_SIZE))
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        getAddonData(env).keyCache->setCapacity(keyCacheSize.As<Napi::Number>().Int64Value());
+    }
 
-    return promise;
+    if (options.Has("keyPoolDepth")) {
+        auto keyPoolDepth = options.Get("keyPoolDepth");
+        if (!keyPoolDepth.IsNumber() || keyPoolDepth.As<Napi::Number>().Int64Value() < 0 ||
+            keyPoolDepth.As<Napi::Number>().Int64Value() > int64_t(MAX_KEY_POOL_DEPTH)) {
+            Napi::TypeError::New(env, "keyPoolDepth must be a number from 0 to " + std::to_string(MAX_KEY_POOL_DEPTH))
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        auto depth = size_t(keyPoolDepth.As<Napi::Number>().Int64Value());
+        auto &keyPool = getAddonData(env).keyPool;
+        if (depth) {
+            if (!keyPool) {
+                keyPool = std::make_shared<KeyPool>();
+            }
+            keyPool->setDepth(depth);
+        } else if (keyPool) {
+            keyPool->setDepth(0);
+            keyPool.reset();
+        }
+    }
+
+    if (options.Has("keyIndex")) {
+        auto keyIndex = options.Get("keyIndex");
+        if (keyIndex.IsNull() || keyIndex.IsUndefined()) {
+            getAddonData(env).keyIndex.reset();
+        } else {
+            if (!keyIndex.IsObject()) {
+                Napi::TypeError::New(env, "keyIndex is not an object").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            auto keyIndexOptions = keyIndex.ToObject();
+            auto path = keyIndexOptions.Get("path");
+            if (!path.IsString() || path.As<Napi::String>().Utf8Value().empty()) {
+                Napi::TypeError::New(env, "keyIndex.path must be a non-empty string").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            auto reconcileSeconds = DEFAULT_KEY_INDEX_RECONCILE_SECONDS;
+            if (keyIndexOptions.Has("reconcileSeconds")) {
+                auto reconcileSecondsProp = keyIndexOptions.Get("reconcileSeconds");
+                if (!reconcileSecondsProp.IsNumber() || !(reconcileSecondsProp.As<Napi::Number>().DoubleValue() >= 0)) {
+                    Napi::TypeError::New(env, "keyIndex.reconcileSeconds must be a non-negative number")
+                        .ThrowAsJavaScriptException();
+                    return env.Undefined();
+                }
+                reconcileSeconds = reconcileSecondsProp.As<Napi::Number>().DoubleValue();
+            }
+            auto index = std::make_shared<KeyIndex>(path.As<Napi::String>().Utf8Value(), reconcileSeconds);
+            reconcileKeyIndexInBackground(index);
+            getAddonData(env).keyIndex = index;
+        }
+    }
+
+    if (options.Has("decryptQueueLimit")) {
+        auto decryptQueueLimit = options.Get("decryptQueueLimit");
+        if (!decryptQueueLimit.IsNumber() || decryptQueueLimit.As<Napi::Number>().Int64Value() < 1 ||
+            decryptQueueLimit.As<Napi::Number>().Int64Value() > int64_t(MAX_DECRYPT_QUEUE_LIMIT)) {
+            Napi::TypeError::New(env, "decryptQueueLimit must be a number from 1 to " +
+                                          std::to_string(MAX_DECRYPT_QUEUE_LIMIT))
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        getAddonData(env).decryptScheduler.setQueueLimit(decryptQueueLimit.As<Napi::Number>().Int64Value());
+    }
+
+    if (options.Has("stats")) {
+        auto stats = options.Get("stats");
+        if (!stats.IsBoolean()) {
+            Napi::TypeError::New(env, "stats is not a boolean").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        setStatsEnabled(stats.As<Napi::Boolean>().Value());
+    }
+
+    if (options.Has("trace")) {
+        auto trace = options.Get("trace");
+        if (trace.IsNull() || trace.IsUndefined()) {
+            getAddonData(env).trace.Reset();
+        } else if (trace.IsFunction()) {
+            getAddonData(env).trace = Napi::Persistent(trace.As<Napi::Function>());
+        } else {
+            Napi::TypeError::New(env, "trace is not a function").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+
+    return env.Undefined();
 }
 
-void resumeDecryptWithAuthentication(void *callbackData, long authErrorCode) {
-    auto decryptContext = reinterpret_cast<DecryptContext *>(callbackData);
+Napi::Promise openEncryptStream(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+
+    auto deferred = Napi::Promise::Deferred::New(env);
+
+    if (rejectIfNotSupported(deferred)) {
+        return deferred.Promise();
+    }
 
-    decryptContext->authErrorCode = authErrorCode;
+    std::string keyTag;
+    Bytes publicKey;
+    if (hasPublicKeyInArgs(info)) {
+        publicKey = getPublicKeyFromArgs(info, deferred);
+        if (publicKey.empty()) {
+            return deferred.Promise();
+        }
+    } else {
+        keyTag = getKeyTagFromArgs(info, deferred);
+        if (keyTag.empty()) {
+            return deferred.Promise();
+        }
+    }
 
-    decryptContext->tsfn.BlockingCall(decryptContext);
-    decryptContext->tsfn.Release();
+    auto promise = deferred.Promise();
+    (new OpenEncryptStreamOperation(env, std::move(deferred), keyTag, publicKey))->queue();
+    return promise;
 }
 
-void decryptFinalizeCallback(Napi::Env env, Napi::Function, DecryptContext *decryptContext, void *) {
-    auto deferred = std::move(decryptContext->deferred);
+Napi::Promise openDecryptStream(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
 
-    auto authErrorCode = decryptContext->authErrorCode;
+    auto deferred = Napi::Promise::Deferred::New(env);
 
-    auto_release queryAttributes = decryptContext->queryAttributes;
-    auto_release encryptedData = decryptContext->encryptedData;
+    if (rejectIfNotSupported(deferred)) {
+        return deferred.Promise();
+    }
 
-    delete decryptContext;
+    auto keyTag = getKeyTagFromArgs(info, deferred);
+    if (keyTag.empty()) {
+        return deferred.Promise();
+    }
 
-    if (authErrorCode) {
-        auto err = Napi::Error::New(env, "User refused to authenticate with Touch ID");
-        err.Set("rejected", Napi::Boolean::New(env, true));
-        err.Set("code", Napi::Number::New(env, authErrorCode));
-        deferred.Reject(err.Value());
-        return;
+    auto touchIdPrompt = getTouchIdPromptFromArgs(info, deferred);
+    if (touchIdPrompt.empty()) {
+        return deferred.Promise();
     }
 
-    auto_release<SecKeyRef> privateKey = nullptr;
-    auto status = SecItemCopyMatching(queryAttributes, privateKey.cfTypeRef());
+    auto promise = deferred.Promise();
+    (new OpenDecryptStreamOperation(env, std::move(deferred), keyTag))->start(touchIdPrompt);
+    return promise;
+}
+
+Napi::Value wipe(const Napi::CallbackInfo &info) {
+    auto env = info.Env();
 
-    if (status != errSecSuccess) {
-        rejectWithErrorCode(deferred, status, "SecItemCopyMatching");
-        return;
+    if (info.Length() != 1 || !info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "buffer is not a buffer").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
 
-    auto supported = SecKeyIsAlgorithmSupported(privateKey, kSecKeyOperationTypeDecrypt,
-                                                kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM);
-    if (!supported) {
-        rejectWithMessage(deferred, "Algorithm not supported");
-        return;
+    auto buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    secureZero(buffer.Data(), buffer.ByteLength());
+    return env.Undefined();
+}
+
+Napi::Value clearKeyCache(const Napi::CallbackInfo &info) {
+    getAddonData(info.Env()).keyCache->clear();
+    return info.Env().Undefined();
+}
+
+Napi::Value getKeyCacheStats(const Napi::CallbackInfo &info) {
+    auto env = info.Env();
+    auto stats = getAddonData(env).keyCache->stats();
+
+    auto ret = Napi::Object::New(env);
+    ret.Set("hits", Napi::Number::New(env, double(stats.hits)));
+    ret.Set("misses", Napi::Number::New(env, double(stats.misses)));
+    ret.Set("size", Napi::Number::New(env, double(stats.size)));
+    ret.Set("capacity", Napi::Number::New(env, double(stats.capacity)));
+    ret.Set("tables", Napi::Number::New(env, double(stats.tables)));
+    return ret;
+}
+
+Napi::Value getKeyIndexStats(const Napi::CallbackInfo &info) {
+    auto env = info.Env();
+    auto &keyIndex = getAddonData(env).keyIndex;
+    if (!keyIndex) {
+        return env.Null();
     }
+    auto stats = keyIndex->stats();
+
+    auto ret = Napi::Object::New(env);
+    ret.Set("hits", Napi::Number::New(env, double(stats.hits)));
+    ret.Set("misses", Napi::Number::New(env, double(stats.misses)));
+    ret.Set("repairs", Napi::Number::New(env, double(stats.repairs)));
+    ret.Set("reconciles", Napi::Number::New(env, double(stats.reconciles)));
+    ret.Set("size", Napi::Number::New(env, double(stats.size)));
+    return ret;
+}
 
-    auto_release<CFErrorRef> error = nullptr;
-    auto_release decryptedData = SecKeyCreateDecryptedData(
-        privateKey, kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM, encryptedData, &error);
-    if (error) {
-        rejectWithCFError(deferred, error, "SecKeyCreateDecryptedData");
-        return;
+Napi::Value getSecureMemoryStats(const Napi::CallbackInfo &info) {
+    auto env = info.Env();
+    auto stats = secureMemoryStats();
+
+    auto ret = Napi::Object::New(env);
+    ret.Set("slabs", Napi::Number::New(env, double(stats.slabCount)));
+    ret.Set("reservedBytes", Napi::Number::New(env, double(stats.reservedBytes)));
+    ret.Set("lockedBytes", Napi::Number::New(env, double(stats.lockedBytes)));
+    ret.Set("inUseBytes", Napi::Number::New(env, double(stats.inUseBytes)));
+    ret.Set("peakInUseBytes", Napi::Number::New(env, double(stats.peakInUseBytes)));
+    ret.Set("allocations", Napi::Number::New(env, double(stats.allocations)));
+    ret.Set("reusedAllocations", Napi::Number::New(env, double(stats.reusedAllocations)));
+    ret.Set("largeAllocations", Napi::Number::New(env, double(stats.largeAllocations)));
+    ret.Set("lockFailures", Napi::Number::New(env, double(stats.lockFailures)));
+    return ret;
+}
+
+Napi::Object histogramSummaryToObject(Napi::Env env, const HistogramSummary &summary) {
+    auto histogram = Napi::Object::New(env);
+    histogram.Set("count", Napi::Number::New(env, double(summary.count)));
+    histogram.Set("mean", Napi::Number::New(env, summary.meanMs));
+    histogram.Set("p50", Napi::Number::New(env, summary.p50Ms));
+    histogram.Set("p95", Napi::Number::New(env, summary.p95Ms));
+    histogram.Set("p99", Napi::Number::New(env, summary.p99Ms));
+    histogram.Set("max", Napi::Number::New(env, summary.maxMs));
+    return histogram;
+}
+
+Napi::Value getKeyPoolStats(const Napi::CallbackInfo &info) {
+    auto env = info.Env();
+    auto &keyPool = getAddonData(env).keyPool;
+    if (!keyPool) {
+        return env.Null();
     }
+    auto stats = keyPool->stats();
+    auto claims = stats.hits + stats.misses;
+
+    auto ret = Napi::Object::New(env);
+    ret.Set("depth", Napi::Number::New(env, double(stats.depth)));
+    ret.Set("size", Napi::Number::New(env, double(stats.size)));
+    ret.Set("hits", Napi::Number::New(env, double(stats.hits)));
+    ret.Set("misses", Napi::Number::New(env, double(stats.misses)));
+    ret.Set("hitRate", Napi::Number::New(env, claims ? double(stats.hits) / double(claims) : 0));
+    ret.Set("refillErrors", Napi::Number::New(env, double(stats.refillErrors)));
+    ret.Set("refill", histogramSummaryToObject(env, stats.refill));
+    return ret;
+}
+
+Napi::Value getInFlightStats(const Napi::CallbackInfo &info) {
+    auto env = info.Env();
+    auto ret = Napi::Object::New(env);
+    ret.Set("operations", Napi::Number::New(env, double(inFlightOperations())));
+    ret.Set("pendingDecrypts", Napi::Number::New(env, double(getAddonData(env).decryptScheduler.pendingCount())));
+    return ret;
+}
 
-    deferred.Resolve(cfDataToBuffer(env, decryptedData));
+Napi::Value getStats(const Napi::CallbackInfo &info) {
+    auto env = info.Env();
+    auto ret = Napi::Object::New(env);
 
-    auto dataBytePtr = CFDataGetBytePtr(decryptedData);
+    forEachOperationStats([&](const std::string &name, const OperationStats &stats) {
+        auto total = stats.phases[PHASE_TOTAL].summary();
+        if (!total.count) {
+            return;
+        }
+
+        auto phases = Napi::Object::New(env);
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            auto summary = phase == PHASE_TOTAL ? total : stats.phases[phase].summary();
+            if (!summary.count) {
+                continue;
+            }
+            phases.Set(phaseName(Phase(phase)), histogramSummaryToObject(env, summary));
+        }
+
+        auto errors = Napi::Object::New(env);
+        for (auto &entry : stats.errors.counts()) {
+            auto code = entry.first == ErrorCounter::OTHER_ERROR_CODE ? "other" : std::to_string(entry.first);
+            errors.Set(code, Napi::Number::New(env, double(entry.second)));
+        }
+
+        auto op = Napi::Object::New(env);
+        op.Set("count", Napi::Number::New(env, double(total.count)));
+        op.Set("errors", errors);
+        op.Set("phases", phases);
+        ret.Set(name, op);
+    });
+    return ret;
+}
 
-    // clean up our copy of decrypted data
-    // this is not const-correct, but looks like there's no way to get CFMutableData from SecKeyCreateDecryptedData
-    memset(const_cast<UInt8 *>(dataBytePtr), 0, CFDataGetLength(decryptedData));
+Napi::Value resetStats(const Napi::CallbackInfo &info) {
+    resetOperationStats();
+    return info.Env().Undefined();
 }
 
 Napi::Object init(Napi::Env env, Napi::Object exports) {
+    initAddonData(env);
+
     exports.DefineProperty(Napi::PropertyDescriptor::Accessor<isSupported>("isSupported", napi_enumerable));
+    exports.Set("checkSupport", Napi::Function::New(env, checkSupport));
+    exports.Set("backend", Napi::String::New(env, getBackend().name()));
+
+    // selected here rather than on the first encrypt, so that known-answer tests don't delay it
+    auto cryptoKernels = Napi::Object::New(env);
+    cryptoKernels.Set("aesGcm", Napi::String::New(env, aesGcmKernelName(aesGcmKernel())));
+    cryptoKernels.Set("sha256", Napi::String::New(env, sha256KernelName(sha256Kernel())));
+    exports.Set("cryptoKernels", cryptoKernels);
 
     exports.Set("createKeyPair", Napi::Function::New(env, createKeyPair));
     exports.Set("findKeyPair", Napi::Function::New(env, findKeyPair));
     exports.Set("deleteKeyPair", Napi::Function::New(env, deleteKeyPair));
+    exports.Set("listKeys", Napi::Function::New(env, listKeys));
 
     exports.Set("encrypt", Napi::Function::New(env, encryptData));
     exports.Set("decrypt", Napi::Function::New(env, decryptData));
+    exports.Set("decryptMany", Napi::Function::New(env, decryptMany));
+    exports.Set("rewrap", Napi::Function::New(env, rewrap));
+    exports.Set("convertCiphertexts", Napi::Function::New(env, convertCiphertexts));
+
+    exports.Set("sign", Napi::Function::New(env, sign));
+    exports.Set("verify", Napi::Function::New(env, verify));
+    exports.Set("verifyMany", Napi::Function::New(env, verifyMany));
+    exports.Set("deriveSharedSecret", Napi::Function::New(env, deriveSharedSecret));
+
+    Session::init(env);
+    exports.Set("openSession", Napi::Function::New(env, openSession));
+
+    CipherStream::init(env);
+    exports.Set("openEncryptStream", Napi::Function::New(env, openEncryptStream));
+    exports.Set("openDecryptStream", Napi::Function::New(env, openDecryptStream));
+
+    exports.Set("wipe", Napi::Function::New(env, wipe));
+
+    exports.Set("configure", Napi::Function::New(env, configure));
+    exports.Set("clearKeyCache", Napi::Function::New(env, clearKeyCache));
+    exports.Set("getKeyCacheStats", Napi::Function::New(env, getKeyCacheStats));
+    exports.Set("getKeyIndexStats", Napi::Function::New(env, getKeyIndexStats));
+    exports.Set("getKeyPoolStats", Napi::Function::New(env, getKeyPoolStats));
+    exports.Set("getSecureMemoryStats", Napi::Function::New(env, getSecureMemoryStats));
+    exports.Set("getInFlightStats", Napi::Function::New(env, getInFlightStats));
+    exports.Set("getStats", Napi::Function::New(env, getStats));
+    exports.Set("resetStats", Napi::Function::New(env, resetStats));
 
     return exports;
 }
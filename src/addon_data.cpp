@@ -0,0 +1,5 @@
+#include "addon_data.h"
+
+void initAddonData(Napi::Env env) { env.SetInstanceData(new AddonData()); }
+
+AddonData &getAddonData(Napi::Env env) { return *env.GetInstanceData<AddonData>(); }
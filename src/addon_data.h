@@ -0,0 +1,30 @@
+#pragma once
+
+#include <napi.h>
+
+#include <memory>
+
+#include "decrypt_scheduler.h"
+#include "key_cache.h"
+#include "key_index.h"
+#include "key_pool.h"
+
+// State of one JS environment: the main thread or a worker thread.
+struct AddonData {
+    // shared with operations, they can still be running on the worker pool when the environment is gone
+    std::shared_ptr<KeyCache> keyCache = std::make_shared<KeyCache>(DEFAULT_KEY_CACHE_SIZE);
+    // null unless enabled with configure
+    std::shared_ptr<KeyIndex> keyIndex;
+    // null unless enabled with configure, like the key index
+    std::shared_ptr<KeyPool> keyPool;
+    // called with the timing of every operation if set
+    Napi::FunctionReference trace;
+    DecryptScheduler decryptScheduler;
+    // classes are defined in every environment, objects can't be created with a constructor from another one
+    Napi::FunctionReference sessionConstructor;
+    Napi::FunctionReference cipherStreamConstructor;
+};
+
+// creates the state of the environment, it's deleted when the environment is torn down
+void initAddonData(Napi::Env env);
+AddonData &getAddonData(Napi::Env env);
@@ -0,0 +1,310 @@
+#include "aes_gcm.h"
+
+#include <cstring>
+
+#include "secure_memory.h"
+
+namespace {
+
+constexpr uint8_t SBOX[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9,
+    0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f,
+    0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15, 0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07,
+    0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75, 0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3,
+    0x29, 0xe3, 0x2f, 0x84, 0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58,
+    0xcf, 0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8, 0x51, 0xa3,
+    0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2, 0xcd, 0x0c, 0x13, 0xec, 0x5f,
+    0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73, 0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+    0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb, 0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac,
+    0x62, 0x91, 0x95, 0xe4, 0x79, 0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a,
+    0xae, 0x08, 0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a, 0x70,
+    0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e, 0xe1, 0xf8, 0x98, 0x11,
+    0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf, 0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42,
+    0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+constexpr uint8_t RCON[10] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+
+// reduction constants for the 4-bit GHASH multiplication
+constexpr uint64_t LAST4[16] = {0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+                                0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0};
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline uint8_t mul2(uint8_t x) { return uint8_t((x << 1) ^ ((x & 0x80) ? 0x1b : 0)); }
+
+inline uint32_t loadBigEndian32(const uint8_t *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline void storeBigEndian32(uint8_t *p, uint32_t x) {
+    p[0] = uint8_t(x >> 24);
+    p[1] = uint8_t(x >> 16);
+    p[2] = uint8_t(x >> 8);
+    p[3] = uint8_t(x);
+}
+
+inline uint64_t loadBigEndian64(const uint8_t *p) {
+    return (uint64_t(loadBigEndian32(p)) << 32) | loadBigEndian32(p + 4);
+}
+
+inline void storeBigEndian64(uint8_t *p, uint64_t x) {
+    storeBigEndian32(p, uint32_t(x >> 32));
+    storeBigEndian32(p + 4, uint32_t(x));
+}
+
+struct EncryptionTable {
+    uint32_t te[4][256];
+
+    EncryptionTable() {
+        for (int i = 0; i < 256; i++) {
+            auto s = SBOX[i];
+            auto s2 = mul2(s);
+            uint8_t s3 = s2 ^ s;
+            auto word = (uint32_t(s2) << 24) | (uint32_t(s) << 16) | (uint32_t(s) << 8) | s3;
+            te[0][i] = word;
+            te[1][i] = rotr(word, 8);
+            te[2][i] = rotr(word, 16);
+            te[3][i] = rotr(word, 24);
+        }
+    }
+};
+
+const EncryptionTable &encryptionTable() {
+    static const EncryptionTable table;
+    return table;
+}
+
+inline uint32_t subWord(uint32_t x) {
+    return (uint32_t(SBOX[x >> 24]) << 24) | (uint32_t(SBOX[(x >> 16) & 0xff]) << 16) |
+           (uint32_t(SBOX[(x >> 8) & 0xff]) << 8) | SBOX[x & 0xff];
+}
+
+inline void incrementCounter(uint8_t *counter) {
+    auto value = loadBigEndian32(counter + 12) + 1;
+    storeBigEndian32(counter + 12, value);
+}
+
+} // namespace
+
+AesGcm::AesGcm(const uint8_t *key, size_t keyLength, AesGcmKernel kernel)
+    : hardware_(aesGcmHardwareKernel(kernel)) {
+    auto nk = int(keyLength / 4);
+    rounds_ = nk + 6;
+
+    auto totalWords = 4 * (rounds_ + 1);
+    for (int i = 0; i < nk; i++) {
+        roundKeys_[i] = loadBigEndian32(key + i * 4);
+    }
+    for (int i = nk; i < totalWords; i++) {
+        auto temp = roundKeys_[i - 1];
+        if (i % nk == 0) {
+            temp = subWord((temp << 8) | (temp >> 24)) ^ (uint32_t(RCON[i / nk - 1]) << 24);
+        } else if (nk > 6 && i % nk == 4) {
+            temp = subWord(temp);
+        }
+        roundKeys_[i] = roundKeys_[i - nk] ^ temp;
+    }
+
+    if (hardware_) {
+        hardware_->init(roundKeys_, rounds_, hardwareRoundKeys_, hPowers_);
+        return;
+    }
+
+    uint8_t h[AES_BLOCK_SIZE] = {0};
+    encryptBlock(h, h);
+    auto vh = loadBigEndian64(h);
+    auto vl = loadBigEndian64(h + 8);
+    secureZero(h, sizeof(h));
+
+    hTableHigh_[0] = 0;
+    hTableLow_[0] = 0;
+    hTableHigh_[8] = vh;
+    hTableLow_[8] = vl;
+    for (int i = 4; i > 0; i >>= 1) {
+        uint64_t reduction = (vl & 1) * 0xe100000000000000ULL;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ reduction;
+        hTableHigh_[i] = vh;
+        hTableLow_[i] = vl;
+    }
+    for (int i = 2; i <= 8; i *= 2) {
+        vh = hTableHigh_[i];
+        vl = hTableLow_[i];
+        for (int j = 1; j < i; j++) {
+            hTableHigh_[i + j] = vh ^ hTableHigh_[j];
+            hTableLow_[i + j] = vl ^ hTableLow_[j];
+        }
+    }
+}
+
+AesGcm::~AesGcm() {
+    secureZero(roundKeys_, sizeof(roundKeys_));
+    secureZero(hTableHigh_, sizeof(hTableHigh_));
+    secureZero(hTableLow_, sizeof(hTableLow_));
+    secureZero(hardwareRoundKeys_, sizeof(hardwareRoundKeys_));
+    secureZero(hPowers_, sizeof(hPowers_));
+}
+
+void AesGcm::encryptBlock(const uint8_t *in, uint8_t *out) const {
+    if (hardware_) {
+        hardware_->encryptBlock(hardwareRoundKeys_, rounds_, in, out);
+        return;
+    }
+    auto &te = encryptionTable().te;
+    auto rk = roundKeys_;
+
+    auto s0 = loadBigEndian32(in) ^ rk[0];
+    auto s1 = loadBigEndian32(in + 4) ^ rk[1];
+    auto s2 = loadBigEndian32(in + 8) ^ rk[2];
+    auto s3 = loadBigEndian32(in + 12) ^ rk[3];
+
+    for (int round = 1; round < rounds_; round++) {
+        rk += 4;
+        auto t0 = te[0][s0 >> 24] ^ te[1][(s1 >> 16) & 0xff] ^ te[2][(s2 >> 8) & 0xff] ^ te[3][s3 & 0xff] ^ rk[0];
+        auto t1 = te[0][s1 >> 24] ^ te[1][(s2 >> 16) & 0xff] ^ te[2][(s3 >> 8) & 0xff] ^ te[3][s0 & 0xff] ^ rk[1];
+        auto t2 = te[0][s2 >> 24] ^ te[1][(s3 >> 16) & 0xff] ^ te[2][(s0 >> 8) & 0xff] ^ te[3][s1 & 0xff] ^ rk[2];
+        auto t3 = te[0][s3 >> 24] ^ te[1][(s0 >> 16) & 0xff] ^ te[2][(s1 >> 8) & 0xff] ^ te[3][s2 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    rk += 4;
+    auto lastRound = [](uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t k) {
+        return ((uint32_t(SBOX[a >> 24]) << 24) | (uint32_t(SBOX[(b >> 16) & 0xff]) << 16) |
+                (uint32_t(SBOX[(c >> 8) & 0xff]) << 8) | SBOX[d & 0xff]) ^
+               k;
+    };
+    storeBigEndian32(out, lastRound(s0, s1, s2, s3, rk[0]));
+    storeBigEndian32(out + 4, lastRound(s1, s2, s3, s0, rk[1]));
+    storeBigEndian32(out + 8, lastRound(s2, s3, s0, s1, rk[2]));
+    storeBigEndian32(out + 12, lastRound(s3, s0, s1, s2, rk[3]));
+}
+
+void AesGcm::ghash(uint8_t *y, const uint8_t *data, size_t length) const {
+    if (hardware_) {
+        hardware_->ghash(hPowers_, y, data, length);
+        return;
+    }
+
+    uint8_t block[AES_BLOCK_SIZE];
+    memcpy(block, y, sizeof(block));
+    while (length > 0) {
+        auto blockLength = length < AES_BLOCK_SIZE ? length : AES_BLOCK_SIZE;
+        for (size_t i = 0; i < blockLength; i++) {
+            block[i] ^= data[i];
+        }
+
+        auto lo = block[15] & 0xf;
+        auto zh = hTableHigh_[lo];
+        auto zl = hTableLow_[lo];
+        for (int i = 15; i >= 0; i--) {
+            lo = block[i] & 0xf;
+            auto hi = (block[i] >> 4) & 0xf;
+            if (i != 15) {
+                auto rem = zl & 0xf;
+                zl = (zh << 60) | (zl >> 4);
+                zh = (zh >> 4) ^ (LAST4[rem] << 48);
+                zh ^= hTableHigh_[lo];
+                zl ^= hTableLow_[lo];
+            }
+            auto rem = zl & 0xf;
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (LAST4[rem] << 48);
+            zh ^= hTableHigh_[hi];
+            zl ^= hTableLow_[hi];
+        }
+        storeBigEndian64(block, zh);
+        storeBigEndian64(block + 8, zl);
+
+        data += blockLength;
+        length -= blockLength;
+    }
+    memcpy(y, block, sizeof(block));
+}
+
+void AesGcm::ghashFinish(uint8_t *y, size_t aadLength, size_t length) const {
+    uint8_t lengths[AES_BLOCK_SIZE];
+    storeBigEndian64(lengths, uint64_t(aadLength) * 8);
+    storeBigEndian64(lengths + 8, uint64_t(length) * 8);
+    ghash(y, lengths, sizeof(lengths));
+}
+
+void AesGcm::computeInitialCounter(const uint8_t *iv, size_t ivLength, uint8_t *counter) const {
+    if (ivLength == 12) {
+        memcpy(counter, iv, 12);
+        storeBigEndian32(counter + 12, 1);
+        return;
+    }
+    memset(counter, 0, AES_BLOCK_SIZE);
+    ghash(counter, iv, ivLength);
+    ghashFinish(counter, 0, ivLength);
+}
+
+void AesGcm::ctr(uint8_t *counter, const uint8_t *in, size_t length, uint8_t *out) const {
+    if (hardware_) {
+        hardware_->ctr(hardwareRoundKeys_, rounds_, counter, in, length, out);
+        return;
+    }
+    uint8_t keyStream[AES_BLOCK_SIZE];
+    while (length > 0) {
+        incrementCounter(counter);
+        encryptBlock(counter, keyStream);
+        auto blockLength = length < AES_BLOCK_SIZE ? length : AES_BLOCK_SIZE;
+        for (size_t i = 0; i < blockLength; i++) {
+            out[i] = in[i] ^ keyStream[i];
+        }
+        in += blockLength;
+        out += blockLength;
+        length -= blockLength;
+    }
+    secureZero(keyStream, sizeof(keyStream));
+}
+
+void AesGcm::encrypt(const uint8_t *iv, size_t ivLength, const uint8_t *aad, size_t aadLength,
+                     const uint8_t *plaintext, size_t length, uint8_t *ciphertext, uint8_t *tag) const {
+    uint8_t initialCounter[AES_BLOCK_SIZE];
+    computeInitialCounter(iv, ivLength, initialCounter);
+
+    uint8_t counter[AES_BLOCK_SIZE];
+    memcpy(counter, initialCounter, sizeof(counter));
+    ctr(counter, plaintext, length, ciphertext);
+
+    uint8_t y[AES_BLOCK_SIZE] = {0};
+    ghash(y, aad, aadLength);
+    ghash(y, ciphertext, length);
+    ghashFinish(y, aadLength, length);
+
+    encryptBlock(initialCounter, tag);
+    for (size_t i = 0; i < GCM_TAG_SIZE; i++) {
+        tag[i] ^= y[i];
+    }
+}
+
+bool AesGcm::decrypt(const uint8_t *iv, size_t ivLength, const uint8_t *aad, size_t aadLength,
+                     const uint8_t *ciphertext, size_t length, const uint8_t *tag, uint8_t *plaintext) const {
+    uint8_t initialCounter[AES_BLOCK_SIZE];
+    computeInitialCounter(iv, ivLength, initialCounter);
+
+    uint8_t y[AES_BLOCK_SIZE] = {0};
+    ghash(y, aad, aadLength);
+    ghash(y, ciphertext, length);
+    ghashFinish(y, aadLength, length);
+
+    uint8_t expectedTag[GCM_TAG_SIZE];
+    encryptBlock(initialCounter, expectedTag);
+    uint8_t diff = 0;
+    for (size_t i = 0; i < GCM_TAG_SIZE; i++) {
+        diff |= (expectedTag[i] ^ y[i]) ^ tag[i];
+    }
+    if (diff != 0) {
+        return false;
+    }
+
+    uint8_t counter[AES_BLOCK_SIZE];
+    memcpy(counter, initialCounter, sizeof(counter));
+    ctr(counter, ciphertext, length, plaintext);
+    return true;
+}
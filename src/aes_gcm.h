@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "crypto_kernels.h"
+
+constexpr size_t AES_BLOCK_SIZE = 16;
+constexpr size_t GCM_TAG_SIZE = 16;
+
+// AES-GCM with 128 or 256-bit keys and IVs of any length.
+// Once constructed, the object can be used from several threads at once.
+// The kernel is the one selected for the CPU unless it's specified, for tests and benchmarks.
+class AesGcm {
+  private:
+    uint32_t roundKeys_[60];
+    int rounds_;
+    uint64_t hTableHigh_[16];
+    uint64_t hTableLow_[16];
+    // null if the portable kernel is used
+    const AesGcmHardwareKernel *hardware_;
+    uint8_t hardwareRoundKeys_[AES_GCM_HARDWARE_ROUND_KEYS_SIZE];
+    uint8_t hPowers_[AES_GCM_HARDWARE_H_POWERS_SIZE];
+
+    void encryptBlock(const uint8_t *in, uint8_t *out) const;
+    // y is the GHASH state as a block
+    void ghash(uint8_t *y, const uint8_t *data, size_t length) const;
+    void ghashFinish(uint8_t *y, size_t aadLength, size_t length) const;
+    void computeInitialCounter(const uint8_t *iv, size_t ivLength, uint8_t *counter) const;
+    void ctr(uint8_t *counter, const uint8_t *in, size_t length, uint8_t *out) const;
+
+  public:
+    AesGcm(const uint8_t *key, size_t keyLength, AesGcmKernel kernel = aesGcmKernel());
+    ~AesGcm();
+
+    AesGcm(const AesGcm &) = delete;
+    AesGcm &operator=(const AesGcm &) = delete;
+
+    void encrypt(const uint8_t *iv, size_t ivLength, const uint8_t *aad, size_t aadLength, const uint8_t *plaintext,
+                 size_t length, uint8_t *ciphertext, uint8_t *tag) const;
+
+    // returns false if the tag doesn't match, plaintext is not written in this case
+    bool decrypt(const uint8_t *iv, size_t ivLength, const uint8_t *aad, size_t aadLength, const uint8_t *ciphertext,
+                 size_t length, const uint8_t *tag, uint8_t *plaintext) const;
+};
@@ -0,0 +1,155 @@
+#include "async_operation.h"
+
+#include "addon_data.h"
+#include "helpers.h"
+#include "key_tag_queue.h"
+#include "worker_pool.h"
+
+AsyncOperation::AsyncOperation(Napi::Env env, Napi::Promise::Deferred deferred, const char *name)
+    : deferred_(std::move(deferred)), name_(name) {
+    tsfn_ = AsyncOperationTSFN::New(env, name, 0, 1, this);
+
+    recordStats_ = statsEnabled();
+    timed_ = recordStats_ || !getAddonData(env).trace.IsEmpty();
+    for (auto &ns : phaseNs_) {
+        ns = -1;
+    }
+    createdAt_ = timestamp();
+    operationCreated();
+}
+
+AsyncOperation::~AsyncOperation() { operationDeleted(); }
+
+int64_t AsyncOperation::timestamp() const { return timed_ ? monotonicNowNs() : 0; }
+
+void AsyncOperation::addPhaseTime(Phase phase, int64_t startedAt) {
+    if (!timed_) {
+        return;
+    }
+    auto ns = monotonicNowNs() - startedAt;
+    phaseNs_[phase] = phaseNs_[phase] < 0 ? ns : phaseNs_[phase] + ns;
+}
+
+AsyncOperation::PhaseTimer::PhaseTimer(AsyncOperation *operation, Phase phase)
+    : operation_(operation), phase_(phase), startedAt_(operation->timestamp()) {}
+
+AsyncOperation::PhaseTimer::~PhaseTimer() { operation_->addPhaseTime(phase_, startedAt_); }
+
+void AsyncOperation::pin(Napi::Object object) { pinned_.push_back(Napi::Persistent(object)); }
+
+void AsyncOperation::queue() {
+    queuedAt_ = timestamp();
+    getWorkerPool().submit([this]() {
+        addPhaseTime(PHASE_QUEUE, queuedAt_);
+        execute();
+        complete();
+    });
+}
+
+void AsyncOperation::queue(const std::string &keyTag) {
+    queuedAt_ = timestamp();
+    getKeyTagQueue().submit(keyTag, [this]() {
+        addPhaseTime(PHASE_QUEUE, queuedAt_);
+        execute();
+        complete();
+    });
+}
+
+void AsyncOperation::complete() {
+    // tsfn_ is copied because the operation can be deleted right after BlockingCall
+    auto tsfn = tsfn_;
+    completedAt_ = timestamp();
+    tsfn.BlockingCall(this);
+    tsfn.Release();
+}
+
+void AsyncOperation::reject(Napi::Env env, Napi::Promise::Deferred &deferred) { deferred.Reject(createError(env)); }
+
+Napi::Value AsyncOperation::createError(Napi::Env env) { return createBackendError(env, error_).Value(); }
+
+void AsyncOperation::finishTiming(Napi::Env env) {
+    addPhaseTime(PHASE_COMPLETE, completedAt_);
+    addPhaseTime(PHASE_TOTAL, createdAt_);
+
+    // errors without a status code are counted as 0
+    auto status = error_ ? error_.code : STATUS_SUCCESS;
+    if (recordStats_) {
+        auto &stats = getOperationStats(name_);
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            if (phaseNs_[phase] >= 0) {
+                stats.phases[phase].record(phaseNs_[phase]);
+            }
+        }
+        if (error_) {
+            stats.errors.record(status);
+        }
+    }
+
+    auto &trace = getAddonData(env).trace;
+    if (trace.IsEmpty()) {
+        return;
+    }
+    auto phases = Napi::Object::New(env);
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        if (phaseNs_[phase] >= 0) {
+            phases.Set(phaseName(Phase(phase)), Napi::Number::New(env, double(phaseNs_[phase]) / 1e6));
+        }
+    }
+    auto event = Napi::Object::New(env);
+    event.Set("operation", Napi::String::New(env, name_));
+    event.Set("error", Napi::Boolean::New(env, bool(error_)));
+    event.Set("status", Napi::Number::New(env, double(status)));
+    event.Set("phases", phases);
+    trace.Call({event});
+    if (env.IsExceptionPending()) {
+        // the promise must still be settled, so an exception thrown by the callback is ignored
+        env.GetAndClearPendingException();
+    }
+}
+
+void asyncOperationCompleteCallback(Napi::Env env, Napi::Function, AsyncOperation *operation, void *) {
+    if (env == nullptr) {
+        // the environment is being torn down, there's no promise to settle anymore,
+        // the operation is still deleted so that it's not counted as in flight
+        delete operation;
+        return;
+    }
+    if (operation->timed_) {
+        operation->finishTiming(env);
+    }
+    if (operation->error_) {
+        operation->reject(env, operation->deferred_);
+    } else {
+        operation->resolve(env, operation->deferred_);
+    }
+    delete operation;
+}
+
+Napi::Value AuthenticatedOperation::createError(Napi::Env env) {
+    if (authErrorCode_) {
+        return createAuthRefusedError(env, authErrorCode_).Value();
+    }
+    return AsyncOperation::createError(env);
+}
+
+void AuthenticatedOperation::start(const std::string &touchIdPrompt) {
+    authStartedAt_ = timestamp();
+    promptContext_ = getBackend().authenticate(
+        touchIdPrompt, [this](const std::shared_ptr<AuthContext> &authContext, long authErrorCode) {
+            addPhaseTime(PHASE_AUTH, authStartedAt_);
+            authContext_ = authContext;
+            authErrorCode_ = authErrorCode;
+            if (authErrorCode) {
+                error_ = errorWithCode(authErrorCode, "authenticate");
+                complete();
+            } else {
+                queue();
+            }
+        });
+}
+
+void AuthenticatedOperation::cancelAuthentication() {
+    if (promptContext_) {
+        promptContext_->invalidate();
+    }
+}
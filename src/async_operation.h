@@ -0,0 +1,119 @@
+#pragma once
+
+#include <napi.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "backend.h"
+#include "stats.h"
+
+class AsyncOperation;
+
+void asyncOperationCompleteCallback(Napi::Env env, Napi::Function, AsyncOperation *operation, void *);
+using AsyncOperationTSFN = Napi::TypedThreadSafeFunction<AsyncOperation, void, asyncOperationCompleteCallback>;
+
+// Promise-based operation: execute runs on the worker pool, then the promise is settled on the JS thread.
+// The object deletes itself after completion.
+class AsyncOperation {
+  private:
+    Napi::Promise::Deferred deferred_;
+    AsyncOperationTSFN tsfn_;
+    std::vector<Napi::ObjectReference> pinned_;
+
+    // timing is off unless stats or tracing were enabled when the operation was created
+    const char *name_;
+    bool timed_ = false;
+    bool recordStats_ = false;
+    int64_t createdAt_ = 0;
+    int64_t queuedAt_ = 0;
+    int64_t completedAt_ = 0;
+    // nanoseconds spent in each phase, -1 if the phase didn't happen
+    int64_t phaseNs_[PHASE_COUNT];
+
+    void finishTiming(Napi::Env env);
+
+    friend void asyncOperationCompleteCallback(Napi::Env env, Napi::Function, AsyncOperation *operation, void *);
+
+  protected:
+    // Adds the time until the end of the scope to a phase of the operation.
+    class PhaseTimer {
+      private:
+        AsyncOperation *operation_;
+        Phase phase_;
+        int64_t startedAt_;
+
+      public:
+        PhaseTimer(AsyncOperation *operation, Phase phase);
+        ~PhaseTimer();
+
+        PhaseTimer(const PhaseTimer &) = delete;
+        PhaseTimer &operator=(const PhaseTimer &) = delete;
+    };
+
+    // monotonic time in nanoseconds if the operation is timed, 0 otherwise
+    int64_t timestamp() const;
+
+    // adds the time since a timestamp to a phase, can be called from any thread, but not concurrently
+    void addPhaseTime(Phase phase, int64_t startedAt);
+
+    // set by execute to reject the promise
+    BackendError error_;
+
+    // called on a worker thread
+    virtual void execute() = 0;
+
+    // called on the JS thread if there was no error
+    virtual void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) = 0;
+
+    // called on the JS thread if execute has set an error, rejects the promise with createError by default
+    virtual void reject(Napi::Env env, Napi::Promise::Deferred &deferred);
+
+    // JS error for error_
+    virtual Napi::Value createError(Napi::Env env);
+
+  public:
+    AsyncOperation(Napi::Env env, Napi::Promise::Deferred deferred, const char *name);
+    virtual ~AsyncOperation();
+
+    AsyncOperation(const AsyncOperation &) = delete;
+    AsyncOperation &operator=(const AsyncOperation &) = delete;
+
+    // keeps a JS object alive until the operation is complete, so that workers can use its memory without a copy
+    void pin(Napi::Object object);
+
+    // runs execute on the worker pool, can be called from any thread
+    void queue();
+    // the same, but after all operations queued earlier for this keyTag are complete
+    void queue(const std::string &keyTag);
+
+    // settles the promise without running execute, can be called from any thread
+    void complete();
+};
+
+// Operation that shows the Touch ID prompt first, execute runs only if the user has authenticated.
+class AuthenticatedOperation : public AsyncOperation {
+  private:
+    long authErrorCode_ = -1;
+    int64_t authStartedAt_ = 0;
+    // returned by authenticate, only used on the JS thread to dismiss the prompt
+    std::shared_ptr<AuthContext> promptContext_;
+
+  protected:
+    // pass it to findKeyPair so that the key can be used without another prompt
+    std::shared_ptr<AuthContext> authContext_;
+
+    // a "rejected" error if the user has refused to authenticate
+    Napi::Value createError(Napi::Env env) override;
+
+  public:
+    using AsyncOperation::AsyncOperation;
+
+    // shows the prompt, then queues the operation, must be called instead of queue
+    void start(const std::string &touchIdPrompt);
+
+    // dismisses the prompt if it's still shown, the operation fails with a "rejected" error then,
+    // must be called on the JS thread before the operation is complete
+    void cancelAuthentication();
+};
@@ -0,0 +1,19 @@
+#include "backend.h"
+
+#if !defined(__APPLE__) && !defined(NODE_SECURE_ENCLAVE_SOFTWARE_BACKEND)
+#error "Secure Enclave is only available on macOS, build with --NODE_SECURE_ENCLAVE_SOFTWARE_BACKEND=1 for tests"
+#endif
+
+BackendError errorWithCode(long code, const std::string &op) {
+    BackendError error;
+    error.code = code;
+    error.op = op;
+    return error;
+}
+
+BackendError errorWithMessage(const std::string &message, const std::string &prop) {
+    BackendError error;
+    error.message = message;
+    error.prop = prop;
+    return error;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "secure_memory.h"
+
+using Bytes = std::vector<uint8_t>;
+
+// status codes shared by all backends, the values are the same as OSStatus codes in Security.framework
+constexpr long STATUS_SUCCESS = 0;
+constexpr long STATUS_IO = -36;
+constexpr long STATUS_PARAM = -50;
+constexpr long STATUS_AUTH_FAILED = -25293;
+constexpr long STATUS_DUPLICATE_ITEM = -25299;
+constexpr long STATUS_ITEM_NOT_FOUND = -25300;
+constexpr long STATUS_DECODE = -26275;
+
+// LAErrorAppCancel, the authentication callback gets it if the prompt was dismissed with AuthContext::invalidate
+constexpr long AUTH_ERROR_APP_CANCEL = -9;
+
+constexpr size_t DEFAULT_DERIVED_KEY_SIZE = 32;
+constexpr size_t MAX_DERIVED_KEY_SIZE = 1024;
+
+struct BackendError {
+    // status code, can be STATUS_SUCCESS if the failed call didn't return a code
+    long code = STATUS_SUCCESS;
+    // name of the failed call, used in error messages
+    std::string op;
+    // custom message for errors without a status code
+    std::string message;
+    // boolean property set on the error object
+    std::string prop;
+
+    explicit operator bool() const { return code != STATUS_SUCCESS || !op.empty() || !message.empty(); }
+};
+
+BackendError errorWithCode(long code, const std::string &op);
+BackendError errorWithMessage(const std::string &message, const std::string &prop = std::string());
+
+// state of user authentication, it can be passed to findKeyPair to use the private key without another prompt
+class AuthContext {
+  public:
+    virtual ~AuthContext() = default;
+
+    // ends the authenticated state, key pairs found with this context can't decrypt anymore;
+    // if the prompt is still shown, it's dismissed
+    virtual void invalidate() = 0;
+};
+
+// called from an arbitrary thread when user authentication is complete,
+// authErrorCode is 0 on success, otherwise it's an LAError code
+using AuthCallback = std::function<void(const std::shared_ptr<AuthContext> &authContext, long authErrorCode)>;
+
+class KeyPair {
+  public:
+    virtual ~KeyPair() = default;
+
+    // public key in X9.63 uncompressed form
+    virtual BackendError copyPublicKey(Bytes &publicKey) = 0;
+
+    // kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM
+    virtual BackendError encrypt(const uint8_t *data, size_t length, Bytes &encrypted) = 0;
+    virtual BackendError decrypt(const uint8_t *data, size_t length, SecureBytes &decrypted) = 0;
+
+    // kSecKeyAlgorithmECDSASignatureMessageX962SHA256, the signature is DER-encoded
+    virtual BackendError sign(const uint8_t *data, size_t length, Bytes &signature) = 0;
+
+    // kSecKeyAlgorithmECDHKeyExchangeCofactorX963SHA256: ECDH with an uncompressed P-256 public key,
+    // then X9.63 KDF with SHA-256 and sharedInfo, derived gets length bytes
+    virtual BackendError deriveSharedSecret(const uint8_t *peerPublicKey, const uint8_t *sharedInfo,
+                                            size_t sharedInfoLength, size_t length, SecureBytes &derived) = 0;
+};
+
+struct KeyInfo {
+    std::string keyTag;
+    // X9.63 uncompressed form
+    Bytes publicKey;
+};
+
+// Key storage and user authentication used by the exported functions.
+// All methods except authenticate can be called from any thread.
+class Backend {
+  public:
+    virtual ~Backend() = default;
+
+    virtual const char *name() const = 0;
+    virtual bool isSupported() = 0;
+
+    // human-readable description of a status code, empty if it's unknown
+    virtual std::string errorMessage(long code) = 0;
+
+    virtual BackendError createKeyPair(const std::string &keyTag, Bytes &publicKey) = 0;
+    virtual BackendError findKeyPair(const std::string &keyTag, AuthContext *authContext,
+                                     std::unique_ptr<KeyPair> &keyPair) = 0;
+    virtual BackendError deleteKeyPair(const std::string &keyTag) = 0;
+    // changes the tag of a key without regenerating it, fails with STATUS_DUPLICATE_ITEM if newKeyTag is taken;
+    // if another process takes newKeyTag at the same time, the rename is rolled back with the same error
+    virtual BackendError renameKeyPair(const std::string &keyTag, const std::string &newKeyTag) = 0;
+
+    // all keys with tags starting with the prefix in one query, sorted by tag, at most limit keys if it's not 0;
+    // tags starting with excludePrefix, if it's not empty, are skipped before the limit is applied
+    virtual BackendError listKeys(const std::string &prefix, const std::string &excludePrefix, size_t limit,
+                                  std::vector<KeyInfo> &keys) = 0;
+
+    // shows the authentication prompt, the callback is called exactly once
+    virtual std::shared_ptr<AuthContext> authenticate(const std::string &touchIdPrompt, AuthCallback callback) = 0;
+};
+
+// backend selected at build time
+Backend &getBackend();
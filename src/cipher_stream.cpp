@@ -0,0 +1,121 @@
+#include "cipher_stream.h"
+
+#include "addon_data.h"
+#include "async_operation.h"
+#include "helpers.h"
+
+class CipherStreamOperation : public AsyncOperation {
+  private:
+    CipherStream *stream_;
+    std::shared_ptr<StreamCipher> cipher_;
+    // pinned input Buffer, see EncryptOperation, not used by final
+    const uint8_t *data_ = nullptr;
+    size_t length_ = 0;
+    bool final_;
+    SecureBytes output_;
+
+  protected:
+    void execute() override {
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        if (final_) {
+            error_ = cipher_->finish(output_);
+        } else {
+            error_ = cipher_->update(data_, length_, output_);
+        }
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        stream_->busy_ = false;
+        deferred.Resolve(bytesToExternalBuffer(env, std::move(output_)));
+    }
+
+    void reject(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        stream_->busy_ = false;
+        stream_->cipher_.reset();
+        AsyncOperation::reject(env, deferred);
+    }
+
+  public:
+    CipherStreamOperation(Napi::Env env, Napi::Promise::Deferred deferred, CipherStream *stream, bool final)
+        : AsyncOperation(env, std::move(deferred), "cipherStream"), stream_(stream), cipher_(stream->cipher_),
+          final_(final) {
+        // the stream object is used when the operation is complete
+        pin(stream->Value());
+        stream_->busy_ = true;
+    }
+
+    void setData(Napi::Buffer<uint8_t> data) {
+        data_ = data.Data();
+        length_ = data.ByteLength();
+        pin(data);
+    }
+};
+
+void CipherStream::init(Napi::Env env) {
+    auto func = DefineClass(env, "CipherStream",
+                            {
+                                InstanceMethod("update", &CipherStream::update),
+                                InstanceMethod("final", &CipherStream::final),
+                                InstanceMethod("close", &CipherStream::close),
+                            });
+    getAddonData(env).cipherStreamConstructor = Napi::Persistent(func);
+}
+
+Napi::Object CipherStream::create(Napi::Env env, std::shared_ptr<StreamCipher> cipher) {
+    return getAddonData(env).cipherStreamConstructor.Value().New(
+        {Napi::External<std::shared_ptr<StreamCipher>>::New(env, &cipher)});
+}
+
+CipherStream::CipherStream(const Napi::CallbackInfo &info) : Napi::ObjectWrap<CipherStream>(info) {
+    if (info.Length() != 1 || !info[0].IsExternal()) {
+        Napi::TypeError::New(info.Env(), "Use createEncryptStream or createDecryptStream to create a stream")
+            .ThrowAsJavaScriptException();
+        return;
+    }
+    cipher_ = *info[0].As<Napi::External<std::shared_ptr<StreamCipher>>>().Data();
+}
+
+Napi::Value CipherStream::process(const Napi::CallbackInfo &info, bool final) {
+    auto env = info.Env();
+
+    auto deferred = Napi::Promise::Deferred::New(env);
+
+    if (!cipher_) {
+        rejectWithMessage(deferred, "Stream is closed");
+        return deferred.Promise();
+    }
+    if (busy_) {
+        rejectWithMessage(deferred, "Previous stream operation is not complete yet");
+        return deferred.Promise();
+    }
+
+    Napi::Buffer<uint8_t> data;
+    if (!final) {
+        if (info.Length() != 1 || !info[0].IsBuffer()) {
+            rejectAsTypeError(deferred, "data is not a buffer");
+            return deferred.Promise();
+        }
+        data = info[0].As<Napi::Buffer<uint8_t>>();
+    }
+
+    auto promise = deferred.Promise();
+    auto operation = new CipherStreamOperation(env, std::move(deferred), this, final);
+    if (!final) {
+        operation->setData(data);
+    } else {
+        // nothing can be processed after the final call
+        cipher_.reset();
+    }
+    operation->queue();
+    return promise;
+}
+
+Napi::Value CipherStream::update(const Napi::CallbackInfo &info) { return process(info, false); }
+
+Napi::Value CipherStream::final(const Napi::CallbackInfo &info) { return process(info, true); }
+
+Napi::Value CipherStream::close(const Napi::CallbackInfo &info) {
+    // a running operation keeps its own reference, the cipher is destroyed when it's complete
+    cipher_.reset();
+    return info.Env().Undefined();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <napi.h>
+
+#include <memory>
+
+#include "stream_cipher.h"
+
+// JS handle of a StreamCipher, wrapped into a Transform stream by node-secure-enclave.js.
+// Calls are processed on the worker pool one at a time, the next one can be made when the previous is settled.
+class CipherStream : public Napi::ObjectWrap<CipherStream> {
+  private:
+    std::shared_ptr<StreamCipher> cipher_;
+    bool busy_ = false;
+
+    Napi::Value update(const Napi::CallbackInfo &info);
+    Napi::Value final(const Napi::CallbackInfo &info);
+    Napi::Value close(const Napi::CallbackInfo &info);
+
+    Napi::Value process(const Napi::CallbackInfo &info, bool final);
+
+    friend class CipherStreamOperation;
+
+  public:
+    static void init(Napi::Env env);
+    static Napi::Object create(Napi::Env env, std::shared_ptr<StreamCipher> cipher);
+
+    explicit CipherStream(const Napi::CallbackInfo &info);
+};
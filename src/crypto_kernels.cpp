@@ -0,0 +1,298 @@
+#include "crypto_kernels.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "aes_gcm.h"
+#include "sha256.h"
+
+#if defined(NODE_SECURE_ENCLAVE_X86_KERNELS)
+#include <cpuid.h>
+#elif defined(NODE_SECURE_ENCLAVE_ARMV8_KERNELS) && defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+namespace {
+
+struct CpuFeatures {
+    bool aesGcm = false;
+    bool sha256 = false;
+};
+
+CpuFeatures detectCpuFeatures() {
+    CpuFeatures features;
+#if defined(NODE_SECURE_ENCLAVE_X86_KERNELS)
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        auto ssse3 = (ecx & bit_SSSE3) != 0;
+        auto sse41 = (ecx & bit_SSE4_1) != 0;
+        features.aesGcm = ssse3 && sse41 && (ecx & bit_AES) && (ecx & bit_PCLMUL);
+        if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+            features.sha256 = ssse3 && sse41 && (ebx & bit_SHA);
+        }
+    }
+#elif defined(NODE_SECURE_ENCLAVE_ARMV8_KERNELS) && defined(__linux__)
+    auto hwcap = getauxval(AT_HWCAP);
+    features.aesGcm = (hwcap & HWCAP_AES) && (hwcap & HWCAP_PMULL);
+    features.sha256 = (hwcap & HWCAP_SHA2) != 0;
+#elif defined(NODE_SECURE_ENCLAVE_ARMV8_KERNELS)
+    // the build targets a CPU with crypto extensions, every Apple silicon CPU has them
+    features.aesGcm = true;
+    features.sha256 = true;
+#endif
+    return features;
+}
+
+const CpuFeatures &cpuFeatures() {
+    static const auto features = detectCpuFeatures();
+    return features;
+}
+
+bool portableKernelsForced() {
+    auto env = getenv("NODE_SECURE_ENCLAVE_CRYPTO_KERNELS");
+    return env && strcmp(env, "portable") == 0;
+}
+
+std::vector<uint8_t> fromHex(const char *hex) {
+    std::vector<uint8_t> bytes(strlen(hex) / 2);
+    for (size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = uint8_t(std::stoul(std::string(hex + i * 2, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+std::vector<uint8_t> sequence(size_t length, uint8_t multiplier, uint8_t offset) {
+    std::vector<uint8_t> bytes(length);
+    for (size_t i = 0; i < length; i++) {
+        bytes[i] = uint8_t(i * multiplier + offset);
+    }
+    return bytes;
+}
+
+struct AesGcmVector {
+    std::vector<uint8_t> key;
+    std::vector<uint8_t> iv;
+    std::vector<uint8_t> aad;
+    std::vector<uint8_t> plaintext;
+    std::vector<uint8_t> ciphertext;
+    std::vector<uint8_t> tag;
+    // checked instead of ciphertext if it's not empty
+    std::vector<uint8_t> ciphertextDigest;
+};
+
+// test cases 2, 4, 6 and 16 from "The Galois/Counter Mode of Operation (GCM)",
+// and a longer message with a 16-byte IV like in ECIES that goes through the parallel code paths
+std::vector<AesGcmVector> aesGcmVectors() {
+    const char *key = "feffe9928665731c6d6a8f9467308308";
+    const char *plaintext = "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+                            "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39";
+    const char *aad = "feedfacedeadbeeffeedfacedeadbeefabaddad2";
+    const char *iv = "cafebabefacedbaddecaf888";
+    return {
+        {fromHex("00000000000000000000000000000000"), fromHex("000000000000000000000000"), {},
+         fromHex("00000000000000000000000000000000"), fromHex("0388dace60b6a392f328c2b971b2fe78"),
+         fromHex("ab6e47d42cec13bdf53a67b21257bddf"), {}},
+        {fromHex(key), fromHex(iv), fromHex(aad), fromHex(plaintext),
+         fromHex("42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+                 "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091"),
+         fromHex("5bc94fbc3221a5db94fae95ae7121a47"), {}},
+        {fromHex(key),
+         fromHex("9313225df88406e555909c5aff5269aa6a7a9538534f7da1e4c303d2a318a728"
+                 "c3c0c95156809539fcf0e2429a6b525416aedbf5a0de6a57a637b39b"),
+         fromHex(aad), fromHex(plaintext),
+         fromHex("8ce24998625615b603a033aca13fb894be9112a5c3a211a8ba262a3cca7e2ca7"
+                 "01e4a9a4fba43c90ccdcb281d48c7c6fd62875d2aca417034c34aee5"),
+         fromHex("619cc5aefffe0bfa462af43c1699d050"), {}},
+        {fromHex("feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308"), fromHex(iv), fromHex(aad),
+         fromHex(plaintext),
+         fromHex("522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+                 "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662"),
+         fromHex("76fc6ece0f4e1768cddf8853bb2d551b"), {}},
+        {sequence(32, 1, 0), sequence(16, 1, 0), sequence(20, 1, 0), sequence(517, 7, 3), {},
+         fromHex("c4b5d470d4e17fd25291ce182bf4286e"),
+         fromHex("6215a2e0cbf48e0812420333da0a3d6cccb839196338fc7b8a8a2ba67af28648")},
+    };
+}
+
+bool checkAesGcmVector(AesGcmKernel kernel, const AesGcmVector &vector) {
+    AesGcm aes(vector.key.data(), vector.key.size(), kernel);
+    auto length = vector.plaintext.size();
+
+    std::vector<uint8_t> ciphertext(length);
+    uint8_t tag[GCM_TAG_SIZE];
+    aes.encrypt(vector.iv.data(), vector.iv.size(), vector.aad.data(), vector.aad.size(), vector.plaintext.data(),
+                length, ciphertext.data(), tag);
+    if (memcmp(tag, vector.tag.data(), GCM_TAG_SIZE) != 0) {
+        return false;
+    }
+    if (vector.ciphertextDigest.empty()) {
+        if (ciphertext != vector.ciphertext) {
+            return false;
+        }
+    } else {
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        Sha256 sha(SHA256_KERNEL_PORTABLE);
+        sha.update(ciphertext.data(), length);
+        sha.finish(digest);
+        if (memcmp(digest, vector.ciphertextDigest.data(), SHA256_DIGEST_SIZE) != 0) {
+            return false;
+        }
+    }
+
+    std::vector<uint8_t> decrypted(length);
+    if (!aes.decrypt(vector.iv.data(), vector.iv.size(), vector.aad.data(), vector.aad.size(), ciphertext.data(),
+                     length, tag, decrypted.data()) ||
+        decrypted != vector.plaintext) {
+        return false;
+    }
+    tag[0] ^= 1;
+    return !aes.decrypt(vector.iv.data(), vector.iv.size(), vector.aad.data(), vector.aad.size(), ciphertext.data(),
+                        length, tag, decrypted.data());
+}
+
+bool checkSha256Vector(Sha256Kernel kernel, const std::string &message, size_t chunkSize, const char *expected) {
+    auto data = reinterpret_cast<const uint8_t *>(message.data());
+    Sha256 sha(kernel);
+    for (size_t offset = 0; offset < message.size(); offset += chunkSize) {
+        sha.update(data + offset, std::min(chunkSize, message.size() - offset));
+    }
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha.finish(digest);
+    return memcmp(digest, fromHex(expected).data(), SHA256_DIGEST_SIZE) == 0;
+}
+
+AesGcmKernel selectAesGcmKernel() {
+    if (portableKernelsForced()) {
+        return AES_GCM_KERNEL_PORTABLE;
+    }
+    for (auto kernel : {AES_GCM_KERNEL_AESNI, AES_GCM_KERNEL_ARMV8}) {
+        if (!aesGcmKernelSupported(kernel)) {
+            continue;
+        }
+        if (aesGcmKnownAnswerTest(kernel)) {
+            return kernel;
+        }
+        fprintf(stderr, "secure-enclave: %s AES-GCM failed known-answer tests, using portable code\n",
+                aesGcmKernelName(kernel));
+    }
+    return AES_GCM_KERNEL_PORTABLE;
+}
+
+Sha256Kernel selectSha256Kernel() {
+    if (portableKernelsForced()) {
+        return SHA256_KERNEL_PORTABLE;
+    }
+    for (auto kernel : {SHA256_KERNEL_SHANI, SHA256_KERNEL_ARMV8}) {
+        if (!sha256KernelSupported(kernel)) {
+            continue;
+        }
+        if (sha256KnownAnswerTest(kernel)) {
+            return kernel;
+        }
+        fprintf(stderr, "secure-enclave: %s SHA-256 failed known-answer tests, using portable code\n",
+                sha256KernelName(kernel));
+    }
+    return SHA256_KERNEL_PORTABLE;
+}
+
+} // namespace
+
+const char *aesGcmKernelName(AesGcmKernel kernel) {
+    switch (kernel) {
+    case AES_GCM_KERNEL_AESNI:
+        return "aesni";
+    case AES_GCM_KERNEL_ARMV8:
+        return "armv8";
+    default:
+        return "portable";
+    }
+}
+
+const char *sha256KernelName(Sha256Kernel kernel) {
+    switch (kernel) {
+    case SHA256_KERNEL_SHANI:
+        return "shani";
+    case SHA256_KERNEL_ARMV8:
+        return "armv8";
+    default:
+        return "portable";
+    }
+}
+
+bool aesGcmKernelSupported(AesGcmKernel kernel) {
+    if (kernel == AES_GCM_KERNEL_PORTABLE) {
+        return true;
+    }
+    return aesGcmHardwareKernel(kernel) && cpuFeatures().aesGcm;
+}
+
+bool sha256KernelSupported(Sha256Kernel kernel) {
+    if (kernel == SHA256_KERNEL_PORTABLE) {
+        return true;
+    }
+    return sha256HardwareCompress(kernel) && cpuFeatures().sha256;
+}
+
+bool aesGcmKnownAnswerTest(AesGcmKernel kernel) {
+    for (auto &vector : aesGcmVectors()) {
+        if (!checkAesGcmVector(kernel, vector)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sha256KnownAnswerTest(Sha256Kernel kernel) {
+    // FIPS 180-2 examples and a longer message hashed in parts that don't line up with blocks
+    return checkSha256Vector(kernel, "", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855") &&
+           checkSha256Vector(kernel, "abc", 3, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") &&
+           checkSha256Vector(kernel, "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56,
+                             "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") &&
+           checkSha256Vector(kernel, std::string(1000, 'a'), 7,
+                             "41edece42d63e8d9bf515a9ba6932e1c20cbc9f5a5d134645adb5db1b9737ea3");
+}
+
+AesGcmKernel aesGcmKernel() {
+    static const auto kernel = selectAesGcmKernel();
+    return kernel;
+}
+
+Sha256Kernel sha256Kernel() {
+    static const auto kernel = selectSha256Kernel();
+    return kernel;
+}
+
+const AesGcmHardwareKernel *aesGcmHardwareKernel(AesGcmKernel kernel) {
+    switch (kernel) {
+#ifdef NODE_SECURE_ENCLAVE_X86_KERNELS
+    case AES_GCM_KERNEL_AESNI:
+        return &AES_GCM_AESNI;
+#endif
+#ifdef NODE_SECURE_ENCLAVE_ARMV8_KERNELS
+    case AES_GCM_KERNEL_ARMV8:
+        return &AES_GCM_ARMV8;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+Sha256Compress sha256HardwareCompress(Sha256Kernel kernel) {
+    switch (kernel) {
+#ifdef NODE_SECURE_ENCLAVE_X86_KERNELS
+    case SHA256_KERNEL_SHANI:
+        return sha256CompressShaNi;
+#endif
+#ifdef NODE_SECURE_ENCLAVE_ARMV8_KERNELS
+    case SHA256_KERNEL_ARMV8:
+        return sha256CompressArmv8;
+#endif
+    default:
+        return nullptr;
+    }
+}
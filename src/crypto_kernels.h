@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Implementations of AES-GCM and SHA-256 used by AesGcm and Sha256, selected once per process.
+// A hardware kernel is selected if it's compiled in, the CPU supports it, and it passes known-answer tests,
+// otherwise the portable one is used. NODE_SECURE_ENCLAVE_CRYPTO_KERNELS=portable forces portable kernels.
+
+#if defined(__x86_64__)
+#define NODE_SECURE_ENCLAVE_X86_KERNELS
+#endif
+
+// ARMv8 crypto extensions are enabled by default on Apple silicon, other arm64 builds use portable kernels
+#if defined(__aarch64__) &&                                                                                          \
+    (defined(__ARM_FEATURE_CRYPTO) || (defined(__ARM_FEATURE_AES) && defined(__ARM_FEATURE_SHA2)))
+#define NODE_SECURE_ENCLAVE_ARMV8_KERNELS
+#endif
+
+enum AesGcmKernel { AES_GCM_KERNEL_PORTABLE, AES_GCM_KERNEL_AESNI, AES_GCM_KERNEL_ARMV8, AES_GCM_KERNEL_COUNT };
+enum Sha256Kernel { SHA256_KERNEL_PORTABLE, SHA256_KERNEL_SHANI, SHA256_KERNEL_ARMV8, SHA256_KERNEL_COUNT };
+
+const char *aesGcmKernelName(AesGcmKernel kernel);
+const char *sha256KernelName(Sha256Kernel kernel);
+
+// compiled in and supported by the CPU
+bool aesGcmKernelSupported(AesGcmKernel kernel);
+bool sha256KernelSupported(Sha256Kernel kernel);
+
+// the kernel must be supported
+bool aesGcmKnownAnswerTest(AesGcmKernel kernel);
+bool sha256KnownAnswerTest(Sha256Kernel kernel);
+
+// kernels used by default, selected on the first call
+AesGcmKernel aesGcmKernel();
+Sha256Kernel sha256Kernel();
+
+// Hardware AES-GCM, round keys are stored as bytes and GHASH works with precomputed powers of H.
+struct AesGcmHardwareKernel {
+    // converts big-endian round key words to bytes and fills hPowers with H, H^2, H^3, H^4
+    void (*init)(const uint32_t *roundKeyWords, int rounds, uint8_t *roundKeys, uint8_t *hPowers);
+    void (*encryptBlock)(const uint8_t *roundKeys, int rounds, const uint8_t *in, uint8_t *out);
+    // increments the 32-bit counter before each block
+    void (*ctr)(const uint8_t *roundKeys, int rounds, uint8_t *counter, const uint8_t *in, size_t length,
+                uint8_t *out);
+    // y is the GHASH state as a block, a partial last block is padded with zeros
+    void (*ghash)(const uint8_t *hPowers, uint8_t *y, const uint8_t *data, size_t length);
+};
+
+constexpr size_t AES_GCM_HARDWARE_ROUND_KEYS_SIZE = 15 * 16;
+constexpr size_t AES_GCM_HARDWARE_H_POWERS_SIZE = 4 * 16;
+
+using Sha256Compress = void (*)(uint32_t *state, const uint8_t *blocks, size_t blockCount);
+
+// round constants, defined in sha256.cpp
+extern const uint32_t SHA256_K[64];
+
+#ifdef NODE_SECURE_ENCLAVE_X86_KERNELS
+extern const AesGcmHardwareKernel AES_GCM_AESNI;
+void sha256CompressShaNi(uint32_t *state, const uint8_t *blocks, size_t blockCount);
+#endif
+
+#ifdef NODE_SECURE_ENCLAVE_ARMV8_KERNELS
+extern const AesGcmHardwareKernel AES_GCM_ARMV8;
+void sha256CompressArmv8(uint32_t *state, const uint8_t *blocks, size_t blockCount);
+#endif
+
+// null for the portable kernel
+const AesGcmHardwareKernel *aesGcmHardwareKernel(AesGcmKernel kernel);
+Sha256Compress sha256HardwareCompress(Sha256Kernel kernel);
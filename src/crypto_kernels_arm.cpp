@@ -0,0 +1,259 @@
+#include "crypto_kernels.h"
+
+#ifdef NODE_SECURE_ENCLAVE_ARMV8_KERNELS
+
+#include <arm_neon.h>
+#include <cstring>
+
+#include "secure_memory.h"
+
+namespace {
+
+// blocks encrypted at once to hide the latency of AESE and AESMC
+constexpr size_t CTR_PARALLEL_BLOCKS = 8;
+// blocks multiplied by H^4..H^1 and reduced once
+constexpr size_t GHASH_PARALLEL_BLOCKS = 4;
+
+constexpr size_t BLOCK_SIZE = 16;
+
+inline uint32_t loadBigEndian32(const uint8_t *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline void storeBigEndian32(uint8_t *p, uint32_t x) {
+    p[0] = uint8_t(x >> 24);
+    p[1] = uint8_t(x >> 16);
+    p[2] = uint8_t(x >> 8);
+    p[3] = uint8_t(x);
+}
+
+// GHASH works with blocks as 128-bit big-endian numbers
+inline uint32x4_t loadSwapped(const uint8_t *p) {
+    auto reversed = vrev64q_u8(vld1q_u8(p));
+    return vreinterpretq_u32_u8(vextq_u8(reversed, reversed, 8));
+}
+
+inline void storeSwapped(uint8_t *p, uint32x4_t x) {
+    auto reversed = vrev64q_u8(vreinterpretq_u8_u32(x));
+    vst1q_u8(p, vextq_u8(reversed, reversed, 8));
+}
+
+// same as _mm_slli_si128 and _mm_srli_si128
+template <int N> inline uint32x4_t shiftLeftBytes(uint32x4_t x) {
+    return vreinterpretq_u32_u8(vextq_u8(vdupq_n_u8(0), vreinterpretq_u8_u32(x), 16 - N));
+}
+
+template <int N> inline uint32x4_t shiftRightBytes(uint32x4_t x) {
+    return vreinterpretq_u32_u8(vextq_u8(vreinterpretq_u8_u32(x), vdupq_n_u8(0), N));
+}
+
+inline uint8x16_t encrypt(const uint8x16_t *roundKeys, int rounds, uint8x16_t block) {
+    for (int round = 0; round < rounds - 1; round++) {
+        block = vaesmcq_u8(vaeseq_u8(block, roundKeys[round]));
+    }
+    return veorq_u8(vaeseq_u8(block, roundKeys[rounds - 1]), roundKeys[rounds]);
+}
+
+inline void loadRoundKeys(const uint8_t *roundKeys, int rounds, uint8x16_t *loaded) {
+    for (int round = 0; round <= rounds; round++) {
+        loaded[round] = vld1q_u8(roundKeys + round * BLOCK_SIZE);
+    }
+}
+
+inline uint32x4_t clmul(uint64_t a, uint64_t b) {
+    return vreinterpretq_u32_u8(vreinterpretq_u8_p128(vmull_p64(poly64_t(a), poly64_t(b))));
+}
+
+// adds the 256-bit carry-less product of a and b to lo, mid and hi, mid overlaps both halves
+inline void clmulAccumulate(uint32x4_t a, uint32x4_t b, uint32x4_t &lo, uint32x4_t &mid, uint32x4_t &hi) {
+    auto a0 = vgetq_lane_u64(vreinterpretq_u64_u32(a), 0);
+    auto a1 = vgetq_lane_u64(vreinterpretq_u64_u32(a), 1);
+    auto b0 = vgetq_lane_u64(vreinterpretq_u64_u32(b), 0);
+    auto b1 = vgetq_lane_u64(vreinterpretq_u64_u32(b), 1);
+    lo = veorq_u32(lo, clmul(a0, b0));
+    mid = veorq_u32(mid, veorq_u32(clmul(a0, b1), clmul(a1, b0)));
+    hi = veorq_u32(hi, clmul(a1, b1));
+}
+
+// reduces an accumulated product modulo x^128 + x^7 + x^2 + x + 1 in the bit-reflected GCM representation,
+// step by step the same as the AES-NI kernel
+inline uint32x4_t reduce(uint32x4_t lo, uint32x4_t mid, uint32x4_t hi) {
+    lo = veorq_u32(lo, shiftLeftBytes<8>(mid));
+    hi = veorq_u32(hi, shiftRightBytes<8>(mid));
+
+    // the product of reflected values is one bit short, shift the 256-bit value left
+    auto loCarry = vshrq_n_u32(lo, 31);
+    auto hiCarry = vshrq_n_u32(hi, 31);
+    lo = vorrq_u32(vshlq_n_u32(lo, 1), shiftLeftBytes<4>(loCarry));
+    hi = vorrq_u32(vshlq_n_u32(hi, 1), shiftLeftBytes<4>(hiCarry));
+    hi = vorrq_u32(hi, shiftRightBytes<12>(loCarry));
+
+    auto a = veorq_u32(veorq_u32(vshlq_n_u32(lo, 31), vshlq_n_u32(lo, 30)), vshlq_n_u32(lo, 25));
+    lo = veorq_u32(lo, shiftLeftBytes<12>(a));
+    auto b = veorq_u32(veorq_u32(vshrq_n_u32(lo, 1), vshrq_n_u32(lo, 2)), vshrq_n_u32(lo, 7));
+    b = veorq_u32(b, shiftRightBytes<4>(a));
+    return veorq_u32(hi, veorq_u32(lo, b));
+}
+
+inline uint32x4_t gfMultiply(uint32x4_t a, uint32x4_t b) {
+    auto lo = vdupq_n_u32(0), mid = vdupq_n_u32(0), hi = vdupq_n_u32(0);
+    clmulAccumulate(a, b, lo, mid, hi);
+    return reduce(lo, mid, hi);
+}
+
+void armv8EncryptBlock(const uint8_t *roundKeys, int rounds, const uint8_t *in, uint8_t *out) {
+    auto block = vld1q_u8(in);
+    for (int round = 0; round < rounds - 1; round++) {
+        block = vaesmcq_u8(vaeseq_u8(block, vld1q_u8(roundKeys + round * BLOCK_SIZE)));
+    }
+    block = vaeseq_u8(block, vld1q_u8(roundKeys + (rounds - 1) * BLOCK_SIZE));
+    vst1q_u8(out, veorq_u8(block, vld1q_u8(roundKeys + rounds * BLOCK_SIZE)));
+}
+
+void armv8Init(const uint32_t *roundKeyWords, int rounds, uint8_t *roundKeys, uint8_t *hPowers) {
+    for (int i = 0; i < 4 * (rounds + 1); i++) {
+        storeBigEndian32(roundKeys + i * 4, roundKeyWords[i]);
+    }
+
+    uint8_t h[BLOCK_SIZE] = {0};
+    armv8EncryptBlock(roundKeys, rounds, h, h);
+    auto h1 = loadSwapped(h);
+    secureZero(h, sizeof(h));
+
+    auto power = h1;
+    for (size_t i = 0; i < GHASH_PARALLEL_BLOCKS; i++) {
+        vst1q_u32(reinterpret_cast<uint32_t *>(hPowers + i * BLOCK_SIZE), power);
+        power = gfMultiply(power, h1);
+    }
+}
+
+inline uint8x16_t counterBlock(uint32x4_t base, uint32_t value) {
+    return vreinterpretq_u8_u32(vsetq_lane_u32(__builtin_bswap32(value), base, 3));
+}
+
+void armv8Ctr(const uint8_t *roundKeys, int rounds, uint8_t *counter, const uint8_t *in, size_t length,
+              uint8_t *out) {
+    uint8x16_t loaded[15];
+    loadRoundKeys(roundKeys, rounds, loaded);
+    auto base = vreinterpretq_u32_u8(vld1q_u8(counter));
+    auto value = loadBigEndian32(counter + 12);
+
+    while (length >= CTR_PARALLEL_BLOCKS * BLOCK_SIZE) {
+        uint8x16_t blocks[CTR_PARALLEL_BLOCKS];
+        for (size_t i = 0; i < CTR_PARALLEL_BLOCKS; i++) {
+            blocks[i] = counterBlock(base, value + uint32_t(i) + 1);
+        }
+        for (int round = 0; round < rounds - 1; round++) {
+            for (size_t i = 0; i < CTR_PARALLEL_BLOCKS; i++) {
+                blocks[i] = vaesmcq_u8(vaeseq_u8(blocks[i], loaded[round]));
+            }
+        }
+        for (size_t i = 0; i < CTR_PARALLEL_BLOCKS; i++) {
+            blocks[i] = veorq_u8(vaeseq_u8(blocks[i], loaded[rounds - 1]), loaded[rounds]);
+            vst1q_u8(out + i * BLOCK_SIZE, veorq_u8(vld1q_u8(in + i * BLOCK_SIZE), blocks[i]));
+        }
+        value += CTR_PARALLEL_BLOCKS;
+        in += CTR_PARALLEL_BLOCKS * BLOCK_SIZE;
+        out += CTR_PARALLEL_BLOCKS * BLOCK_SIZE;
+        length -= CTR_PARALLEL_BLOCKS * BLOCK_SIZE;
+    }
+
+    while (length > 0) {
+        value++;
+        auto keyStream = encrypt(loaded, rounds, counterBlock(base, value));
+        if (length >= BLOCK_SIZE) {
+            vst1q_u8(out, veorq_u8(vld1q_u8(in), keyStream));
+            in += BLOCK_SIZE;
+            out += BLOCK_SIZE;
+            length -= BLOCK_SIZE;
+        } else {
+            uint8_t block[BLOCK_SIZE];
+            vst1q_u8(block, keyStream);
+            for (size_t i = 0; i < length; i++) {
+                out[i] = in[i] ^ block[i];
+            }
+            secureZero(block, sizeof(block));
+            length = 0;
+        }
+    }
+    storeBigEndian32(counter + 12, value);
+}
+
+void armv8Ghash(const uint8_t *hPowers, uint8_t *y, const uint8_t *data, size_t length) {
+    uint32x4_t h[GHASH_PARALLEL_BLOCKS];
+    for (size_t i = 0; i < GHASH_PARALLEL_BLOCKS; i++) {
+        h[i] = vld1q_u32(reinterpret_cast<const uint32_t *>(hPowers + i * BLOCK_SIZE));
+    }
+    auto state = loadSwapped(y);
+
+    while (length >= GHASH_PARALLEL_BLOCKS * BLOCK_SIZE) {
+        auto lo = vdupq_n_u32(0), mid = vdupq_n_u32(0), hi = vdupq_n_u32(0);
+        // (((y + x0) * H + x1) * H + x2) * H + x3) * H = (y + x0) * H^4 + x1 * H^3 + x2 * H^2 + x3 * H
+        clmulAccumulate(veorq_u32(state, loadSwapped(data)), h[3], lo, mid, hi);
+        for (size_t i = 1; i < GHASH_PARALLEL_BLOCKS; i++) {
+            clmulAccumulate(loadSwapped(data + i * BLOCK_SIZE), h[GHASH_PARALLEL_BLOCKS - 1 - i], lo, mid, hi);
+        }
+        state = reduce(lo, mid, hi);
+        data += GHASH_PARALLEL_BLOCKS * BLOCK_SIZE;
+        length -= GHASH_PARALLEL_BLOCKS * BLOCK_SIZE;
+    }
+
+    while (length > 0) {
+        uint32x4_t block;
+        if (length >= BLOCK_SIZE) {
+            block = loadSwapped(data);
+            data += BLOCK_SIZE;
+            length -= BLOCK_SIZE;
+        } else {
+            uint8_t padded[BLOCK_SIZE] = {0};
+            memcpy(padded, data, length);
+            block = loadSwapped(padded);
+            length = 0;
+        }
+        state = gfMultiply(veorq_u32(state, block), h[0]);
+    }
+    storeSwapped(y, state);
+}
+
+} // namespace
+
+const AesGcmHardwareKernel AES_GCM_ARMV8 = {armv8Init, armv8EncryptBlock, armv8Ctr, armv8Ghash};
+
+void sha256CompressArmv8(uint32_t *state, const uint8_t *blocks, size_t blockCount) {
+    auto abcd = vld1q_u32(state);
+    auto efgh = vld1q_u32(state + 4);
+
+    for (; blockCount > 0; blockCount--, blocks += 64) {
+        auto abcdSaved = abcd;
+        auto efghSaved = efgh;
+
+        // message words for the current and the next three groups of four rounds
+        uint32x4_t w[4];
+        for (int i = 0; i < 4; i++) {
+            w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + i * 16)));
+        }
+        // unrolled, so that message words stay in registers
+#pragma GCC unroll 16
+        for (int group = 0; group < 16; group++) {
+            auto &current = w[group % 4];
+            auto wk = vaddq_u32(current, vld1q_u32(SHA256_K + group * 4));
+            if (group < 12) {
+                current = vsha256su0q_u32(current, w[(group + 1) % 4]);
+            }
+            auto abcdPrevious = abcd;
+            abcd = vsha256hq_u32(abcd, efgh, wk);
+            efgh = vsha256h2q_u32(efgh, abcdPrevious, wk);
+            if (group < 12) {
+                current = vsha256su1q_u32(current, w[(group + 2) % 4], w[(group + 3) % 4]);
+            }
+        }
+
+        abcd = vaddq_u32(abcd, abcdSaved);
+        efgh = vaddq_u32(efgh, efghSaved);
+    }
+
+    vst1q_u32(state, abcd);
+    vst1q_u32(state + 4, efgh);
+}
+
+#endif
@@ -0,0 +1,254 @@
+#include "crypto_kernels.h"
+
+#ifdef NODE_SECURE_ENCLAVE_X86_KERNELS
+
+#include <cstring>
+#include <immintrin.h>
+
+#include "secure_memory.h"
+
+// functions are compiled for these extensions without changing build flags, they are called only if CPUID has them
+#define TARGET_AESNI __attribute__((target("aes,pclmul,ssse3,sse4.1")))
+#define TARGET_SHANI __attribute__((target("sha,ssse3,sse4.1")))
+
+namespace {
+
+// blocks encrypted at once to hide the latency of AESENC
+constexpr size_t CTR_PARALLEL_BLOCKS = 8;
+// blocks multiplied by H^4..H^1 and reduced once
+constexpr size_t GHASH_PARALLEL_BLOCKS = 4;
+
+constexpr size_t BLOCK_SIZE = 16;
+
+inline uint32_t loadBigEndian32(const uint8_t *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline void storeBigEndian32(uint8_t *p, uint32_t x) {
+    p[0] = uint8_t(x >> 24);
+    p[1] = uint8_t(x >> 16);
+    p[2] = uint8_t(x >> 8);
+    p[3] = uint8_t(x);
+}
+
+TARGET_AESNI inline __m128i load(const uint8_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+
+TARGET_AESNI inline void store(uint8_t *p, __m128i x) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), x); }
+
+// GHASH works with blocks as 128-bit big-endian numbers
+TARGET_AESNI inline __m128i byteSwap(__m128i x) {
+    return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+TARGET_AESNI inline __m128i encrypt(const __m128i *roundKeys, int rounds, __m128i block) {
+    block = _mm_xor_si128(block, roundKeys[0]);
+    for (int round = 1; round < rounds; round++) {
+        block = _mm_aesenc_si128(block, roundKeys[round]);
+    }
+    return _mm_aesenclast_si128(block, roundKeys[rounds]);
+}
+
+TARGET_AESNI inline void loadRoundKeys(const uint8_t *roundKeys, int rounds, __m128i *loaded) {
+    for (int round = 0; round <= rounds; round++) {
+        loaded[round] = load(roundKeys + round * BLOCK_SIZE);
+    }
+}
+
+// adds the 256-bit carry-less product of a and b to lo, mid and hi, mid overlaps both halves
+TARGET_AESNI inline void clmulAccumulate(__m128i a, __m128i b, __m128i &lo, __m128i &mid, __m128i &hi) {
+    lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(a, b, 0x00));
+    mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x10));
+    mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x01));
+    hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(a, b, 0x11));
+}
+
+// reduces an accumulated product modulo x^128 + x^7 + x^2 + x + 1 in the bit-reflected GCM representation
+TARGET_AESNI inline __m128i reduce(__m128i lo, __m128i mid, __m128i hi) {
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    // the product of reflected values is one bit short, shift the 256-bit value left
+    auto loCarry = _mm_srli_epi32(lo, 31);
+    auto hiCarry = _mm_srli_epi32(hi, 31);
+    lo = _mm_or_si128(_mm_slli_epi32(lo, 1), _mm_slli_si128(loCarry, 4));
+    hi = _mm_or_si128(_mm_slli_epi32(hi, 1), _mm_slli_si128(hiCarry, 4));
+    hi = _mm_or_si128(hi, _mm_srli_si128(loCarry, 12));
+
+    auto a = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+    lo = _mm_xor_si128(lo, _mm_slli_si128(a, 12));
+    auto b = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+    b = _mm_xor_si128(b, _mm_srli_si128(a, 4));
+    return _mm_xor_si128(hi, _mm_xor_si128(lo, b));
+}
+
+TARGET_AESNI inline __m128i gfMultiply(__m128i a, __m128i b) {
+    auto lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    clmulAccumulate(a, b, lo, mid, hi);
+    return reduce(lo, mid, hi);
+}
+
+TARGET_AESNI void aesniEncryptBlock(const uint8_t *roundKeys, int rounds, const uint8_t *in, uint8_t *out) {
+    auto block = _mm_xor_si128(load(in), load(roundKeys));
+    for (int round = 1; round < rounds; round++) {
+        block = _mm_aesenc_si128(block, load(roundKeys + round * BLOCK_SIZE));
+    }
+    store(out, _mm_aesenclast_si128(block, load(roundKeys + rounds * BLOCK_SIZE)));
+}
+
+TARGET_AESNI void aesniInit(const uint32_t *roundKeyWords, int rounds, uint8_t *roundKeys, uint8_t *hPowers) {
+    for (int i = 0; i < 4 * (rounds + 1); i++) {
+        storeBigEndian32(roundKeys + i * 4, roundKeyWords[i]);
+    }
+
+    uint8_t h[BLOCK_SIZE] = {0};
+    aesniEncryptBlock(roundKeys, rounds, h, h);
+    auto h1 = byteSwap(load(h));
+    secureZero(h, sizeof(h));
+
+    auto power = h1;
+    for (size_t i = 0; i < GHASH_PARALLEL_BLOCKS; i++) {
+        store(hPowers + i * BLOCK_SIZE, power);
+        power = gfMultiply(power, h1);
+    }
+}
+
+TARGET_AESNI void aesniCtr(const uint8_t *roundKeys, int rounds, uint8_t *counter, const uint8_t *in, size_t length,
+                           uint8_t *out) {
+    __m128i loaded[15];
+    loadRoundKeys(roundKeys, rounds, loaded);
+    auto base = load(counter);
+    auto value = loadBigEndian32(counter + 12);
+
+    while (length >= CTR_PARALLEL_BLOCKS * BLOCK_SIZE) {
+        __m128i blocks[CTR_PARALLEL_BLOCKS];
+        for (size_t i = 0; i < CTR_PARALLEL_BLOCKS; i++) {
+            auto block = _mm_insert_epi32(base, int(__builtin_bswap32(value + uint32_t(i) + 1)), 3);
+            blocks[i] = _mm_xor_si128(block, loaded[0]);
+        }
+        for (int round = 1; round < rounds; round++) {
+            for (size_t i = 0; i < CTR_PARALLEL_BLOCKS; i++) {
+                blocks[i] = _mm_aesenc_si128(blocks[i], loaded[round]);
+            }
+        }
+        for (size_t i = 0; i < CTR_PARALLEL_BLOCKS; i++) {
+            blocks[i] = _mm_aesenclast_si128(blocks[i], loaded[rounds]);
+            store(out + i * BLOCK_SIZE, _mm_xor_si128(load(in + i * BLOCK_SIZE), blocks[i]));
+        }
+        value += CTR_PARALLEL_BLOCKS;
+        in += CTR_PARALLEL_BLOCKS * BLOCK_SIZE;
+        out += CTR_PARALLEL_BLOCKS * BLOCK_SIZE;
+        length -= CTR_PARALLEL_BLOCKS * BLOCK_SIZE;
+    }
+
+    while (length > 0) {
+        value++;
+        auto keyStream = encrypt(loaded, rounds, _mm_insert_epi32(base, int(__builtin_bswap32(value)), 3));
+        if (length >= BLOCK_SIZE) {
+            store(out, _mm_xor_si128(load(in), keyStream));
+            in += BLOCK_SIZE;
+            out += BLOCK_SIZE;
+            length -= BLOCK_SIZE;
+        } else {
+            uint8_t block[BLOCK_SIZE];
+            store(block, keyStream);
+            for (size_t i = 0; i < length; i++) {
+                out[i] = in[i] ^ block[i];
+            }
+            secureZero(block, sizeof(block));
+            length = 0;
+        }
+    }
+    storeBigEndian32(counter + 12, value);
+}
+
+TARGET_AESNI void aesniGhash(const uint8_t *hPowers, uint8_t *y, const uint8_t *data, size_t length) {
+    __m128i h[GHASH_PARALLEL_BLOCKS];
+    for (size_t i = 0; i < GHASH_PARALLEL_BLOCKS; i++) {
+        h[i] = load(hPowers + i * BLOCK_SIZE);
+    }
+    auto state = byteSwap(load(y));
+
+    while (length >= GHASH_PARALLEL_BLOCKS * BLOCK_SIZE) {
+        auto lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        // (((y + x0) * H + x1) * H + x2) * H + x3) * H = (y + x0) * H^4 + x1 * H^3 + x2 * H^2 + x3 * H
+        clmulAccumulate(_mm_xor_si128(state, byteSwap(load(data))), h[3], lo, mid, hi);
+        for (size_t i = 1; i < GHASH_PARALLEL_BLOCKS; i++) {
+            clmulAccumulate(byteSwap(load(data + i * BLOCK_SIZE)), h[GHASH_PARALLEL_BLOCKS - 1 - i], lo, mid, hi);
+        }
+        state = reduce(lo, mid, hi);
+        data += GHASH_PARALLEL_BLOCKS * BLOCK_SIZE;
+        length -= GHASH_PARALLEL_BLOCKS * BLOCK_SIZE;
+    }
+
+    while (length > 0) {
+        __m128i block;
+        if (length >= BLOCK_SIZE) {
+            block = load(data);
+            data += BLOCK_SIZE;
+            length -= BLOCK_SIZE;
+        } else {
+            uint8_t padded[BLOCK_SIZE] = {0};
+            memcpy(padded, data, length);
+            block = load(padded);
+            length = 0;
+        }
+        state = gfMultiply(_mm_xor_si128(state, byteSwap(block)), h[0]);
+    }
+    store(y, byteSwap(state));
+}
+
+} // namespace
+
+const AesGcmHardwareKernel AES_GCM_AESNI = {aesniInit, aesniEncryptBlock, aesniCtr, aesniGhash};
+
+TARGET_SHANI void sha256CompressShaNi(uint32_t *state, const uint8_t *blocks, size_t blockCount) {
+    const auto byteSwapWords = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // SHA256RNDS2 keeps the state as ABEF and CDGH
+    auto dcba = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state));
+    auto hgfe = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4));
+    auto cdab = _mm_shuffle_epi32(dcba, 0xb1);
+    auto efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+    auto abef = _mm_alignr_epi8(cdab, efgh, 8);
+    auto cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+
+    for (; blockCount > 0; blockCount--, blocks += 64) {
+        auto abefSaved = abef;
+        auto cdghSaved = cdgh;
+
+        // message words for the current and the next three groups of four rounds
+        __m128i w[4];
+        // unrolled, so that message words stay in registers
+#pragma GCC unroll 16
+        for (int group = 0; group < 16; group++) {
+            auto &current = w[group % 4];
+            if (group < 4) {
+                current = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks + group * 16)), byteSwapWords);
+            }
+            auto k = _mm_loadu_si128(reinterpret_cast<const __m128i *>(SHA256_K + group * 4));
+            auto wk = _mm_add_epi32(current, k);
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+            if (group >= 3 && group < 15) {
+                auto &next = w[(group + 1) % 4];
+                next = _mm_add_epi32(next, _mm_alignr_epi8(current, w[(group + 3) % 4], 4));
+                next = _mm_sha256msg2_epu32(next, current);
+            }
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0e));
+            if (group >= 1 && group < 13) {
+                auto &previous = w[(group + 3) % 4];
+                previous = _mm_sha256msg1_epu32(previous, current);
+            }
+        }
+
+        abef = _mm_add_epi32(abef, abefSaved);
+        cdgh = _mm_add_epi32(cdgh, cdghSaved);
+    }
+
+    auto feba = _mm_shuffle_epi32(abef, 0x1b);
+    auto dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+#endif
@@ -0,0 +1,280 @@
+#include "decrypt_scheduler.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "addon_data.h"
+#include "async_operation.h"
+#include "envelope.h"
+#include "helpers.h"
+#include "secure_memory.h"
+#include "worker_pool.h"
+
+namespace {
+
+constexpr const char *ABORTED_MESSAGE = "The operation was aborted";
+constexpr const char *TIMED_OUT_MESSAGE = "The operation has timed out";
+
+} // namespace
+
+// Decrypts calls for one keyTag after one prompt and settles all of them with one hop to the JS thread.
+// Its own promise is not returned to JS, each call has a promise of its own.
+class DecryptBatchOperation : public AuthenticatedOperation {
+  private:
+    struct Item {
+        DecryptRequest request;
+        SecureBytes decryptedData;
+        BackendError error;
+        // rejected while a worker could be decrypting it, the result is dropped
+        bool aborted;
+    };
+
+    DecryptScheduler *scheduler_;
+    std::shared_ptr<KeyIndex> keyIndex_;
+    std::string keyTag_;
+    std::mutex mutex_;
+    // appended on the JS thread until execute closes the batch
+    std::vector<Item> items_;
+    bool closed_ = false;
+    // all calls were aborted before the user has authenticated, the prompt has been dismissed
+    bool cancelled_ = false;
+
+    void settled(Napi::Env env, Napi::Promise::Deferred &deferred) {
+        deferred.Resolve(env.Undefined());
+        scheduler_->active_ = nullptr;
+        scheduler_->startNext(env);
+    }
+
+  protected:
+    void execute() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        if (items_.empty()) {
+            // all calls were aborted right after the user has authenticated
+            return;
+        }
+
+        std::unique_ptr<KeyPair> keyPair;
+        {
+            PhaseTimer timer(this, PHASE_LOOKUP);
+            error_ = getBackend().findKeyPair(keyTag_, authContext_.get(), keyPair);
+            removeMissingKeyFromIndex(keyIndex_, keyTag_, error_);
+        }
+        if (error_) {
+            return;
+        }
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        getWorkerPool().parallelFor(items_.size(), [this, &keyPair](size_t index) {
+            auto &item = items_[index];
+            item.error = decryptWithKeyPair(*keyPair, item.request.data, item.request.length, item.decryptedData);
+        });
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        for (auto &item : items_) {
+            if (item.aborted) {
+                continue;
+            }
+            scheduler_->unwatch(item.request);
+            if (item.error) {
+                item.request.deferred.Reject(createBackendError(env, item.error).Value());
+            } else {
+                item.request.deferred.Resolve(bytesToExternalBuffer(env, std::move(item.decryptedData)));
+            }
+        }
+        settled(env, deferred);
+    }
+
+    void reject(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        auto error = createError(env);
+        for (auto &item : items_) {
+            if (item.aborted) {
+                continue;
+            }
+            scheduler_->unwatch(item.request);
+            item.request.deferred.Reject(error);
+        }
+        settled(env, deferred);
+    }
+
+  public:
+    DecryptBatchOperation(Napi::Env env, DecryptScheduler *scheduler, const std::string &keyTag,
+                          std::deque<DecryptRequest> &requests)
+        : AuthenticatedOperation(env, Napi::Promise::Deferred::New(env), "decrypt"), scheduler_(scheduler),
+          keyIndex_(getAddonData(env).keyIndex), keyTag_(keyTag) {
+        items_.reserve(requests.size());
+        for (auto &request : requests) {
+            items_.push_back(Item{std::move(request), SecureBytes(), BackendError(), false});
+        }
+    }
+
+    const std::string &keyTag() const { return keyTag_; }
+
+    // joins the call to the batch unless the user has already authenticated or the batch is full
+    bool tryAdd(DecryptRequest &request, size_t limit) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_ || cancelled_ || items_.size() >= limit) {
+            return false;
+        }
+        items_.push_back(Item{std::move(request), SecureBytes(), BackendError(), false});
+        return true;
+    }
+
+    // rejects a call of this batch, the prompt is dismissed if no calls are left
+    void abort(uint64_t id, const char *message) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = std::find_if(items_.begin(), items_.end(),
+                               [id](const Item &item) { return item.request.id == id && !item.aborted; });
+        if (it == items_.end()) {
+            return;
+        }
+        if (closed_) {
+            // a worker can be using the input, so it stays pinned until the batch is complete
+            lock.unlock();
+            it->aborted = true;
+            scheduler_->rejectAborted(it->request, message);
+            return;
+        }
+        auto request = std::move(it->request);
+        items_.erase(it);
+        cancelled_ = items_.empty();
+        lock.unlock();
+        scheduler_->rejectAborted(request, message);
+        if (cancelled_) {
+            cancelAuthentication();
+        }
+    }
+
+    size_t pendingCount() const {
+        return size_t(std::count_if(items_.begin(), items_.end(), [](const Item &item) { return !item.aborted; }));
+    }
+};
+
+void DecryptScheduler::enqueue(Napi::Env env, const std::string &keyTag, DecryptRequest request,
+                               const DecryptAbortOptions &abortOptions) {
+    if (!abortOptions.signal.IsEmpty() && abortOptions.signal.Get("aborted").ToBoolean().Value()) {
+        rejectWithMessageAndProp(request.deferred, ABORTED_MESSAGE, "aborted");
+        return;
+    }
+    watch(env, request, abortOptions);
+
+    if (active_ && active_->keyTag() == keyTag && active_->tryAdd(request, queueLimit_)) {
+        return;
+    }
+
+    auto &queue = pending_[keyTag];
+    if (queue.size() >= queueLimit_) {
+        unwatch(request);
+        rejectWithMessageAndProp(request.deferred, "Too many pending decrypt calls for this keyTag", "queueFull");
+        return;
+    }
+    if (queue.empty()) {
+        turns_.push_back(keyTag);
+    }
+    queue.push_back(std::move(request));
+
+    if (!active_) {
+        startNext(env);
+    }
+}
+
+void DecryptScheduler::watch(Napi::Env env, DecryptRequest &request, const DecryptAbortOptions &abortOptions) {
+    if (abortOptions.signal.IsEmpty() && abortOptions.timeoutMs <= 0) {
+        return;
+    }
+    auto id = nextId_++;
+    request.id = id;
+
+    if (!abortOptions.signal.IsEmpty()) {
+        auto listener =
+            Napi::Function::New(env, [this, id](const Napi::CallbackInfo &) { abort(id, ABORTED_MESSAGE); });
+        abortOptions.signal.Get("addEventListener")
+            .As<Napi::Function>()
+            .Call(abortOptions.signal, {Napi::String::New(env, "abort"), listener});
+        request.signal = Napi::Persistent(abortOptions.signal);
+        request.abortListener = Napi::Persistent(listener);
+    }
+
+    if (abortOptions.timeoutMs > 0) {
+        auto onTimeout =
+            Napi::Function::New(env, [this, id](const Napi::CallbackInfo &) { abort(id, TIMED_OUT_MESSAGE); });
+        auto timer = env.Global().Get("setTimeout").As<Napi::Function>().Call(
+            {onTimeout, Napi::Number::New(env, abortOptions.timeoutMs)});
+        // timers are objects in Node.js; a timer id of another host can't be cleared, the callback does nothing then
+        if (timer.IsObject()) {
+            request.timer = Napi::Persistent(timer.As<Napi::Object>());
+        }
+    }
+}
+
+void DecryptScheduler::unwatch(DecryptRequest &request) {
+    auto env = request.deferred.Env();
+    if (!request.abortListener.IsEmpty()) {
+        auto signal = request.signal.Value();
+        signal.Get("removeEventListener")
+            .As<Napi::Function>()
+            .Call(signal, {Napi::String::New(env, "abort"), request.abortListener.Value()});
+        request.abortListener.Reset();
+        request.signal.Reset();
+    }
+    if (!request.timer.IsEmpty()) {
+        env.Global().Get("clearTimeout").As<Napi::Function>().Call({request.timer.Value()});
+        request.timer.Reset();
+    }
+}
+
+void DecryptScheduler::abort(uint64_t id, const char *message) {
+    for (auto entry = pending_.begin(); entry != pending_.end(); entry++) {
+        auto &queue = entry->second;
+        auto it = std::find_if(queue.begin(), queue.end(), [id](const DecryptRequest &request) {
+            return request.id == id;
+        });
+        if (it == queue.end()) {
+            continue;
+        }
+        auto request = std::move(*it);
+        queue.erase(it);
+        if (queue.empty()) {
+            turns_.erase(std::find(turns_.begin(), turns_.end(), entry->first));
+            pending_.erase(entry);
+        }
+        rejectAborted(request, message);
+        return;
+    }
+    if (active_) {
+        active_->abort(id, message);
+    }
+}
+
+void DecryptScheduler::rejectAborted(DecryptRequest &request, const char *message) {
+    unwatch(request);
+    rejectWithMessageAndProp(request.deferred, message, "aborted");
+}
+
+void DecryptScheduler::startNext(Napi::Env env) {
+    if (turns_.empty()) {
+        return;
+    }
+    auto keyTag = turns_.front();
+    turns_.pop_front();
+    auto entry = pending_.find(keyTag);
+    auto requests = std::move(entry->second);
+    pending_.erase(entry);
+
+    auto touchIdPrompt = requests.front().touchIdPrompt;
+    active_ = new DecryptBatchOperation(env, this, keyTag, requests);
+    active_->start(touchIdPrompt);
+}
+
+void DecryptScheduler::setQueueLimit(size_t queueLimit) { queueLimit_ = queueLimit; }
+
+size_t DecryptScheduler::pendingCount() const {
+    size_t count = active_ ? active_->pendingCount() : 0;
+    for (auto &entry : pending_) {
+        count += entry.second.size();
+    }
+    return count;
+}
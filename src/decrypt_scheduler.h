@@ -0,0 +1,73 @@
+#pragma once
+
+#include <napi.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+
+constexpr size_t DEFAULT_DECRYPT_QUEUE_LIMIT = 1024;
+constexpr size_t MAX_DECRYPT_QUEUE_LIMIT = 65536;
+
+class DecryptBatchOperation;
+
+struct DecryptRequest {
+    Napi::Promise::Deferred deferred;
+    // keeps the input Buffer alive until the call is complete, data points to its contents
+    Napi::ObjectReference buffer;
+    const uint8_t *data;
+    size_t length;
+    std::string touchIdPrompt;
+    // set by the scheduler if the call can be aborted, the listener and the timer are removed when it's settled
+    uint64_t id = 0;
+    Napi::ObjectReference signal{};
+    Napi::FunctionReference abortListener{};
+    Napi::ObjectReference timer{};
+};
+
+// Ways to abort a pending decrypt call, both are optional.
+struct DecryptAbortOptions {
+    // AbortSignal
+    Napi::Object signal;
+    // 0 if there's no timeout
+    double timeoutMs = 0;
+};
+
+// Queues decrypt calls by keyTag, so that concurrent calls for one key are served by one prompt.
+// Only one prompt is shown at a time, keyTags take turns in the order of their first pending call.
+// A batch takes all calls for its keyTag made before the user has authenticated, calls made later wait for the
+// next turn. A call can be aborted while it's pending, if its batch has no other calls, the prompt is dismissed.
+// All methods are called on the JS thread.
+class DecryptScheduler {
+  private:
+    std::map<std::string, std::deque<DecryptRequest>> pending_;
+    // keyTags with pending calls, in the order of their turns
+    std::deque<std::string> turns_;
+    DecryptBatchOperation *active_ = nullptr;
+    size_t queueLimit_ = DEFAULT_DECRYPT_QUEUE_LIMIT;
+    uint64_t nextId_ = 1;
+
+    void startNext(Napi::Env env);
+    // subscribes to the signal and starts the timer
+    void watch(Napi::Env env, DecryptRequest &request, const DecryptAbortOptions &abortOptions);
+    // must be called before the call is settled
+    void unwatch(DecryptRequest &request);
+    // rejects a call that is pending or in the active batch with an "aborted" error
+    void abort(uint64_t id, const char *message);
+    void rejectAborted(DecryptRequest &request, const char *message);
+
+    friend class DecryptBatchOperation;
+
+  public:
+    // rejects the call if there are too many calls pending for the keyTag
+    void enqueue(Napi::Env env, const std::string &keyTag, DecryptRequest request,
+                 const DecryptAbortOptions &abortOptions);
+
+    // maximum number of pending calls per keyTag
+    void setQueueLimit(size_t queueLimit);
+
+    // calls that are queued or in the active batch and haven't been settled yet
+    size_t pendingCount() const;
+};
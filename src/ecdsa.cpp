@@ -0,0 +1,99 @@
+#include "ecdsa.h"
+
+#include <cstring>
+
+#include "secure_memory.h"
+#include "sha256.h"
+
+namespace {
+
+constexpr uint8_t DER_SEQUENCE = 0x30;
+constexpr uint8_t DER_INTEGER = 0x02;
+
+void sha256(const uint8_t *data, size_t length, uint8_t *digest) {
+    Sha256 sha;
+    sha.update(data, length);
+    sha.finish(digest);
+}
+
+// writes a positive big-endian number as a minimal DER INTEGER
+size_t writeDerInteger(uint8_t *out, const uint8_t *value) {
+    size_t skip = 0;
+    while (skip < P256_SCALAR_SIZE - 1 && value[skip] == 0) {
+        skip++;
+    }
+    auto padding = value[skip] & 0x80 ? 1 : 0;
+    auto length = P256_SCALAR_SIZE - skip + padding;
+    out[0] = DER_INTEGER;
+    out[1] = uint8_t(length);
+    out[2] = 0;
+    memcpy(out + 2 + padding, value + skip, P256_SCALAR_SIZE - skip);
+    return 2 + length;
+}
+
+// reads a DER INTEGER into a 32-byte big-endian number, only minimal encodings of positive numbers are accepted
+bool readDerInteger(const uint8_t *&ptr, const uint8_t *end, uint8_t *value) {
+    if (end - ptr < 2 || ptr[0] != DER_INTEGER) {
+        return false;
+    }
+    size_t length = ptr[1];
+    ptr += 2;
+    if (length == 0 || size_t(end - ptr) < length || (ptr[0] & 0x80)) {
+        return false;
+    }
+    if (length > 1 && ptr[0] == 0 && !(ptr[1] & 0x80)) {
+        return false;
+    }
+    if (ptr[0] == 0 && length > 1) {
+        ptr++;
+        length--;
+    }
+    if (length > P256_SCALAR_SIZE) {
+        return false;
+    }
+    memset(value, 0, P256_SCALAR_SIZE - length);
+    memcpy(value + P256_SCALAR_SIZE - length, ptr, length);
+    ptr += length;
+    return true;
+}
+
+} // namespace
+
+bool ecdsaSign(const uint8_t *privateKey, const uint8_t *data, size_t length, uint8_t *signature,
+               size_t &signatureLength) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256(data, length, digest);
+    uint8_t raw[P256_SIGNATURE_SIZE];
+    auto ok = p256Sign(privateKey, digest, raw);
+    secureZero(digest, sizeof(digest));
+    if (!ok) {
+        return false;
+    }
+
+    auto ptr = signature + 2;
+    ptr += writeDerInteger(ptr, raw);
+    ptr += writeDerInteger(ptr, raw + P256_SCALAR_SIZE);
+    signatureLength = size_t(ptr - signature);
+    signature[0] = DER_SEQUENCE;
+    signature[1] = uint8_t(signatureLength - 2);
+    return true;
+}
+
+bool ecdsaVerify(const uint8_t *publicKey, const uint8_t *data, size_t length, const uint8_t *signature,
+                 size_t signatureLength) {
+    // the longest signature is 72 bytes, so the length always has the short form
+    if (signatureLength < 2 || signatureLength > ECDSA_MAX_SIGNATURE_SIZE || signature[0] != DER_SEQUENCE ||
+        signature[1] != signatureLength - 2) {
+        return false;
+    }
+    uint8_t raw[P256_SIGNATURE_SIZE];
+    auto ptr = signature + 2;
+    auto end = signature + signatureLength;
+    if (!readDerInteger(ptr, end, raw) || !readDerInteger(ptr, end, raw + P256_SCALAR_SIZE) || ptr != end) {
+        return false;
+    }
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256(data, length, digest);
+    return p256Verify(publicKey, digest, raw);
+}
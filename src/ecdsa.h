@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "p256.h"
+
+// In-process implementation of kSecKeyAlgorithmECDSASignatureMessageX962SHA256 for P-256 keys:
+// the message is hashed with SHA-256, the signature is DER-encoded as in Security.framework.
+
+// SEQUENCE of two INTEGERs, each up to 33 bytes
+constexpr size_t ECDSA_MAX_SIGNATURE_SIZE = 2 + 2 * (2 + P256_SCALAR_SIZE + 1);
+
+// signature must have room for ECDSA_MAX_SIGNATURE_SIZE bytes, signatureLength is set to the actual size
+bool ecdsaSign(const uint8_t *privateKey, const uint8_t *data, size_t length, uint8_t *signature,
+               size_t &signatureLength);
+
+// returns false for invalid signatures and non-canonical DER encodings
+bool ecdsaVerify(const uint8_t *publicKey, const uint8_t *data, size_t length, const uint8_t *signature,
+                 size_t signatureLength);
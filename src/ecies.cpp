@@ -0,0 +1,106 @@
+#include "ecies.h"
+
+#include <cstring>
+
+#include "secure_memory.h"
+#include "sha256.h"
+
+namespace {
+
+constexpr size_t AES_KEY_SIZE = 16;
+constexpr size_t IV_SIZE = 16;
+
+constexpr uint8_t COMPACT_MAGIC = 0xec;
+constexpr uint8_t COMPACT_VERSION = 1;
+// kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM with P-256
+constexpr uint8_t COMPACT_ALGORITHM_P256_X963_SHA256_AES_GCM = 1;
+constexpr uint8_t COMPACT_HEADER = (COMPACT_VERSION << 4) | COMPACT_ALGORITHM_P256_X963_SHA256_AES_GCM;
+
+struct DerivedKey {
+    uint8_t bytes[AES_KEY_SIZE + IV_SIZE];
+
+    DerivedKey(const uint8_t *sharedSecret, const uint8_t *ephemeralPublicKey) {
+        x963KdfSha256(sharedSecret, P256_FIELD_SIZE, ephemeralPublicKey, P256_PUBLIC_KEY_SIZE, bytes, sizeof(bytes));
+    }
+
+    ~DerivedKey() { secureZero(bytes, sizeof(bytes)); }
+
+    const uint8_t *key() const { return bytes; }
+    const uint8_t *iv() const { return bytes + AES_KEY_SIZE; }
+};
+
+} // namespace
+
+bool eciesEncrypt(const uint8_t *publicKey, const uint8_t *data, size_t length, uint8_t *encrypted,
+                  const P256PublicKeyTable *table) {
+    uint8_t ephemeralPrivateKey[P256_SCALAR_SIZE];
+    auto ephemeralPublicKey = encrypted;
+    if (!p256GenerateKeyPair(ephemeralPrivateKey, ephemeralPublicKey)) {
+        secureZero(ephemeralPrivateKey, sizeof(ephemeralPrivateKey));
+        return false;
+    }
+
+    uint8_t sharedSecret[P256_FIELD_SIZE];
+    auto ok = p256Ecdh(ephemeralPrivateKey, publicKey, sharedSecret, table);
+    secureZero(ephemeralPrivateKey, sizeof(ephemeralPrivateKey));
+    if (!ok) {
+        return false;
+    }
+
+    DerivedKey derived(sharedSecret, ephemeralPublicKey);
+    secureZero(sharedSecret, sizeof(sharedSecret));
+
+    AesGcm aes(derived.key(), AES_KEY_SIZE);
+    auto ciphertext = encrypted + P256_PUBLIC_KEY_SIZE;
+    aes.encrypt(derived.iv(), IV_SIZE, nullptr, 0, data, length, ciphertext, ciphertext + length);
+    return true;
+}
+
+bool eciesDecrypt(const uint8_t *privateKey, const uint8_t *data, size_t length, uint8_t *decrypted) {
+    if (length < ECIES_OVERHEAD) {
+        return false;
+    }
+    auto ephemeralPublicKey = data;
+
+    uint8_t sharedSecret[P256_FIELD_SIZE];
+    if (!p256Ecdh(privateKey, ephemeralPublicKey, sharedSecret)) {
+        return false;
+    }
+
+    DerivedKey derived(sharedSecret, ephemeralPublicKey);
+    secureZero(sharedSecret, sizeof(sharedSecret));
+
+    AesGcm aes(derived.key(), AES_KEY_SIZE);
+    auto ciphertext = data + P256_PUBLIC_KEY_SIZE;
+    auto ciphertextLength = length - ECIES_OVERHEAD;
+    return aes.decrypt(derived.iv(), IV_SIZE, nullptr, 0, ciphertext, ciphertextLength, ciphertext + ciphertextLength,
+                       decrypted);
+}
+
+bool isCompactEcies(const uint8_t *data, size_t length) {
+    return length >= ECIES_COMPACT_OVERHEAD && data[0] == COMPACT_MAGIC && data[1] == COMPACT_HEADER;
+}
+
+bool eciesToCompact(const uint8_t *data, size_t length, uint8_t *compact) {
+    if (length < ECIES_OVERHEAD || !p256IsValidPublicKey(data, P256_PUBLIC_KEY_SIZE)) {
+        return false;
+    }
+    uint8_t compressed[P256_COMPRESSED_PUBLIC_KEY_SIZE];
+    p256CompressPublicKey(data, compressed);
+    // the output is shorter, so it can be written over the input
+    memmove(compact + 2 + P256_COMPRESSED_PUBLIC_KEY_SIZE, data + P256_PUBLIC_KEY_SIZE,
+            length - P256_PUBLIC_KEY_SIZE);
+    compact[0] = COMPACT_MAGIC;
+    compact[1] = COMPACT_HEADER;
+    memcpy(compact + 2, compressed, sizeof(compressed));
+    return true;
+}
+
+bool eciesFromCompact(const uint8_t *compact, size_t length, uint8_t *expanded) {
+    if (!isCompactEcies(compact, length) || !p256DecompressPublicKey(compact + 2, expanded)) {
+        return false;
+    }
+    auto offset = 2 + P256_COMPRESSED_PUBLIC_KEY_SIZE;
+    memcpy(expanded + P256_PUBLIC_KEY_SIZE, compact + offset, length - offset);
+    return true;
+}
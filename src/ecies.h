@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "aes_gcm.h"
+#include "p256.h"
+
+// In-process implementation of kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM for P-256 keys.
+// Output format is the same as in Security.framework: ephemeral public key || ciphertext || GCM tag,
+// where AES-128 key and 16-byte IV are derived with X9.63 KDF from the shared secret and the ephemeral public key.
+
+constexpr size_t ECIES_OVERHEAD = P256_PUBLIC_KEY_SIZE + GCM_TAG_SIZE;
+
+// encrypted must have room for length + ECIES_OVERHEAD bytes
+// table, if passed, must be precomputed from publicKey
+bool eciesEncrypt(const uint8_t *publicKey, const uint8_t *data, size_t length, uint8_t *encrypted,
+                  const P256PublicKeyTable *table = nullptr);
+
+// decrypted must have room for length - ECIES_OVERHEAD bytes
+bool eciesDecrypt(const uint8_t *privateKey, const uint8_t *data, size_t length, uint8_t *decrypted);
+
+// Compact form of the same ciphertext, for storing many small items, it's 30 bytes shorter:
+//  magic 0xEC | version (4 bits) and algorithm (4 bits) | compressed ephemeral public key (33) | ciphertext | GCM tag
+// The ephemeral key is expanded back before decryption, X9.63 KDF takes it in uncompressed form.
+
+constexpr size_t ECIES_COMPACT_OVERHEAD = 2 + P256_COMPRESSED_PUBLIC_KEY_SIZE + GCM_TAG_SIZE;
+
+// tells compact ciphertext from ECIES output and envelopes, the header must be known
+bool isCompactEcies(const uint8_t *data, size_t length);
+
+// compact must have room for length - ECIES_OVERHEAD + ECIES_COMPACT_OVERHEAD bytes, it can be the same as data
+bool eciesToCompact(const uint8_t *data, size_t length, uint8_t *compact);
+
+// expanded must have room for length - ECIES_COMPACT_OVERHEAD + ECIES_OVERHEAD bytes
+bool eciesFromCompact(const uint8_t *compact, size_t length, uint8_t *expanded);
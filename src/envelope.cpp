@@ -0,0 +1,253 @@
+#include "envelope.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "aes_gcm.h"
+#include "ecies.h"
+#include "secure_memory.h"
+#include "secure_random.h"
+#include "worker_pool.h"
+
+namespace {
+
+constexpr uint8_t ENVELOPE_MAGIC[4] = {'N', 'S', 'E', 'E'};
+constexpr uint8_t ENVELOPE_VERSION = 1;
+constexpr size_t NONCE_PREFIX_SIZE = 8;
+constexpr size_t NONCE_SIZE = NONCE_PREFIX_SIZE + 4;
+// magic, version, chunk size, nonce prefix, plaintext length
+constexpr size_t AAD_SIZE = sizeof(ENVELOPE_MAGIC) + 1 + 4 + NONCE_PREFIX_SIZE + 8;
+constexpr size_t MAX_CHUNK_SIZE = 16 * 1024 * 1024;
+constexpr size_t WRAPPED_KEY_SIZE = ENVELOPE_DATA_KEY_SIZE + ECIES_OVERHEAD;
+
+struct EnvelopeHeader {
+    const uint8_t *aad;
+    size_t chunkSize;
+    const uint8_t *noncePrefix;
+    uint64_t plaintextLength;
+    const uint8_t *wrappedKey;
+    size_t wrappedKeyLength;
+    const uint8_t *chunks;
+    size_t chunkCount;
+};
+
+void writeBigEndian(uint8_t *out, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        out[size - 1 - i] = uint8_t(value >> (8 * i));
+    }
+}
+
+uint64_t readBigEndian(const uint8_t *in, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+void chunkNonce(const uint8_t *noncePrefix, size_t index, uint8_t *nonce) {
+    memcpy(nonce, noncePrefix, NONCE_PREFIX_SIZE);
+    writeBigEndian(nonce + NONCE_PREFIX_SIZE, index, 4);
+}
+
+size_t chunkCount(uint64_t plaintextLength, size_t chunkSize) {
+    return size_t((plaintextLength + chunkSize - 1) / chunkSize);
+}
+
+bool parseHeader(const uint8_t *data, size_t length, EnvelopeHeader &header) {
+    if (length < AAD_SIZE + 2 || !isEnvelope(data, length) || data[sizeof(ENVELOPE_MAGIC)] != ENVELOPE_VERSION) {
+        return false;
+    }
+    auto pos = data + sizeof(ENVELOPE_MAGIC) + 1;
+
+    header.aad = data;
+    header.chunkSize = size_t(readBigEndian(pos, 4));
+    pos += 4;
+    header.noncePrefix = pos;
+    pos += NONCE_PREFIX_SIZE;
+    header.plaintextLength = readBigEndian(pos, 8);
+    pos += 8;
+    header.wrappedKeyLength = size_t(readBigEndian(pos, 2));
+    pos += 2;
+    header.wrappedKey = pos;
+
+    if (header.chunkSize == 0 || header.chunkSize > MAX_CHUNK_SIZE || header.plaintextLength == 0 ||
+        header.plaintextLength > length) {
+        return false;
+    }
+    header.chunkCount = chunkCount(header.plaintextLength, header.chunkSize);
+    if (header.chunkCount > UINT32_MAX) {
+        return false;
+    }
+
+    auto headerLength = size_t(pos - data) + header.wrappedKeyLength;
+    auto chunksLength = size_t(header.plaintextLength) + header.chunkCount * GCM_TAG_SIZE;
+    if (headerLength > length || length - headerLength != chunksLength) {
+        return false;
+    }
+    header.chunks = data + headerLength;
+    return true;
+}
+
+} // namespace
+
+bool isEnvelope(const uint8_t *data, size_t length) {
+    return length >= sizeof(ENVELOPE_MAGIC) && memcmp(data, ENVELOPE_MAGIC, sizeof(ENVELOPE_MAGIC)) == 0;
+}
+
+bool envelopeEncrypt(const uint8_t *publicKey, const uint8_t *data, size_t length, Bytes &envelope,
+                     const P256PublicKeyTable *table) {
+    uint8_t dataKey[ENVELOPE_DATA_KEY_SIZE];
+    uint8_t noncePrefix[NONCE_PREFIX_SIZE];
+    if (!secureRandomBytes(dataKey, sizeof(dataKey)) || !secureRandomBytes(noncePrefix, sizeof(noncePrefix))) {
+        secureZero(dataKey, sizeof(dataKey));
+        return false;
+    }
+
+    auto count = chunkCount(length, ENVELOPE_CHUNK_SIZE);
+    auto headerLength = AAD_SIZE + 2 + WRAPPED_KEY_SIZE;
+    envelope.resize(headerLength + length + count * GCM_TAG_SIZE);
+
+    auto pos = envelope.data();
+    memcpy(pos, ENVELOPE_MAGIC, sizeof(ENVELOPE_MAGIC));
+    pos += sizeof(ENVELOPE_MAGIC);
+    *pos++ = ENVELOPE_VERSION;
+    writeBigEndian(pos, ENVELOPE_CHUNK_SIZE, 4);
+    pos += 4;
+    memcpy(pos, noncePrefix, NONCE_PREFIX_SIZE);
+    pos += NONCE_PREFIX_SIZE;
+    writeBigEndian(pos, length, 8);
+    pos += 8;
+    writeBigEndian(pos, WRAPPED_KEY_SIZE, 2);
+    pos += 2;
+
+    auto wrapped = eciesEncrypt(publicKey, dataKey, sizeof(dataKey), pos, table);
+    if (!wrapped) {
+        secureZero(dataKey, sizeof(dataKey));
+        envelope.clear();
+        return false;
+    }
+
+    AesGcm aes(dataKey, sizeof(dataKey));
+    secureZero(dataKey, sizeof(dataKey));
+
+    auto aad = envelope.data();
+    auto chunks = envelope.data() + headerLength;
+    getWorkerPool().parallelFor(count, [&](size_t index) {
+        auto offset = index * ENVELOPE_CHUNK_SIZE;
+        auto chunkLength = std::min(ENVELOPE_CHUNK_SIZE, length - offset);
+        auto out = chunks + offset + index * GCM_TAG_SIZE;
+        uint8_t nonce[NONCE_SIZE];
+        chunkNonce(noncePrefix, index, nonce);
+        aes.encrypt(nonce, sizeof(nonce), aad, AAD_SIZE, data + offset, chunkLength, out, out + chunkLength);
+    });
+    return true;
+}
+
+BackendError envelopeDecrypt(KeyPair &keyPair, const uint8_t *data, size_t length, SecureBytes &decrypted) {
+    EnvelopeHeader header;
+    if (!parseHeader(data, length, header)) {
+        return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData");
+    }
+
+    SecureBytes dataKey;
+    if (auto error = keyPair.decrypt(header.wrappedKey, header.wrappedKeyLength, dataKey)) {
+        return error;
+    }
+    if (dataKey.size() != ENVELOPE_DATA_KEY_SIZE) {
+        return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData");
+    }
+    AesGcm aes(dataKey.data(), dataKey.size());
+
+    auto plaintextLength = size_t(header.plaintextLength);
+    decrypted.resize(plaintextLength);
+    std::atomic<bool> authenticated{true};
+    getWorkerPool().parallelFor(header.chunkCount, [&](size_t index) {
+        auto offset = index * header.chunkSize;
+        auto chunkLength = std::min(header.chunkSize, plaintextLength - offset);
+        auto in = header.chunks + offset + index * GCM_TAG_SIZE;
+        uint8_t nonce[NONCE_SIZE];
+        chunkNonce(header.noncePrefix, index, nonce);
+        if (!aes.decrypt(nonce, sizeof(nonce), header.aad, AAD_SIZE, in, chunkLength, in + chunkLength,
+                         decrypted.data() + offset)) {
+            authenticated = false;
+        }
+    });
+
+    if (!authenticated) {
+        secureZero(decrypted.data(), decrypted.size());
+        decrypted.clear();
+        return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData");
+    }
+    return BackendError();
+}
+
+BackendError envelopeRewrap(KeyPair &keyPair, const uint8_t *toPublicKey, const P256PublicKeyTable *toTable,
+                            const uint8_t *data, size_t length, Bytes &rewrapped) {
+    EnvelopeHeader header;
+    if (!parseHeader(data, length, header)) {
+        return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData");
+    }
+
+    SecureBytes dataKey;
+    if (auto error = keyPair.decrypt(header.wrappedKey, header.wrappedKeyLength, dataKey)) {
+        return error;
+    }
+    if (dataKey.size() != ENVELOPE_DATA_KEY_SIZE) {
+        return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData");
+    }
+
+    // the header is the same except for the wrapped key
+    auto chunksLength = size_t(data + length - header.chunks);
+    rewrapped.resize(AAD_SIZE + 2 + WRAPPED_KEY_SIZE + chunksLength);
+    auto pos = rewrapped.data();
+    memcpy(pos, data, AAD_SIZE);
+    pos += AAD_SIZE;
+    writeBigEndian(pos, WRAPPED_KEY_SIZE, 2);
+    pos += 2;
+    if (!eciesEncrypt(toPublicKey, dataKey.data(), dataKey.size(), pos, toTable)) {
+        rewrapped.clear();
+        return errorWithCode(STATUS_PARAM, "SecKeyCreateEncryptedData");
+    }
+    pos += WRAPPED_KEY_SIZE;
+    memcpy(pos, header.chunks, chunksLength);
+    return BackendError();
+}
+
+BackendError decryptWithKeyPair(KeyPair &keyPair, const uint8_t *data, size_t length, SecureBytes &decrypted) {
+    if (isEnvelope(data, length)) {
+        return envelopeDecrypt(keyPair, data, length, decrypted);
+    }
+    if (isCompactEcies(data, length)) {
+        Bytes expanded(length - ECIES_COMPACT_OVERHEAD + ECIES_OVERHEAD);
+        if (!eciesFromCompact(data, length, expanded.data())) {
+            return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData");
+        }
+        return keyPair.decrypt(expanded.data(), expanded.size(), decrypted);
+    }
+    return keyPair.decrypt(data, length, decrypted);
+}
+
+BackendError rewrapWithKeyPair(KeyPair &keyPair, const uint8_t *toPublicKey, const P256PublicKeyTable *toTable,
+                               const uint8_t *data, size_t length, Bytes &rewrapped) {
+    if (isEnvelope(data, length)) {
+        return envelopeRewrap(keyPair, toPublicKey, toTable, data, length, rewrapped);
+    }
+
+    SecureBytes decrypted;
+    if (auto error = decryptWithKeyPair(keyPair, data, length, decrypted)) {
+        return error;
+    }
+    rewrapped.resize(decrypted.size() + ECIES_OVERHEAD);
+    if (!eciesEncrypt(toPublicKey, decrypted.data(), decrypted.size(), rewrapped.data(), toTable)) {
+        rewrapped.clear();
+        return errorWithCode(STATUS_PARAM, "SecKeyCreateEncryptedData");
+    }
+    // compact items stay compact
+    if (isCompactEcies(data, length)) {
+        eciesToCompact(rewrapped.data(), rewrapped.size(), rewrapped.data());
+        rewrapped.resize(decrypted.size() + ECIES_COMPACT_OVERHEAD);
+    }
+    return BackendError();
+}
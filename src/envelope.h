@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "backend.h"
+#include "p256.h"
+
+// Envelope format for large payloads: a random AES-256 data key is wrapped with ECIES,
+// the payload is encrypted with AES-GCM in fixed-size chunks, which are processed in parallel.
+//
+//  magic "NSEE" | version (1) | chunk size (4, BE) | nonce prefix (8) | plaintext length (8, BE)
+//  | wrapped key length (2, BE) | wrapped key | chunk 0 ciphertext | tag 0 | chunk 1 ciphertext | tag 1 | ...
+//
+// Chunk nonce is nonce prefix || chunk index (4, BE). Fields before the wrapped key are authenticated
+// as AAD of every chunk, the wrapped key is not, so that it can be re-wrapped without touching chunks.
+
+constexpr size_t ENVELOPE_CHUNK_SIZE = 64 * 1024;
+constexpr size_t ENVELOPE_DATA_KEY_SIZE = 32;
+
+// tells envelopes from ECIES ciphertext, which starts with 0x04, the uncompressed point prefix
+bool isEnvelope(const uint8_t *data, size_t length);
+
+// wraps a new data key with publicKey and encrypts the payload on the worker pool,
+// table, if passed, must be precomputed from publicKey
+bool envelopeEncrypt(const uint8_t *publicKey, const uint8_t *data, size_t length, Bytes &envelope,
+                     const P256PublicKeyTable *table = nullptr);
+
+// unwraps the data key with one keyPair->decrypt call and decrypts chunks on the worker pool
+BackendError envelopeDecrypt(KeyPair &keyPair, const uint8_t *data, size_t length, SecureBytes &decrypted);
+
+// unwraps the data key and wraps it with toPublicKey, chunks are copied as is;
+// toTable, if passed, must be precomputed from toPublicKey
+BackendError envelopeRewrap(KeyPair &keyPair, const uint8_t *toPublicKey, const P256PublicKeyTable *toTable,
+                            const uint8_t *data, size_t length, Bytes &rewrapped);
+
+// decrypts envelopes, plain and compact ECIES ciphertext
+BackendError decryptWithKeyPair(KeyPair &keyPair, const uint8_t *data, size_t length, SecureBytes &decrypted);
+
+// re-encrypts any of them for another key in the same format, plaintext stays in secure memory
+BackendError rewrapWithKeyPair(KeyPair &keyPair, const uint8_t *toPublicKey, const P256PublicKeyTable *toTable,
+                               const uint8_t *data, size_t length, Bytes &rewrapped);
@@ -1,8 +1,8 @@
 #include "helpers.h"
 
-#include <Security/Security.h>
-
-#include "auto_release.h"
+#include "key_pool.h"
+#include "p256.h"
+#include "secure_memory.h"
 
 void rejectAsTypeError(Napi::Promise::Deferred &deferred, const std::string &message) {
     auto env = deferred.Env();
@@ -29,25 +29,22 @@ void rejectWithMessageAndProp(Napi::Promise::Deferred &deferred, const std::stri
     deferred.Reject(err.Value());
 }
 
-void rejectWithErrorCode(Napi::Promise::Deferred &deferred, long code, const std::string &op) {
-    auto env = deferred.Env();
-
+Napi::Error createErrorWithCode(Napi::Env env, long code, const std::string &op) {
     std::string msg;
     std::string extraProp;
 
-    if (code == errSecSuccess) {
+    if (code == STATUS_SUCCESS) {
         msg = op + ": unknown error without error code";
-    } else if (code == errSecItemNotFound) {
+    } else if (code == STATUS_ITEM_NOT_FOUND) {
         extraProp = "keyNotFound";
         msg = "Key not found in Secure Enclave";
-    } else if (code == errSecParam) {
+    } else if (code == STATUS_PARAM) {
         extraProp = "badParam";
         msg = op + ": bad parameter";
     } else {
-        auto_release errorMessage = SecCopyErrorMessageString(code, NULL);
-        if (errorMessage) {
-            auto str = CFStringGetCStringPtr(errorMessage, kCFStringEncodingUTF8);
-            msg = op + ": " + str;
+        auto errorMessage = getBackend().errorMessage(code);
+        if (!errorMessage.empty()) {
+            msg = op + ": " + errorMessage;
         } else {
             msg = op + ": error code " + std::to_string(code);
         }
@@ -58,133 +55,289 @@ void rejectWithErrorCode(Napi::Promise::Deferred &deferred, long code, const std
     if (!extraProp.empty()) {
         err.Set(extraProp, Napi::Boolean::New(env, true));
     }
-    deferred.Reject(err.Value());
+    return err;
+}
+
+Napi::Error createBackendError(Napi::Env env, const BackendError &error) {
+    if (!error.message.empty()) {
+        auto err = Napi::Error::New(env, error.message);
+        if (!error.prop.empty()) {
+            err.Set(error.prop, true);
+        }
+        return err;
+    } else if (error.code == STATUS_DUPLICATE_ITEM) {
+        auto err = Napi::Error::New(env, "A key with this keyTag already exists, please delete it first");
+        err.Set("keyExists", true);
+        return err;
+    } else {
+        return createErrorWithCode(env, error.code, error.op);
+    }
 }
 
-void rejectWithCFError(Napi::Promise::Deferred &deferred, CFErrorRef error, const std::string &op) {
-    auto code = CFErrorGetCode(error);
-    rejectWithErrorCode(deferred, code, op);
+Napi::Error createAuthRefusedError(Napi::Env env, long authErrorCode) {
+    auto err = Napi::Error::New(env, "User refused to authenticate with Touch ID");
+    err.Set("rejected", Napi::Boolean::New(env, true));
+    err.Set("code", Napi::Number::New(env, authErrorCode));
+    return err;
+}
+
+void rejectWithErrorCode(Napi::Promise::Deferred &deferred, long code, const std::string &op) {
+    deferred.Reject(createErrorWithCode(deferred.Env(), code, op).Value());
+}
+
+void rejectWithBackendError(Napi::Promise::Deferred &deferred, const BackendError &error) {
+    deferred.Reject(createBackendError(deferred.Env(), error).Value());
 }
 
 bool rejectIfNotSupported(Napi::Promise::Deferred &deferred) {
-    if (!isBiometricAuthSupported()) {
+    if (!getBackend().isSupported()) {
         rejectWithMessageAndProp(deferred, "Biometric auth is not supported", "notSupported");
         return true;
     }
     return false;
 }
 
-CFDataRef getKeyTagFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred) {
+std::string getKeyTagFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred, const char *name) {
     if (info.Length() != 1) {
         rejectAsTypeError(deferred, "Expected exactly one argument");
-        return nullptr;
+        return std::string();
     }
 
     if (!info[0].IsObject()) {
         rejectAsTypeError(deferred, "options is not an object");
-        return nullptr;
+        return std::string();
     }
 
     auto arg = info[0].ToObject();
 
-    if (!arg.Has("keyTag")) {
-        rejectAsTypeError(deferred, "keyTag property is missing");
-        return nullptr;
+    if (!arg.Has(name)) {
+        rejectAsTypeError(deferred, std::string(name) + " property is missing");
+        return std::string();
     }
 
-    auto keyTagProp = arg.Get("keyTag");
+    auto keyTagProp = arg.Get(name);
     if (!keyTagProp.IsString()) {
-        rejectAsTypeError(deferred, "keyTag is not a string");
-        return nullptr;
+        rejectAsTypeError(deferred, std::string(name) + " is not a string");
+        return std::string();
     }
     auto keyTag = keyTagProp.As<Napi::String>();
 
     auto keyTagStr = keyTag.Utf8Value();
     if (keyTagStr.length() == 0) {
-        rejectAsTypeError(deferred, "keyTag cannot be empty");
-        return nullptr;
+        rejectAsTypeError(deferred, std::string(name) + " cannot be empty");
+        return std::string();
     }
 
-    return CFDataCreate(kCFAllocatorDefault, reinterpret_cast<const UInt8 *>(keyTagStr.c_str()), keyTagStr.length());
-}
-
-CFMutableDictionaryRef getKeyQueryAttributesFromArgs(const Napi::CallbackInfo &info,
-                                                     Napi::Promise::Deferred &deferred) {
-    auto_release keyTagData = getKeyTagFromArgs(info, deferred);
-    if (!keyTagData) {
-        return nullptr;
+    // pooled keys are managed by the addon, they must not be taken, found or deleted by their tags
+    if (isKeyPoolTag(keyTagStr)) {
+        rejectAsTypeError(deferred, std::string(name) + " cannot start with " + KEY_POOL_TAG_PREFIX);
+        return std::string();
     }
 
-    auto queryAttributes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks,
-                                                     &kCFTypeDictionaryValueCallBacks);
-
-    CFDictionaryAddValue(queryAttributes, kSecClass, kSecClassKey);
-    CFDictionaryAddValue(queryAttributes, kSecAttrKeyClass, kSecAttrKeyClassPrivate);
-    CFDictionaryAddValue(queryAttributes, kSecAttrKeyType, kSecAttrKeyTypeEC);
-    CFDictionaryAddValue(queryAttributes, kSecAttrApplicationTag, keyTagData);
-    CFDictionaryAddValue(queryAttributes, kSecReturnRef, kCFBooleanTrue);
-#ifndef NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN
-    CFDictionaryAddValue(queryAttributes, kSecAttrTokenID, kSecAttrTokenIDSecureEnclave);
-#endif
-
-    return queryAttributes;
+    return keyTagStr;
 }
 
-CFDataRef getDataFromArgsNoCopy(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred) {
+Napi::Buffer<uint8_t> getDataFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred) {
     auto object = info[0].ToObject();
 
     if (!object.Has("data")) {
         rejectAsTypeError(deferred, "data property is missing");
-        return nullptr;
+        return Napi::Buffer<uint8_t>();
     }
 
     auto dataProp = object.Get("data");
     if (!dataProp.IsBuffer()) {
         rejectAsTypeError(deferred, "data is not a buffer");
-        return nullptr;
+        return Napi::Buffer<uint8_t>();
     }
 
-    auto buffer = dataProp.As<Napi::Buffer<UInt8>>();
+    auto buffer = dataProp.As<Napi::Buffer<uint8_t>>();
     if (buffer.ByteLength() == 0) {
         rejectAsTypeError(deferred, "data cannot be empty");
-        return nullptr;
+        return Napi::Buffer<uint8_t>();
     }
 
-    return CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, buffer.Data(), buffer.ByteLength(), kCFAllocatorNull);
+    return buffer;
 }
 
-CFDataRef getDataFromArgsAsCopy(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred) {
-    auto_release data = getDataFromArgsNoCopy(info, deferred);
-    if (!data) {
-        return nullptr;
+std::vector<Napi::Buffer<uint8_t>> getItemsFromArgs(const Napi::CallbackInfo &info,
+                                                    Napi::Promise::Deferred &deferred) {
+    auto object = info[0].ToObject();
+
+    if (!object.Has("items")) {
+        rejectAsTypeError(deferred, "items property is missing");
+        return std::vector<Napi::Buffer<uint8_t>>();
+    }
+
+    auto itemsProp = object.Get("items");
+    if (!itemsProp.IsArray()) {
+        rejectAsTypeError(deferred, "items is not an array");
+        return std::vector<Napi::Buffer<uint8_t>>();
+    }
+
+    auto items = itemsProp.As<Napi::Array>();
+    if (items.Length() == 0) {
+        rejectAsTypeError(deferred, "items cannot be empty");
+        return std::vector<Napi::Buffer<uint8_t>>();
+    }
+
+    std::vector<Napi::Buffer<uint8_t>> buffers;
+    buffers.reserve(items.Length());
+    for (uint32_t i = 0; i < items.Length(); i++) {
+        auto item = items.Get(i);
+        if (!item.IsBuffer() || item.As<Napi::Buffer<uint8_t>>().ByteLength() == 0) {
+            rejectAsTypeError(deferred, "items must contain only non-empty buffers");
+            return std::vector<Napi::Buffer<uint8_t>>();
+        }
+        buffers.push_back(item.As<Napi::Buffer<uint8_t>>());
     }
-    return CFDataCreateCopy(kCFAllocatorDefault, data);
+
+    return buffers;
 }
 
-CFStringRef getTouchIdPromptFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred) {
+Napi::Buffer<uint8_t> getSignatureFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred) {
+    auto object = info[0].ToObject();
+
+    if (!object.Has("signature")) {
+        rejectAsTypeError(deferred, "signature property is missing");
+        return Napi::Buffer<uint8_t>();
+    }
+
+    auto signatureProp = object.Get("signature");
+    if (!signatureProp.IsBuffer()) {
+        rejectAsTypeError(deferred, "signature is not a buffer");
+        return Napi::Buffer<uint8_t>();
+    }
+
+    return signatureProp.As<Napi::Buffer<uint8_t>>();
+}
+
+std::vector<std::pair<Napi::Buffer<uint8_t>, Napi::Buffer<uint8_t>>>
+getSignedItemsFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred) {
+    using SignedItems = std::vector<std::pair<Napi::Buffer<uint8_t>, Napi::Buffer<uint8_t>>>;
+
+    auto object = info[0].ToObject();
+
+    if (!object.Has("items")) {
+        rejectAsTypeError(deferred, "items property is missing");
+        return SignedItems();
+    }
+
+    auto itemsProp = object.Get("items");
+    if (!itemsProp.IsArray()) {
+        rejectAsTypeError(deferred, "items is not an array");
+        return SignedItems();
+    }
+
+    auto items = itemsProp.As<Napi::Array>();
+    if (items.Length() == 0) {
+        rejectAsTypeError(deferred, "items cannot be empty");
+        return SignedItems();
+    }
+
+    SignedItems signedItems;
+    signedItems.reserve(items.Length());
+    for (uint32_t i = 0; i < items.Length(); i++) {
+        auto item = items.Get(i);
+        if (!item.IsObject()) {
+            rejectAsTypeError(deferred, "items must contain only objects with data and signature buffers");
+            return SignedItems();
+        }
+        auto data = item.ToObject().Get("data");
+        auto signature = item.ToObject().Get("signature");
+        if (!data.IsBuffer() || !signature.IsBuffer()) {
+            rejectAsTypeError(deferred, "items must contain only objects with data and signature buffers");
+            return SignedItems();
+        }
+        signedItems.emplace_back(data.As<Napi::Buffer<uint8_t>>(), signature.As<Napi::Buffer<uint8_t>>());
+    }
+
+    return signedItems;
+}
+
+bool hasPublicKeyInArgs(const Napi::CallbackInfo &info) {
+    return info.Length() == 1 && info[0].IsObject() && info[0].ToObject().Has("publicKey");
+}
+
+Bytes getPublicKeyFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred) {
+    auto publicKeyProp = info[0].ToObject().Get("publicKey");
+    if (!publicKeyProp.IsBuffer()) {
+        rejectAsTypeError(deferred, "publicKey is not a buffer");
+        return Bytes();
+    }
+
+    auto buffer = publicKeyProp.As<Napi::Buffer<uint8_t>>();
+    if (!p256IsValidPublicKey(buffer.Data(), buffer.ByteLength())) {
+        rejectAsTypeError(deferred, "publicKey is not a valid P-256 public key");
+        return Bytes();
+    }
+
+    return Bytes(buffer.Data(), buffer.Data() + buffer.ByteLength());
+}
+
+std::string getTouchIdPromptFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred) {
     auto object = info[0].ToObject();
 
     if (!object.Has("touchIdPrompt")) {
         rejectAsTypeError(deferred, "touchIdPrompt property is missing");
-        return nullptr;
+        return std::string();
     }
 
     auto touchIdPromptProp = object.Get("touchIdPrompt");
     if (!touchIdPromptProp.IsString()) {
         rejectAsTypeError(deferred, "touchIdPrompt is not a string");
-        return nullptr;
+        return std::string();
     }
 
     std::string touchIdPromptStr = touchIdPromptProp.As<Napi::String>();
     if (touchIdPromptStr.length() == 0) {
         rejectAsTypeError(deferred, "touchIdPrompt cannot be empty");
-        return nullptr;
+        return std::string();
+    }
+
+    return touchIdPromptStr;
+}
+
+Napi::Buffer<uint8_t> bytesToBuffer(Napi::Env env, const Bytes &bytes) {
+    return Napi::Buffer<uint8_t>::Copy(env, bytes.data(), bytes.size());
+}
+
+namespace {
+
+void releaseExternalBytes(Bytes *data) {
+    secureZero(data->data(), data->size());
+    delete data;
+}
+
+// SecureBytes are zeroized when they go back to the pool
+void releaseExternalBytes(SecureBytes *data) { delete data; }
+
+template <typename T> Napi::Buffer<uint8_t> moveToExternalBuffer(Napi::Env env, T &&bytes) {
+    if (bytes.empty()) {
+        return Napi::Buffer<uint8_t>::New(env, 0);
+    }
+    auto data = new T(std::move(bytes));
+    // the C API is called directly because Buffer::New throws if it fails
+    napi_value value;
+    auto status = napi_create_external_buffer(
+        env, data->size(), data->data(),
+        [](napi_env, void *, void *hint) { releaseExternalBytes(static_cast<T *>(hint)); }, data, &value);
+    if (status == napi_ok) {
+        return Napi::Buffer<uint8_t>(env, value);
     }
+    // napi_no_external_buffers_allowed where V8 has the memory cage (Electron 21 and later), older headers don't have
+    // this status, so any failure is handled the same way: the data is copied to a JS-owned Buffer and zeroized
+    auto buffer = Napi::Buffer<uint8_t>::Copy(env, data->data(), data->size());
+    releaseExternalBytes(data);
+    return buffer;
+}
+
+} // namespace
 
-    return CFStringCreateWithCString(kCFAllocatorDefault, touchIdPromptStr.c_str(), kCFStringEncodingUTF8);
+Napi::Buffer<uint8_t> bytesToExternalBuffer(Napi::Env env, Bytes &&bytes) {
+    return moveToExternalBuffer(env, std::move(bytes));
 }
 
-Napi::Buffer<UInt8> cfDataToBuffer(Napi::Env env, CFDataRef cfData) {
-    auto length = CFDataGetLength(cfData);
-    return Napi::Buffer<UInt8>::Copy(env, CFDataGetBytePtr(cfData), length);
+Napi::Buffer<uint8_t> bytesToExternalBuffer(Napi::Env env, SecureBytes &&bytes) {
+    return moveToExternalBuffer(env, std::move(bytes));
 }
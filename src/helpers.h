@@ -1,24 +1,41 @@
 #pragma once
 
-#include <Security/Security.h>
 #include <napi.h>
 
 #include <string>
+#include <utility>
+#include <vector>
 
-bool isBiometricAuthSupported();
-void authenticateAndDecrypt(CFStringRef touchIdPrompt, CFMutableDictionaryRef queryAttributes, void *callbackData);
+#include "backend.h"
+
+Napi::Error createErrorWithCode(Napi::Env env, long code, const std::string &op);
+Napi::Error createBackendError(Napi::Env env, const BackendError &error);
+Napi::Error createAuthRefusedError(Napi::Env env, long authErrorCode);
 
 void rejectAsTypeError(Napi::Promise::Deferred &deferred, const std::string &message);
 void rejectWithMessage(Napi::Promise::Deferred &deferred, const std::string &message);
 void rejectWithMessageAndProp(Napi::Promise::Deferred &deferred, const std::string &message, const std::string &prop);
 void rejectWithErrorCode(Napi::Promise::Deferred &deferred, long code, const std::string &op);
-void rejectWithCFError(Napi::Promise::Deferred &deferred, CFErrorRef error, const std::string &op);
+void rejectWithBackendError(Napi::Promise::Deferred &deferred, const BackendError &error);
 bool rejectIfNotSupported(Napi::Promise::Deferred &deferred);
 
-CFDataRef getKeyTagFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred);
-CFMutableDictionaryRef getKeyQueryAttributesFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred);
-CFDataRef getDataFromArgsNoCopy(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred);
-CFDataRef getDataFromArgsAsCopy(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred);
-CFStringRef getTouchIdPromptFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred);
+// name is the property that holds the key tag
+std::string getKeyTagFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred,
+                              const char *name = "keyTag");
+Napi::Buffer<uint8_t> getDataFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred);
+std::vector<Napi::Buffer<uint8_t>> getItemsFromArgs(const Napi::CallbackInfo &info,
+                                                    Napi::Promise::Deferred &deferred);
+Napi::Buffer<uint8_t> getSignatureFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred);
+// items of verifyMany: [{ data, signature }]
+std::vector<std::pair<Napi::Buffer<uint8_t>, Napi::Buffer<uint8_t>>>
+getSignedItemsFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred);
+bool hasPublicKeyInArgs(const Napi::CallbackInfo &info);
+Bytes getPublicKeyFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred);
+std::string getTouchIdPromptFromArgs(const Napi::CallbackInfo &info, Napi::Promise::Deferred &deferred);
 
-Napi::Buffer<UInt8> cfDataToBuffer(Napi::Env env, CFDataRef cfData);
+Napi::Buffer<uint8_t> bytesToBuffer(Napi::Env env, const Bytes &bytes);
+// moves bytes to a Buffer without a copy, the memory is zeroized when the Buffer is garbage collected;
+// where external buffers are not allowed, the Buffer is a copy and the bytes are zeroized right away
+Napi::Buffer<uint8_t> bytesToExternalBuffer(Napi::Env env, Bytes &&bytes);
+// the same for plaintext and key material, the memory goes back to the secure memory pool
+Napi::Buffer<uint8_t> bytesToExternalBuffer(Napi::Env env, SecureBytes &&bytes);
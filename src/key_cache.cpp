@@ -0,0 +1,110 @@
+#include "key_cache.h"
+
+#include <utility>
+
+KeyCache::KeyCache(size_t capacity) : capacity_(capacity) {}
+
+void KeyCache::evict() {
+    while (entries_.size() > capacity_) {
+        erase(std::prev(entries_.end()));
+    }
+}
+
+void KeyCache::erase(std::list<Entry>::iterator it) {
+    if (it->table) {
+        tables_--;
+    }
+    index_.erase(it->keyTag);
+    entries_.erase(it);
+}
+
+bool KeyCache::get(const std::string &keyTag, Bytes &publicKey) {
+    std::shared_ptr<const P256PublicKeyTable> table;
+    return get(keyTag, publicKey, table);
+}
+
+bool KeyCache::get(const std::string &keyTag, Bytes &publicKey, std::shared_ptr<const P256PublicKeyTable> &table) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(keyTag);
+    if (it == index_.end()) {
+        misses_++;
+        return false;
+    }
+    hits_++;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    publicKey = it->second->publicKey;
+    table = it->second->table;
+    return true;
+}
+
+uint64_t KeyCache::generation() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return generation_;
+}
+
+void KeyCache::set(const std::string &keyTag, const Bytes &publicKey, uint64_t generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_) {
+        // the key could have been deleted after it was found, it's looked up again next time
+        return;
+    }
+    auto it = index_.find(keyTag);
+    if (it != index_.end()) {
+        auto &entry = *it->second;
+        if (entry.publicKey != publicKey) {
+            entry.publicKey = publicKey;
+            if (entry.table) {
+                entry.table = nullptr;
+                tables_--;
+            }
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return;
+    }
+    if (capacity_ == 0) {
+        return;
+    }
+    entries_.push_front(Entry{keyTag, publicKey, nullptr});
+    index_[keyTag] = entries_.begin();
+    evict();
+}
+
+void KeyCache::setTable(const std::string &keyTag, const Bytes &publicKey,
+                        std::shared_ptr<const P256PublicKeyTable> table) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(keyTag);
+    if (!table || it == index_.end() || it->second->publicKey != publicKey || it->second->table) {
+        return;
+    }
+    it->second->table = std::move(table);
+    tables_++;
+}
+
+void KeyCache::remove(const std::string &keyTag) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_++;
+    auto it = index_.find(keyTag);
+    if (it == index_.end()) {
+        return;
+    }
+    erase(it->second);
+}
+
+void KeyCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_++;
+    entries_.clear();
+    index_.clear();
+    tables_ = 0;
+}
+
+void KeyCache::setCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+    evict();
+}
+
+KeyCacheStats KeyCache::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return KeyCacheStats{hits_, misses_, entries_.size(), capacity_, tables_};
+}
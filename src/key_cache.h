@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "backend.h"
+#include "p256.h"
+
+constexpr size_t DEFAULT_KEY_CACHE_SIZE = 256;
+constexpr size_t MAX_KEY_CACHE_SIZE = 65536;
+
+struct KeyCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    size_t size;
+    size_t capacity;
+    // entries with a precomputed public key table
+    size_t tables;
+};
+
+// Public keys of known key pairs, so that findKeyPair and encrypt don't need a keychain lookup.
+// Least recently used entries are evicted, entries are invalidated when a key is created or deleted.
+// A lookup that races with a deletion could put the deleted key back, so set is given the generation taken before
+// the keychain was queried and does nothing if any key has been removed since.
+// Private keys are not cached: a SecKeyRef is bound to the LAContext it was found with.
+// Keys used for encryption more than once also get a precomputed table, see P256PublicKeyTable.
+class KeyCache {
+  private:
+    struct Entry {
+        std::string keyTag;
+        Bytes publicKey;
+        // built lazily, shared with operations that are using it
+        std::shared_ptr<const P256PublicKeyTable> table;
+    };
+
+    std::mutex mutex_;
+    // most recently used first
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    size_t capacity_;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    size_t tables_ = 0;
+    // incremented by remove and clear
+    uint64_t generation_ = 0;
+
+    void evict();
+    void erase(std::list<Entry>::iterator it);
+
+  public:
+    explicit KeyCache(size_t capacity);
+
+    KeyCache(const KeyCache &) = delete;
+    KeyCache &operator=(const KeyCache &) = delete;
+
+    bool get(const std::string &keyTag, Bytes &publicKey);
+    // table is null if it has not been built yet
+    bool get(const std::string &keyTag, Bytes &publicKey, std::shared_ptr<const P256PublicKeyTable> &table);
+    // must be called before the keychain lookup whose result is passed to set
+    uint64_t generation();
+    void set(const std::string &keyTag, const Bytes &publicKey, uint64_t generation);
+    // ignored if the entry is gone or has another public key, or the table is null
+    void setTable(const std::string &keyTag, const Bytes &publicKey, std::shared_ptr<const P256PublicKeyTable> table);
+    void remove(const std::string &keyTag);
+    void clear();
+
+    // 0 disables the cache
+    void setCapacity(size_t capacity);
+    KeyCacheStats stats();
+};
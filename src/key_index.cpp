@@ -0,0 +1,427 @@
+#include "key_index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "key_pool.h"
+#include "p256.h"
+#include "sha256.h"
+#include "worker_pool.h"
+
+namespace {
+
+constexpr uint8_t INDEX_MAGIC[4] = {'N', 'S', 'E', 'I'};
+constexpr uint8_t INDEX_VERSION = 1;
+constexpr size_t COUNT_OFFSET = sizeof(INDEX_MAGIC) + 4;
+constexpr size_t CHECKSUM_OFFSET = COUNT_OFFSET + 4;
+constexpr size_t HEADER_SIZE = CHECKSUM_OFFSET + SHA256_DIGEST_SIZE;
+constexpr size_t MAX_KEY_TAG_LENGTH = 0xffff;
+constexpr size_t MAX_INDEX_SIZE = 256 * 1024 * 1024;
+
+uint32_t readUint32(const uint8_t *data) {
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+void appendUint32(Bytes &data, uint32_t value) {
+    data.push_back(uint8_t(value >> 24));
+    data.push_back(uint8_t(value >> 16));
+    data.push_back(uint8_t(value >> 8));
+    data.push_back(uint8_t(value));
+}
+
+// entry at the offset, bounds are checked when the file is mapped
+struct EntryView {
+    const char *keyTag;
+    size_t keyTagLength;
+    const uint8_t *publicKey;
+};
+
+EntryView entryAt(const uint8_t *map, uint32_t index) {
+    auto entry = map + readUint32(map + HEADER_SIZE + size_t(index) * 4);
+    auto keyTagLength = (size_t(entry[0]) << 8) | size_t(entry[1]);
+    return EntryView{reinterpret_cast<const char *>(entry + 2), keyTagLength, entry + 2 + keyTagLength};
+}
+
+int compareKeyTag(const EntryView &entry, const std::string &keyTag) {
+    auto result = memcmp(entry.keyTag, keyTag.data(), std::min(entry.keyTagLength, keyTag.length()));
+    if (result != 0) {
+        return result;
+    }
+    return entry.keyTagLength < keyTag.length() ? -1 : entry.keyTagLength > keyTag.length() ? 1 : 0;
+}
+
+bool validateIndex(const uint8_t *data, size_t length) {
+    if (length < HEADER_SIZE || memcmp(data, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        data[sizeof(INDEX_MAGIC)] != INDEX_VERSION) {
+        return false;
+    }
+
+    uint8_t checksum[SHA256_DIGEST_SIZE];
+    Sha256 sha;
+    sha.update(data + HEADER_SIZE, length - HEADER_SIZE);
+    sha.finish(checksum);
+    if (memcmp(checksum, data + CHECKSUM_OFFSET, SHA256_DIGEST_SIZE) != 0) {
+        return false;
+    }
+
+    auto count = readUint32(data + COUNT_OFFSET);
+    if (size_t(count) > (length - HEADER_SIZE) / 4) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        auto offset = size_t(readUint32(data + HEADER_SIZE + size_t(i) * 4));
+        if (offset < HEADER_SIZE + size_t(count) * 4 || offset + 2 > length) {
+            return false;
+        }
+        auto keyTagLength = (size_t(data[offset]) << 8) | size_t(data[offset + 1]);
+        if (offset + 2 + keyTagLength + P256_PUBLIC_KEY_SIZE > length) {
+            return false;
+        }
+        if (i > 0) {
+            auto previous = entryAt(data, i - 1);
+            auto current = entryAt(data, i);
+            if (compareKeyTag(previous, std::string(current.keyTag, current.keyTagLength)) >= 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+Bytes serializeIndex(const std::vector<KeyInfo> &entries) {
+    Bytes data(INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+    data.push_back(INDEX_VERSION);
+    data.insert(data.end(), 3, 0);
+    appendUint32(data, uint32_t(entries.size()));
+    data.insert(data.end(), SHA256_DIGEST_SIZE, 0);
+
+    auto offset = HEADER_SIZE + entries.size() * 4;
+    for (auto &entry : entries) {
+        appendUint32(data, uint32_t(offset));
+        offset += 2 + entry.keyTag.length() + P256_PUBLIC_KEY_SIZE;
+    }
+    for (auto &entry : entries) {
+        data.push_back(uint8_t(entry.keyTag.length() >> 8));
+        data.push_back(uint8_t(entry.keyTag.length()));
+        data.insert(data.end(), entry.keyTag.begin(), entry.keyTag.end());
+        data.insert(data.end(), entry.publicKey.begin(), entry.publicKey.end());
+    }
+
+    Sha256 sha;
+    sha.update(data.data() + HEADER_SIZE, data.size() - HEADER_SIZE);
+    sha.finish(data.data() + CHECKSUM_OFFSET);
+    return data;
+}
+
+bool isIndexable(const std::string &keyTag, const Bytes &publicKey) {
+    return keyTag.length() <= MAX_KEY_TAG_LENGTH && publicKey.size() == P256_PUBLIC_KEY_SIZE;
+}
+
+// Exclusive lock on <path>.lock held while the index is re-read and rewritten, so that concurrent writers don't lose
+// each other's entries. The index itself can't be locked because it's replaced by rename. flock locks belong to the
+// open file, so writers in other worker threads of the same process wait too.
+class IndexFileLock {
+  private:
+    int fd_;
+
+  public:
+    explicit IndexFileLock(const std::string &path) {
+        fd_ = open((path + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        while (fd_ >= 0 && flock(fd_, LOCK_EX) != 0) {
+            if (errno != EINTR) {
+                close(fd_);
+                fd_ = -1;
+            }
+        }
+    }
+    ~IndexFileLock() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    IndexFileLock(const IndexFileLock &) = delete;
+    IndexFileLock &operator=(const IndexFileLock &) = delete;
+
+    explicit operator bool() const { return fd_ >= 0; }
+};
+
+} // namespace
+
+KeyIndex::KeyIndex(std::string path, double reconcileSeconds)
+    : path_(std::move(path)), reconcileSeconds_(reconcileSeconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    mapLocked();
+}
+
+KeyIndex::~KeyIndex() { unmapLocked(); }
+
+void KeyIndex::mapLocked() {
+    unmapLocked();
+
+    auto fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || size_t(st.st_size) > MAX_INDEX_SIZE) {
+        close(fd);
+        return;
+    }
+    auto length = size_t(st.st_size);
+    auto map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+
+    auto data = static_cast<const uint8_t *>(map);
+    if (!validateIndex(data, length)) {
+        munmap(map, length);
+        return;
+    }
+    map_ = data;
+    mapLength_ = length;
+    count_ = readUint32(data + COUNT_OFFSET);
+}
+
+void KeyIndex::unmapLocked() {
+    if (map_) {
+        munmap(const_cast<uint8_t *>(map_), mapLength_);
+    }
+    map_ = nullptr;
+    mapLength_ = 0;
+    count_ = 0;
+}
+
+uint32_t KeyIndex::lowerBoundLocked(const std::string &keyTag) const {
+    uint32_t low = 0;
+    auto high = count_;
+    while (low < high) {
+        auto middle = low + (high - low) / 2;
+        if (compareKeyTag(entryAt(map_, middle), keyTag) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+bool KeyIndex::findLocked(const std::string &keyTag, Bytes &publicKey) const {
+    if (!map_) {
+        return false;
+    }
+    auto index = lowerBoundLocked(keyTag);
+    if (index >= count_) {
+        return false;
+    }
+    auto entry = entryAt(map_, index);
+    if (compareKeyTag(entry, keyTag) != 0) {
+        return false;
+    }
+    publicKey.assign(entry.publicKey, entry.publicKey + P256_PUBLIC_KEY_SIZE);
+    return true;
+}
+
+std::vector<KeyInfo> KeyIndex::entriesLocked() const {
+    std::vector<KeyInfo> entries;
+    entries.reserve(count_);
+    for (uint32_t i = 0; i < count_; i++) {
+        auto entry = entryAt(map_, i);
+        entries.push_back(KeyInfo{std::string(entry.keyTag, entry.keyTagLength),
+                                  Bytes(entry.publicKey, entry.publicKey + P256_PUBLIC_KEY_SIZE)});
+    }
+    return entries;
+}
+
+void KeyIndex::writeLocked(std::vector<KeyInfo> entries) {
+    std::sort(entries.begin(), entries.end(), [](const KeyInfo &a, const KeyInfo &b) { return a.keyTag < b.keyTag; });
+    auto data = serializeIndex(entries);
+
+    // a new file is renamed over the old one, so that other processes see either the old or the new index;
+    // the temp name is unique, environments in worker threads can write at the same time
+    auto tempPath = path_ + ".XXXXXX";
+    auto fd = mkstemp(&tempPath[0]);
+    if (fd < 0) {
+        return;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    auto remaining = data.size();
+    auto ptr = data.data();
+    while (remaining > 0) {
+        auto written = write(fd, ptr, remaining);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            break;
+        }
+        ptr += written;
+        remaining -= size_t(written);
+    }
+    // the data must be on disk before the rename, otherwise a crash can leave an empty index
+    auto synced = remaining == 0 && fsync(fd) == 0;
+    close(fd);
+    if (!synced || rename(tempPath.c_str(), path_.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return;
+    }
+    mapLocked();
+}
+
+bool KeyIndex::get(const std::string &keyTag, Bytes &publicKey) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = findLocked(keyTag, publicKey);
+    if (found) {
+        hits_++;
+    } else {
+        misses_++;
+    }
+    return found;
+}
+
+void KeyIndex::set(const std::string &keyTag, const Bytes &publicKey) {
+    if (!isIndexable(keyTag, publicKey)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    Bytes existing;
+    if (findLocked(keyTag, existing) && existing == publicKey) {
+        return;
+    }
+
+    // the mapping can be older than the file, it's re-read under the lock so that other writers' entries are kept
+    IndexFileLock fileLock(path_);
+    if (!fileLock) {
+        return;
+    }
+    mapLocked();
+    auto found = findLocked(keyTag, existing);
+    if (found && existing == publicKey) {
+        return;
+    }
+
+    auto entries = entriesLocked();
+    if (found) {
+        // the key was replaced, probably by another process
+        repairs_++;
+        for (auto &entry : entries) {
+            if (entry.keyTag == keyTag) {
+                entry.publicKey = publicKey;
+            }
+        }
+    } else {
+        entries.push_back(KeyInfo{keyTag, publicKey});
+    }
+    writeLocked(std::move(entries));
+}
+
+void KeyIndex::remove(const std::string &keyTag) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // the entry can be added by another process after the mapping was made, so the file is always re-read
+    IndexFileLock fileLock(path_);
+    if (!fileLock) {
+        return;
+    }
+    mapLocked();
+    Bytes existing;
+    if (!findLocked(keyTag, existing)) {
+        return;
+    }
+    auto entries = entriesLocked();
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [&keyTag](const KeyInfo &entry) { return entry.keyTag == keyTag; }),
+                  entries.end());
+    writeLocked(std::move(entries));
+}
+
+bool KeyIndex::startReconcile() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    if (reconciling_ || (reconciles_ && now - lastReconcile_ < std::chrono::duration<double>(reconcileSeconds_))) {
+        return false;
+    }
+    reconciling_ = true;
+    lastReconcile_ = now;
+    return true;
+}
+
+void KeyIndex::finishReconcile(const std::vector<KeyInfo> *keys) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reconciling_ = false;
+    reconciles_++;
+    if (!keys) {
+        return;
+    }
+
+    IndexFileLock fileLock(path_);
+    if (!fileLock) {
+        return;
+    }
+    mapLocked();
+
+    std::vector<KeyInfo> entries;
+    for (auto &key : *keys) {
+        if (isIndexable(key.keyTag, key.publicKey)) {
+            entries.push_back(key);
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const KeyInfo &a, const KeyInfo &b) { return a.keyTag < b.keyTag; });
+
+    // entries that are missing, extra or have a different public key
+    auto current = entriesLocked();
+    uint64_t differences = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < current.size() || j < entries.size()) {
+        if (j == entries.size() || (i < current.size() && current[i].keyTag < entries[j].keyTag)) {
+            differences++;
+            i++;
+        } else if (i == current.size() || entries[j].keyTag < current[i].keyTag) {
+            differences++;
+            j++;
+        } else {
+            if (current[i].publicKey != entries[j].publicKey) {
+                differences++;
+            }
+            i++;
+            j++;
+        }
+    }
+
+    if (differences || !map_) {
+        repairs_ += differences;
+        writeLocked(std::move(entries));
+    }
+}
+
+KeyIndexStats KeyIndex::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return KeyIndexStats{hits_, misses_, repairs_, reconciles_, count_};
+}
+
+void reconcileKeyIndexInBackground(const std::shared_ptr<KeyIndex> &keyIndex) {
+    if (!keyIndex->startReconcile()) {
+        return;
+    }
+    getWorkerPool().submit([keyIndex]() {
+        std::vector<KeyInfo> keys;
+        auto error = getBackend().listKeys(std::string(), KEY_POOL_TAG_PREFIX, 0, keys);
+        keyIndex->finishReconcile(error ? nullptr : &keys);
+    });
+}
+
+void removeMissingKeyFromIndex(const std::shared_ptr<KeyIndex> &keyIndex, const std::string &keyTag,
+                               const BackendError &error) {
+    if (keyIndex && error.code == STATUS_ITEM_NOT_FOUND) {
+        keyIndex->remove(keyTag);
+    }
+}
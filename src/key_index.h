@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "backend.h"
+
+// Index file format, a sorted table of keyTags and public keys that is looked up in place through mmap:
+//
+//  magic "NSEI" | version (1) | reserved (3) | entry count (4, BE) | SHA-256 of the rest of the file (32)
+//  | entry offsets (4 each, BE, from the start of the file, sorted by keyTag)
+//  | entries: keyTag length (2, BE) | keyTag | public key (65)
+//
+// The file is validated when it's mapped, a file that fails validation is ignored and rewritten on the next change.
+// Updates write a new file and rename it over the old one, so readers in other processes never see a partial file.
+// Writers hold a lock on <path>.lock and re-read the file first, so that changes made by other processes are kept.
+
+constexpr double DEFAULT_KEY_INDEX_RECONCILE_SECONDS = 60;
+
+struct KeyIndexStats {
+    uint64_t hits;
+    uint64_t misses;
+    // entries that didn't match the keychain and were fixed
+    uint64_t repairs;
+    uint64_t reconciles;
+    size_t size;
+};
+
+// Persistent keyTag -> public key index, so that findKeyPair doesn't need the keychain on cold start.
+// It's a hint that can be stale: it's reconciled with the keychain in the background every reconcileSeconds. Until
+// then, findKeyPair can return a key deleted by another process; the entry is removed when an operation using the key
+// doesn't find it in the keychain.
+class KeyIndex {
+  private:
+    std::mutex mutex_;
+    std::string path_;
+    double reconcileSeconds_;
+    // null if the file doesn't exist or is invalid
+    const uint8_t *map_ = nullptr;
+    size_t mapLength_ = 0;
+    uint32_t count_ = 0;
+    std::chrono::steady_clock::time_point lastReconcile_;
+    bool reconciling_ = false;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t repairs_ = 0;
+    uint64_t reconciles_ = 0;
+
+    void mapLocked();
+    void unmapLocked();
+    // index of the entry with this keyTag, or the position where it should be inserted
+    uint32_t lowerBoundLocked(const std::string &keyTag) const;
+    bool findLocked(const std::string &keyTag, Bytes &publicKey) const;
+    std::vector<KeyInfo> entriesLocked() const;
+    void writeLocked(std::vector<KeyInfo> entries);
+
+  public:
+    KeyIndex(std::string path, double reconcileSeconds);
+    ~KeyIndex();
+
+    KeyIndex(const KeyIndex &) = delete;
+    KeyIndex &operator=(const KeyIndex &) = delete;
+
+    const std::string &path() const { return path_; }
+
+    bool get(const std::string &keyTag, Bytes &publicKey);
+
+    // called with keychain results, counted as a repair if the index was wrong
+    void set(const std::string &keyTag, const Bytes &publicKey);
+    void remove(const std::string &keyTag);
+
+    // returns true if it's time to reconcile and no reconcile is running, the caller must call finishReconcile
+    bool startReconcile();
+    // replaces the index with all keys from the keychain, keys is null if the keychain couldn't be listed
+    void finishReconcile(const std::vector<KeyInfo> *keys);
+
+    KeyIndexStats stats();
+};
+
+// lists keys and reconciles the index on the worker pool if it's time to do it
+void reconcileKeyIndexInBackground(const std::shared_ptr<KeyIndex> &keyIndex);
+
+// called with the result of a keychain lookup by keyTag, removes the entry if the key is not in the keychain anymore
+void removeMissingKeyFromIndex(const std::shared_ptr<KeyIndex> &keyIndex, const std::string &keyTag,
+                               const BackendError &error);
@@ -0,0 +1,164 @@
+#include "key_pool.h"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "worker_pool.h"
+
+namespace {
+
+std::atomic<uint64_t> nextKeyNumber{0};
+std::once_flag staleKeysDeleted;
+
+std::string newPoolTag() {
+    return KEY_POOL_TAG_PREFIX + std::to_string(getpid()) + "." + std::to_string(nextKeyNumber++);
+}
+
+// a key is stale if the process that generated it is gone, a pid can be reused, then the key stays until next time;
+// tags not like <pid>.<n> weren't made by the pool and are never deleted
+bool isStalePoolTag(const std::string &keyTag) {
+    auto suffix = keyTag.substr(strlen(KEY_POOL_TAG_PREFIX));
+    auto dot = suffix.find('.');
+    auto isNumber = [](const std::string &str) {
+        return !str.empty() && str.length() <= 18 && str.find_first_not_of("0123456789") == std::string::npos;
+    };
+    if (dot == std::string::npos || !isNumber(suffix.substr(0, dot)) || !isNumber(suffix.substr(dot + 1))) {
+        return false;
+    }
+    auto pid = strtoll(suffix.c_str(), nullptr, 10);
+    if (pid <= 0 || pid != pid_t(pid)) {
+        return false;
+    }
+    return pid != getpid() && kill(pid_t(pid), 0) != 0 && errno == ESRCH;
+}
+
+void deleteStaleKeys() {
+    std::vector<KeyInfo> keys;
+    if (getBackend().listKeys(KEY_POOL_TAG_PREFIX, std::string(), 0, keys)) {
+        return;
+    }
+    for (auto &key : keys) {
+        if (isStalePoolTag(key.keyTag)) {
+            getBackend().deleteKeyPair(key.keyTag);
+        }
+    }
+}
+
+void deleteKeysInBackground(std::vector<std::string> keyTags) {
+    if (keyTags.empty()) {
+        return;
+    }
+    getWorkerPool().submit([keyTags]() {
+        for (auto &keyTag : keyTags) {
+            getBackend().deleteKeyPair(keyTag);
+        }
+    });
+}
+
+} // namespace
+
+KeyPool::~KeyPool() {
+    for (auto &key : keys_) {
+        getBackend().deleteKeyPair(key.keyTag);
+    }
+}
+
+void KeyPool::refillLocked() {
+    if (refilling_ || keys_.size() >= depth_) {
+        return;
+    }
+    refilling_ = true;
+    auto self = shared_from_this();
+    getWorkerPool().submit([self]() { self->refillOne(); });
+}
+
+void KeyPool::refillOne() {
+    std::call_once(staleKeysDeleted, deleteStaleKeys);
+
+    auto keyTag = newPoolTag();
+    Bytes publicKey;
+    auto startedAt = monotonicNowNs();
+    auto error = getBackend().createKeyPair(keyTag, publicKey);
+    auto durationNs = monotonicNowNs() - startedAt;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    refilling_ = false;
+    if (error) {
+        // not retried right away, the next claim starts another refill
+        refillErrors_++;
+        return;
+    }
+    refillLatency_.record(durationNs);
+    if (keys_.size() >= depth_) {
+        // the depth was reduced while the key was being generated
+        lock.unlock();
+        getBackend().deleteKeyPair(keyTag);
+        return;
+    }
+    keys_.push_back(PooledKey{std::move(keyTag), std::move(publicKey)});
+    refillLocked();
+}
+
+void KeyPool::setDepth(size_t depth) {
+    std::vector<std::string> extraKeyTags;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        depth_ = depth;
+        while (keys_.size() > depth_) {
+            extraKeyTags.push_back(std::move(keys_.back().keyTag));
+            keys_.pop_back();
+        }
+        refillLocked();
+    }
+    deleteKeysInBackground(std::move(extraKeyTags));
+}
+
+bool KeyPool::claim(const std::string &keyTag, Bytes &publicKey, BackendError &error) {
+    PooledKey key;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (keys_.empty()) {
+            misses_++;
+            refillLocked();
+            return false;
+        }
+        key = std::move(keys_.front());
+        keys_.pop_front();
+    }
+
+    auto renameError = getBackend().renameKeyPair(key.keyTag, keyTag);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!renameError) {
+        hits_++;
+        publicKey = std::move(key.publicKey);
+        refillLocked();
+        return true;
+    }
+    if (renameError.code == STATUS_DUPLICATE_ITEM) {
+        // the same error as createKeyPair, the pooled key can still be used for another tag
+        keys_.push_front(std::move(key));
+        error = renameError;
+        return true;
+    }
+    // the pooled key was deleted by someone else or is broken
+    misses_++;
+    deleteKeysInBackground({key.keyTag});
+    refillLocked();
+    return false;
+}
+
+KeyPoolStats KeyPool::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return KeyPoolStats{depth_, keys_.size(), hits_, misses_, refillErrors_, refillLatency_.summary()};
+}
+
+bool isKeyPoolTag(const std::string &keyTag) {
+    return keyTag.compare(0, strlen(KEY_POOL_TAG_PREFIX), KEY_POOL_TAG_PREFIX) == 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "backend.h"
+#include "stats.h"
+
+constexpr size_t MAX_KEY_POOL_DEPTH = 32;
+
+// pooled keys have tags like net.antelle.node-secure-enclave.pool.<pid>.<n>
+constexpr const char *KEY_POOL_TAG_PREFIX = "net.antelle.node-secure-enclave.pool.";
+
+struct KeyPoolStats {
+    size_t depth;
+    // keys ready to be claimed
+    size_t size;
+    // createKeyPair calls served from the pool, and ones that had to generate a key
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t refillErrors;
+    // time to generate one key in the background
+    HistogramSummary refill;
+};
+
+// Keys generated in the background under temporary tags, so that createKeyPair doesn't wait for key generation.
+// A key is claimed by renaming it to the requested tag. The pool is refilled on the worker pool, one key per task,
+// so other operations aren't held up. Keys left by processes that are not running anymore are deleted on the first
+// refill. All methods can be called from any thread.
+class KeyPool : public std::enable_shared_from_this<KeyPool> {
+  private:
+    struct PooledKey {
+        std::string keyTag;
+        Bytes publicKey;
+    };
+
+    std::mutex mutex_;
+    size_t depth_ = 0;
+    std::deque<PooledKey> keys_;
+    bool refilling_ = false;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t refillErrors_ = 0;
+    Histogram refillLatency_;
+
+    // starts a refill task unless one is running or the pool is full
+    void refillLocked();
+    void refillOne();
+
+  public:
+    KeyPool() = default;
+    // deletes keys that haven't been claimed
+    ~KeyPool();
+
+    KeyPool(const KeyPool &) = delete;
+    KeyPool &operator=(const KeyPool &) = delete;
+
+    // the pool is refilled up to depth keys, extra keys are deleted in the background
+    void setDepth(size_t depth);
+
+    // renames a pooled key to keyTag; returns false if no key could be claimed, then a new key must be generated,
+    // if keyTag is taken, returns true with the error; must run in the keyTag's turn in KeyTagQueue, so that the
+    // claim doesn't race with other calls for keyTag in this process
+    bool claim(const std::string &keyTag, Bytes &publicKey, BackendError &error);
+
+    KeyPoolStats stats();
+};
+
+// pooled keys are hidden from listKeys and the key index
+bool isKeyPoolTag(const std::string &keyTag);
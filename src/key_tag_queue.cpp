@@ -0,0 +1,46 @@
+#include "key_tag_queue.h"
+
+#include <utility>
+
+#include "worker_pool.h"
+
+void KeyTagQueue::submit(const std::string &keyTag, std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &tasks = tasks_[keyTag];
+        tasks.push_back(std::move(task));
+        if (tasks.size() > 1) {
+            // started when the previous one is done
+            return;
+        }
+    }
+    runNext(keyTag);
+}
+
+void KeyTagQueue::runNext(const std::string &keyTag) {
+    getWorkerPool().submit([this, keyTag]() {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            // the empty function stays in the queue while the task is running
+            task = std::move(tasks_[keyTag].front());
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = tasks_.find(keyTag);
+            it->second.pop_front();
+            if (it->second.empty()) {
+                tasks_.erase(it);
+                return;
+            }
+        }
+        runNext(keyTag);
+    });
+}
+
+KeyTagQueue &getKeyTagQueue() {
+    // never destroyed, worker threads can still finish tasks while static objects are destroyed on exit
+    static auto queue = new KeyTagQueue();
+    return *queue;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Runs tasks on the worker pool one keyTag at a time: a task starts after all tasks submitted earlier for its keyTag
+// have finished, tasks for other keyTags run in parallel. It's shared by all environments in the process, so that
+// creating, claiming and deleting a key can't interleave, see CreateKeyPairOperation.
+class KeyTagQueue {
+  private:
+    std::mutex mutex_;
+    // the first task of a keyTag is the running one, keyTags without tasks are removed
+    std::unordered_map<std::string, std::deque<std::function<void()>>> tasks_;
+
+    void runNext(const std::string &keyTag);
+
+  public:
+    KeyTagQueue() = default;
+
+    KeyTagQueue(const KeyTagQueue &) = delete;
+    KeyTagQueue &operator=(const KeyTagQueue &) = delete;
+
+    void submit(const std::string &keyTag, std::function<void()> task);
+};
+
+KeyTagQueue &getKeyTagQueue();
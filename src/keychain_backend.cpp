@@ -0,0 +1,478 @@
+#include <Security/Security.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "auto_release.h"
+#include "backend.h"
+#include "objc_impl.h"
+#include "p256.h"
+
+namespace {
+
+constexpr int KEY_SIZE_IN_BITS = 256;
+
+CFDataRef createKeyTagData(const std::string &keyTag) {
+    return CFDataCreate(kCFAllocatorDefault, reinterpret_cast<const UInt8 *>(keyTag.c_str()), keyTag.length());
+}
+
+// query for all our private keys
+CFMutableDictionaryRef createKeyQueryAttributes() {
+    auto queryAttributes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks,
+                                                     &kCFTypeDictionaryValueCallBacks);
+
+    CFDictionaryAddValue(queryAttributes, kSecClass, kSecClassKey);
+    CFDictionaryAddValue(queryAttributes, kSecAttrKeyClass, kSecAttrKeyClassPrivate);
+    CFDictionaryAddValue(queryAttributes, kSecAttrKeyType, kSecAttrKeyTypeEC);
+    CFDictionaryAddValue(queryAttributes, kSecReturnRef, kCFBooleanTrue);
+#ifndef NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN
+    CFDictionaryAddValue(queryAttributes, kSecAttrTokenID, kSecAttrTokenIDSecureEnclave);
+#endif
+
+    return queryAttributes;
+}
+
+CFMutableDictionaryRef createKeyQueryAttributes(const std::string &keyTag) {
+    auto_release keyTagData = createKeyTagData(keyTag);
+
+    auto queryAttributes = createKeyQueryAttributes();
+    CFDictionaryAddValue(queryAttributes, kSecAttrApplicationTag, keyTagData);
+
+    return queryAttributes;
+}
+
+// changes the tag of one key, found by its tag and application label
+OSStatus updateKeyTag(const std::string &keyTag, CFDataRef applicationLabel, const std::string &newKeyTag) {
+    // SecItemUpdate doesn't accept return types in the query
+    auto_release queryAttributes = createKeyQueryAttributes(keyTag);
+    CFDictionaryRemoveValue(queryAttributes, kSecReturnRef);
+    CFDictionaryAddValue(queryAttributes, kSecAttrApplicationLabel, applicationLabel);
+
+    auto_release newKeyTagData = createKeyTagData(newKeyTag);
+    auto_release updateAttributes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks,
+                                                              &kCFTypeDictionaryValueCallBacks);
+    CFDictionaryAddValue(updateAttributes, kSecAttrApplicationTag, newKeyTagData);
+    CFDictionaryAddValue(updateAttributes, kSecAttrLabel, newKeyTagData);
+
+    auto status = SecItemUpdate(queryAttributes, updateAttributes);
+
+#ifdef NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN
+    if (status == errSecSuccess) {
+        CFDictionarySetValue(queryAttributes, kSecAttrKeyClass, kSecAttrKeyClassPublic);
+        SecItemUpdate(queryAttributes, updateAttributes);
+    }
+#endif
+
+    return status;
+}
+
+Bytes cfDataToBytes(CFDataRef cfData) {
+    auto bytePtr = CFDataGetBytePtr(cfData);
+    return Bytes(bytePtr, bytePtr + CFDataGetLength(cfData));
+}
+
+BackendError errorFromCFError(CFErrorRef error, const std::string &op) {
+    return errorWithCode(error ? CFErrorGetCode(error) : errSecSuccess, op);
+}
+
+BackendError copyExternalRepresentation(SecKeyRef privateKey, Bytes &publicKeyBytes) {
+    auto_release publicKey = SecKeyCopyPublicKey(privateKey);
+    if (!publicKey) {
+        return errorWithMessage("Can't extract public key");
+    }
+
+    auto_release<CFErrorRef> error = nullptr;
+    auto_release publicKeyData = SecKeyCopyExternalRepresentation(publicKey, &error);
+    if (!publicKeyData) {
+        return errorFromCFError(error, "SecKeyCopyExternalRepresentation");
+    }
+
+    publicKeyBytes = cfDataToBytes(publicKeyData);
+    return BackendError();
+}
+
+class KeychainAuthContext : public AuthContext {
+  public:
+    // LAContext, attached to key queries with kSecUseAuthenticationContext
+    auto_release<CFTypeRef> laContext;
+
+    explicit KeychainAuthContext(CFTypeRef context) : laContext(context) {}
+
+    void invalidate() override { invalidateAuthenticationContext(laContext); }
+};
+
+struct AuthCallbackData {
+    std::shared_ptr<AuthContext> authContext;
+    AuthCallback callback;
+};
+
+class KeychainKeyPair : public KeyPair {
+  private:
+    auto_release<SecKeyRef> privateKey_;
+
+  public:
+    explicit KeychainKeyPair(SecKeyRef privateKey) : privateKey_(privateKey) {}
+
+    BackendError copyPublicKey(Bytes &publicKey) override { return copyExternalRepresentation(privateKey_, publicKey); }
+
+    BackendError encrypt(const uint8_t *data, size_t length, Bytes &encrypted) override {
+        auto_release publicKey = SecKeyCopyPublicKey(privateKey_);
+        if (!publicKey) {
+            return errorWithMessage("Can't extract public key");
+        }
+
+        auto supported = SecKeyIsAlgorithmSupported(publicKey, kSecKeyOperationTypeEncrypt,
+                                                    kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM);
+        if (!supported) {
+            return errorWithMessage("Algorithm not supported");
+        }
+
+        // data points to the memory owned by the caller, no need to clean it up here
+        auto_release decryptedData = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, data, length, kCFAllocatorNull);
+
+        auto_release<CFErrorRef> error = nullptr;
+        auto_release encryptedData = SecKeyCreateEncryptedData(
+            publicKey, kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM, decryptedData, &error);
+        if (error || !encryptedData) {
+            return errorFromCFError(error, "SecKeyCreateEncryptedData");
+        }
+
+        encrypted = cfDataToBytes(encryptedData);
+        return BackendError();
+    }
+
+    BackendError decrypt(const uint8_t *data, size_t length, SecureBytes &decrypted) override {
+        auto supported = SecKeyIsAlgorithmSupported(privateKey_, kSecKeyOperationTypeDecrypt,
+                                                    kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM);
+        if (!supported) {
+            return errorWithMessage("Algorithm not supported");
+        }
+
+        auto_release encryptedData = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, data, length, kCFAllocatorNull);
+
+        auto_release<CFErrorRef> error = nullptr;
+        auto_release decryptedData = SecKeyCreateDecryptedData(
+            privateKey_, kSecKeyAlgorithmECIESEncryptionCofactorVariableIVX963SHA256AESGCM, encryptedData, &error);
+        if (error || !decryptedData) {
+            return errorFromCFError(error, "SecKeyCreateDecryptedData");
+        }
+
+        auto decryptedBytes = CFDataGetBytePtr(decryptedData);
+        decrypted.assign(decryptedBytes, decryptedBytes + CFDataGetLength(decryptedData));
+
+        // clean up our copy of decrypted data
+        // this is not const-correct, but looks like there's no way to get CFMutableData from SecKeyCreateDecryptedData
+        auto dataBytePtr = CFDataGetBytePtr(decryptedData);
+        memset(const_cast<UInt8 *>(dataBytePtr), 0, CFDataGetLength(decryptedData));
+
+        return BackendError();
+    }
+
+    BackendError sign(const uint8_t *data, size_t length, Bytes &signature) override {
+        auto supported = SecKeyIsAlgorithmSupported(privateKey_, kSecKeyOperationTypeSign,
+                                                    kSecKeyAlgorithmECDSASignatureMessageX962SHA256);
+        if (!supported) {
+            return errorWithMessage("Algorithm not supported");
+        }
+
+        auto_release dataToSign = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, data, length, kCFAllocatorNull);
+
+        auto_release<CFErrorRef> error = nullptr;
+        auto_release signatureData =
+            SecKeyCreateSignature(privateKey_, kSecKeyAlgorithmECDSASignatureMessageX962SHA256, dataToSign, &error);
+        if (error || !signatureData) {
+            return errorFromCFError(error, "SecKeyCreateSignature");
+        }
+
+        signature = cfDataToBytes(signatureData);
+        return BackendError();
+    }
+
+    BackendError deriveSharedSecret(const uint8_t *peerPublicKey, const uint8_t *sharedInfo, size_t sharedInfoLength,
+                                    size_t length, SecureBytes &derived) override {
+        auto supported = SecKeyIsAlgorithmSupported(privateKey_, kSecKeyOperationTypeKeyExchange,
+                                                    kSecKeyAlgorithmECDHKeyExchangeCofactorX963SHA256);
+        if (!supported) {
+            return errorWithMessage("Algorithm not supported");
+        }
+
+        auto_release keySize = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &KEY_SIZE_IN_BITS);
+        auto_release peerKeyAttributes = CFDictionaryCreateMutable(
+            kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        CFDictionaryAddValue(peerKeyAttributes, kSecAttrKeyType, kSecAttrKeyTypeEC);
+        CFDictionaryAddValue(peerKeyAttributes, kSecAttrKeyClass, kSecAttrKeyClassPublic);
+        CFDictionaryAddValue(peerKeyAttributes, kSecAttrKeySizeInBits, keySize);
+
+        auto_release<CFErrorRef> error = nullptr;
+        auto_release peerKeyData = CFDataCreate(kCFAllocatorDefault, peerPublicKey, P256_PUBLIC_KEY_SIZE);
+        auto_release peerKey = SecKeyCreateWithData(peerKeyData, peerKeyAttributes, &error);
+        if (!peerKey) {
+            return errorFromCFError(error, "SecKeyCreateWithData");
+        }
+
+        auto requestedSize = CFIndex(length);
+        auto_release requestedSizeNumber = CFNumberCreate(kCFAllocatorDefault, kCFNumberCFIndexType, &requestedSize);
+        auto_release sharedInfoData = CFDataCreate(kCFAllocatorDefault, sharedInfo, CFIndex(sharedInfoLength));
+        auto_release parameters = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks,
+                                                            &kCFTypeDictionaryValueCallBacks);
+        CFDictionaryAddValue(parameters, kSecKeyKeyExchangeParameterRequestedSize, requestedSizeNumber);
+        CFDictionaryAddValue(parameters, kSecKeyKeyExchangeParameterSharedInfo, sharedInfoData);
+
+        auto_release derivedData = SecKeyCopyKeyExchangeResult(
+            privateKey_, kSecKeyAlgorithmECDHKeyExchangeCofactorX963SHA256, peerKey, parameters, &error);
+        if (error || !derivedData) {
+            return errorFromCFError(error, "SecKeyCopyKeyExchangeResult");
+        }
+
+        auto dataBytePtr = CFDataGetBytePtr(derivedData);
+        derived.assign(dataBytePtr, dataBytePtr + CFDataGetLength(derivedData));
+
+        // clean up our copy, see decrypt
+        memset(const_cast<UInt8 *>(dataBytePtr), 0, CFDataGetLength(derivedData));
+
+        return BackendError();
+    }
+};
+
+class KeychainBackend : public Backend {
+  public:
+    const char *name() const override { return "keychain"; }
+
+    bool isSupported() override { return isBiometricAuthSupported(); }
+
+    std::string errorMessage(long code) override {
+        auto_release errorMessage = SecCopyErrorMessageString(static_cast<OSStatus>(code), nullptr);
+        if (!errorMessage) {
+            return std::string();
+        }
+        auto str = CFStringGetCStringPtr(errorMessage, kCFStringEncodingUTF8);
+        if (str) {
+            return str;
+        }
+        char buffer[1024];
+        if (CFStringGetCString(errorMessage, buffer, sizeof(buffer), kCFStringEncodingUTF8)) {
+            return buffer;
+        }
+        return std::string();
+    }
+
+    BackendError createKeyPair(const std::string &keyTag, Bytes &publicKey) override {
+        auto_release queryAttributes = createKeyQueryAttributes(keyTag);
+
+        auto_release<SecKeyRef> existingPrivateKey = nullptr;
+        auto existingKeyStatus = SecItemCopyMatching(queryAttributes, existingPrivateKey.cfTypeRef());
+
+        if (existingKeyStatus == errSecSuccess) {
+            return errorWithCode(STATUS_DUPLICATE_ITEM, "SecItemCopyMatching");
+        } else if (existingKeyStatus != errSecItemNotFound) {
+            return errorWithCode(existingKeyStatus, "SecItemCopyMatching");
+        }
+
+        auto_release keyTagData = createKeyTagData(keyTag);
+
+        auto_release keySize = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &KEY_SIZE_IN_BITS);
+
+        auto_release creteKeyAttributes = CFDictionaryCreateMutable(
+            kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+        auto_release privateKeyAttrs = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks,
+                                                                 &kCFTypeDictionaryValueCallBacks);
+
+        CFDictionaryAddValue(privateKeyAttrs, kSecAttrIsPermanent, kCFBooleanTrue);
+        CFDictionaryAddValue(privateKeyAttrs, kSecAttrApplicationTag, keyTagData);
+        CFDictionaryAddValue(privateKeyAttrs, kSecAttrLabel, keyTagData);
+
+        CFDictionaryAddValue(creteKeyAttributes, kSecAttrKeyType, kSecAttrKeyTypeEC);
+        CFDictionaryAddValue(creteKeyAttributes, kSecAttrKeySizeInBits, keySize);
+        CFDictionaryAddValue(creteKeyAttributes, kSecPrivateKeyAttrs, privateKeyAttrs);
+
+#ifdef NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN
+        auto_release publicKeyAttrs = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks,
+                                                                &kCFTypeDictionaryValueCallBacks);
+
+        CFDictionaryAddValue(publicKeyAttrs, kSecAttrIsPermanent, kCFBooleanTrue);
+        CFDictionaryAddValue(publicKeyAttrs, kSecAttrApplicationTag, keyTagData);
+        CFDictionaryAddValue(publicKeyAttrs, kSecAttrLabel, keyTagData);
+
+        CFDictionaryAddValue(creteKeyAttributes, kSecPublicKeyAttrs, publicKeyAttrs);
+#else
+        auto accessControl = kSecAccessControlPrivateKeyUsage | kSecAccessControlBiometryCurrentSet;
+        if (__builtin_available(macOS 10.15, *)) {
+            accessControl |= (kSecAccessControlOr | kSecAccessControlWatch);
+        }
+        auto_release access = SecAccessControlCreateWithFlags(
+            kCFAllocatorDefault, kSecAttrAccessibleWhenUnlockedThisDeviceOnly, accessControl, nullptr);
+        CFDictionaryAddValue(privateKeyAttrs, kSecAttrAccessControl, access);
+
+        CFDictionaryAddValue(creteKeyAttributes, kSecAttrTokenID, kSecAttrTokenIDSecureEnclave);
+#endif
+
+        auto_release<CFErrorRef> error = nullptr;
+        auto_release privateKey = SecKeyCreateRandomKey(creteKeyAttributes, &error);
+        if (!privateKey) {
+            return errorFromCFError(error, "SecKeyCreateRandomKey");
+        }
+
+        return copyExternalRepresentation(privateKey, publicKey);
+    }
+
+    BackendError findKeyPair(const std::string &keyTag, AuthContext *authContext,
+                             std::unique_ptr<KeyPair> &keyPair) override {
+        auto_release queryAttributes = createKeyQueryAttributes(keyTag);
+
+        auto keychainAuthContext = static_cast<KeychainAuthContext *>(authContext);
+        if (keychainAuthContext && keychainAuthContext->laContext) {
+            CFDictionaryAddValue(queryAttributes, kSecUseAuthenticationContext, keychainAuthContext->laContext);
+        }
+
+        SecKeyRef privateKey = nullptr;
+        auto status = SecItemCopyMatching(queryAttributes, reinterpret_cast<CFTypeRef *>(&privateKey));
+        if (status != errSecSuccess) {
+            return errorWithCode(status, "SecItemCopyMatching");
+        }
+
+        keyPair = std::make_unique<KeychainKeyPair>(privateKey);
+        return BackendError();
+    }
+
+    BackendError deleteKeyPair(const std::string &keyTag) override {
+        auto_release queryAttributes = createKeyQueryAttributes(keyTag);
+
+        auto status = SecItemDelete(queryAttributes);
+        if (status != errSecSuccess) {
+            return errorWithCode(status, "SecItemDelete");
+        }
+
+#ifdef NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN
+        CFDictionarySetValue(queryAttributes, kSecAttrKeyClass, kSecAttrKeyClassPublic);
+        SecItemDelete(queryAttributes);
+#endif
+
+        return BackendError();
+    }
+
+    BackendError renameKeyPair(const std::string &keyTag, const std::string &newKeyTag) override {
+        auto_release newQueryAttributes = createKeyQueryAttributes(newKeyTag);
+
+        auto_release<SecKeyRef> existingPrivateKey = nullptr;
+        auto existingKeyStatus = SecItemCopyMatching(newQueryAttributes, existingPrivateKey.cfTypeRef());
+
+        if (existingKeyStatus == errSecSuccess) {
+            return errorWithCode(STATUS_DUPLICATE_ITEM, "SecItemCopyMatching");
+        } else if (existingKeyStatus != errSecItemNotFound) {
+            return errorWithCode(existingKeyStatus, "SecItemCopyMatching");
+        }
+
+        // the key is updated by its application label, so that a rollback doesn't touch another key with the tag
+        auto_release queryAttributes = createKeyQueryAttributes(keyTag);
+        CFDictionaryRemoveValue(queryAttributes, kSecReturnRef);
+        CFDictionaryAddValue(queryAttributes, kSecReturnAttributes, kCFBooleanTrue);
+        auto_release<CFDictionaryRef> attributes = nullptr;
+        auto status = SecItemCopyMatching(queryAttributes, attributes.cfTypeRef());
+        if (status != errSecSuccess) {
+            return errorWithCode(status, "SecItemCopyMatching");
+        }
+        auto applicationLabel = static_cast<CFDataRef>(CFDictionaryGetValue(attributes, kSecAttrApplicationLabel));
+        if (!applicationLabel) {
+            return errorWithCode(errSecItemNotFound, "SecItemCopyMatching");
+        }
+
+        status = updateKeyTag(keyTag, applicationLabel, newKeyTag);
+        if (status != errSecSuccess) {
+            return errorWithCode(status, "SecItemUpdate");
+        }
+
+        // the check above and the update are not atomic: calls in this process are ordered by keyTag, but another
+        // process could have taken the tag in between, then the key gets its old tag back
+        CFDictionaryRemoveValue(newQueryAttributes, kSecReturnRef);
+        CFDictionaryAddValue(newQueryAttributes, kSecReturnAttributes, kCFBooleanTrue);
+        CFDictionaryAddValue(newQueryAttributes, kSecMatchLimit, kSecMatchLimitAll);
+        auto_release<CFArrayRef> items = nullptr;
+        status = SecItemCopyMatching(newQueryAttributes, items.cfTypeRef());
+        if (status == errSecSuccess && CFArrayGetCount(items) > 1) {
+            updateKeyTag(newKeyTag, applicationLabel, keyTag);
+            return errorWithCode(STATUS_DUPLICATE_ITEM, "SecItemUpdate");
+        }
+
+        return BackendError();
+    }
+
+    BackendError listKeys(const std::string &prefix, const std::string &excludePrefix, size_t limit,
+                          std::vector<KeyInfo> &keys) override {
+        auto_release queryAttributes = createKeyQueryAttributes();
+        CFDictionaryAddValue(queryAttributes, kSecReturnAttributes, kCFBooleanTrue);
+        CFDictionaryAddValue(queryAttributes, kSecMatchLimit, kSecMatchLimitAll);
+
+        auto_release<CFArrayRef> items = nullptr;
+        auto status = SecItemCopyMatching(queryAttributes, items.cfTypeRef());
+        if (status == errSecItemNotFound) {
+            return BackendError();
+        } else if (status != errSecSuccess) {
+            return errorWithCode(status, "SecItemCopyMatching");
+        }
+
+        // keys are retained by items, public keys are copied only for the keys that are returned
+        std::vector<std::pair<std::string, SecKeyRef>> found;
+        auto count = CFArrayGetCount(items);
+        for (CFIndex i = 0; i < count; i++) {
+            auto item = static_cast<CFDictionaryRef>(CFArrayGetValueAtIndex(items, i));
+            auto keyTagData = static_cast<CFDataRef>(CFDictionaryGetValue(item, kSecAttrApplicationTag));
+            auto privateKey = static_cast<SecKeyRef>(const_cast<void *>(CFDictionaryGetValue(item, kSecValueRef)));
+            if (!keyTagData || CFGetTypeID(keyTagData) != CFDataGetTypeID() || !privateKey) {
+                continue;
+            }
+            auto keyTagBytes = reinterpret_cast<const char *>(CFDataGetBytePtr(keyTagData));
+            std::string keyTag(keyTagBytes, keyTagBytes + CFDataGetLength(keyTagData));
+            auto excluded =
+                !excludePrefix.empty() && keyTag.compare(0, excludePrefix.length(), excludePrefix) == 0;
+            if (keyTag.compare(0, prefix.length(), prefix) == 0 && !excluded) {
+                found.emplace_back(std::move(keyTag), privateKey);
+            }
+        }
+
+        std::sort(found.begin(), found.end(),
+                  [](const std::pair<std::string, SecKeyRef> &a, const std::pair<std::string, SecKeyRef> &b) {
+                      return a.first < b.first;
+                  });
+        if (limit && found.size() > limit) {
+            found.resize(limit);
+        }
+
+        keys.reserve(found.size());
+        for (auto &entry : found) {
+            KeyInfo key{entry.first, Bytes()};
+            if (auto error = copyExternalRepresentation(entry.second, key.publicKey)) {
+                return error;
+            }
+            keys.push_back(std::move(key));
+        }
+        return BackendError();
+    }
+
+    std::shared_ptr<AuthContext> authenticate(const std::string &touchIdPrompt, AuthCallback callback) override {
+        auto_release touchIdPromptStr =
+            CFStringCreateWithCString(kCFAllocatorDefault, touchIdPrompt.c_str(), kCFStringEncodingUTF8);
+
+        auto authContext = std::make_shared<KeychainAuthContext>(createAuthenticationContext());
+
+        // deleted in authenticationCompleted
+        auto callbackData = new AuthCallbackData{authContext, std::move(callback)};
+
+        authenticateUser(authContext->laContext, touchIdPromptStr, callbackData);
+
+        return authContext;
+    }
+};
+
+} // namespace
+
+void authenticationCompleted(void *callbackData, long authErrorCode) {
+    auto authCallbackData = static_cast<AuthCallbackData *>(callbackData);
+    authCallbackData->callback(authCallbackData->authContext, authErrorCode);
+    delete authCallbackData;
+}
+
+Backend &getBackend() {
+    static KeychainBackend backend;
+    return backend;
+}
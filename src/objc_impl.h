@@ -0,0 +1,17 @@
+#pragma once
+
+#include <CoreFoundation/CoreFoundation.h>
+
+bool isBiometricAuthSupported();
+
+// returns a retained LAContext that can be used in keychain queries, or nullptr in test builds
+CFTypeRef createAuthenticationContext();
+
+// shows the Touch ID prompt and calls authenticationCompleted with callbackData when it's done
+void authenticateUser(CFTypeRef authenticationContext, CFStringRef touchIdPrompt, void *callbackData);
+
+// ends the authenticated state of the context, keys found with it can't be used anymore
+void invalidateAuthenticationContext(CFTypeRef authenticationContext);
+
+// implemented by the backend, called from an arbitrary thread
+void authenticationCompleted(void *callbackData, long authErrorCode);
@@ -1,20 +1,15 @@
 #include <LocalAuthentication/LocalAuthentication.h>
 
-void resumeDecryptWithAuthentication(void *callbackData, long authErrorCode);
+#include "objc_impl.h"
 
-bool isBiometricAuthSupported() {
-    static bool checked = false;
-    static bool supported = false;
-    if (checked) {
-        return supported;
-    }
+static bool probeBiometricAuth() {
     LAContext *context = [[LAContext alloc] init];
     NSError *error = nil;
     LAPolicy policy = LAPolicyDeviceOwnerAuthenticationWithBiometrics;
     if (@available(macOS 10.15, *)) {
         policy = LAPolicyDeviceOwnerAuthenticationWithBiometricsOrWatch;
     }
-    supported = [context canEvaluatePolicy:policy error:&error];
+    bool supported = [context canEvaluatePolicy:policy error:&error];
     if (!supported && context.biometryType == LABiometryTypeTouchID && error && error.code == LAErrorBiometryLockout) {
         supported = true;
     }
@@ -22,12 +17,21 @@ bool isBiometricAuthSupported() {
     supported = true;
 #endif
     [context release];
-    checked = true;
     return supported;
 }
 
-void tryAuthenticate(LAContext *context, bool useBiometrics, CFStringRef touchIdPrompt,
-                     CFMutableDictionaryRef queryAttributes, void *callbackData, bool retryOnLockout) {
+bool isBiometricAuthSupported() {
+    // probed once per process, worker threads can call it concurrently
+    static dispatch_once_t once;
+    static bool supported = false;
+    dispatch_once(&once, ^{
+      supported = probeBiometricAuth();
+    });
+    return supported;
+}
+
+void tryAuthenticate(LAContext *context, bool useBiometrics, CFStringRef touchIdPrompt, void *callbackData,
+                     bool retryOnLockout) {
     CFRetain(touchIdPrompt);
     LAPolicy policy = LAPolicyDeviceOwnerAuthentication;
     if (useBiometrics) {
@@ -47,31 +51,38 @@ void tryAuthenticate(LAContext *context, bool useBiometrics, CFStringRef touchId
                         }
                         if (useBiometrics && errorCode == LAErrorBiometryLockout && retryOnLockout) {
                             dispatch_async(dispatch_get_main_queue(), ^{
-                              tryAuthenticate(context, false, touchIdPrompt, queryAttributes, callbackData, false);
+                              tryAuthenticate(context, false, touchIdPrompt, callbackData, false);
                               CFRelease(touchIdPrompt);
                             });
                         } else if (!useBiometrics && success) {
                             dispatch_async(dispatch_get_main_queue(), ^{
-                              tryAuthenticate(context, true, touchIdPrompt, queryAttributes, callbackData, false);
+                              tryAuthenticate(context, true, touchIdPrompt, callbackData, false);
                               CFRelease(touchIdPrompt);
                             });
                         } else {
                             CFRelease(touchIdPrompt);
-                            resumeDecryptWithAuthentication(callbackData, errorCode);
+                            authenticationCompleted(callbackData, errorCode);
                         }
                       }];
 }
 
-void authenticateAndDecrypt(CFStringRef touchIdPrompt, CFMutableDictionaryRef queryAttributes, void *callbackData) {
+CFTypeRef createAuthenticationContext() {
+#ifdef NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN
+    return nullptr;
+#else
+    // the caller takes ownership of this reference
+    return (CFTypeRef)[[LAContext alloc] init];
+#endif
+}
+
+void authenticateUser(CFTypeRef authenticationContext, CFStringRef touchIdPrompt, void *callbackData) {
 #ifdef NODE_SECURE_ENCLAVE_BUILD_FOR_TESTING_WITH_REGULAR_KEYCHAIN
     dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
       // we don't need this thread, it's here for life-like tests
-      resumeDecryptWithAuthentication(callbackData, 0);
+      authenticationCompleted(callbackData, 0);
     });
 #else
-    LAContext *context = [[LAContext alloc] init];
-    CFDictionaryAddValue(queryAttributes, kSecUseAuthenticationContext, context);
-    [context release];
+    LAContext *context = (LAContext *)authenticationContext;
 
     NSError *error = nil;
     LAPolicy policy = LAPolicyDeviceOwnerAuthenticationWithBiometrics;
@@ -81,6 +92,12 @@ void authenticateAndDecrypt(CFStringRef touchIdPrompt, CFMutableDictionaryRef qu
     [context canEvaluatePolicy:policy error:&error];
 
     bool useBiometrics = error && error.code == LAErrorBiometryLockout;
-    tryAuthenticate(context, useBiometrics, touchIdPrompt, queryAttributes, callbackData, useBiometrics);
+    tryAuthenticate(context, useBiometrics, touchIdPrompt, callbackData, useBiometrics);
 #endif
 }
+
+void invalidateAuthenticationContext(CFTypeRef authenticationContext) {
+    if (authenticationContext) {
+        [(LAContext *)authenticationContext invalidate];
+    }
+}
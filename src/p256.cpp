@@ -0,0 +1,893 @@
+#include "p256.h"
+
+#include <cstring>
+#include <vector>
+
+#include "secure_memory.h"
+#include "secure_random.h"
+
+// Constant-time P-256 arithmetic: field elements are kept in Montgomery form in four 64-bit limbs,
+// points use projective coordinates with complete addition formulas (Renes, Costello, Batina, 2015),
+// so that there are no special cases depending on secret data.
+// Multiplications of the generator use a precomputed comb table, public keys used often can have a window table,
+// both store affine points and are always scanned in full, so that memory access doesn't depend on the scalar.
+
+namespace {
+
+using u128 = unsigned __int128;
+
+struct Fe {
+    uint64_t v[4];
+};
+
+struct Modulus {
+    uint64_t m[4];
+    uint64_t m0inv;
+    Fe rr;
+    Fe one;
+
+    explicit Modulus(const uint64_t *modulus);
+};
+
+struct Point {
+    Fe x;
+    Fe y;
+    Fe z;
+};
+
+// Z = 1, the identity can't be represented
+struct AffinePoint {
+    Fe x;
+    Fe y;
+};
+
+constexpr uint64_t P[4] = {0xffffffffffffffffULL, 0x00000000ffffffffULL, 0x0000000000000000ULL,
+                           0xffffffff00000001ULL};
+constexpr uint64_t N[4] = {0xf3b9cac2fc632551ULL, 0xbce6faada7179e84ULL, 0xffffffffffffffffULL,
+                           0xffffffff00000000ULL};
+
+constexpr uint8_t B_BYTES[P256_FIELD_SIZE] = {
+    0x5a, 0xc6, 0x35, 0xd8, 0xaa, 0x3a, 0x93, 0xe7, 0xb3, 0xeb, 0xbd, 0x55, 0x76, 0x98, 0x86, 0xbc,
+    0x65, 0x1d, 0x06, 0xb0, 0xcc, 0x53, 0xb0, 0xf6, 0x3b, 0xce, 0x3c, 0x3e, 0x27, 0xd2, 0x60, 0x4b,
+};
+constexpr uint8_t GX_BYTES[P256_FIELD_SIZE] = {
+    0x6b, 0x17, 0xd1, 0xf2, 0xe1, 0x2c, 0x42, 0x47, 0xf8, 0xbc, 0xe6, 0xe5, 0x63, 0xa4, 0x40, 0xf2,
+    0x77, 0x03, 0x7d, 0x81, 0x2d, 0xeb, 0x33, 0xa0, 0xf4, 0xa1, 0x39, 0x45, 0xd8, 0x98, 0xc2, 0x96,
+};
+constexpr uint8_t GY_BYTES[P256_FIELD_SIZE] = {
+    0x4f, 0xe3, 0x42, 0xe2, 0xfe, 0x1a, 0x7f, 0x9b, 0x8e, 0xe7, 0xeb, 0x4a, 0x7c, 0x0f, 0x9e, 0x16,
+    0x2b, 0xce, 0x33, 0x57, 0x6b, 0x31, 0x5e, 0xce, 0xcb, 0xb6, 0x40, 0x68, 0x37, 0xbf, 0x51, 0xf5,
+};
+
+// r = t - m if t >= m, otherwise r = t; t is a 5-limb number less than 2m
+void reduceOnce(uint64_t *r, const uint64_t *t, uint64_t carry, const uint64_t *m) {
+    uint64_t d[4];
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; i++) {
+        auto diff = u128(t[i]) - m[i] - borrow;
+        d[i] = uint64_t(diff);
+        borrow = uint64_t(diff >> 64) & 1;
+    }
+    auto useDiff = 1 - (borrow & (1 - carry));
+    auto mask = 0 - useDiff;
+    for (int i = 0; i < 4; i++) {
+        r[i] = (d[i] & mask) | (t[i] & ~mask);
+    }
+}
+
+void feAdd(Fe &r, const Fe &a, const Fe &b, const Modulus &mod) {
+    uint64_t t[4];
+    u128 carry = 0;
+    for (int i = 0; i < 4; i++) {
+        carry += u128(a.v[i]) + b.v[i];
+        t[i] = uint64_t(carry);
+        carry >>= 64;
+    }
+    reduceOnce(r.v, t, uint64_t(carry), mod.m);
+}
+
+void feSub(Fe &r, const Fe &a, const Fe &b, const Modulus &mod) {
+    uint64_t t[4];
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; i++) {
+        auto diff = u128(a.v[i]) - b.v[i] - borrow;
+        t[i] = uint64_t(diff);
+        borrow = uint64_t(diff >> 64) & 1;
+    }
+    auto mask = 0 - borrow;
+    u128 carry = 0;
+    for (int i = 0; i < 4; i++) {
+        carry += u128(t[i]) + (mod.m[i] & mask);
+        r.v[i] = uint64_t(carry);
+        carry >>= 64;
+    }
+}
+
+void feMul(Fe &r, const Fe &a, const Fe &b, const Modulus &mod) {
+    uint64_t t[6] = {0};
+    for (int i = 0; i < 4; i++) {
+        u128 carry = 0;
+        for (int j = 0; j < 4; j++) {
+            carry += u128(a.v[j]) * b.v[i] + t[j];
+            t[j] = uint64_t(carry);
+            carry >>= 64;
+        }
+        carry += t[4];
+        t[4] = uint64_t(carry);
+        t[5] = uint64_t(carry >> 64);
+
+        auto q = t[0] * mod.m0inv;
+        carry = u128(q) * mod.m[0] + t[0];
+        carry >>= 64;
+        for (int j = 1; j < 4; j++) {
+            carry += u128(q) * mod.m[j] + t[j];
+            t[j - 1] = uint64_t(carry);
+            carry >>= 64;
+        }
+        carry += t[4];
+        t[3] = uint64_t(carry);
+        t[4] = t[5] + uint64_t(carry >> 64);
+    }
+    reduceOnce(r.v, t, t[4], mod.m);
+}
+
+void feSquare(Fe &r, const Fe &a, const Modulus &mod) { feMul(r, a, a, mod); }
+
+// r = a^e, the exponent is public
+void fePow(Fe &r, const Fe &a, const uint64_t *e, const Modulus &mod) {
+    auto result = mod.one;
+    for (int i = 255; i >= 0; i--) {
+        feSquare(result, result, mod);
+        if ((e[i / 64] >> (i % 64)) & 1) {
+            feMul(result, result, a, mod);
+        }
+    }
+    r = result;
+}
+
+void feInvert(Fe &r, const Fe &a, const Modulus &mod) {
+    uint64_t e[4];
+    memcpy(e, mod.m, sizeof(e));
+    e[0] -= 2;
+    fePow(r, a, e, mod);
+}
+
+bool feIsZero(const Fe &a) { return (a.v[0] | a.v[1] | a.v[2] | a.v[3]) == 0; }
+
+bool feEqual(const Fe &a, const Fe &b) {
+    return ((a.v[0] ^ b.v[0]) | (a.v[1] ^ b.v[1]) | (a.v[2] ^ b.v[2]) | (a.v[3] ^ b.v[3])) == 0;
+}
+
+// loads a big-endian number, returns false if it's not less than the modulus
+bool feFromBytes(Fe &r, const uint8_t *bytes, const Modulus &mod) {
+    Fe raw;
+    for (int i = 0; i < 4; i++) {
+        uint64_t limb = 0;
+        for (int j = 0; j < 8; j++) {
+            limb = (limb << 8) | bytes[(3 - i) * 8 + j];
+        }
+        raw.v[i] = limb;
+    }
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; i++) {
+        auto diff = u128(raw.v[i]) - mod.m[i] - borrow;
+        borrow = uint64_t(diff >> 64) & 1;
+    }
+    feMul(r, raw, mod.rr, mod);
+    secureZero(&raw, sizeof(raw));
+    return borrow == 1;
+}
+
+void feToBytes(uint8_t *bytes, const Fe &a, const Modulus &mod) {
+    Fe raw;
+    Fe one = {{1, 0, 0, 0}};
+    feMul(raw, a, one, mod);
+    for (int i = 0; i < 4; i++) {
+        auto limb = raw.v[i];
+        for (int j = 7; j >= 0; j--) {
+            bytes[(3 - i) * 8 + j] = uint8_t(limb);
+            limb >>= 8;
+        }
+    }
+    secureZero(&raw, sizeof(raw));
+}
+
+Modulus::Modulus(const uint64_t *modulus) {
+    memcpy(m, modulus, sizeof(m));
+
+    uint64_t inv = 1;
+    for (int i = 0; i < 7; i++) {
+        inv *= 2 - m[0] * inv;
+    }
+    m0inv = 0 - inv;
+
+    // R mod m = 2^256 - m, since m > 2^255
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; i++) {
+        auto diff = u128(0) - m[i] - borrow;
+        one.v[i] = uint64_t(diff);
+        borrow = uint64_t(diff >> 64) & 1;
+    }
+
+    // R^2 mod m = R * 2^256 mod m
+    rr = one;
+    for (int i = 0; i < 256; i++) {
+        feAdd(rr, rr, rr, *this);
+    }
+}
+
+struct Curve {
+    Modulus p{P};
+    Modulus n{N};
+    Fe b;
+    Point g;
+
+    Curve() {
+        feFromBytes(b, B_BYTES, p);
+        feFromBytes(g.x, GX_BYTES, p);
+        feFromBytes(g.y, GY_BYTES, p);
+        g.z = p.one;
+    }
+};
+
+const Curve &curve() {
+    static const Curve instance;
+    return instance;
+}
+
+Point identity() {
+    auto &c = curve();
+    return Point{{{0, 0, 0, 0}}, c.p.one, {{0, 0, 0, 0}}};
+}
+
+// complete addition for a = -3, algorithm 4 from https://eprint.iacr.org/2015/1060
+void pointAdd(Point &r, const Point &p1, const Point &p2) {
+    auto &c = curve();
+    auto &mod = c.p;
+    Fe t0, t1, t2, t3, t4, x3, y3, z3;
+
+    feMul(t0, p1.x, p2.x, mod);
+    feMul(t1, p1.y, p2.y, mod);
+    feMul(t2, p1.z, p2.z, mod);
+    feAdd(t3, p1.x, p1.y, mod);
+    feAdd(t4, p2.x, p2.y, mod);
+    feMul(t3, t3, t4, mod);
+    feAdd(t4, t0, t1, mod);
+    feSub(t3, t3, t4, mod);
+    feAdd(t4, p1.y, p1.z, mod);
+    feAdd(x3, p2.y, p2.z, mod);
+    feMul(t4, t4, x3, mod);
+    feAdd(x3, t1, t2, mod);
+    feSub(t4, t4, x3, mod);
+    feAdd(x3, p1.x, p1.z, mod);
+    feAdd(y3, p2.x, p2.z, mod);
+    feMul(x3, x3, y3, mod);
+    feAdd(y3, t0, t2, mod);
+    feSub(y3, x3, y3, mod);
+    feMul(z3, c.b, t2, mod);
+    feSub(x3, y3, z3, mod);
+    feAdd(z3, x3, x3, mod);
+    feAdd(x3, x3, z3, mod);
+    feSub(z3, t1, x3, mod);
+    feAdd(x3, t1, x3, mod);
+    feMul(y3, c.b, y3, mod);
+    feAdd(t1, t2, t2, mod);
+    feAdd(t2, t1, t2, mod);
+    feSub(y3, y3, t2, mod);
+    feSub(y3, y3, t0, mod);
+    feAdd(t1, y3, y3, mod);
+    feAdd(y3, t1, y3, mod);
+    feAdd(t1, t0, t0, mod);
+    feAdd(t0, t1, t0, mod);
+    feSub(t0, t0, t2, mod);
+    feMul(t1, t4, y3, mod);
+    feMul(t2, t0, y3, mod);
+    feMul(y3, x3, z3, mod);
+    feAdd(y3, y3, t2, mod);
+    feMul(x3, t3, x3, mod);
+    feSub(x3, x3, t1, mod);
+    feMul(z3, t4, z3, mod);
+    feMul(t1, t3, t0, mod);
+    feAdd(z3, z3, t1, mod);
+
+    r.x = x3;
+    r.y = y3;
+    r.z = z3;
+}
+
+// doubling for a = -3, algorithm 6 from https://eprint.iacr.org/2015/1060
+void pointDouble(Point &r, const Point &p) {
+    auto &c = curve();
+    auto &mod = c.p;
+    Fe t0, t1, t2, t3, x3, y3, z3;
+
+    feSquare(t0, p.x, mod);
+    feSquare(t1, p.y, mod);
+    feSquare(t2, p.z, mod);
+    feMul(t3, p.x, p.y, mod);
+    feAdd(t3, t3, t3, mod);
+    feMul(z3, p.x, p.z, mod);
+    feAdd(z3, z3, z3, mod);
+    feMul(y3, c.b, t2, mod);
+    feSub(y3, y3, z3, mod);
+    feAdd(x3, y3, y3, mod);
+    feAdd(y3, x3, y3, mod);
+    feSub(x3, t1, y3, mod);
+    feAdd(y3, t1, y3, mod);
+    feMul(y3, x3, y3, mod);
+    feMul(x3, x3, t3, mod);
+    feAdd(t3, t2, t2, mod);
+    feAdd(t2, t2, t3, mod);
+    feMul(z3, c.b, z3, mod);
+    feSub(z3, z3, t2, mod);
+    feSub(z3, z3, t0, mod);
+    feAdd(t3, z3, z3, mod);
+    feAdd(z3, z3, t3, mod);
+    feAdd(t3, t0, t0, mod);
+    feAdd(t0, t3, t0, mod);
+    feSub(t0, t0, t2, mod);
+    feMul(t0, t0, z3, mod);
+    feAdd(y3, y3, t0, mod);
+    feMul(t0, p.y, p.z, mod);
+    feAdd(t0, t0, t0, mod);
+    feMul(z3, t0, z3, mod);
+    feSub(x3, x3, z3, mod);
+    feMul(z3, t0, t1, mod);
+    feAdd(z3, z3, z3, mod);
+    feAdd(z3, z3, z3, mod);
+
+    r.x = x3;
+    r.y = y3;
+    r.z = z3;
+}
+
+void pointSelect(Point &r, const Point *table, size_t tableSize, uint64_t index) {
+    memset(&r, 0, sizeof(r));
+    for (size_t i = 0; i < tableSize; i++) {
+        auto mask = 0 - uint64_t(((i ^ index) - 1) >> 63);
+        for (int j = 0; j < 4; j++) {
+            r.x.v[j] |= table[i].x.v[j] & mask;
+            r.y.v[j] |= table[i].y.v[j] & mask;
+            r.z.v[j] |= table[i].z.v[j] & mask;
+        }
+    }
+}
+
+// r = k * p with a fixed 4-bit window, k is a big-endian scalar
+void scalarMul(Point &r, const Point &p, const uint8_t *scalar) {
+    Point table[16];
+    table[0] = identity();
+    table[1] = p;
+    for (int i = 2; i < 16; i++) {
+        if (i % 2 == 0) {
+            pointDouble(table[i], table[i / 2]);
+        } else {
+            pointAdd(table[i], table[i - 1], p);
+        }
+    }
+
+    auto result = identity();
+    Point selected;
+    for (size_t i = 0; i < P256_SCALAR_SIZE * 2; i++) {
+        if (i > 0) {
+            for (int j = 0; j < 4; j++) {
+                pointDouble(result, result);
+            }
+        }
+        auto nibble = (i % 2 == 0) ? (scalar[i / 2] >> 4) : (scalar[i / 2] & 0xf);
+        pointSelect(selected, table, 16, nibble);
+        pointAdd(result, result, selected);
+    }
+    r = result;
+
+    secureZero(table, sizeof(table));
+    secureZero(&selected, sizeof(selected));
+    secureZero(&result, sizeof(result));
+}
+
+// complete mixed addition for a = -3, algorithm 5 from https://eprint.iacr.org/2015/1060
+void pointAddAffine(Point &r, const Point &p1, const AffinePoint &p2) {
+    auto &c = curve();
+    auto &mod = c.p;
+    Fe t0, t1, t2, t3, t4, x3, y3, z3;
+
+    feMul(t0, p1.x, p2.x, mod);
+    feMul(t1, p1.y, p2.y, mod);
+    feAdd(t3, p2.x, p2.y, mod);
+    feAdd(t4, p1.x, p1.y, mod);
+    feMul(t3, t3, t4, mod);
+    feAdd(t4, t0, t1, mod);
+    feSub(t3, t3, t4, mod);
+    feMul(t4, p2.y, p1.z, mod);
+    feAdd(t4, t4, p1.y, mod);
+    feMul(y3, p2.x, p1.z, mod);
+    feAdd(y3, y3, p1.x, mod);
+    feMul(z3, c.b, p1.z, mod);
+    feSub(x3, y3, z3, mod);
+    feAdd(z3, x3, x3, mod);
+    feAdd(x3, x3, z3, mod);
+    feSub(z3, t1, x3, mod);
+    feAdd(x3, t1, x3, mod);
+    feMul(y3, c.b, y3, mod);
+    feAdd(t1, p1.z, p1.z, mod);
+    feAdd(t2, t1, p1.z, mod);
+    feSub(y3, y3, t2, mod);
+    feSub(y3, y3, t0, mod);
+    feAdd(t1, y3, y3, mod);
+    feAdd(y3, t1, y3, mod);
+    feAdd(t1, t0, t0, mod);
+    feAdd(t0, t1, t0, mod);
+    feSub(t0, t0, t2, mod);
+    feMul(t1, t4, y3, mod);
+    feMul(t2, t0, y3, mod);
+    feMul(y3, x3, z3, mod);
+    feAdd(y3, y3, t2, mod);
+    feMul(x3, t3, x3, mod);
+    feSub(x3, x3, t1, mod);
+    feMul(z3, t4, z3, mod);
+    feMul(t1, t3, t0, mod);
+    feAdd(z3, z3, t1, mod);
+
+    r.x = x3;
+    r.y = y3;
+    r.z = z3;
+}
+
+// r = p if mask is all ones, r is unchanged if it's zero
+void pointMove(Point &r, const Point &p, uint64_t mask) {
+    for (int j = 0; j < 4; j++) {
+        r.x.v[j] = (p.x.v[j] & mask) | (r.x.v[j] & ~mask);
+        r.y.v[j] = (p.y.v[j] & mask) | (r.y.v[j] & ~mask);
+        r.z.v[j] = (p.z.v[j] & mask) | (r.z.v[j] & ~mask);
+    }
+}
+
+// r += table[index - 1], nothing is added if index is 0; all entries are read
+void pointAddSelected(Point &r, const AffinePoint *table, size_t tableSize, uint64_t index) {
+    AffinePoint selected;
+    memset(&selected, 0, sizeof(selected));
+    for (size_t i = 0; i < tableSize; i++) {
+        auto mask = 0 - uint64_t((((i + 1) ^ index) - 1) >> 63);
+        for (int j = 0; j < 4; j++) {
+            selected.x.v[j] |= table[i].x.v[j] & mask;
+            selected.y.v[j] |= table[i].y.v[j] & mask;
+        }
+    }
+    Point sum;
+    pointAddAffine(sum, r, selected);
+    pointMove(r, sum, 0 - uint64_t((0 - index) >> 63));
+
+    secureZero(&selected, sizeof(selected));
+    secureZero(&sum, sizeof(sum));
+}
+
+// converts points to affine with a single inversion, the points are public and none of them is the identity
+void pointsToAffine(AffinePoint *r, const Point *points, size_t count) {
+    auto &mod = curve().p;
+    std::vector<Fe> products(count);
+    products[0] = points[0].z;
+    for (size_t i = 1; i < count; i++) {
+        feMul(products[i], products[i - 1], points[i].z, mod);
+    }
+    Fe inv, zInv;
+    feInvert(inv, products[count - 1], mod);
+    for (size_t i = count - 1; i > 0; i--) {
+        feMul(zInv, inv, products[i - 1], mod);
+        feMul(inv, inv, points[i].z, mod);
+        feMul(r[i].x, points[i].x, zInv, mod);
+        feMul(r[i].y, points[i].y, zInv, mod);
+    }
+    feMul(r[0].x, points[0].x, inv, mod);
+    feMul(r[0].y, points[0].y, inv, mod);
+}
+
+// Lim-Lee comb: with d = COMB_SPACING, tooth j of comb i is the bit i + d * j of the scalar,
+// so k * G is the sum of 2^i * T[comb i], where T[v] is the sum of 2^(d * j) * G for bits j set in v.
+// Combs are split in COMB_COUNT groups with own tables, 2^(COMB_ROUNDS * group) * T,
+// then one doubling per round is shared by all groups.
+constexpr size_t COMB_TEETH = 6;
+constexpr size_t COMB_SPACING = (P256_SCALAR_SIZE * 8 + COMB_TEETH - 1) / COMB_TEETH;
+constexpr size_t COMB_COUNT = 4;
+constexpr size_t COMB_ROUNDS = (COMB_SPACING + COMB_COUNT - 1) / COMB_COUNT;
+constexpr size_t COMB_TABLE_SIZE = (1 << COMB_TEETH) - 1;
+
+struct CombTable {
+    // entry v - 1 is the multiple for comb value v
+    AffinePoint points[COMB_COUNT][COMB_TABLE_SIZE];
+
+    CombTable() {
+        std::vector<Point> multiples(COMB_COUNT * COMB_TABLE_SIZE);
+        auto base = curve().g;
+        for (size_t group = 0; group < COMB_COUNT; group++) {
+            Point teeth[COMB_TEETH];
+            teeth[0] = base;
+            for (size_t j = 1; j < COMB_TEETH; j++) {
+                teeth[j] = teeth[j - 1];
+                for (size_t i = 0; i < COMB_SPACING; i++) {
+                    pointDouble(teeth[j], teeth[j]);
+                }
+            }
+            auto groupMultiples = multiples.data() + group * COMB_TABLE_SIZE;
+            for (size_t v = 1; v <= COMB_TABLE_SIZE; v++) {
+                auto lowest = __builtin_ctzll(v);
+                auto rest = v & (v - 1);
+                if (rest) {
+                    pointAdd(groupMultiples[v - 1], groupMultiples[rest - 1], teeth[lowest]);
+                } else {
+                    groupMultiples[v - 1] = teeth[lowest];
+                }
+            }
+            for (size_t i = 0; i < COMB_ROUNDS; i++) {
+                pointDouble(base, base);
+            }
+        }
+        pointsToAffine(&points[0][0], multiples.data(), multiples.size());
+    }
+};
+
+const CombTable &combTable() {
+    static const CombTable instance;
+    return instance;
+}
+
+uint64_t scalarBit(const uint8_t *scalar, size_t bit) {
+    if (bit >= P256_SCALAR_SIZE * 8) {
+        return 0;
+    }
+    return (scalar[P256_SCALAR_SIZE - 1 - bit / 8] >> (bit % 8)) & 1;
+}
+
+// r = k * G using the comb table, k is a big-endian scalar
+void baseMul(Point &r, const uint8_t *scalar) {
+    auto &table = combTable();
+    auto result = identity();
+    for (size_t round = COMB_ROUNDS; round-- > 0;) {
+        if (round != COMB_ROUNDS - 1) {
+            pointDouble(result, result);
+        }
+        for (size_t group = COMB_COUNT; group-- > 0;) {
+            auto comb = round + group * COMB_ROUNDS;
+            if (comb >= COMB_SPACING) {
+                continue;
+            }
+            uint64_t value = 0;
+            for (size_t j = 0; j < COMB_TEETH; j++) {
+                value |= scalarBit(scalar, comb + COMB_SPACING * j) << j;
+            }
+            pointAddSelected(result, table.points[group], COMB_TABLE_SIZE, value);
+        }
+    }
+    r = result;
+    secureZero(&result, sizeof(result));
+}
+
+// Fixed 4-bit windows, window 4 * i + j is added from table i, which holds multiples of 2^(16 * i) * Q,
+// so that only 12 doublings are needed instead of 252.
+constexpr size_t WINDOW_BITS = 4;
+constexpr size_t WINDOW_COUNT = P256_SCALAR_SIZE * 8 / WINDOW_BITS;
+constexpr size_t WINDOW_STRIDE = 4;
+constexpr size_t WINDOW_TABLE_COUNT = WINDOW_COUNT / WINDOW_STRIDE;
+constexpr size_t WINDOW_TABLE_SIZE = (1 << WINDOW_BITS) - 1;
+
+struct WindowTable {
+    // entry m - 1 of table i is m * 2^(16 * i) * Q
+    AffinePoint points[WINDOW_TABLE_COUNT][WINDOW_TABLE_SIZE];
+
+    explicit WindowTable(const Point &q) {
+        std::vector<Point> multiples(WINDOW_TABLE_COUNT * WINDOW_TABLE_SIZE);
+        auto base = q;
+        for (size_t i = 0; i < WINDOW_TABLE_COUNT; i++) {
+            auto tableMultiples = multiples.data() + i * WINDOW_TABLE_SIZE;
+            tableMultiples[0] = base;
+            for (size_t m = 2; m <= WINDOW_TABLE_SIZE; m++) {
+                if (m % 2 == 0) {
+                    pointDouble(tableMultiples[m - 1], tableMultiples[m / 2 - 1]);
+                } else {
+                    pointAdd(tableMultiples[m - 1], tableMultiples[m - 2], base);
+                }
+            }
+            for (size_t j = 0; j < WINDOW_BITS * WINDOW_STRIDE; j++) {
+                pointDouble(base, base);
+            }
+        }
+        pointsToAffine(&points[0][0], multiples.data(), multiples.size());
+    }
+};
+
+// r = k * Q using the window table of Q, k is a big-endian scalar
+void windowMul(Point &r, const WindowTable &table, const uint8_t *scalar) {
+    auto result = identity();
+    for (size_t j = WINDOW_STRIDE; j-- > 0;) {
+        if (j != WINDOW_STRIDE - 1) {
+            for (size_t i = 0; i < WINDOW_BITS; i++) {
+                pointDouble(result, result);
+            }
+        }
+        for (size_t i = WINDOW_TABLE_COUNT; i-- > 0;) {
+            auto window = i * WINDOW_STRIDE + j;
+            auto byte = scalar[P256_SCALAR_SIZE - 1 - window / 2];
+            uint64_t value = (window % 2 == 0) ? (byte & 0xf) : (byte >> 4);
+            pointAddSelected(result, table.points[i], WINDOW_TABLE_SIZE, value);
+        }
+    }
+    r = result;
+    secureZero(&result, sizeof(result));
+}
+
+bool pointToAffineBytes(uint8_t *x, uint8_t *y, const Point &p) {
+    auto &mod = curve().p;
+    if (feIsZero(p.z)) {
+        return false;
+    }
+    Fe zInv, ax, ay;
+    feInvert(zInv, p.z, mod);
+    feMul(ax, p.x, zInv, mod);
+    feToBytes(x, ax, mod);
+    if (y) {
+        feMul(ay, p.y, zInv, mod);
+        feToBytes(y, ay, mod);
+    }
+    return true;
+}
+
+bool pointFromPublicKey(Point &r, const uint8_t *publicKey) {
+    auto &c = curve();
+    auto &mod = c.p;
+    if (publicKey[0] != 0x04) {
+        return false;
+    }
+    if (!feFromBytes(r.x, publicKey + 1, mod) || !feFromBytes(r.y, publicKey + 1 + P256_FIELD_SIZE, mod)) {
+        return false;
+    }
+    r.z = mod.one;
+
+    // y^2 = x^3 - 3x + b
+    Fe lhs, rhs, t;
+    feSquare(lhs, r.y, mod);
+    feSquare(rhs, r.x, mod);
+    feMul(rhs, rhs, r.x, mod);
+    feAdd(t, r.x, r.x, mod);
+    feAdd(t, t, r.x, mod);
+    feSub(rhs, rhs, t, mod);
+    feAdd(rhs, rhs, c.b, mod);
+    return feEqual(lhs, rhs);
+}
+
+bool isValidScalar(const uint8_t *scalar) {
+    Fe unused;
+    auto lessThanN = feFromBytes(unused, scalar, curve().n);
+    uint8_t nonZero = 0;
+    for (size_t i = 0; i < P256_SCALAR_SIZE; i++) {
+        nonZero |= scalar[i];
+    }
+    secureZero(&unused, sizeof(unused));
+    return lessThanN && nonZero;
+}
+
+bool randomScalar(uint8_t *scalar) {
+    do {
+        if (!secureRandomBytes(scalar, P256_SCALAR_SIZE)) {
+            return false;
+        }
+    } while (!isValidScalar(scalar));
+    return true;
+}
+
+// loads a big-endian 256-bit number modulo n, such as a digest or an X coordinate
+void scalarFromBytesReduced(Fe &r, const uint8_t *bytes) {
+    auto &mod = curve().n;
+    Fe raw;
+    for (int i = 0; i < 4; i++) {
+        uint64_t limb = 0;
+        for (int j = 0; j < 8; j++) {
+            limb = (limb << 8) | bytes[(3 - i) * 8 + j];
+        }
+        raw.v[i] = limb;
+    }
+    // the number is less than 2n
+    reduceOnce(raw.v, raw.v, 0, mod.m);
+    feMul(r, raw, mod.rr, mod);
+    secureZero(&raw, sizeof(raw));
+}
+
+} // namespace
+
+struct P256PublicKeyTable {
+    WindowTable window;
+
+    explicit P256PublicKeyTable(const Point &q) : window(q) {}
+};
+
+bool p256GenerateKeyPair(uint8_t *privateKey, uint8_t *publicKey) {
+    return randomScalar(privateKey) && p256ComputePublicKey(privateKey, publicKey);
+}
+
+bool p256ComputePublicKey(const uint8_t *privateKey, uint8_t *publicKey) {
+    if (!isValidScalar(privateKey)) {
+        return false;
+    }
+    Point point;
+    baseMul(point, privateKey);
+    publicKey[0] = 0x04;
+    return pointToAffineBytes(publicKey + 1, publicKey + 1 + P256_FIELD_SIZE, point);
+}
+
+bool p256ComputePublicKeyGeneric(const uint8_t *privateKey, uint8_t *publicKey) {
+    if (!isValidScalar(privateKey)) {
+        return false;
+    }
+    Point point;
+    scalarMul(point, curve().g, privateKey);
+    publicKey[0] = 0x04;
+    return pointToAffineBytes(publicKey + 1, publicKey + 1 + P256_FIELD_SIZE, point);
+}
+
+bool p256IsValidPublicKey(const uint8_t *publicKey, size_t length) {
+    if (length != P256_PUBLIC_KEY_SIZE) {
+        return false;
+    }
+    Point point;
+    return pointFromPublicKey(point, publicKey);
+}
+
+void p256CompressPublicKey(const uint8_t *publicKey, uint8_t *compressed) {
+    compressed[0] = 0x02 | (publicKey[P256_PUBLIC_KEY_SIZE - 1] & 1);
+    memcpy(compressed + 1, publicKey + 1, P256_FIELD_SIZE);
+}
+
+bool p256DecompressPublicKey(const uint8_t *compressed, uint8_t *publicKey) {
+    auto &c = curve();
+    auto &mod = c.p;
+    if (compressed[0] != 0x02 && compressed[0] != 0x03) {
+        return false;
+    }
+    Fe x;
+    if (!feFromBytes(x, compressed + 1, mod)) {
+        return false;
+    }
+
+    // y^2 = x^3 - 3x + b, y = (y^2)^((p + 1) / 4) since p = 3 mod 4
+    Fe rhs, t, y, check;
+    feSquare(rhs, x, mod);
+    feMul(rhs, rhs, x, mod);
+    feAdd(t, x, x, mod);
+    feAdd(t, t, x, mod);
+    feSub(rhs, rhs, t, mod);
+    feAdd(rhs, rhs, c.b, mod);
+
+    uint64_t e[4];
+    uint64_t carry = 1;
+    for (int i = 0; i < 4; i++) {
+        e[i] = mod.m[i] + carry;
+        carry = e[i] < carry;
+    }
+    for (int i = 0; i < 4; i++) {
+        e[i] = (e[i] >> 2) | (i < 3 ? e[i + 1] << 62 : 0);
+    }
+    fePow(y, rhs, e, mod);
+    feSquare(check, y, mod);
+    if (!feEqual(check, rhs)) {
+        return false;
+    }
+
+    publicKey[0] = 0x04;
+    memcpy(publicKey + 1, compressed + 1, P256_FIELD_SIZE);
+    auto yBytes = publicKey + 1 + P256_FIELD_SIZE;
+    feToBytes(yBytes, y, mod);
+    if ((yBytes[P256_FIELD_SIZE - 1] & 1) != (compressed[0] & 1)) {
+        Fe zero = {{0, 0, 0, 0}};
+        feSub(y, zero, y, mod);
+        feToBytes(yBytes, y, mod);
+    }
+    return true;
+}
+
+std::shared_ptr<const P256PublicKeyTable> p256PrecomputePublicKey(const uint8_t *publicKey) {
+    Point point;
+    if (!pointFromPublicKey(point, publicKey)) {
+        return nullptr;
+    }
+    return std::make_shared<const P256PublicKeyTable>(point);
+}
+
+bool p256Ecdh(const uint8_t *privateKey, const uint8_t *peerPublicKey, uint8_t *sharedSecret,
+              const P256PublicKeyTable *peerTable) {
+    if (!isValidScalar(privateKey)) {
+        return false;
+    }
+    Point shared;
+    if (peerTable) {
+        windowMul(shared, peerTable->window, privateKey);
+    } else {
+        Point peer;
+        if (!pointFromPublicKey(peer, peerPublicKey)) {
+            return false;
+        }
+        scalarMul(shared, peer, privateKey);
+    }
+    auto ok = pointToAffineBytes(sharedSecret, nullptr, shared);
+    secureZero(&shared, sizeof(shared));
+    return ok;
+}
+
+bool p256Sign(const uint8_t *privateKey, const uint8_t *digest, uint8_t *signature) {
+    if (!isValidScalar(privateKey)) {
+        return false;
+    }
+    auto &mod = curve().n;
+    Fe e, d, k, kInv, r, s;
+    scalarFromBytesReduced(e, digest);
+    feFromBytes(d, privateKey, mod);
+
+    uint8_t nonce[P256_SCALAR_SIZE];
+    uint8_t x[P256_FIELD_SIZE];
+    Point point;
+    auto ok = false;
+    // r and s are zero with a negligible probability, then another nonce is tried
+    while (!ok) {
+        if (!randomScalar(nonce)) {
+            break;
+        }
+
+        // r = x(k * G) mod n, s = k^-1 * (e + r * d) mod n
+        baseMul(point, nonce);
+        if (!pointToAffineBytes(x, nullptr, point)) {
+            continue;
+        }
+        scalarFromBytesReduced(r, x);
+        feFromBytes(k, nonce, mod);
+        feInvert(kInv, k, mod);
+        feMul(s, r, d, mod);
+        feAdd(s, s, e, mod);
+        feMul(s, s, kInv, mod);
+        ok = !feIsZero(r) && !feIsZero(s);
+    }
+    if (ok) {
+        feToBytes(signature, r, mod);
+        feToBytes(signature + P256_SCALAR_SIZE, s, mod);
+    }
+
+    secureZero(nonce, sizeof(nonce));
+    secureZero(&point, sizeof(point));
+    secureZero(&d, sizeof(d));
+    secureZero(&k, sizeof(k));
+    secureZero(&kInv, sizeof(kInv));
+    return ok;
+}
+
+bool p256Verify(const uint8_t *publicKey, const uint8_t *digest, const uint8_t *signature) {
+    // everything here is public, but constant-time code is reused as is
+    auto &mod = curve().n;
+    if (!isValidScalar(signature) || !isValidScalar(signature + P256_SCALAR_SIZE)) {
+        return false;
+    }
+    Point q;
+    if (!pointFromPublicKey(q, publicKey)) {
+        return false;
+    }
+    Fe e, r, s, w, u1, u2;
+    scalarFromBytesReduced(e, digest);
+    feFromBytes(r, signature, mod);
+    feFromBytes(s, signature + P256_SCALAR_SIZE, mod);
+
+    // x(u1 * G + u2 * Q) mod n == r, where u1 = e / s, u2 = r / s
+    feInvert(w, s, mod);
+    feMul(u1, e, w, mod);
+    feMul(u2, r, w, mod);
+    uint8_t u1Bytes[P256_SCALAR_SIZE], u2Bytes[P256_SCALAR_SIZE];
+    feToBytes(u1Bytes, u1, mod);
+    feToBytes(u2Bytes, u2, mod);
+
+    Point p1, p2, sum;
+    baseMul(p1, u1Bytes);
+    scalarMul(p2, q, u2Bytes);
+    pointAdd(sum, p1, p2);
+
+    uint8_t x[P256_FIELD_SIZE];
+    if (!pointToAffineBytes(x, nullptr, sum)) {
+        return false;
+    }
+    Fe xn;
+    scalarFromBytesReduced(xn, x);
+    return feEqual(xn, r);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+constexpr size_t P256_SCALAR_SIZE = 32;
+constexpr size_t P256_FIELD_SIZE = 32;
+// X9.63 uncompressed point: 04 || X || Y
+constexpr size_t P256_PUBLIC_KEY_SIZE = 1 + 2 * P256_FIELD_SIZE;
+// SEC 1 compressed point: 02 or 03, depending on the parity of Y, || X
+constexpr size_t P256_COMPRESSED_PUBLIC_KEY_SIZE = 1 + P256_FIELD_SIZE;
+// ECDSA signature: r || s
+constexpr size_t P256_SIGNATURE_SIZE = 2 * P256_SCALAR_SIZE;
+
+// generates a random private key and the corresponding public key in X9.63 uncompressed form
+bool p256GenerateKeyPair(uint8_t *privateKey, uint8_t *publicKey);
+
+bool p256ComputePublicKey(const uint8_t *privateKey, uint8_t *publicKey);
+
+// the same without the precomputed table of the generator, for benchmarks and tests
+bool p256ComputePublicKeyGeneric(const uint8_t *privateKey, uint8_t *publicKey);
+
+// checks that the public key is an uncompressed point on the curve
+bool p256IsValidPublicKey(const uint8_t *publicKey, size_t length);
+
+// the public key must be valid
+void p256CompressPublicKey(const uint8_t *publicKey, uint8_t *compressed);
+
+// recovers Y, returns false if the point is not on the curve
+bool p256DecompressPublicKey(const uint8_t *compressed, uint8_t *publicKey);
+
+// Precomputed multiples of a public key, ECDH with them is about 3 times faster. Building one costs about
+// two multiplications and it takes 15 KiB, so it's worth it for keys that are used many times.
+struct P256PublicKeyTable;
+
+// null if the public key is invalid
+std::shared_ptr<const P256PublicKeyTable> p256PrecomputePublicKey(const uint8_t *publicKey);
+
+// computes X coordinate of privateKey * peerPublicKey, which is the ECDH shared secret;
+// P-256 has cofactor 1, so it's the same for standard and cofactor Diffie-Hellman.
+// peerTable, if passed, must be precomputed from peerPublicKey, then the public key is not used
+bool p256Ecdh(const uint8_t *privateKey, const uint8_t *peerPublicKey, uint8_t *sharedSecret,
+              const P256PublicKeyTable *peerTable = nullptr);
+
+// ECDSA signature of a SHA-256 digest with a random nonce
+bool p256Sign(const uint8_t *privateKey, const uint8_t *digest, uint8_t *signature);
+
+// checks an ECDSA signature of a SHA-256 digest, the public key must be valid, see p256IsValidPublicKey
+bool p256Verify(const uint8_t *publicKey, const uint8_t *digest, const uint8_t *signature);
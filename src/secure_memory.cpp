@@ -0,0 +1,214 @@
+#include "secure_memory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+
+constexpr size_t SIZE_CLASS_COUNT = 11;
+static_assert(SECURE_MEMORY_MIN_BLOCK_SIZE << (SIZE_CLASS_COUNT - 1) == SECURE_MEMORY_MAX_POOLED_SIZE,
+              "size classes must cover all pooled sizes");
+
+// small blocks share 64 KiB slabs, large ones get at least 4 blocks per slab
+constexpr size_t MIN_SLAB_SIZE = 64 * 1024;
+constexpr size_t MIN_BLOCKS_PER_SLAB = 4;
+
+size_t pageSize() {
+    static const size_t size = size_t(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+size_t roundUpToPage(size_t size) { return (size + pageSize() - 1) / pageSize() * pageSize(); }
+
+size_t sizeClassIndex(size_t size) {
+    size_t index = 0;
+    while ((SECURE_MEMORY_MIN_BLOCK_SIZE << index) < size) {
+        index++;
+    }
+    return index;
+}
+
+size_t sizeClassBlockSize(size_t index) { return SECURE_MEMORY_MIN_BLOCK_SIZE << index; }
+
+class SecureMemoryPool {
+  private:
+    struct SizeClass {
+        std::mutex mutex;
+        std::vector<uint8_t *> free;
+    };
+
+    SizeClass classes_[SIZE_CLASS_COUNT];
+
+    // large blocks and whether they were locked
+    std::mutex largeMutex_;
+    std::unordered_map<uint8_t *, bool> largeBlocks_;
+
+    std::atomic<size_t> slabCount_{0};
+    std::atomic<size_t> reservedBytes_{0};
+    std::atomic<size_t> lockedBytes_{0};
+    std::atomic<size_t> inUseBytes_{0};
+    std::atomic<size_t> peakInUseBytes_{0};
+    std::atomic<uint64_t> allocations_{0};
+    std::atomic<uint64_t> reusedAllocations_{0};
+    std::atomic<uint64_t> largeAllocations_{0};
+    std::atomic<uint64_t> lockFailures_{0};
+
+    // maps size bytes between two guard pages, locks them and returns the start of the usable range
+    uint8_t *mapGuarded(size_t size, bool &locked) {
+        auto page = pageSize();
+        auto mapped = mmap(nullptr, size + 2 * page, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (mapped == MAP_FAILED) {
+            fprintf(stderr, "secure-enclave: can't map %zu bytes of secure memory\n", size);
+            abort();
+        }
+        auto data = static_cast<uint8_t *>(mapped) + page;
+        if (mprotect(data, size, PROT_READ | PROT_WRITE) != 0) {
+            fprintf(stderr, "secure-enclave: can't protect secure memory\n");
+            abort();
+        }
+#ifdef MADV_DONTDUMP
+        madvise(data, size, MADV_DONTDUMP);
+#endif
+        locked = mlock(data, size) == 0;
+        if (locked) {
+            lockedBytes_ += size;
+        } else {
+            lockFailures_++;
+        }
+        reservedBytes_ += size;
+        return data;
+    }
+
+    void unmapGuarded(uint8_t *data, size_t size, bool locked) {
+        if (locked) {
+            munlock(data, size);
+            lockedBytes_ -= size;
+        }
+        munmap(data - pageSize(), size + 2 * pageSize());
+        reservedBytes_ -= size;
+    }
+
+    void addInUse(size_t size) {
+        auto inUse = inUseBytes_ += size;
+        auto peak = peakInUseBytes_.load(std::memory_order_relaxed);
+        while (inUse > peak && !peakInUseBytes_.compare_exchange_weak(peak, inUse, std::memory_order_relaxed)) {
+        }
+    }
+
+  public:
+    void *allocate(size_t size) {
+        allocations_++;
+        if (size > SECURE_MEMORY_MAX_POOLED_SIZE) {
+            largeAllocations_++;
+            auto mappedSize = roundUpToPage(size);
+            bool locked;
+            auto data = mapGuarded(mappedSize, locked);
+            {
+                std::lock_guard<std::mutex> lock(largeMutex_);
+                largeBlocks_[data] = locked;
+            }
+            addInUse(mappedSize);
+            return data;
+        }
+
+        auto index = sizeClassIndex(size);
+        auto blockSize = sizeClassBlockSize(index);
+        auto &sizeClass = classes_[index];
+        addInUse(blockSize);
+
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        if (!sizeClass.free.empty()) {
+            reusedAllocations_++;
+            auto block = sizeClass.free.back();
+            sizeClass.free.pop_back();
+            return block;
+        }
+
+        auto slabSize = roundUpToPage(std::max(MIN_SLAB_SIZE, blockSize * MIN_BLOCKS_PER_SLAB));
+        bool locked;
+        auto slab = mapGuarded(slabSize, locked);
+        slabCount_++;
+        auto blockCount = slabSize / blockSize;
+        sizeClass.free.reserve(sizeClass.free.size() + blockCount - 1);
+        // the first block is returned, others are pushed in reverse order, so that they are used from the start
+        for (auto i = blockCount - 1; i > 0; i--) {
+            sizeClass.free.push_back(slab + i * blockSize);
+        }
+        return slab;
+    }
+
+    void deallocate(void *ptr, size_t size) {
+        if (!ptr) {
+            return;
+        }
+        auto data = static_cast<uint8_t *>(ptr);
+        if (size > SECURE_MEMORY_MAX_POOLED_SIZE) {
+            auto mappedSize = roundUpToPage(size);
+            secureZero(data, size);
+            inUseBytes_ -= mappedSize;
+            bool locked;
+            {
+                std::lock_guard<std::mutex> lock(largeMutex_);
+                auto it = largeBlocks_.find(data);
+                locked = it->second;
+                largeBlocks_.erase(it);
+            }
+            unmapGuarded(data, mappedSize, locked);
+            return;
+        }
+
+        auto index = sizeClassIndex(size);
+        auto blockSize = sizeClassBlockSize(index);
+        // the rest of the block has not been used since it was zeroized last time
+        secureZero(data, size);
+        inUseBytes_ -= blockSize;
+
+        auto &sizeClass = classes_[index];
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        sizeClass.free.push_back(data);
+    }
+
+    SecureMemoryStats stats() {
+        SecureMemoryStats stats;
+        stats.slabCount = slabCount_;
+        stats.reservedBytes = reservedBytes_;
+        stats.lockedBytes = lockedBytes_;
+        stats.inUseBytes = inUseBytes_;
+        stats.peakInUseBytes = peakInUseBytes_;
+        stats.allocations = allocations_;
+        stats.reusedAllocations = reusedAllocations_;
+        stats.largeAllocations = largeAllocations_;
+        stats.lockFailures = lockFailures_;
+        return stats;
+    }
+};
+
+SecureMemoryPool &pool() {
+    // never destroyed, blocks can be released by static destructors and detached threads at exit
+    static auto instance = new SecureMemoryPool();
+    return *instance;
+}
+
+} // namespace
+
+void secureZero(void *data, size_t length) {
+    if (!length) {
+        return;
+    }
+    memset(data, 0, length);
+    // the compiler must assume that the zeroed memory is read here, so memset can't be removed
+    __asm__ __volatile__("" : : "r"(data) : "memory");
+}
+
+void *secureAllocate(size_t size) { return pool().allocate(size); }
+
+void secureDeallocate(void *ptr, size_t size) { pool().deallocate(ptr, size); }
+
+SecureMemoryStats secureMemoryStats() { return pool().stats(); }
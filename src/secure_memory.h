@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// overwrites memory with zeros in a way that can't be optimized out by the compiler
+void secureZero(void *data, size_t length);
+
+// Pool of memory for plaintext and key material.
+// Blocks of up to SECURE_MEMORY_MAX_POOLED_SIZE bytes are rounded up to a power of two and carved from slabs,
+// which are locked in RAM, excluded from core dumps where possible, and surrounded by inaccessible guard pages.
+// Released blocks are zeroized and kept in per-size free lists, so pages are locked once and reused.
+// Larger blocks get their own guarded mapping, which is unmapped when they are released.
+// If memory can't be locked, for example because of RLIMIT_MEMLOCK, it's used anyway and counted in lockFailures.
+
+constexpr size_t SECURE_MEMORY_MIN_BLOCK_SIZE = 64;
+constexpr size_t SECURE_MEMORY_MAX_POOLED_SIZE = 64 * 1024;
+
+struct SecureMemoryStats {
+    size_t slabCount;
+    // mapped for slabs and large blocks, without guard pages
+    size_t reservedBytes;
+    size_t lockedBytes;
+    // blocks in use, rounded up to their size classes
+    size_t inUseBytes;
+    size_t peakInUseBytes;
+    uint64_t allocations;
+    // allocations served from free lists, without new mappings
+    uint64_t reusedAllocations;
+    uint64_t largeAllocations;
+    uint64_t lockFailures;
+};
+
+// can be called from any thread, aborts if the memory can't be mapped, like operator new without exceptions
+void *secureAllocate(size_t size);
+// zeroizes the block, size must be the same as in secureAllocate
+void secureDeallocate(void *ptr, size_t size);
+
+SecureMemoryStats secureMemoryStats();
+
+template <class T> class SecureAllocator {
+  public:
+    using value_type = T;
+
+    SecureAllocator() = default;
+    template <class U> SecureAllocator(const SecureAllocator<U> &) {}
+
+    T *allocate(size_t count) { return static_cast<T *>(secureAllocate(count * sizeof(T))); }
+    void deallocate(T *ptr, size_t count) { secureDeallocate(ptr, count * sizeof(T)); }
+
+    template <class U> bool operator==(const SecureAllocator<U> &) const { return true; }
+    template <class U> bool operator!=(const SecureAllocator<U> &) const { return false; }
+};
+
+// bytes that are zeroized when released, including copies left behind when the vector grows
+using SecureBytes = std::vector<uint8_t, SecureAllocator<uint8_t>>;
@@ -0,0 +1,53 @@
+#include "secure_random.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <stdlib.h>
+#elif defined(__linux__)
+#include <sys/random.h>
+#endif
+
+bool secureRandomBytes(uint8_t *data, size_t length) {
+#if defined(__APPLE__)
+    arc4random_buf(data, length);
+    return true;
+#else
+#if defined(__linux__)
+    while (length > 0) {
+        auto read = getrandom(data, length, 0);
+        if (read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        data += read;
+        length -= read;
+    }
+    if (length == 0) {
+        return true;
+    }
+#endif
+    auto fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    while (length > 0) {
+        auto read = ::read(fd, data, length);
+        if (read <= 0) {
+            if (read < 0 && errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return false;
+        }
+        data += read;
+        length -= read;
+    }
+    close(fd);
+    return true;
+#endif
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// fills the buffer with bytes from the OS CSPRNG, returns false if the OS refused to provide them
+bool secureRandomBytes(uint8_t *data, size_t length);
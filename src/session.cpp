@@ -0,0 +1,127 @@
+#include "session.h"
+
+#include "addon_data.h"
+#include "async_operation.h"
+#include "envelope.h"
+#include "helpers.h"
+#include "secure_memory.h"
+
+namespace {
+
+class SessionDecryptOperation : public AsyncOperation {
+  private:
+    std::shared_ptr<SessionState> state_;
+    // pinned input Buffer, see EncryptOperation
+    const uint8_t *data_;
+    size_t length_;
+    SecureBytes decryptedData_;
+
+  protected:
+    void execute() override {
+        // no keychain lookup and no prompt, the key was found with an authenticated context
+        auto keyPair = state_->keyPair();
+        if (!keyPair) {
+            error_ = errorWithMessage("Session is closed or expired", "sessionClosed");
+            return;
+        }
+        PhaseTimer timer(this, PHASE_CRYPTO);
+        error_ = decryptWithKeyPair(*keyPair, data_, length_, decryptedData_);
+    }
+
+    void resolve(Napi::Env env, Napi::Promise::Deferred &deferred) override {
+        deferred.Resolve(bytesToExternalBuffer(env, std::move(decryptedData_)));
+    }
+
+  public:
+    SessionDecryptOperation(Napi::Env env, Napi::Promise::Deferred deferred, std::shared_ptr<SessionState> state,
+                            Napi::Buffer<uint8_t> data)
+        : AsyncOperation(env, std::move(deferred), "sessionDecrypt"), state_(std::move(state)),
+          data_(data.Data()), length_(data.ByteLength()) {
+        pin(data);
+    }
+};
+
+} // namespace
+
+SessionState::SessionState(std::shared_ptr<AuthContext> authContext, std::unique_ptr<KeyPair> keyPair,
+                           double reuseSeconds)
+    : authContext_(std::move(authContext)), keyPair_(std::move(keyPair)),
+      expiresAt_(std::chrono::steady_clock::now() +
+                 std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                     std::chrono::duration<double>(reuseSeconds))) {}
+
+SessionState::~SessionState() { closeLocked(); }
+
+void SessionState::closeLocked() {
+    if (authContext_) {
+        authContext_->invalidate();
+    }
+    authContext_.reset();
+    keyPair_.reset();
+}
+
+std::shared_ptr<KeyPair> SessionState::keyPair() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (keyPair_ && std::chrono::steady_clock::now() >= expiresAt_) {
+        closeLocked();
+    }
+    return keyPair_;
+}
+
+bool SessionState::isOpen() { return keyPair() != nullptr; }
+
+void SessionState::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closeLocked();
+}
+
+void Session::init(Napi::Env env) {
+    auto func = DefineClass(env, "Session",
+                            {
+                                InstanceMethod("decrypt", &Session::decrypt),
+                                InstanceMethod("close", &Session::close),
+                                InstanceAccessor("isOpen", &Session::isOpen, nullptr, napi_enumerable),
+                            });
+    getAddonData(env).sessionConstructor = Napi::Persistent(func);
+}
+
+Napi::Object Session::create(Napi::Env env, std::shared_ptr<SessionState> state) {
+    return getAddonData(env).sessionConstructor.Value().New(
+        {Napi::External<std::shared_ptr<SessionState>>::New(env, &state)});
+}
+
+Session::Session(const Napi::CallbackInfo &info) : Napi::ObjectWrap<Session>(info) {
+    if (info.Length() != 1 || !info[0].IsExternal()) {
+        Napi::TypeError::New(info.Env(), "Use openSession to create a session").ThrowAsJavaScriptException();
+        return;
+    }
+    state_ = *info[0].As<Napi::External<std::shared_ptr<SessionState>>>().Data();
+}
+
+Napi::Value Session::decrypt(const Napi::CallbackInfo &info) {
+    auto env = info.Env();
+
+    auto deferred = Napi::Promise::Deferred::New(env);
+
+    if (info.Length() != 1 || !info[0].IsBuffer()) {
+        rejectAsTypeError(deferred, "data is not a buffer");
+        return deferred.Promise();
+    }
+
+    auto data = info[0].As<Napi::Buffer<uint8_t>>();
+    if (data.ByteLength() == 0) {
+        rejectAsTypeError(deferred, "data cannot be empty");
+        return deferred.Promise();
+    }
+
+    auto promise = deferred.Promise();
+    (new SessionDecryptOperation(env, std::move(deferred), state_, data))->queue();
+    return promise;
+}
+
+Napi::Value Session::close(const Napi::CallbackInfo &info) {
+    state_->close();
+    return info.Env().Undefined();
+}
+
+Napi::Value Session::isOpen(const Napi::CallbackInfo &info) { return Napi::Boolean::New(info.Env(), state_->isOpen()); }
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <napi.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "backend.h"
+
+constexpr double DEFAULT_SESSION_REUSE_SECONDS = 300;
+
+// Authenticated context and the private key found with it, shared by the JS Session object and its operations.
+class SessionState {
+  private:
+    std::mutex mutex_;
+    std::shared_ptr<AuthContext> authContext_;
+    std::shared_ptr<KeyPair> keyPair_;
+    std::chrono::steady_clock::time_point expiresAt_;
+
+    void closeLocked();
+
+  public:
+    SessionState(std::shared_ptr<AuthContext> authContext, std::unique_ptr<KeyPair> keyPair, double reuseSeconds);
+    ~SessionState();
+
+    SessionState(const SessionState &) = delete;
+    SessionState &operator=(const SessionState &) = delete;
+
+    // returns nullptr if the session is closed or expired, an expired session is closed here
+    std::shared_ptr<KeyPair> keyPair();
+
+    bool isOpen();
+
+    // invalidates the authentication, decrypts that are already running are finished
+    void close();
+};
+
+// JS handle returned by openSession.
+class Session : public Napi::ObjectWrap<Session> {
+  private:
+    std::shared_ptr<SessionState> state_;
+
+    Napi::Value decrypt(const Napi::CallbackInfo &info);
+    Napi::Value close(const Napi::CallbackInfo &info);
+    Napi::Value isOpen(const Napi::CallbackInfo &info);
+
+  public:
+    static void init(Napi::Env env);
+    static Napi::Object create(Napi::Env env, std::shared_ptr<SessionState> state);
+
+    explicit Session(const Napi::CallbackInfo &info);
+};
@@ -0,0 +1,167 @@
+#include "sha256.h"
+
+#include <cstring>
+
+#include "secure_memory.h"
+
+const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+namespace {
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline uint32_t loadBigEndian32(const uint8_t *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline void storeBigEndian32(uint8_t *p, uint32_t x) {
+    p[0] = uint8_t(x >> 24);
+    p[1] = uint8_t(x >> 16);
+    p[2] = uint8_t(x >> 8);
+    p[3] = uint8_t(x);
+}
+
+void compressBlocks(uint32_t *state, const uint8_t *blocks, size_t blockCount) {
+    uint32_t w[64];
+    for (; blockCount > 0; blockCount--, blocks += SHA256_BLOCK_SIZE) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = loadBigEndian32(blocks + i * 4);
+        }
+        for (int i = 16; i < 64; i++) {
+            auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        auto a = state[0], b = state[1], c = state[2], d = state[3];
+        auto e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; i++) {
+            auto s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            auto ch = (e & f) ^ (~e & g);
+            auto t1 = h + s1 + ch + SHA256_K[i] + w[i];
+            auto s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            auto maj = (a & b) ^ (a & c) ^ (b & c);
+            auto t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+    secureZero(w, sizeof(w));
+}
+
+} // namespace
+
+Sha256::Sha256(Sha256Kernel kernel)
+    : state_{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19} {
+    compress_ = sha256HardwareCompress(kernel);
+    if (!compress_) {
+        compress_ = compressBlocks;
+    }
+}
+
+Sha256::~Sha256() {
+    secureZero(state_, sizeof(state_));
+    secureZero(buffer_, sizeof(buffer_));
+}
+
+void Sha256::update(const uint8_t *data, size_t length) {
+    // data can be null if it's empty
+    if (length == 0) {
+        return;
+    }
+    totalLength_ += length;
+
+    if (bufferLength_ > 0) {
+        auto toCopy = SHA256_BLOCK_SIZE - bufferLength_;
+        if (toCopy > length) {
+            toCopy = length;
+        }
+        memcpy(buffer_ + bufferLength_, data, toCopy);
+        bufferLength_ += toCopy;
+        data += toCopy;
+        length -= toCopy;
+        if (bufferLength_ < SHA256_BLOCK_SIZE) {
+            return;
+        }
+        compress_(state_, buffer_, 1);
+        bufferLength_ = 0;
+    }
+
+    auto blockCount = length / SHA256_BLOCK_SIZE;
+    if (blockCount > 0) {
+        compress_(state_, data, blockCount);
+        data += blockCount * SHA256_BLOCK_SIZE;
+        length -= blockCount * SHA256_BLOCK_SIZE;
+    }
+
+    if (length > 0) {
+        memcpy(buffer_, data, length);
+        bufferLength_ = length;
+    }
+}
+
+void Sha256::finish(uint8_t *digest) {
+    auto bitLength = totalLength_ * 8;
+
+    buffer_[bufferLength_++] = 0x80;
+    if (bufferLength_ > SHA256_BLOCK_SIZE - 8) {
+        memset(buffer_ + bufferLength_, 0, SHA256_BLOCK_SIZE - bufferLength_);
+        compress_(state_, buffer_, 1);
+        bufferLength_ = 0;
+    }
+    memset(buffer_ + bufferLength_, 0, SHA256_BLOCK_SIZE - 8 - bufferLength_);
+    storeBigEndian32(buffer_ + SHA256_BLOCK_SIZE - 8, uint32_t(bitLength >> 32));
+    storeBigEndian32(buffer_ + SHA256_BLOCK_SIZE - 4, uint32_t(bitLength));
+    compress_(state_, buffer_, 1);
+
+    for (int i = 0; i < 8; i++) {
+        storeBigEndian32(digest + i * 4, state_[i]);
+    }
+}
+
+void x963KdfSha256(const uint8_t *sharedSecret, size_t sharedSecretLength, const uint8_t *sharedInfo,
+                   size_t sharedInfoLength, uint8_t *derived, size_t derivedLength) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint32_t counter = 1;
+    while (derivedLength > 0) {
+        uint8_t counterBytes[4];
+        storeBigEndian32(counterBytes, counter++);
+
+        Sha256 sha;
+        sha.update(sharedSecret, sharedSecretLength);
+        sha.update(counterBytes, sizeof(counterBytes));
+        sha.update(sharedInfo, sharedInfoLength);
+        sha.finish(digest);
+
+        auto toCopy = derivedLength < SHA256_DIGEST_SIZE ? derivedLength : SHA256_DIGEST_SIZE;
+        memcpy(derived, digest, toCopy);
+        derived += toCopy;
+        derivedLength -= toCopy;
+    }
+    secureZero(digest, sizeof(digest));
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "crypto_kernels.h"
+
+constexpr size_t SHA256_DIGEST_SIZE = 32;
+constexpr size_t SHA256_BLOCK_SIZE = 64;
+
+// The kernel is the one selected for the CPU unless it's specified, for tests and benchmarks.
+class Sha256 {
+  private:
+    Sha256Compress compress_;
+    uint32_t state_[8];
+    uint8_t buffer_[SHA256_BLOCK_SIZE];
+    size_t bufferLength_ = 0;
+    uint64_t totalLength_ = 0;
+
+  public:
+    Sha256(Sha256Kernel kernel = sha256Kernel());
+    ~Sha256();
+
+    void update(const uint8_t *data, size_t length);
+    void finish(uint8_t *digest);
+};
+
+// ANSI X9.63 key derivation function with SHA-256, as used by kSecKeyAlgorithmECIES*X963SHA256* algorithms
+void x963KdfSha256(const uint8_t *sharedSecret, size_t sharedSecretLength, const uint8_t *sharedInfo,
+                   size_t sharedInfoLength, uint8_t *derived, size_t derivedLength);
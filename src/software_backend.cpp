@@ -0,0 +1,493 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "backend.h"
+#include "ecdsa.h"
+#include "ecies.h"
+#include "p256.h"
+#include "secure_memory.h"
+#include "sha256.h"
+
+// Portable backend that keeps keys in files and simulates user authentication.
+// It's used to run tests and benchmarks on machines without Secure Enclave, its ciphertext is compatible with
+// the keychain backend, and operation names in errors are the same as in Security.framework.
+//
+// Environment variables:
+//  - NODE_SECURE_ENCLAVE_ALLOW_SOFTWARE_BACKEND: must be 1, otherwise isSupported is false and operations fail
+//  - NODE_SECURE_ENCLAVE_KEYSTORE: directory with key files, ~/.node-secure-enclave by default
+//  - NODE_SECURE_ENCLAVE_AUTH_SCRIPT: comma-separated results of the next authentication prompts,
+//    each one is an LAError code (0 is success) with an optional delay in milliseconds, for example "0,-2@500";
+//    the last result is repeated, the script starts over when the variable is changed
+
+namespace {
+
+constexpr uint8_t KEY_FILE_MAGIC[4] = {'N', 'S', 'E', 'K'};
+constexpr uint8_t KEY_FILE_VERSION = 1;
+constexpr size_t KEY_FILE_HEADER_SIZE = sizeof(KEY_FILE_MAGIC) + 1 + 2;
+constexpr size_t MAX_KEY_TAG_LENGTH = 0xffff;
+
+struct KeyMaterial {
+    uint8_t privateKey[P256_SCALAR_SIZE];
+    uint8_t publicKey[P256_PUBLIC_KEY_SIZE];
+
+    ~KeyMaterial() { secureZero(privateKey, sizeof(privateKey)); }
+};
+
+std::string keyStoreDir() {
+    auto dir = getenv("NODE_SECURE_ENCLAVE_KEYSTORE");
+    if (dir && *dir) {
+        return dir;
+    }
+    auto home = getenv("HOME");
+    return std::string(home && *home ? home : "/tmp") + "/.node-secure-enclave";
+}
+
+// key tags can contain any characters, so files are named after tag hashes
+std::string keyFilePath(const std::string &keyTag) {
+    static const char HEX[] = "0123456789abcdef";
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    Sha256 sha;
+    sha.update(reinterpret_cast<const uint8_t *>(keyTag.data()), keyTag.length());
+    sha.finish(digest);
+
+    std::string path = keyStoreDir() + "/";
+    for (auto byte : digest) {
+        path += HEX[byte >> 4];
+        path += HEX[byte & 0xf];
+    }
+    return path + ".key";
+}
+
+SecureBytes serializeKeyFile(const std::string &keyTag, const KeyMaterial &key) {
+    SecureBytes data(KEY_FILE_MAGIC, KEY_FILE_MAGIC + sizeof(KEY_FILE_MAGIC));
+    data.push_back(KEY_FILE_VERSION);
+    data.push_back(uint8_t(keyTag.length() >> 8));
+    data.push_back(uint8_t(keyTag.length()));
+    data.insert(data.end(), keyTag.begin(), keyTag.end());
+    data.insert(data.end(), key.privateKey, key.privateKey + sizeof(key.privateKey));
+    data.insert(data.end(), key.publicKey, key.publicKey + sizeof(key.publicKey));
+    return data;
+}
+
+// reads the key and its tag, which is stored in the file because file names are hashes
+bool parseKeyFile(const SecureBytes &data, std::string &keyTag, KeyMaterial &key) {
+    if (data.size() < KEY_FILE_HEADER_SIZE || memcmp(data.data(), KEY_FILE_MAGIC, sizeof(KEY_FILE_MAGIC)) != 0 ||
+        data[sizeof(KEY_FILE_MAGIC)] != KEY_FILE_VERSION) {
+        return false;
+    }
+    auto keyTagLength = (size_t(data[5]) << 8) | data[6];
+    if (data.size() != KEY_FILE_HEADER_SIZE + keyTagLength + P256_SCALAR_SIZE + P256_PUBLIC_KEY_SIZE) {
+        return false;
+    }
+    auto ptr = data.data() + KEY_FILE_HEADER_SIZE;
+    keyTag.assign(reinterpret_cast<const char *>(ptr), keyTagLength);
+    ptr += keyTagLength;
+    memcpy(key.privateKey, ptr, P256_SCALAR_SIZE);
+    memcpy(key.publicKey, ptr + P256_SCALAR_SIZE, P256_PUBLIC_KEY_SIZE);
+    return p256IsValidPublicKey(key.publicKey, P256_PUBLIC_KEY_SIZE);
+}
+
+bool writeAll(int fd, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        auto written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+// creates the file only if it doesn't exist yet, this is atomic even across processes
+long writeNewFile(const std::string &path, const SecureBytes &data) {
+    static std::atomic<unsigned> tempFileCounter{0};
+
+    mkdir(keyStoreDir().c_str(), 0700);
+
+    auto tempPath = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(tempFileCounter++);
+    auto fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return STATUS_IO;
+    }
+    auto written = writeAll(fd, data.data(), data.size()) && fsync(fd) == 0;
+    close(fd);
+    if (!written) {
+        unlink(tempPath.c_str());
+        return STATUS_IO;
+    }
+
+    auto linkResult = link(tempPath.c_str(), path.c_str());
+    auto linkErrno = errno;
+    unlink(tempPath.c_str());
+    if (linkResult != 0) {
+        return linkErrno == EEXIST ? STATUS_DUPLICATE_ITEM : STATUS_IO;
+    }
+    return STATUS_SUCCESS;
+}
+
+long readFile(const std::string &path, SecureBytes &data) {
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? STATUS_ITEM_NOT_FOUND : STATUS_IO;
+    }
+    uint8_t buffer[4096];
+    while (true) {
+        auto read = ::read(fd, buffer, sizeof(buffer));
+        if (read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            secureZero(buffer, sizeof(buffer));
+            return STATUS_IO;
+        }
+        if (read == 0) {
+            break;
+        }
+        data.insert(data.end(), buffer, buffer + read);
+    }
+    close(fd);
+    secureZero(buffer, sizeof(buffer));
+    return STATUS_SUCCESS;
+}
+
+struct AuthStep {
+    long code = 0;
+    long delayMs = 0;
+};
+
+class AuthScript {
+  private:
+    std::mutex mutex_;
+    std::string source_;
+    std::vector<AuthStep> steps_;
+    size_t position_ = 0;
+
+    void parse() {
+        steps_.clear();
+        position_ = 0;
+        size_t start = 0;
+        while (start <= source_.length()) {
+            auto end = source_.find(',', start);
+            if (end == std::string::npos) {
+                end = source_.length();
+            }
+            auto item = source_.substr(start, end - start);
+            if (!item.empty()) {
+                AuthStep step;
+                step.code = strtol(item.c_str(), nullptr, 10);
+                auto at = item.find('@');
+                if (at != std::string::npos) {
+                    step.delayMs = strtol(item.c_str() + at + 1, nullptr, 10);
+                }
+                steps_.push_back(step);
+            }
+            start = end + 1;
+        }
+    }
+
+  public:
+    AuthStep next() {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto env = getenv("NODE_SECURE_ENCLAVE_AUTH_SCRIPT");
+        std::string source = env ? env : "";
+        if (source != source_) {
+            source_ = source;
+            parse();
+        }
+
+        if (steps_.empty()) {
+            return AuthStep();
+        }
+        auto step = steps_[position_];
+        if (position_ + 1 < steps_.size()) {
+            position_++;
+        }
+        return step;
+    }
+};
+
+class SoftwareAuthContext : public AuthContext {
+  private:
+    std::mutex mutex_;
+    std::condition_variable invalidatedCondition_;
+    bool invalidated_ = false;
+
+  public:
+    // shared with key pairs found with this context, like an LAContext is retained by a SecKeyRef
+    std::shared_ptr<std::atomic<bool>> authenticated = std::make_shared<std::atomic<bool>>(false);
+
+    void invalidate() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        invalidated_ = true;
+        *authenticated = false;
+        invalidatedCondition_.notify_all();
+    }
+
+    // waits for the simulated user, returns the result of the step or AUTH_ERROR_APP_CANCEL if it was invalidated
+    long prompt(const AuthStep &step) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        invalidatedCondition_.wait_for(lock, std::chrono::milliseconds(step.delayMs),
+                                       [this]() { return invalidated_; });
+        if (invalidated_) {
+            return AUTH_ERROR_APP_CANCEL;
+        }
+        *authenticated = step.code == 0;
+        return step.code;
+    }
+};
+
+class SoftwareKeyPair : public KeyPair {
+  private:
+    KeyMaterial key_;
+    std::shared_ptr<std::atomic<bool>> authenticated_;
+
+  public:
+    SoftwareKeyPair(const KeyMaterial &key, std::shared_ptr<std::atomic<bool>> authenticated)
+        : key_(key), authenticated_(std::move(authenticated)) {}
+
+    BackendError copyPublicKey(Bytes &publicKey) override {
+        publicKey.assign(key_.publicKey, key_.publicKey + sizeof(key_.publicKey));
+        return BackendError();
+    }
+
+    BackendError encrypt(const uint8_t *data, size_t length, Bytes &encrypted) override {
+        encrypted.resize(length + ECIES_OVERHEAD);
+        if (!eciesEncrypt(key_.publicKey, data, length, encrypted.data())) {
+            encrypted.clear();
+            return errorWithCode(STATUS_PARAM, "SecKeyCreateEncryptedData");
+        }
+        return BackendError();
+    }
+
+    BackendError decrypt(const uint8_t *data, size_t length, SecureBytes &decrypted) override {
+        // like Secure Enclave keys, private keys can be used only after user authentication
+        if (!authenticated_ || !*authenticated_) {
+            return errorWithCode(STATUS_AUTH_FAILED, "SecKeyCreateDecryptedData");
+        }
+        if (length < ECIES_OVERHEAD) {
+            return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData");
+        }
+        decrypted.resize(length - ECIES_OVERHEAD);
+        if (!eciesDecrypt(key_.privateKey, data, length, decrypted.data())) {
+            decrypted = SecureBytes();
+            return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData");
+        }
+        return BackendError();
+    }
+
+    BackendError sign(const uint8_t *data, size_t length, Bytes &signature) override {
+        if (!authenticated_ || !*authenticated_) {
+            return errorWithCode(STATUS_AUTH_FAILED, "SecKeyCreateSignature");
+        }
+        signature.resize(ECDSA_MAX_SIGNATURE_SIZE);
+        size_t signatureLength = 0;
+        if (!ecdsaSign(key_.privateKey, data, length, signature.data(), signatureLength)) {
+            signature.clear();
+            return errorWithCode(STATUS_PARAM, "SecKeyCreateSignature");
+        }
+        signature.resize(signatureLength);
+        return BackendError();
+    }
+
+    BackendError deriveSharedSecret(const uint8_t *peerPublicKey, const uint8_t *sharedInfo, size_t sharedInfoLength,
+                                    size_t length, SecureBytes &derived) override {
+        if (!authenticated_ || !*authenticated_) {
+            return errorWithCode(STATUS_AUTH_FAILED, "SecKeyCopyKeyExchangeResult");
+        }
+        uint8_t sharedSecret[P256_FIELD_SIZE];
+        if (!p256Ecdh(key_.privateKey, peerPublicKey, sharedSecret)) {
+            return errorWithCode(STATUS_PARAM, "SecKeyCopyKeyExchangeResult");
+        }
+        derived.resize(length);
+        x963KdfSha256(sharedSecret, sizeof(sharedSecret), sharedInfo, sharedInfoLength, derived.data(), length);
+        secureZero(sharedSecret, sizeof(sharedSecret));
+        return BackendError();
+    }
+};
+
+class SoftwareBackend : public Backend {
+  private:
+    AuthScript authScript_;
+
+    BackendError readKey(const std::string &keyTag, KeyMaterial &key) {
+        SecureBytes data;
+        auto status = readFile(keyFilePath(keyTag), data);
+        std::string fileKeyTag;
+        auto parsed = status == STATUS_SUCCESS && parseKeyFile(data, fileKeyTag, key) && fileKeyTag == keyTag;
+        if (status != STATUS_SUCCESS) {
+            return errorWithCode(status, "SecItemCopyMatching");
+        }
+        if (!parsed) {
+            return errorWithCode(STATUS_DECODE, "SecItemCopyMatching");
+        }
+        return BackendError();
+    }
+
+  public:
+    const char *name() const override { return "software"; }
+
+    // keys aren't protected by hardware and prompts are simulated, so it's off unless a test or a benchmark asks for it
+    bool isSupported() override {
+        auto allow = getenv("NODE_SECURE_ENCLAVE_ALLOW_SOFTWARE_BACKEND");
+        return allow && strcmp(allow, "1") == 0;
+    }
+
+    std::string errorMessage(long code) override {
+        switch (code) {
+        case STATUS_IO:
+            return "I/O error.";
+        case STATUS_PARAM:
+            return "One or more parameters passed to a function were not valid.";
+        case STATUS_AUTH_FAILED:
+            return "The user name or passphrase you entered is not correct.";
+        case STATUS_DUPLICATE_ITEM:
+            return "The specified item already exists in the keychain.";
+        case STATUS_ITEM_NOT_FOUND:
+            return "The specified item could not be found in the keychain.";
+        case STATUS_DECODE:
+            return "Unable to decode the provided data.";
+        default:
+            return std::string();
+        }
+    }
+
+    BackendError createKeyPair(const std::string &keyTag, Bytes &publicKey) override {
+        if (keyTag.length() > MAX_KEY_TAG_LENGTH) {
+            return errorWithCode(STATUS_PARAM, "SecKeyCreateRandomKey");
+        }
+
+        auto path = keyFilePath(keyTag);
+        if (access(path.c_str(), F_OK) == 0) {
+            return errorWithCode(STATUS_DUPLICATE_ITEM, "SecItemCopyMatching");
+        }
+
+        KeyMaterial key;
+        if (!p256GenerateKeyPair(key.privateKey, key.publicKey)) {
+            return errorWithCode(STATUS_PARAM, "SecKeyCreateRandomKey");
+        }
+
+        auto data = serializeKeyFile(keyTag, key);
+        auto status = writeNewFile(path, data);
+        if (status != STATUS_SUCCESS) {
+            return errorWithCode(status, "SecKeyCreateRandomKey");
+        }
+
+        publicKey.assign(key.publicKey, key.publicKey + sizeof(key.publicKey));
+        return BackendError();
+    }
+
+    BackendError findKeyPair(const std::string &keyTag, AuthContext *authContext,
+                             std::unique_ptr<KeyPair> &keyPair) override {
+        KeyMaterial key;
+        if (auto error = readKey(keyTag, key)) {
+            return error;
+        }
+        auto softwareAuthContext = static_cast<SoftwareAuthContext *>(authContext);
+        keyPair = std::make_unique<SoftwareKeyPair>(
+            key, softwareAuthContext ? softwareAuthContext->authenticated : std::shared_ptr<std::atomic<bool>>());
+        return BackendError();
+    }
+
+    BackendError deleteKeyPair(const std::string &keyTag) override {
+        if (unlink(keyFilePath(keyTag).c_str()) != 0) {
+            return errorWithCode(errno == ENOENT ? STATUS_ITEM_NOT_FOUND : STATUS_IO, "SecItemDelete");
+        }
+        return BackendError();
+    }
+
+    BackendError renameKeyPair(const std::string &keyTag, const std::string &newKeyTag) override {
+        if (newKeyTag.length() > MAX_KEY_TAG_LENGTH) {
+            return errorWithCode(STATUS_PARAM, "SecItemUpdate");
+        }
+
+        KeyMaterial key;
+        if (auto error = readKey(keyTag, key)) {
+            return error;
+        }
+
+        // the tag is stored in the file, so the key is written under the new name first; the new file appears
+        // atomically and only if the tag is free, then the old one is removed
+        auto status = writeNewFile(keyFilePath(newKeyTag), serializeKeyFile(newKeyTag, key));
+        if (status != STATUS_SUCCESS) {
+            return errorWithCode(status, "SecItemUpdate");
+        }
+        unlink(keyFilePath(keyTag).c_str());
+        return BackendError();
+    }
+
+    BackendError listKeys(const std::string &prefix, const std::string &excludePrefix, size_t limit,
+                          std::vector<KeyInfo> &keys) override {
+        auto dirPath = keyStoreDir();
+        auto dir = opendir(dirPath.c_str());
+        if (!dir) {
+            return errno == ENOENT ? BackendError() : errorWithCode(STATUS_IO, "SecItemCopyMatching");
+        }
+
+        // like a keychain query, the whole store is read, broken files are skipped
+        std::vector<KeyInfo> found;
+        while (auto entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.length() < 4 || name.compare(name.length() - 4, 4, ".key") != 0) {
+                continue;
+            }
+            SecureBytes data;
+            KeyMaterial key;
+            KeyInfo info;
+            auto parsed =
+                readFile(dirPath + "/" + name, data) == STATUS_SUCCESS && parseKeyFile(data, info.keyTag, key);
+            auto excluded =
+                !excludePrefix.empty() && info.keyTag.compare(0, excludePrefix.length(), excludePrefix) == 0;
+            if (parsed && info.keyTag.compare(0, prefix.length(), prefix) == 0 && !excluded) {
+                info.publicKey.assign(key.publicKey, key.publicKey + sizeof(key.publicKey));
+                found.push_back(std::move(info));
+            }
+        }
+        closedir(dir);
+
+        std::sort(found.begin(), found.end(),
+                  [](const KeyInfo &a, const KeyInfo &b) { return a.keyTag < b.keyTag; });
+        if (limit && found.size() > limit) {
+            found.resize(limit);
+        }
+        keys = std::move(found);
+        return BackendError();
+    }
+
+    std::shared_ptr<AuthContext> authenticate(const std::string &, AuthCallback callback) override {
+        auto context = std::make_shared<SoftwareAuthContext>();
+        auto step = authScript_.next();
+
+        // a separate thread, like the one LocalAuthentication calls us from
+        std::thread([context, step, callback]() {
+            auto code = context->prompt(step);
+            callback(context, code);
+        }).detach();
+
+        return context;
+    }
+};
+
+} // namespace
+
+Backend &getBackend() {
+    static SoftwareBackend backend;
+    return backend;
+}
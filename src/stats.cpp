@@ -0,0 +1,189 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+std::atomic<bool> enabled{false};
+std::atomic<int64_t> inFlight{0};
+std::mutex registryMutex;
+std::map<std::string, std::unique_ptr<OperationStats>> registry;
+
+// values below 8 have their own buckets, others are split into 4 buckets per power of two
+size_t bucketIndex(uint64_t value) {
+    if (value < 8) {
+        return size_t(value);
+    }
+    auto exponent = 63 - size_t(__builtin_clzll(value));
+    auto sub = size_t(value >> (exponent - 2)) & 3;
+    return 8 + (exponent - 3) * 4 + sub;
+}
+
+double bucketMiddleMs(size_t index) {
+    if (index < 8) {
+        return double(index) / 1000;
+    }
+    auto exponent = (index - 8) / 4 + 3;
+    auto sub = (index - 8) % 4;
+    auto width = uint64_t(1) << (exponent - 2);
+    auto lower = (4 + sub) * width;
+    return (double(lower) + double(width) / 2) / 1000;
+}
+
+} // namespace
+
+const char *phaseName(Phase phase) {
+    static const char *names[PHASE_COUNT] = {"queue", "auth", "lookup", "crypto", "complete", "total"};
+    return names[phase];
+}
+
+Histogram::Histogram() {
+    for (auto &bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::record(int64_t durationNs) {
+    auto us = durationNs > 0 ? uint64_t(durationNs) / 1000 : 0;
+    auto index = std::min(bucketIndex(us), BUCKET_COUNT - 1);
+    buckets_[index].fetch_add(1, std::memory_order_relaxed);
+    sumUs_.fetch_add(us, std::memory_order_relaxed);
+    auto max = maxUs_.load(std::memory_order_relaxed);
+    while (us > max && !maxUs_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+}
+
+HistogramSummary Histogram::summary() const {
+    uint64_t counts[BUCKET_COUNT];
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    HistogramSummary summary{};
+    summary.count = total;
+    if (!total) {
+        return summary;
+    }
+    summary.meanMs = double(sumUs_.load(std::memory_order_relaxed)) / double(total) / 1000;
+    summary.maxMs = double(maxUs_.load(std::memory_order_relaxed)) / 1000;
+
+    // nearest rank, reported as the middle of the bucket
+    auto percentile = [&](double p) {
+        auto target = std::max(uint64_t(std::ceil(p * double(total))), uint64_t(1));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            seen += counts[i];
+            if (seen >= target) {
+                return std::min(bucketMiddleMs(i), summary.maxMs);
+            }
+        }
+        return summary.maxMs;
+    };
+    summary.p50Ms = percentile(0.5);
+    summary.p95Ms = percentile(0.95);
+    summary.p99Ms = percentile(0.99);
+    return summary;
+}
+
+void Histogram::reset() {
+    for (auto &bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    sumUs_.store(0, std::memory_order_relaxed);
+    maxUs_.store(0, std::memory_order_relaxed);
+}
+
+ErrorCounter::ErrorCounter() {
+    for (size_t i = 0; i < SLOT_COUNT; i++) {
+        codes_[i].store(FREE_SLOT, std::memory_order_relaxed);
+        counts_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void ErrorCounter::record(long code) {
+    for (size_t i = 0; i < SLOT_COUNT; i++) {
+        auto slotCode = codes_[i].load(std::memory_order_acquire);
+        if (slotCode == FREE_SLOT) {
+            // claim the slot, or find out who claimed it first
+            if (codes_[i].compare_exchange_strong(slotCode, code, std::memory_order_acq_rel)) {
+                slotCode = code;
+            }
+        }
+        if (slotCode == code) {
+            counts_[i].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    other_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<std::pair<int64_t, uint64_t>> ErrorCounter::counts() const {
+    std::vector<std::pair<int64_t, uint64_t>> result;
+    for (size_t i = 0; i < SLOT_COUNT; i++) {
+        auto code = codes_[i].load(std::memory_order_acquire);
+        auto count = counts_[i].load(std::memory_order_relaxed);
+        if (code != FREE_SLOT && count) {
+            result.emplace_back(code, count);
+        }
+    }
+    auto other = other_.load(std::memory_order_relaxed);
+    if (other) {
+        result.emplace_back(OTHER_ERROR_CODE, other);
+    }
+    return result;
+}
+
+void ErrorCounter::reset() {
+    for (auto &count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    other_.store(0, std::memory_order_relaxed);
+}
+
+bool statsEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+void setStatsEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+
+OperationStats &getOperationStats(const char *name) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto &stats = registry[name];
+    if (!stats) {
+        stats = std::make_unique<OperationStats>();
+    }
+    return *stats;
+}
+
+void forEachOperationStats(const std::function<void(const std::string &name, const OperationStats &stats)> &fn) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto &entry : registry) {
+        fn(entry.first, *entry.second);
+    }
+}
+
+void resetOperationStats() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto &entry : registry) {
+        for (auto &phase : entry.second->phases) {
+            phase.reset();
+        }
+        entry.second->errors.reset();
+    }
+}
+
+void operationCreated() { inFlight.fetch_add(1, std::memory_order_relaxed); }
+
+void operationDeleted() { inFlight.fetch_sub(1, std::memory_order_relaxed); }
+
+int64_t inFlightOperations() { return inFlight.load(std::memory_order_relaxed); }
+
+int64_t monotonicNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Phases of an operation, measured with a monotonic clock:
+//  - queue: waiting for a worker thread
+//  - auth: waiting for the user to authenticate
+//  - lookup: finding the key in the keychain
+//  - crypto: encryption, decryption or key generation
+//  - complete: the hop from the worker thread to the JS thread
+//  - total: from the call to the promise settlement
+enum Phase { PHASE_QUEUE, PHASE_AUTH, PHASE_LOOKUP, PHASE_CRYPTO, PHASE_COMPLETE, PHASE_TOTAL, PHASE_COUNT };
+
+const char *phaseName(Phase phase);
+
+struct HistogramSummary {
+    uint64_t count;
+    double meanMs;
+    double p50Ms;
+    double p95Ms;
+    double p99Ms;
+    double maxMs;
+};
+
+// Lock-free histogram of durations, with buckets of about 20% width from 1 microsecond to hours.
+class Histogram {
+  private:
+    static constexpr size_t BUCKET_COUNT = 160;
+
+    std::atomic<uint64_t> buckets_[BUCKET_COUNT];
+    std::atomic<uint64_t> sumUs_{0};
+    std::atomic<uint64_t> maxUs_{0};
+
+  public:
+    Histogram();
+
+    Histogram(const Histogram &) = delete;
+    Histogram &operator=(const Histogram &) = delete;
+
+    void record(int64_t durationNs);
+    HistogramSummary summary() const;
+    void reset();
+};
+
+// Lock-free counters of errors by status code, codes that don't fit are counted together.
+class ErrorCounter {
+  private:
+    static constexpr size_t SLOT_COUNT = 16;
+    static constexpr int64_t FREE_SLOT = INT64_MIN;
+
+    std::atomic<int64_t> codes_[SLOT_COUNT];
+    std::atomic<uint64_t> counts_[SLOT_COUNT];
+    std::atomic<uint64_t> other_{0};
+
+  public:
+    ErrorCounter();
+
+    ErrorCounter(const ErrorCounter &) = delete;
+    ErrorCounter &operator=(const ErrorCounter &) = delete;
+
+    void record(long code);
+    // pairs of code and count, codes that didn't fit have OTHER_ERROR_CODE
+    std::vector<std::pair<int64_t, uint64_t>> counts() const;
+    void reset();
+
+    static constexpr int64_t OTHER_ERROR_CODE = FREE_SLOT;
+};
+
+struct OperationStats {
+    Histogram phases[PHASE_COUNT];
+    ErrorCounter errors;
+};
+
+// measuring is off by default, so that it costs nothing
+bool statsEnabled();
+void setStatsEnabled(bool enabled);
+
+// stats of operations with this name, created on first use, never deleted
+OperationStats &getOperationStats(const char *name);
+void forEachOperationStats(const std::function<void(const std::string &name, const OperationStats &stats)> &fn);
+void resetOperationStats();
+
+// native operations that have been created and not deleted yet, counted even if stats are off
+void operationCreated();
+void operationDeleted();
+int64_t inFlightOperations();
+
+int64_t monotonicNowNs();
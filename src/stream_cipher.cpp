@@ -0,0 +1,271 @@
+#include "stream_cipher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "ecies.h"
+#include "secure_memory.h"
+#include "secure_random.h"
+#include "worker_pool.h"
+
+namespace {
+
+constexpr uint8_t STREAM_MAGIC[4] = {'N', 'S', 'E', 'S'};
+constexpr uint8_t STREAM_VERSION = 1;
+constexpr size_t DATA_KEY_SIZE = 32;
+constexpr size_t NONCE_PREFIX_SIZE = 7;
+constexpr size_t NONCE_SIZE = NONCE_PREFIX_SIZE + 4 + 1;
+// magic, version, frame size, nonce prefix
+constexpr size_t AAD_SIZE = sizeof(STREAM_MAGIC) + 1 + 4 + NONCE_PREFIX_SIZE;
+constexpr size_t FIXED_HEADER_SIZE = AAD_SIZE + 2;
+constexpr size_t MAX_FRAME_SIZE = 16 * 1024 * 1024;
+constexpr size_t MAX_WRAPPED_KEY_SIZE = 1024;
+
+void frameNonce(const uint8_t *aad, uint32_t index, bool last, uint8_t *nonce) {
+    memcpy(nonce, aad + AAD_SIZE - NONCE_PREFIX_SIZE, NONCE_PREFIX_SIZE);
+    nonce[NONCE_PREFIX_SIZE] = uint8_t(index >> 24);
+    nonce[NONCE_PREFIX_SIZE + 1] = uint8_t(index >> 16);
+    nonce[NONCE_PREFIX_SIZE + 2] = uint8_t(index >> 8);
+    nonce[NONCE_PREFIX_SIZE + 3] = uint8_t(index);
+    nonce[NONCE_PREFIX_SIZE + 4] = last ? 1 : 0;
+}
+
+BackendError encryptionError() { return errorWithCode(STATUS_PARAM, "SecKeyCreateEncryptedData"); }
+
+BackendError decryptionError() { return errorWithCode(STATUS_PARAM, "SecKeyCreateDecryptedData"); }
+
+} // namespace
+
+StreamEncryptor::~StreamEncryptor() { secureZero(pending_.data(), pending_.size()); }
+
+bool StreamEncryptor::init(const uint8_t *publicKey, const P256PublicKeyTable *table) {
+    uint8_t dataKey[DATA_KEY_SIZE];
+    header_.resize(FIXED_HEADER_SIZE + DATA_KEY_SIZE + ECIES_OVERHEAD);
+
+    auto pos = header_.data();
+    memcpy(pos, STREAM_MAGIC, sizeof(STREAM_MAGIC));
+    pos += sizeof(STREAM_MAGIC);
+    *pos++ = STREAM_VERSION;
+    *pos++ = uint8_t(STREAM_FRAME_SIZE >> 24);
+    *pos++ = uint8_t(STREAM_FRAME_SIZE >> 16);
+    *pos++ = uint8_t(STREAM_FRAME_SIZE >> 8);
+    *pos++ = uint8_t(STREAM_FRAME_SIZE);
+    auto noncePrefix = pos;
+    pos += NONCE_PREFIX_SIZE;
+    *pos++ = uint8_t((DATA_KEY_SIZE + ECIES_OVERHEAD) >> 8);
+    *pos++ = uint8_t(DATA_KEY_SIZE + ECIES_OVERHEAD);
+
+    auto ok = secureRandomBytes(noncePrefix, NONCE_PREFIX_SIZE) && secureRandomBytes(dataKey, sizeof(dataKey)) &&
+              eciesEncrypt(publicKey, dataKey, sizeof(dataKey), pos, table);
+    if (ok) {
+        aes_ = std::make_unique<AesGcm>(dataKey, sizeof(dataKey));
+    }
+    secureZero(dataKey, sizeof(dataKey));
+    return ok;
+}
+
+void StreamEncryptor::writeFrame(const uint8_t *data, size_t length, bool last, uint8_t *output) {
+    uint8_t nonce[NONCE_SIZE];
+    frameNonce(header_.data(), frameIndex_, last, nonce);
+    aes_->encrypt(nonce, sizeof(nonce), header_.data(), AAD_SIZE, data, length, output, output + length);
+    frameIndex_++;
+}
+
+BackendError StreamEncryptor::writeFrames(const uint8_t *data, size_t count, SecureBytes &output) {
+    if (count >= UINT32_MAX - frameIndex_) {
+        return encryptionError();
+    }
+    auto frameSize = STREAM_FRAME_SIZE + GCM_TAG_SIZE;
+    auto out = output.size();
+    output.resize(out + count * frameSize);
+
+    auto firstIndex = frameIndex_;
+    getWorkerPool().parallelFor(count, [&](size_t i) {
+        uint8_t nonce[NONCE_SIZE];
+        frameNonce(header_.data(), uint32_t(firstIndex + i), false, nonce);
+        auto in = data + i * STREAM_FRAME_SIZE;
+        auto frame = output.data() + out + i * frameSize;
+        aes_->encrypt(nonce, sizeof(nonce), header_.data(), AAD_SIZE, in, STREAM_FRAME_SIZE, frame,
+                      frame + STREAM_FRAME_SIZE);
+    });
+    frameIndex_ += uint32_t(count);
+    return BackendError();
+}
+
+BackendError StreamEncryptor::update(const uint8_t *data, size_t length, SecureBytes &output) {
+    if (finished_ || !aes_) {
+        return encryptionError();
+    }
+    if (!headerWritten_) {
+        output.insert(output.end(), header_.begin(), header_.end());
+        headerWritten_ = true;
+    }
+
+    if (!pending_.empty()) {
+        auto take = std::min(STREAM_FRAME_SIZE - pending_.size(), length);
+        pending_.insert(pending_.end(), data, data + take);
+        data += take;
+        length -= take;
+        if (pending_.size() < STREAM_FRAME_SIZE) {
+            return BackendError();
+        }
+        auto error = writeFrames(pending_.data(), 1, output);
+        secureZero(pending_.data(), pending_.size());
+        pending_.clear();
+        if (error) {
+            return error;
+        }
+    }
+
+    auto count = length / STREAM_FRAME_SIZE;
+    if (count) {
+        if (auto error = writeFrames(data, count, output)) {
+            return error;
+        }
+    }
+
+    auto rest = count * STREAM_FRAME_SIZE;
+    pending_.assign(data + rest, data + length);
+    return BackendError();
+}
+
+BackendError StreamEncryptor::finish(SecureBytes &output) {
+    if (finished_ || !aes_) {
+        return encryptionError();
+    }
+    finished_ = true;
+    if (!headerWritten_) {
+        output.insert(output.end(), header_.begin(), header_.end());
+        headerWritten_ = true;
+    }
+
+    auto out = output.size();
+    output.resize(out + pending_.size() + GCM_TAG_SIZE);
+    writeFrame(pending_.data(), pending_.size(), true, output.data() + out);
+    secureZero(pending_.data(), pending_.size());
+    pending_.clear();
+    return BackendError();
+}
+
+StreamDecryptor::StreamDecryptor(std::shared_ptr<AuthContext> authContext, std::unique_ptr<KeyPair> keyPair)
+    : authContext_(std::move(authContext)), keyPair_(std::move(keyPair)) {}
+
+StreamDecryptor::~StreamDecryptor() {
+    if (authContext_) {
+        authContext_->invalidate();
+    }
+}
+
+BackendError StreamDecryptor::readHeader() {
+    if (buffer_.size() < FIXED_HEADER_SIZE) {
+        return BackendError();
+    }
+    auto header = buffer_.data();
+    if (memcmp(header, STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0 || header[sizeof(STREAM_MAGIC)] != STREAM_VERSION) {
+        return decryptionError();
+    }
+    auto frameSizeBytes = header + sizeof(STREAM_MAGIC) + 1;
+    auto frameSize = (size_t(frameSizeBytes[0]) << 24) | (size_t(frameSizeBytes[1]) << 16) |
+                     (size_t(frameSizeBytes[2]) << 8) | size_t(frameSizeBytes[3]);
+    auto wrappedKeyLength = (size_t(header[AAD_SIZE]) << 8) | size_t(header[AAD_SIZE + 1]);
+    if (frameSize == 0 || frameSize > MAX_FRAME_SIZE || wrappedKeyLength > MAX_WRAPPED_KEY_SIZE) {
+        return decryptionError();
+    }
+    if (buffer_.size() < FIXED_HEADER_SIZE + wrappedKeyLength) {
+        return BackendError();
+    }
+
+    SecureBytes dataKey;
+    if (auto error = keyPair_->decrypt(header + FIXED_HEADER_SIZE, wrappedKeyLength, dataKey)) {
+        return error;
+    }
+    if (dataKey.size() != DATA_KEY_SIZE) {
+        return decryptionError();
+    }
+    aes_ = std::make_unique<AesGcm>(dataKey.data(), dataKey.size());
+
+    frameSize_ = frameSize;
+    aad_.assign(header, header + AAD_SIZE);
+    buffer_.erase(buffer_.begin(), buffer_.begin() + FIXED_HEADER_SIZE + wrappedKeyLength);
+    return BackendError();
+}
+
+BackendError StreamDecryptor::readFrames(SecureBytes &output) {
+    // the last frame is shorter than others, so a full frame is never the last one
+    auto frameSize = frameSize_ + GCM_TAG_SIZE;
+    auto count = buffer_.size() / frameSize;
+    if (!count) {
+        return BackendError();
+    }
+    if (count >= UINT32_MAX - frameIndex_) {
+        return decryptionError();
+    }
+
+    auto out = output.size();
+    output.resize(out + count * frameSize_);
+
+    std::atomic<bool> authenticated{true};
+    auto firstIndex = frameIndex_;
+    getWorkerPool().parallelFor(count, [&](size_t i) {
+        uint8_t nonce[NONCE_SIZE];
+        frameNonce(aad_.data(), uint32_t(firstIndex + i), false, nonce);
+        auto frame = buffer_.data() + i * frameSize;
+        if (!aes_->decrypt(nonce, sizeof(nonce), aad_.data(), AAD_SIZE, frame, frameSize_, frame + frameSize_,
+                           output.data() + out + i * frameSize_)) {
+            authenticated = false;
+        }
+    });
+    if (!authenticated) {
+        secureZero(output.data() + out, count * frameSize_);
+        output.resize(out);
+        return decryptionError();
+    }
+
+    frameIndex_ += uint32_t(count);
+    buffer_.erase(buffer_.begin(), buffer_.begin() + count * frameSize);
+    return BackendError();
+}
+
+BackendError StreamDecryptor::update(const uint8_t *data, size_t length, SecureBytes &output) {
+    if (finished_) {
+        return decryptionError();
+    }
+    buffer_.insert(buffer_.end(), data, data + length);
+    if (!aes_) {
+        if (auto error = readHeader()) {
+            finished_ = true;
+            return error;
+        }
+        if (!aes_) {
+            return BackendError();
+        }
+    }
+    if (auto error = readFrames(output)) {
+        finished_ = true;
+        return error;
+    }
+    return BackendError();
+}
+
+BackendError StreamDecryptor::finish(SecureBytes &output) {
+    if (finished_ || !aes_ || buffer_.size() < GCM_TAG_SIZE) {
+        finished_ = true;
+        return decryptionError();
+    }
+    finished_ = true;
+
+    auto length = buffer_.size() - GCM_TAG_SIZE;
+    auto out = output.size();
+    output.resize(out + length);
+
+    uint8_t nonce[NONCE_SIZE];
+    frameNonce(aad_.data(), frameIndex_, true, nonce);
+    if (!aes_->decrypt(nonce, sizeof(nonce), aad_.data(), AAD_SIZE, buffer_.data(), length, buffer_.data() + length,
+                       output.data() + out)) {
+        output.resize(out);
+        return decryptionError();
+    }
+    buffer_.clear();
+    return BackendError();
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "aes_gcm.h"
+#include "backend.h"
+#include "p256.h"
+
+// Stream format, for data of unknown length processed in constant memory:
+//
+//  magic "NSES" | version (1) | frame size (4, BE) | nonce prefix (7) | wrapped key length (2, BE) | wrapped key
+//  | frame 0 ciphertext | tag 0 | frame 1 ciphertext | tag 1 | ... | final frame ciphertext | final tag
+//
+// A random AES-256 data key is wrapped with ECIES, frames are encrypted with AES-GCM.
+// All frames but the last one are exactly frame size long, the last one is shorter, possibly empty.
+// Frame nonce is nonce prefix || frame index (4, BE) || 1 for the last frame, 0 otherwise,
+// so that frames can't be reordered and the stream can't be truncated unnoticed.
+// Fields before the wrapped key are authenticated as AAD of every frame.
+
+constexpr size_t STREAM_FRAME_SIZE = 64 * 1024;
+
+// Incremental encryptor or decryptor, methods must not be called concurrently.
+class StreamCipher {
+  public:
+    virtual ~StreamCipher() = default;
+
+    // appends output for the data that can be processed, the rest is kept until the next call
+    virtual BackendError update(const uint8_t *data, size_t length, SecureBytes &output) = 0;
+
+    // appends output for the rest of the stream, the cipher can't be used after that
+    virtual BackendError finish(SecureBytes &output) = 0;
+};
+
+class StreamEncryptor : public StreamCipher {
+  private:
+    std::unique_ptr<AesGcm> aes_;
+    Bytes header_;
+    // plaintext of the frame that is not complete yet
+    SecureBytes pending_;
+    uint32_t frameIndex_ = 0;
+    bool headerWritten_ = false;
+    bool finished_ = false;
+
+    void writeFrame(const uint8_t *data, size_t length, bool last, uint8_t *output);
+    BackendError writeFrames(const uint8_t *data, size_t count, SecureBytes &output);
+
+  public:
+    StreamEncryptor() = default;
+    ~StreamEncryptor() override;
+
+    // generates and wraps the data key, returns false if it can't be done
+    bool init(const uint8_t *publicKey, const P256PublicKeyTable *table = nullptr);
+
+    BackendError update(const uint8_t *data, size_t length, SecureBytes &output) override;
+    BackendError finish(SecureBytes &output) override;
+};
+
+class StreamDecryptor : public StreamCipher {
+  private:
+    std::shared_ptr<AuthContext> authContext_;
+    std::unique_ptr<KeyPair> keyPair_;
+    std::unique_ptr<AesGcm> aes_;
+    Bytes aad_;
+    size_t frameSize_ = 0;
+    // header until it's complete, then the frame that can't be decrypted yet
+    Bytes buffer_;
+    uint32_t frameIndex_ = 0;
+    bool finished_ = false;
+
+    BackendError readHeader();
+    BackendError readFrames(SecureBytes &output);
+
+  public:
+    // keyPair must be found with authContext, the context is invalidated when the decryptor is destroyed
+    StreamDecryptor(std::shared_ptr<AuthContext> authContext, std::unique_ptr<KeyPair> keyPair);
+    ~StreamDecryptor() override;
+
+    BackendError update(const uint8_t *data, size_t length, SecureBytes &output) override;
+    BackendError finish(SecureBytes &output) override;
+};
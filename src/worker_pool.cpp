@@ -0,0 +1,149 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace {
+
+// shared with helper tasks, which can start after parallelFor has returned and must find no work left
+struct ParallelForState {
+    std::function<void(size_t)> fn;
+    size_t count;
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable condition;
+    size_t done = 0;
+
+    void work() {
+        while (true) {
+            auto index = next++;
+            if (index >= count) {
+                return;
+            }
+            fn(index);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (++done == count) {
+                condition.notify_all();
+            }
+        }
+    }
+};
+
+} // namespace
+
+WorkerPool::WorkerPool(size_t threadCount) : targetThreadCount_(threadCount) {}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        // tasks that haven't started can't complete anymore, the process is exiting
+        queue_.clear();
+    }
+    condition_.notify_all();
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+}
+
+void WorkerPool::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        condition_.wait(lock, [this] {
+            return stopping_ || !queue_.empty() || runningThreadCount_ > targetThreadCount_;
+        });
+        if (stopping_ || runningThreadCount_ > targetThreadCount_) {
+            runningThreadCount_--;
+            if (!stopping_) {
+                retiredThreads_.push_back(std::this_thread::get_id());
+            }
+            return;
+        }
+
+        auto task = std::move(queue_.front());
+        queue_.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+std::vector<std::thread> WorkerPool::takeRetiredThreadsLocked() {
+    std::vector<std::thread> retired;
+    for (auto &id : retiredThreads_) {
+        auto it = std::find_if(threads_.begin(), threads_.end(),
+                               [&id](const std::thread &thread) { return thread.get_id() == id; });
+        if (it != threads_.end()) {
+            retired.push_back(std::move(*it));
+            threads_.erase(it);
+        }
+    }
+    retiredThreads_.clear();
+    return retired;
+}
+
+void WorkerPool::submit(std::function<void()> task) {
+    std::vector<std::thread> retired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired = takeRetiredThreadsLocked();
+        queue_.push_back(std::move(task));
+        if (runningThreadCount_ < targetThreadCount_) {
+            runningThreadCount_++;
+            threads_.emplace_back(&WorkerPool::run, this);
+        }
+    }
+    condition_.notify_one();
+    // they have left run, so this doesn't wait for long
+    for (auto &thread : retired) {
+        thread.join();
+    }
+}
+
+void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)> &fn) {
+    if (count == 0) {
+        return;
+    }
+
+    auto state = std::make_shared<ParallelForState>();
+    state->fn = fn;
+    state->count = count;
+
+    auto helpers = std::min(threadCount(), count) - 1;
+    for (size_t i = 0; i < helpers; i++) {
+        submit([state]() { state->work(); });
+    }
+    state->work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock, [&state] { return state->done == state->count; });
+}
+
+void WorkerPool::setThreadCount(size_t threadCount) {
+    std::vector<std::thread> retired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired = takeRetiredThreadsLocked();
+        targetThreadCount_ = threadCount;
+        while (runningThreadCount_ < targetThreadCount_ && runningThreadCount_ < queue_.size()) {
+            runningThreadCount_++;
+            threads_.emplace_back(&WorkerPool::run, this);
+        }
+    }
+    condition_.notify_all();
+    for (auto &thread : retired) {
+        thread.join();
+    }
+}
+
+size_t WorkerPool::threadCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return targetThreadCount_;
+}
+
+WorkerPool &getWorkerPool() {
+    static WorkerPool pool(DEFAULT_WORKER_THREADS);
+    return pool;
+}
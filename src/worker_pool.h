@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+constexpr size_t DEFAULT_WORKER_THREADS = 4;
+constexpr size_t MAX_WORKER_THREADS = 64;
+
+// Fixed-size pool of native threads for blocking keychain and crypto work.
+// Threads are started on first use, tasks are executed in FIFO order.
+class WorkerPool {
+  private:
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<std::function<void()>> queue_;
+    std::vector<std::thread> threads_;
+    // threads that have exited after the thread count was reduced, they are joined by the next submit or
+    // setThreadCount, so that threads_ doesn't grow when the count is changed many times
+    std::vector<std::thread::id> retiredThreads_;
+    size_t targetThreadCount_;
+    size_t runningThreadCount_ = 0;
+    bool stopping_ = false;
+
+    void run();
+    // removes retired threads from threads_, the caller joins them without holding the lock
+    std::vector<std::thread> takeRetiredThreadsLocked();
+
+  public:
+    explicit WorkerPool(size_t threadCount);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    // runs fn(0) .. fn(count - 1) on the pool and on the calling thread, returns when all of them are done
+    // the calling thread takes part in the work, so it's safe to call from a pool thread
+    void parallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+    // extra threads exit after finishing their current task, new threads are started on demand
+    void setThreadCount(size_t threadCount);
+    size_t threadCount();
+};
+
+WorkerPool &getWorkerPool();
@@ -1,4 +1,13 @@
 const assert = require('assert');
+const childProcess = require('child_process');
+const crypto = require('crypto');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { Readable, Writable } = require('stream');
+const pipeline = require('util').promisify(require('stream').pipeline);
+
+process.env.NODE_SECURE_ENCLAVE_KEYSTORE = path.join(os.tmpdir(), 'node-secure-enclave-unit-tests');
 
 const keyTag = 'net.antelle.node-secure-enclave.unit-tests.key';
 const keyTagAnother = 'net.antelle.node-secure-enclave.unit-tests.another-key';
@@ -20,6 +29,76 @@ describe('node-secure-enclave', function () {
         it('checks if Secure Enclave is supported', () => {
             assert.strictEqual(nodeSecureEnclave().isSupported, true);
         });
+
+        it('checks support asynchronously', async () => {
+            assert.strictEqual(await nodeSecureEnclave().checkSupport(), true);
+        });
+    });
+
+    describe('backend', () => {
+        it('reports the backend', () => {
+            assert.ok(['keychain', 'software'].includes(nodeSecureEnclave().backend));
+        });
+
+        it('disables the software backend unless allowed', function () {
+            if (nodeSecureEnclave().backend !== 'software') {
+                this.skip();
+            }
+
+            const modulePath = JSON.stringify(require.resolve('..'));
+            const env = { ...process.env };
+            delete env.NODE_SECURE_ENCLAVE_ALLOW_SOFTWARE_BACKEND;
+            const output = childProcess.execFileSync(
+                process.execPath,
+                ['-p', `require(${modulePath}).isSupported`],
+                { env }
+            );
+            assert.strictEqual(output.toString().trim(), 'false');
+        });
+    });
+
+    describe('cryptoKernels', () => {
+        it('reports crypto kernels', () => {
+            const { cryptoKernels } = nodeSecureEnclave();
+            assert.ok(['aesni', 'armv8', 'portable'].includes(cryptoKernels.aesGcm));
+            assert.ok(['shani', 'armv8', 'portable'].includes(cryptoKernels.sha256));
+        });
+
+        it('uses portable kernels if asked to', () => {
+            const modulePath = JSON.stringify(require.resolve('..'));
+            const output = childProcess.execFileSync(
+                process.execPath,
+                ['-p', `JSON.stringify(require(${modulePath}).cryptoKernels)`],
+                { env: { ...process.env, NODE_SECURE_ENCLAVE_CRYPTO_KERNELS: 'portable' } }
+            );
+            assert.deepStrictEqual(JSON.parse(output), { aesGcm: 'portable', sha256: 'portable' });
+        });
+
+        it('decrypts data encrypted by node crypto', async () => {
+            const { publicKey } = await nodeSecureEnclave().createKeyPair({ keyTag });
+            // lengths around the blocks processed in parallel by hardware kernels
+            const data = [1, 15, 16, 17, 63, 64, 65, 127, 128, 129, 1000, 65539].map((length) =>
+                crypto.randomBytes(length)
+            );
+            const items = data.map((item) => {
+                const ephemeral = crypto.createECDH('prime256v1');
+                const ephemeralPublicKey = ephemeral.generateKeys();
+                const derived = x963Kdf(ephemeral.computeSecret(publicKey), ephemeralPublicKey, 32);
+                const cipher = crypto.createCipheriv(
+                    'aes-128-gcm',
+                    derived.subarray(0, 16),
+                    derived.subarray(16)
+                );
+                const encrypted = Buffer.concat([cipher.update(item), cipher.final()]);
+                return Buffer.concat([ephemeralPublicKey, encrypted, cipher.getAuthTag()]);
+            });
+
+            const results = await nodeSecureEnclave().decryptMany({ keyTag, items, touchIdPrompt });
+            assert.deepStrictEqual(
+                results.map((result) => result.data.toString('hex')),
+                data.map((item) => item.toString('hex'))
+            );
+        });
     });
 
     describe('createKeyPair', async () => {
@@ -43,6 +122,30 @@ describe('node-secure-enclave', function () {
             );
         });
 
+        it('creates only one key for concurrent calls', async () => {
+            const results = await Promise.allSettled([
+                nodeSecureEnclave().createKeyPair({ keyTag }),
+                nodeSecureEnclave().createKeyPair({ keyTag })
+            ]);
+            assert.strictEqual(results.filter((r) => r.status === 'fulfilled').length, 1);
+            const rejected = results.find((r) => r.status === 'rejected');
+            assert.strictEqual(rejected.reason.keyExists, true);
+
+            const found = await nodeSecureEnclave().findKeyPair({ keyTag });
+            const created = results.find((r) => r.status === 'fulfilled').value;
+            assert.strictEqual(found.publicKey.toString('hex'), created.publicKey.toString('hex'));
+        });
+
+        it('deletes and creates keys in call order', async () => {
+            const { publicKey } = await nodeSecureEnclave().createKeyPair({ keyTag });
+            const [deleted, created] = await Promise.all([
+                nodeSecureEnclave().deleteKeyPair({ keyTag }),
+                nodeSecureEnclave().createKeyPair({ keyTag })
+            ]);
+            assert.strictEqual(deleted, true);
+            assert.notStrictEqual(created.publicKey.toString('hex'), publicKey.toString('hex'));
+        });
+
         it('throws an error when key already exists', async () => {
             const key = await nodeSecureEnclave().createKeyPair({ keyTag });
             assert.ok(key?.publicKey instanceof Buffer);
@@ -103,8 +206,300 @@ describe('node-secure-enclave', function () {
         });
     });
 
+    describe('listKeys', () => {
+        const prefix = 'net.antelle.node-secure-enclave.unit-tests.';
+
+        it('lists keys by prefix', async () => {
+            const key = await nodeSecureEnclave().createKeyPair({ keyTag });
+            const another = await nodeSecureEnclave().createKeyPair({ keyTag: keyTagAnother });
+
+            const keys = await nodeSecureEnclave().listKeys({ prefix });
+            assert.deepStrictEqual(
+                keys.map((k) => k.keyTag),
+                [keyTagAnother, keyTag]
+            );
+            assert.strictEqual(keys[0].publicKey.toString('hex'), another.publicKey.toString('hex'));
+            assert.strictEqual(keys[1].publicKey.toString('hex'), key.publicKey.toString('hex'));
+
+            const all = await nodeSecureEnclave().listKeys();
+            assert.ok(all.some((k) => k.keyTag === keyTag));
+        });
+
+        it('limits the number of keys', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            await nodeSecureEnclave().createKeyPair({ keyTag: keyTagAnother });
+
+            const keys = await nodeSecureEnclave().listKeys({ prefix, limit: 1 });
+            assert.deepStrictEqual(
+                keys.map((k) => k.keyTag),
+                [keyTagAnother]
+            );
+        });
+
+        it('returns an empty array if nothing is found', async () => {
+            assert.deepStrictEqual(await nodeSecureEnclave().listKeys({ prefix }), []);
+        });
+
+        it('throws on invalid options', async () => {
+            await assert.rejects(
+                nodeSecureEnclave().listKeys({ prefix: 1 }),
+                /TypeError: prefix is not a string/
+            );
+            await assert.rejects(
+                nodeSecureEnclave().listKeys({ limit: 0 }),
+                /TypeError: limit must be a positive number/
+            );
+        });
+    });
+
+    describe('keyIndex', () => {
+        const indexPath = path.join(os.tmpdir(), 'node-secure-enclave-unit-tests.idx');
+
+        afterEach(() => {
+            nodeSecureEnclave().configure({ keyIndex: null });
+            fs.rmSync(indexPath, { force: true });
+        });
+
+        it('serves findKeyPair from the index', async () => {
+            nodeSecureEnclave().configure({ keyIndex: { path: indexPath } });
+            const { publicKey } = await nodeSecureEnclave().createKeyPair({ keyTag });
+            assert.ok(fs.existsSync(indexPath));
+
+            nodeSecureEnclave().clearKeyCache();
+            nodeSecureEnclave().configure({ keyIndex: { path: indexPath } });
+            const found = await nodeSecureEnclave().findKeyPair({ keyTag });
+            assert.strictEqual(found.publicKey.toString('hex'), publicKey.toString('hex'));
+            assert.strictEqual(nodeSecureEnclave().getKeyIndexStats().hits, 1);
+
+            await nodeSecureEnclave().deleteKeyPair({ keyTag });
+            assert.strictEqual(await nodeSecureEnclave().findKeyPair({ keyTag }), null);
+            assert.strictEqual(nodeSecureEnclave().getKeyIndexStats().size, 0);
+        });
+
+        it('removes a stale entry when the key is not in the keychain', async function () {
+            if (nodeSecureEnclave().backend !== 'software') {
+                this.skip();
+            }
+
+            nodeSecureEnclave().configure({ keyIndex: { path: indexPath } });
+            while (nodeSecureEnclave().getKeyIndexStats().reconciles < 1) {
+                await new Promise((resolve) => setTimeout(resolve, 10));
+            }
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            nodeSecureEnclave().clearKeyCache();
+
+            // deleted by another process, the index doesn't know about it until the next reconcile
+            const keyFileName = crypto.createHash('sha256').update(keyTag).digest('hex') + '.key';
+            fs.rmSync(path.join(process.env.NODE_SECURE_ENCLAVE_KEYSTORE, keyFileName));
+            assert.ok(await nodeSecureEnclave().findKeyPair({ keyTag }));
+
+            await assert.rejects(nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('test') }));
+            assert.strictEqual(await nodeSecureEnclave().findKeyPair({ keyTag }), null);
+            assert.strictEqual(nodeSecureEnclave().getKeyIndexStats().size, 0);
+        });
+
+        it('returns null stats when the index is off', () => {
+            assert.strictEqual(nodeSecureEnclave().getKeyIndexStats(), null);
+        });
+
+        it('throws on invalid options', () => {
+            assert.throws(
+                () => nodeSecureEnclave().configure({ keyIndex: { path: '' } }),
+                /keyIndex.path must be a non-empty string/
+            );
+            assert.throws(
+                () => nodeSecureEnclave().configure({ keyIndex: { path: indexPath, reconcileSeconds: -1 } }),
+                /keyIndex.reconcileSeconds must be a non-negative number/
+            );
+        });
+    });
+
+    describe('keyPool', () => {
+        afterEach(() => {
+            nodeSecureEnclave().configure({ keyPoolDepth: 0 });
+        });
+
+        async function waitForPool(size) {
+            while (nodeSecureEnclave().getKeyPoolStats().size < size) {
+                await new Promise((resolve) => setTimeout(resolve, 10));
+            }
+        }
+
+        it('creates keys from the pool', async () => {
+            nodeSecureEnclave().configure({ keyPoolDepth: 2 });
+            await waitForPool(2);
+
+            const { publicKey } = await nodeSecureEnclave().createKeyPair({ keyTag });
+            const found = await nodeSecureEnclave().findKeyPair({ keyTag });
+            assert.strictEqual(found.publicKey.toString('hex'), publicKey.toString('hex'));
+
+            const data = Buffer.from('pooled');
+            const encrypted = await nodeSecureEnclave().encrypt({ keyTag, data });
+            const decrypted = await nodeSecureEnclave().decrypt({
+                keyTag,
+                data: encrypted,
+                touchIdPrompt
+            });
+            assert.strictEqual(decrypted.equals(data), true);
+
+            await assert.rejects(
+                nodeSecureEnclave().createKeyPair({ keyTag }),
+                (e) => e.keyExists === true
+            );
+
+            const stats = nodeSecureEnclave().getKeyPoolStats();
+            assert.strictEqual(stats.depth, 2);
+            assert.strictEqual(stats.hits, 1);
+            assert.strictEqual(stats.misses, 0);
+            assert.strictEqual(stats.hitRate, 1);
+            assert.ok(stats.refill.count >= 2);
+
+            await waitForPool(2);
+            const keys = await nodeSecureEnclave().listKeys();
+            const poolPrefix = 'net.antelle.node-secure-enclave.pool.';
+            assert.ok(keys.every((key) => !key.keyTag.startsWith(poolPrefix)));
+        });
+
+        it('generates a key when the pool is empty', async () => {
+            nodeSecureEnclave().configure({ keyPoolDepth: 1 });
+            await waitForPool(1);
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            await nodeSecureEnclave().createKeyPair({ keyTag: keyTagAnother });
+
+            const stats = nodeSecureEnclave().getKeyPoolStats();
+            assert.strictEqual(stats.hits + stats.misses, 2);
+            assert.ok(await nodeSecureEnclave().findKeyPair({ keyTag: keyTagAnother }));
+        });
+
+        it('applies the listKeys limit after hiding pooled keys', async () => {
+            nodeSecureEnclave().configure({ keyPoolDepth: 2 });
+            await waitForPool(2);
+
+            // pooled tags sort before these ones
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const keys = await nodeSecureEnclave().listKeys({ limit: 1 });
+            assert.strictEqual(keys.length, 1);
+            assert.ok(!keys[0].keyTag.startsWith('net.antelle.node-secure-enclave.pool.'));
+        });
+
+        it('rejects the reserved pool prefix', async () => {
+            const poolKeyTag = 'net.antelle.node-secure-enclave.pool.user';
+            for (const method of ['createKeyPair', 'findKeyPair', 'deleteKeyPair']) {
+                await assert.rejects(
+                    nodeSecureEnclave()[method]({ keyTag: poolKeyTag }),
+                    /TypeError: keyTag cannot start with net\.antelle\.node-secure-enclave\.pool\./
+                );
+            }
+        });
+
+        it('returns null stats when the pool is off', () => {
+            assert.strictEqual(nodeSecureEnclave().getKeyPoolStats(), null);
+        });
+
+        it('throws on invalid keyPoolDepth', () => {
+            assert.throws(
+                () => nodeSecureEnclave().configure({ keyPoolDepth: 33 }),
+                /keyPoolDepth must be a number from 0 to 32/
+            );
+        });
+    });
+
     describe('encrypt', () => {
         testDataMethodBehavior('encrypt');
+
+        it('encrypts data with a public key', async () => {
+            const data = Buffer.from('Hello, world!');
+
+            const { publicKey } = await nodeSecureEnclave().createKeyPair({ keyTag });
+
+            const encrypted = await nodeSecureEnclave().encrypt({ publicKey, data });
+            assert.strictEqual(encrypted instanceof Buffer, true);
+            assert.strictEqual(encrypted.length, data.length + 65 + 16);
+
+            const decrypted = await nodeSecureEnclave().decrypt({
+                keyTag,
+                touchIdPrompt,
+                data: encrypted
+            });
+            assert.strictEqual(decrypted.toString('hex'), data.toString('hex'));
+        });
+
+        it('throws on invalid publicKey', async () => {
+            const data = Buffer.from('test');
+            await assert.rejects(
+                async () => await nodeSecureEnclave().encrypt({ publicKey: 'key', data }),
+                /TypeError: publicKey is not a buffer/
+            );
+            await assert.rejects(
+                async () =>
+                    await nodeSecureEnclave().encrypt({ publicKey: Buffer.alloc(65, 4), data }),
+                /TypeError: publicKey is not a valid P-256 public key/
+            );
+        });
+
+        it('encrypts data in the compact format', async () => {
+            const data = Buffer.from('Hello, world!');
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+
+            const encrypted = await nodeSecureEnclave().encrypt({ keyTag, data, compact: true });
+            assert.strictEqual(encrypted.length, data.length + 2 + 33 + 16);
+            assert.strictEqual(encrypted.subarray(0, 2).toString('hex'), 'ec11');
+
+            const [{ data: standard }] = await nodeSecureEnclave().convertCiphertexts({
+                items: [encrypted],
+                format: 'standard'
+            });
+            const ephemeralPublicKey = crypto.ECDH.convertKey(
+                standard.subarray(0, 65),
+                'prime256v1',
+                null,
+                null,
+                'compressed'
+            );
+            assert.ok(encrypted.subarray(2, 35).equals(ephemeralPublicKey));
+
+            for (const item of [encrypted, standard]) {
+                const decrypted = await nodeSecureEnclave().decrypt({
+                    keyTag,
+                    touchIdPrompt,
+                    data: item
+                });
+                assert.strictEqual(decrypted.toString('hex'), data.toString('hex'));
+            }
+        });
+
+        it('throws on bad compact option', async () => {
+            const data = Buffer.from('test');
+            await assert.rejects(
+                async () => await nodeSecureEnclave().encrypt({ keyTag, data, compact: 1 }),
+                /TypeError: compact is not a boolean/
+            );
+            await assert.rejects(
+                async () =>
+                    await nodeSecureEnclave().encrypt({
+                        keyTag,
+                        data,
+                        compact: true,
+                        envelope: true
+                    }),
+                /TypeError: envelope and compact cannot be used together/
+            );
+        });
+
+        it('does not use a cached public key after the key is deleted', async () => {
+            const data = Buffer.from('test');
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            await nodeSecureEnclave().encrypt({ keyTag, data });
+            await nodeSecureEnclave().deleteKeyPair({ keyTag });
+
+            await assert.rejects(
+                async () => await nodeSecureEnclave().encrypt({ keyTag, data }),
+                (e) => e.keyNotFound === true
+            );
+        });
     });
 
     describe('decrypt', () => {
@@ -145,6 +540,225 @@ describe('node-secure-enclave', function () {
             assert.strictEqual(decrypted.toString('hex'), data.toString('hex'));
         });
 
+        it('throws an error when user refuses to authenticate', async function () {
+            if (nodeSecureEnclave().backend !== 'software') {
+                this.skip();
+            }
+
+            const data = Buffer.from('Hello, world!');
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const encrypted = await nodeSecureEnclave().encrypt({ keyTag, data });
+
+            process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT = '-2';
+            try {
+                await assert.rejects(
+                    async () => {
+                        await nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data: encrypted });
+                    },
+                    (e) => {
+                        return (
+                            e.message === 'User refused to authenticate with Touch ID' &&
+                            e.rejected === true &&
+                            e.code === -2
+                        );
+                    }
+                );
+            } finally {
+                delete process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT;
+            }
+        });
+
+        it('serves concurrent calls with one prompt', async function () {
+            if (nodeSecureEnclave().backend !== 'software') {
+                this.skip();
+            }
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const items = [Buffer.from('one'), Buffer.from('two'), Buffer.from('three')];
+            const encrypted = await Promise.all(
+                items.map((data) => nodeSecureEnclave().encrypt({ keyTag, data }))
+            );
+
+            // the first prompt succeeds, the next one is refused
+            process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT = '0@50,-2';
+            try {
+                const decrypted = await Promise.all(
+                    encrypted.map((data) =>
+                        nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data })
+                    )
+                );
+                assert.deepStrictEqual(
+                    decrypted.map((data) => data.toString()),
+                    ['one', 'two', 'three']
+                );
+
+                await assert.rejects(
+                    nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data: encrypted[0] }),
+                    (e) => e.rejected === true
+                );
+            } finally {
+                delete process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT;
+            }
+        });
+
+        it('rejects calls over the queue limit', async function () {
+            if (nodeSecureEnclave().backend !== 'software') {
+                this.skip();
+            }
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const data = await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('test') });
+
+            process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT = '0@100';
+            nodeSecureEnclave().configure({ decryptQueueLimit: 1 });
+            try {
+                // one call is in the prompted batch, one waits for the next turn, one is over the limit
+                const results = await Promise.allSettled([
+                    nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data }),
+                    nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data }),
+                    nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data })
+                ]);
+                assert.deepStrictEqual(
+                    results.map((result) => result.status),
+                    ['fulfilled', 'fulfilled', 'rejected']
+                );
+                assert.strictEqual(results[2].reason.queueFull, true);
+            } finally {
+                nodeSecureEnclave().configure({ decryptQueueLimit: 1024 });
+                delete process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT;
+            }
+        });
+
+        it('throws on invalid decryptQueueLimit', () => {
+            assert.throws(
+                () => nodeSecureEnclave().configure({ decryptQueueLimit: 0 }),
+                /decryptQueueLimit must be a number from 1 to 65536/
+            );
+        });
+
+        it('aborts a call and dismisses the prompt', async function () {
+            if (nodeSecureEnclave().backend !== 'software' || typeof AbortController === 'undefined') {
+                this.skip();
+            }
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const data = await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('test') });
+
+            // the user would authenticate in 5 seconds, the prompt is dismissed before that
+            process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT = '0@5000';
+            try {
+                const controller = new AbortController();
+                const startedAt = Date.now();
+                const decrypted = nodeSecureEnclave().decrypt({
+                    keyTag,
+                    touchIdPrompt,
+                    data,
+                    signal: controller.signal
+                });
+                assert.strictEqual(nodeSecureEnclave().getInFlightStats().pendingDecrypts, 1);
+                setTimeout(() => controller.abort(), 50);
+                await assert.rejects(decrypted, (e) => e.aborted === true);
+                assert.ok(Date.now() - startedAt < 2000);
+
+                while (nodeSecureEnclave().getInFlightStats().operations > 0) {
+                    await new Promise((resolve) => setTimeout(resolve, 10));
+                }
+                assert.deepStrictEqual(nodeSecureEnclave().getInFlightStats(), {
+                    operations: 0,
+                    pendingDecrypts: 0
+                });
+
+                await assert.rejects(
+                    nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data, signal: controller.signal }),
+                    (e) => e.aborted === true
+                );
+            } finally {
+                delete process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT;
+            }
+        });
+
+        it('times out a call without affecting other calls', async function () {
+            if (nodeSecureEnclave().backend !== 'software') {
+                this.skip();
+            }
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const data = await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('test') });
+
+            process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT = '0@300';
+            try {
+                const results = await Promise.allSettled([
+                    nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data, timeoutMs: 50 }),
+                    nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data })
+                ]);
+                assert.strictEqual(results[0].status, 'rejected');
+                assert.strictEqual(results[0].reason.aborted, true);
+                assert.strictEqual(results[0].reason.message, 'The operation has timed out');
+                assert.strictEqual(results[1].status, 'fulfilled');
+                assert.strictEqual(results[1].value.toString(), 'test');
+                assert.strictEqual(nodeSecureEnclave().getInFlightStats().pendingDecrypts, 0);
+            } finally {
+                delete process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT;
+            }
+        });
+
+        it('throws on bad signal and timeoutMs options', async () => {
+            const data = Buffer.from('test');
+            await assert.rejects(
+                nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data, signal: {} }),
+                /TypeError: signal is not an AbortSignal/
+            );
+            await assert.rejects(
+                nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data, timeoutMs: 0 }),
+                /TypeError: timeoutMs must be a positive number/
+            );
+        });
+
+        it('treats undefined signal and timeoutMs as missing', async function () {
+            if (nodeSecureEnclave().backend !== 'software') {
+                this.skip();
+            }
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const data = await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('test') });
+
+            const decrypted = await nodeSecureEnclave().decrypt({
+                keyTag,
+                touchIdPrompt,
+                data,
+                signal: undefined,
+                timeoutMs: undefined
+            });
+            assert.strictEqual(decrypted.toString(), 'test');
+        });
+
+        it('encrypts and decrypts large data in an envelope', async () => {
+            const data = crypto.randomBytes(1024 * 1024 + 123);
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+
+            const encrypted = await nodeSecureEnclave().encrypt({ keyTag, data, envelope: true });
+            assert.strictEqual(encrypted.subarray(0, 4).toString(), 'NSEE');
+
+            const decrypted = await nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data: encrypted });
+            assert.strictEqual(decrypted.equals(data), true);
+
+            encrypted[encrypted.length - 100] ^= 1;
+            await assert.rejects(
+                async () => await nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data: encrypted }),
+                (e) => e.badParam === true
+            );
+        });
+
+        it('throws on bad envelope option', async () => {
+            await assert.rejects(
+                async () =>
+                    await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('test'), envelope: 1 }),
+                /TypeError: envelope is not a boolean/
+            );
+        });
+
         it('throws an error for bad data', async () => {
             const data = Buffer.from('broken');
 
@@ -156,10 +770,749 @@ describe('node-secure-enclave', function () {
         });
     });
 
+    describe('decryptMany', () => {
+        it('throws on invalid items', async () => {
+            await assert.rejects(
+                async () => await nodeSecureEnclave().decryptMany({ keyTag, touchIdPrompt }),
+                /TypeError: items property is missing/
+            );
+            await assert.rejects(
+                async () => await nodeSecureEnclave().decryptMany({ keyTag, items: [], touchIdPrompt }),
+                /TypeError: items cannot be empty/
+            );
+            await assert.rejects(
+                async () =>
+                    await nodeSecureEnclave().decryptMany({
+                        keyTag,
+                        items: [Buffer.from('test'), 'test'],
+                        touchIdPrompt
+                    }),
+                /TypeError: items must contain only non-empty buffers/
+            );
+        });
+
+        it('decrypts many items with per-item errors', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+
+            const data = [];
+            const items = [];
+            for (let i = 0; i < 20; i++) {
+                data.push(Buffer.from(`item ${i}`));
+                items.push(await nodeSecureEnclave().encrypt({ keyTag, data: data[i] }));
+            }
+            items.push(Buffer.from('broken'));
+
+            const results = await nodeSecureEnclave().decryptMany({ keyTag, items, touchIdPrompt });
+            assert.strictEqual(results.length, items.length);
+            for (let i = 0; i < data.length; i++) {
+                assert.strictEqual(results[i].data.toString(), data[i].toString());
+                assert.strictEqual(results[i].error, undefined);
+            }
+            assert.strictEqual(results[data.length].data, undefined);
+            assert.strictEqual(results[data.length].error.badParam, true);
+        });
+
+        it('authenticates only once', async function () {
+            if (nodeSecureEnclave().backend !== 'software') {
+                this.skip();
+            }
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const items = [
+                await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('one') }),
+                await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('two') })
+            ];
+
+            // the first prompt is approved, all next ones are refused
+            process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT = '0,-2';
+            try {
+                const results = await nodeSecureEnclave().decryptMany({ keyTag, items, touchIdPrompt });
+                assert.deepStrictEqual(
+                    results.map((r) => r.data.toString()),
+                    ['one', 'two']
+                );
+                await assert.rejects(
+                    async () => await nodeSecureEnclave().decryptMany({ keyTag, items, touchIdPrompt }),
+                    (e) => e.rejected === true
+                );
+            } finally {
+                delete process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT;
+            }
+        });
+    });
+
+    describe('convertCiphertexts', () => {
+        it('converts items in bulk', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+
+            const data = [...Array(10)].map((_, i) => Buffer.from(`item ${i}`));
+            const items = [];
+            for (const item of data) {
+                items.push(await nodeSecureEnclave().encrypt({ keyTag, data: item }));
+            }
+            const envelope = await nodeSecureEnclave().encrypt({
+                keyTag,
+                data: data[0],
+                envelope: true
+            });
+
+            const compact = await nodeSecureEnclave().convertCiphertexts({
+                items: [...items, envelope, Buffer.from('broken')],
+                format: 'compact'
+            });
+            for (let i = 0; i < items.length; i++) {
+                assert.strictEqual(compact[i].data.length, items[i].length - 30);
+            }
+            assert.ok(compact[items.length].data.equals(envelope));
+            assert.strictEqual(compact[items.length + 1].error.badParam, true);
+
+            const compactItems = compact.slice(0, items.length).map((result) => result.data);
+            const decrypted = await nodeSecureEnclave().decryptMany({
+                keyTag,
+                items: compactItems,
+                touchIdPrompt
+            });
+            assert.deepStrictEqual(
+                decrypted.map((result) => result.data.toString()),
+                data.map((item) => item.toString())
+            );
+
+            const standard = await nodeSecureEnclave().convertCiphertexts({
+                items: [...compactItems, items[0]],
+                format: 'standard'
+            });
+            assert.deepStrictEqual(
+                standard.map((result) => result.data.toString('hex')),
+                [...items, items[0]].map((item) => item.toString('hex'))
+            );
+        });
+
+        it('throws on invalid format', async () => {
+            await assert.rejects(
+                async () =>
+                    await nodeSecureEnclave().convertCiphertexts({
+                        items: [Buffer.from('test')],
+                        format: 'short'
+                    }),
+                /TypeError: format must be 'compact' or 'standard'/
+            );
+        });
+    });
+
+    describe('rewrap', () => {
+        it('throws on invalid key tags', async () => {
+            const items = [Buffer.from('test')];
+            await assert.rejects(
+                async () =>
+                    await nodeSecureEnclave().rewrap({
+                        toKeyTag: keyTagAnother,
+                        items,
+                        touchIdPrompt
+                    }),
+                /TypeError: fromKeyTag property is missing/
+            );
+            await assert.rejects(
+                async () =>
+                    await nodeSecureEnclave().rewrap({
+                        fromKeyTag: keyTag,
+                        toKeyTag: '',
+                        items,
+                        touchIdPrompt
+                    }),
+                /TypeError: toKeyTag cannot be empty/
+            );
+        });
+
+        it('moves items to another key with per-item errors', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            await nodeSecureEnclave().createKeyPair({ keyTag: keyTagAnother });
+
+            const data = [Buffer.from('small'), crypto.randomBytes(200000)];
+            const items = [
+                await nodeSecureEnclave().encrypt({ keyTag, data: data[0] }),
+                await nodeSecureEnclave().encrypt({ keyTag, data: data[1], envelope: true }),
+                Buffer.from('broken')
+            ];
+
+            const results = await nodeSecureEnclave().rewrap({
+                fromKeyTag: keyTag,
+                toKeyTag: keyTagAnother,
+                items,
+                touchIdPrompt
+            });
+            assert.strictEqual(results.length, items.length);
+            assert.strictEqual(results[2].data, undefined);
+            assert.strictEqual(results[2].error.badParam, true);
+
+            // envelope chunks are kept as is
+            const rewrapped = [results[0].data, results[1].data];
+            assert.strictEqual(rewrapped[1].length, items[1].length);
+            assert.ok(rewrapped[1].subarray(-100000).equals(items[1].subarray(-100000)));
+
+            const decrypted = await nodeSecureEnclave().decryptMany({
+                keyTag: keyTagAnother,
+                items: rewrapped,
+                touchIdPrompt
+            });
+            assert.deepStrictEqual(
+                decrypted.map((result) => result.data.toString('hex')),
+                data.map((item) => item.toString('hex'))
+            );
+
+            const withOldKey = await nodeSecureEnclave().decryptMany({
+                keyTag,
+                items: rewrapped,
+                touchIdPrompt
+            });
+            assert.ok(withOldKey.every((result) => result.error));
+        });
+    });
+
+    describe('sign', () => {
+        function toNodePublicKey(publicKey) {
+            return crypto.createPublicKey({
+                key: {
+                    kty: 'EC',
+                    crv: 'P-256',
+                    x: publicKey.subarray(1, 33).toString('base64url'),
+                    y: publicKey.subarray(33).toString('base64url')
+                },
+                format: 'jwk'
+            });
+        }
+
+        it('signs data and verifies the signature', async () => {
+            const { publicKey } = await nodeSecureEnclave().createKeyPair({ keyTag });
+            const data = Buffer.from('Hello, world!');
+
+            const signature = await nodeSecureEnclave().sign({ keyTag, data, touchIdPrompt });
+            assert.ok(signature instanceof Buffer);
+            assert.strictEqual(crypto.verify('sha256', data, toNodePublicKey(publicKey), signature), true);
+
+            assert.strictEqual(await nodeSecureEnclave().verify({ publicKey, data, signature }), true);
+            assert.strictEqual(await nodeSecureEnclave().verify({ keyTag, data, signature }), true);
+            assert.strictEqual(
+                await nodeSecureEnclave().verify({ publicKey, data: Buffer.from('Hello'), signature }),
+                false
+            );
+        });
+
+        it('verifies signatures made by other implementations', async () => {
+            const { privateKey, publicKey } = crypto.generateKeyPairSync('ec', { namedCurve: 'P-256' });
+            const jwk = publicKey.export({ format: 'jwk' });
+            const rawPublicKey = Buffer.concat([
+                Buffer.from([4]),
+                Buffer.from(jwk.x, 'base64url'),
+                Buffer.from(jwk.y, 'base64url')
+            ]);
+
+            const items = [];
+            for (let i = 0; i < 50; i++) {
+                const data = Buffer.from(`record ${i}`);
+                items.push({ data, signature: crypto.sign('sha256', data, privateKey) });
+            }
+            items[7] = { data: Buffer.from('forged'), signature: items[7].signature };
+            items[9] = { data: items[9].data, signature: Buffer.from('broken') };
+
+            const results = await nodeSecureEnclave().verifyMany({ publicKey: rawPublicKey, items });
+            assert.deepStrictEqual(
+                results,
+                items.map((item, i) => i !== 7 && i !== 9)
+            );
+        });
+
+        it('throws on invalid arguments', async () => {
+            const { publicKey } = await nodeSecureEnclave().createKeyPair({ keyTag });
+            const data = Buffer.from('test');
+            await assert.rejects(
+                nodeSecureEnclave().sign({ keyTag, data }),
+                /TypeError: touchIdPrompt property is missing/
+            );
+            await assert.rejects(
+                nodeSecureEnclave().verify({ publicKey, data }),
+                /TypeError: signature property is missing/
+            );
+            await assert.rejects(
+                nodeSecureEnclave().verifyMany({ publicKey, items: [data] }),
+                /TypeError: items must contain only objects with data and signature buffers/
+            );
+        });
+
+        it('rejects signing if the user refuses to authenticate', async function () {
+            if (nodeSecureEnclave().backend !== 'software') {
+                this.skip();
+            }
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT = '-2,0';
+            try {
+                await assert.rejects(
+                    nodeSecureEnclave().sign({ keyTag, data: Buffer.from('test'), touchIdPrompt }),
+                    (e) => e.rejected === true
+                );
+            } finally {
+                delete process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT;
+            }
+        });
+    });
+
+    describe('deriveSharedSecret', () => {
+        it('derives the same key as the peer', async () => {
+            const { publicKey } = await nodeSecureEnclave().createKeyPair({ keyTag });
+            const peer = crypto.createECDH('prime256v1');
+            const peerPublicKey = peer.generateKeys();
+            const info = Buffer.from('test protocol');
+
+            const derived = await nodeSecureEnclave().deriveSharedSecret({
+                keyTag,
+                peerPublicKey,
+                kdf: { info, length: 45 },
+                touchIdPrompt
+            });
+            const expected = x963Kdf(peer.computeSecret(publicKey), info, 45);
+            assert.strictEqual(derived.toString('hex'), expected.toString('hex'));
+
+            const defaultLength = await nodeSecureEnclave().deriveSharedSecret({
+                keyTag,
+                peerPublicKey,
+                touchIdPrompt
+            });
+            assert.strictEqual(
+                defaultLength.toString('hex'),
+                x963Kdf(peer.computeSecret(publicKey), Buffer.alloc(0), 32).toString('hex')
+            );
+        });
+
+        it('throws on invalid arguments', async () => {
+            const peerPublicKey = crypto.createECDH('prime256v1').generateKeys();
+            await assert.rejects(
+                nodeSecureEnclave().deriveSharedSecret({
+                    keyTag,
+                    peerPublicKey: Buffer.alloc(65),
+                    touchIdPrompt
+                }),
+                /TypeError: peerPublicKey is not a valid P-256 public key/
+            );
+            await assert.rejects(
+                nodeSecureEnclave().deriveSharedSecret({
+                    keyTag,
+                    peerPublicKey,
+                    kdf: { length: 0 },
+                    touchIdPrompt
+                }),
+                /TypeError: kdf.length must be an integer from 1 to 1024/
+            );
+            await assert.rejects(
+                nodeSecureEnclave().deriveSharedSecret({
+                    keyTag,
+                    peerPublicKey,
+                    kdf: { info: 'info' },
+                    touchIdPrompt
+                }),
+                /TypeError: kdf.info is not a buffer/
+            );
+        });
+    });
+
+    describe('openSession', () => {
+        it('throws on invalid reuseSeconds', async () => {
+            await assert.rejects(
+                async () =>
+                    await nodeSecureEnclave().openSession({ keyTag, touchIdPrompt, reuseSeconds: 0 }),
+                /TypeError: reuseSeconds must be a positive number/
+            );
+        });
+
+        it('throws an error if the key is not found', async () => {
+            await assert.rejects(
+                async () => await nodeSecureEnclave().openSession({ keyTag, touchIdPrompt }),
+                (e) => e.keyNotFound === true
+            );
+        });
+
+        it('decrypts data without prompting again', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const encrypted = await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('test') });
+
+            // the first prompt is approved, all next ones are refused
+            process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT = '0,-2';
+            try {
+                const session = await nodeSecureEnclave().openSession({ keyTag, touchIdPrompt });
+                assert.strictEqual(session.isOpen, true);
+                for (let i = 0; i < 3; i++) {
+                    const decrypted = await session.decrypt(encrypted);
+                    assert.strictEqual(decrypted.toString(), 'test');
+                }
+
+                session.close();
+                assert.strictEqual(session.isOpen, false);
+                await assert.rejects(
+                    async () => await session.decrypt(encrypted),
+                    (e) => e.sessionClosed === true
+                );
+            } finally {
+                delete process.env.NODE_SECURE_ENCLAVE_AUTH_SCRIPT;
+            }
+        });
+
+        it('expires after reuseSeconds', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const encrypted = await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('test') });
+
+            const session = await nodeSecureEnclave().openSession({
+                keyTag,
+                touchIdPrompt,
+                reuseSeconds: 0.2
+            });
+            assert.strictEqual((await session.decrypt(encrypted)).toString(), 'test');
+
+            await new Promise((resolve) => setTimeout(resolve, 300));
+            assert.strictEqual(session.isOpen, false);
+            await assert.rejects(
+                async () => await session.decrypt(encrypted),
+                (e) => e.sessionClosed === true
+            );
+        });
+    });
+
+    describe('streams', () => {
+        async function pipe(chunks, transform) {
+            const output = [];
+            await pipeline(
+                Readable.from(chunks),
+                transform,
+                new Writable({
+                    write(chunk, encoding, callback) {
+                        output.push(chunk);
+                        callback();
+                    }
+                })
+            );
+            return Buffer.concat(output);
+        }
+
+        function split(data, size) {
+            const chunks = [];
+            for (let i = 0; i < data.length; i += size) {
+                chunks.push(data.subarray(i, i + size));
+            }
+            return chunks;
+        }
+
+        it('encrypts and decrypts a stream', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+
+            for (const size of [0, 1, 65536, 300000]) {
+                const data = crypto.randomBytes(size);
+                const encrypted = await pipe(
+                    split(data, 10000),
+                    nodeSecureEnclave().createEncryptStream({ keyTag })
+                );
+                const decrypted = await pipe(
+                    split(encrypted, 7777),
+                    nodeSecureEnclave().createDecryptStream({ keyTag, touchIdPrompt })
+                );
+                assert.strictEqual(decrypted.equals(data), true);
+            }
+        });
+
+        it('throws an error for a truncated stream', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+
+            const data = crypto.randomBytes(100000);
+            const encrypted = await pipe([data], nodeSecureEnclave().createEncryptStream({ keyTag }));
+            const truncated = encrypted.subarray(0, encrypted.length - 1000);
+            await assert.rejects(
+                async () =>
+                    await pipe(
+                        [truncated],
+                        nodeSecureEnclave().createDecryptStream({ keyTag, touchIdPrompt })
+                    ),
+                (e) => e.badParam === true
+            );
+        });
+
+        it('throws an error if the key is not found', async () => {
+            await assert.rejects(
+                async () =>
+                    await pipe([Buffer.from('test')], nodeSecureEnclave().createEncryptStream({ keyTag })),
+                (e) => e.keyNotFound === true
+            );
+        });
+    });
+
+    describe('worker threads', () => {
+        it('works in several worker threads at once', async () => {
+            const { Worker } = require('worker_threads');
+            const code = `
+                const { parentPort, workerData } = require('worker_threads');
+                const secureEnclave = require(workerData.modulePath);
+                (async () => {
+                    const { keyTag, touchIdPrompt } = workerData;
+                    await secureEnclave.createKeyPair({ keyTag });
+                    const data = Buffer.from(keyTag);
+                    const encrypted = await secureEnclave.encrypt({ keyTag, data });
+                    const decrypted = await secureEnclave.decrypt({
+                        keyTag,
+                        data: encrypted,
+                        touchIdPrompt
+                    });
+                    const session = await secureEnclave.openSession({ keyTag, touchIdPrompt });
+                    const decryptedInSession = await session.decrypt(encrypted);
+                    session.close();
+                    await secureEnclave.deleteKeyPair({ keyTag });
+                    return decrypted.equals(data) && decryptedInSession.equals(data);
+                })().then((ok) => parentPort.postMessage(ok));
+            `;
+            const results = await Promise.all(
+                [1, 2, 3].map(
+                    (i) =>
+                        new Promise((resolve, reject) => {
+                            const worker = new Worker(code, {
+                                eval: true,
+                                workerData: {
+                                    modulePath: require.resolve('..'),
+                                    keyTag: `${keyTag}.worker-${i}`,
+                                    touchIdPrompt
+                                }
+                            });
+                            worker.on('message', resolve);
+                            worker.on('error', reject);
+                        })
+                )
+            );
+            assert.deepStrictEqual(results, [true, true, true]);
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const data = Buffer.from('main');
+            const encrypted = await nodeSecureEnclave().encrypt({ keyTag, data });
+            const decrypted = await nodeSecureEnclave().decrypt({
+                keyTag,
+                data: encrypted,
+                touchIdPrompt
+            });
+            assert.strictEqual(decrypted.equals(data), true);
+        });
+    });
+
+    describe('secure memory', () => {
+        it('returns decrypted data to the pool', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const encrypted = await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('secret') });
+
+            const before = nodeSecureEnclave().getSecureMemoryStats();
+            const decrypted = await nodeSecureEnclave().decrypt({ keyTag, data: encrypted, touchIdPrompt });
+            assert.strictEqual(decrypted.toString(), 'secret');
+
+            const after = nodeSecureEnclave().getSecureMemoryStats();
+            assert.ok(after.allocations > before.allocations);
+            assert.ok(after.inUseBytes > 0);
+            assert.ok(after.reservedBytes >= after.inUseBytes);
+            assert.ok(after.peakInUseBytes >= after.inUseBytes);
+            assert.ok(after.lockedBytes <= after.reservedBytes);
+        });
+    });
+
+    describe('wipe', () => {
+        it('zeroizes a buffer', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const encrypted = await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('secret') });
+            const decrypted = await nodeSecureEnclave().decrypt({ keyTag, touchIdPrompt, data: encrypted });
+            assert.strictEqual(decrypted.toString(), 'secret');
+
+            nodeSecureEnclave().wipe(decrypted);
+            assert.deepStrictEqual([...decrypted], [0, 0, 0, 0, 0, 0]);
+        });
+
+        it('throws on bad argument', () => {
+            assert.throws(() => nodeSecureEnclave().wipe('secret'), /TypeError: buffer is not a buffer/);
+        });
+    });
+
+    describe('configure', () => {
+        it('changes the number of worker threads', async () => {
+            nodeSecureEnclave().configure({ workerThreads: 2 });
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            const data = Buffer.from('Hello, world!');
+            const encrypted = await Promise.all(
+                Array.from({ length: 10 }, () => nodeSecureEnclave().encrypt({ keyTag, data }))
+            );
+            assert.strictEqual(new Set(encrypted.map((e) => e.toString('hex'))).size, 10);
+
+            nodeSecureEnclave().configure({ workerThreads: 4 });
+        });
+
+        it('throws on bad workerThreads', () => {
+            assert.throws(
+                () => nodeSecureEnclave().configure({ workerThreads: 0 }),
+                /TypeError: workerThreads must be a number from 1 to 64/
+            );
+        });
+
+        it('throws on bad keyCacheSize', () => {
+            assert.throws(
+                () => nodeSecureEnclave().configure({ keyCacheSize: -1 }),
+                /TypeError: keyCacheSize must be a number from 0 to 65536/
+            );
+        });
+    });
+
+    describe('key cache', () => {
+        it('serves repeated lookups from the cache', async () => {
+            const { publicKey } = await nodeSecureEnclave().createKeyPair({ keyTag });
+            nodeSecureEnclave().clearKeyCache();
+            const before = nodeSecureEnclave().getKeyCacheStats();
+            assert.strictEqual(before.size, 0);
+
+            const first = await nodeSecureEnclave().findKeyPair({ keyTag });
+            const second = await nodeSecureEnclave().findKeyPair({ keyTag });
+            assert.strictEqual(first.publicKey.toString('hex'), publicKey.toString('hex'));
+            assert.strictEqual(second.publicKey.toString('hex'), publicKey.toString('hex'));
+
+            const after = nodeSecureEnclave().getKeyCacheStats();
+            assert.strictEqual(after.misses - before.misses, 1);
+            assert.strictEqual(after.hits - before.hits, 1);
+            assert.strictEqual(after.size, 1);
+        });
+
+        it('invalidates keys on delete', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            assert.ok(await nodeSecureEnclave().findKeyPair({ keyTag }));
+
+            await nodeSecureEnclave().deleteKeyPair({ keyTag });
+            assert.strictEqual(await nodeSecureEnclave().findKeyPair({ keyTag }), null);
+
+            const { publicKey } = await nodeSecureEnclave().createKeyPair({ keyTag });
+            const found = await nodeSecureEnclave().findKeyPair({ keyTag });
+            assert.strictEqual(found.publicKey.toString('hex'), publicKey.toString('hex'));
+        });
+
+        it('precomputes tables for keys used for encryption', async () => {
+            const { publicKey } = await nodeSecureEnclave().createKeyPair({ keyTag });
+            nodeSecureEnclave().clearKeyCache();
+            assert.strictEqual(nodeSecureEnclave().getKeyCacheStats().tables, 0);
+
+            const data = [...Array(20)].map(() => crypto.randomBytes(100));
+            const items = [];
+            for (const item of data) {
+                items.push(await nodeSecureEnclave().encrypt({ keyTag, data: item }));
+            }
+            items.push(await nodeSecureEnclave().encrypt({ publicKey, data: data[0] }));
+            assert.strictEqual(nodeSecureEnclave().getKeyCacheStats().tables, 1);
+
+            const results = await nodeSecureEnclave().decryptMany({ keyTag, items, touchIdPrompt });
+            assert.deepStrictEqual(
+                results.map((result) => result.data.toString('hex')),
+                [...data, data[0]].map((item) => item.toString('hex'))
+            );
+
+            await nodeSecureEnclave().deleteKeyPair({ keyTag });
+            assert.strictEqual(nodeSecureEnclave().getKeyCacheStats().tables, 0);
+        });
+
+        it('can be disabled', async () => {
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            nodeSecureEnclave().configure({ keyCacheSize: 0 });
+            try {
+                const before = nodeSecureEnclave().getKeyCacheStats();
+                await nodeSecureEnclave().findKeyPair({ keyTag });
+                await nodeSecureEnclave().findKeyPair({ keyTag });
+                const after = nodeSecureEnclave().getKeyCacheStats();
+                assert.strictEqual(after.size, 0);
+                assert.strictEqual(after.hits - before.hits, 0);
+            } finally {
+                nodeSecureEnclave().configure({ keyCacheSize: 256 });
+            }
+        });
+    });
+
+    describe('stats', () => {
+        afterEach(() => {
+            nodeSecureEnclave().configure({ stats: false, trace: null });
+            nodeSecureEnclave().resetStats();
+        });
+
+        it('collects latency of operations', async () => {
+            nodeSecureEnclave().configure({ stats: true });
+            nodeSecureEnclave().resetStats();
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            await nodeSecureEnclave().findKeyPair({ keyTag });
+            await nodeSecureEnclave().encrypt({ keyTag, data: Buffer.from('hello') });
+
+            const stats = nodeSecureEnclave().getStats();
+            for (const op of ['createKeyPair', 'findKeyPair', 'encrypt']) {
+                assert.strictEqual(stats[op].count, 1);
+                assert.deepStrictEqual(stats[op].errors, {});
+                const total = stats[op].phases.total;
+                assert.strictEqual(total.count, 1);
+                assert.ok(total.p50 >= 0 && total.p50 <= total.p99 && total.p99 <= total.max);
+                assert.ok(stats[op].phases.queue);
+                assert.ok(stats[op].phases.complete);
+            }
+            assert.ok(stats.createKeyPair.phases.crypto);
+            assert.ok(stats.encrypt.phases.lookup);
+            assert.ok(stats.encrypt.phases.crypto);
+        });
+
+        it('counts errors by status', async () => {
+            nodeSecureEnclave().configure({ stats: true });
+            nodeSecureEnclave().resetStats();
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            await assert.rejects(nodeSecureEnclave().createKeyPair({ keyTag }), /already exists/);
+
+            const stats = nodeSecureEnclave().getStats();
+            assert.strictEqual(stats.createKeyPair.count, 2);
+            assert.deepStrictEqual(stats.createKeyPair.errors, { '-25299': 1 });
+        });
+
+        it('collects nothing when disabled', async () => {
+            nodeSecureEnclave().resetStats();
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            assert.deepStrictEqual(nodeSecureEnclave().getStats(), {});
+        });
+
+        it('calls the trace callback', async () => {
+            const events = [];
+            nodeSecureEnclave().configure({ trace: (event) => events.push(event) });
+
+            await nodeSecureEnclave().createKeyPair({ keyTag });
+            await nodeSecureEnclave().findKeyPair({ keyTag: 'missing-' + keyTag });
+
+            assert.strictEqual(events.length, 2);
+            assert.strictEqual(events[0].operation, 'createKeyPair');
+            assert.strictEqual(events[0].error, false);
+            assert.strictEqual(events[0].status, 0);
+            assert.ok(events[0].phases.total >= events[0].phases.crypto);
+            assert.strictEqual(events[1].operation, 'findKeyPair');
+            assert.ok(events[1].phases.lookup >= 0);
+            assert.strictEqual(events[1].phases.auth, undefined);
+        });
+
+        it('throws on invalid options', () => {
+            assert.throws(() => nodeSecureEnclave().configure({ stats: 1 }), /stats is not a boolean/);
+            assert.throws(() => nodeSecureEnclave().configure({ trace: 1 }), /trace is not a function/);
+        });
+    });
+
     function nodeSecureEnclave() {
         return require('..');
     }
 
+    function x963Kdf(sharedSecret, info, length) {
+        const blocks = [];
+        for (let counter = 1; blocks.length * 32 < length; counter++) {
+            const counterBytes = Buffer.alloc(4);
+            counterBytes.writeUInt32BE(counter);
+            blocks.push(
+                crypto.createHash('sha256').update(sharedSecret).update(counterBytes).update(info).digest()
+            );
+        }
+        return Buffer.concat(blocks).subarray(0, length);
+    }
+
     function testCommonMethodBehavior(methodName) {
         const method = nodeSecureEnclave()[methodName];
 